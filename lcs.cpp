@@ -9,6 +9,20 @@ Last Update		:		June 19th, 2012
 #include <vtkXMLUnstructuredGridReader.h>
 #include <cstring>
 
+namespace {
+
+// Coefficients of the Cash-Karp stages, the same as in lcsBlockedTracingKernelOfRK45.cl
+const double stageWeightsOfRK45[6][5] = {
+	{0.0, 0.0, 0.0, 0.0, 0.0},
+	{0.2, 0.0, 0.0, 0.0, 0.0},
+	{3.0 / 40, 9.0 / 40, 0.0, 0.0, 0.0},
+	{0.3, -0.9, 1.2, 0.0, 0.0},
+	{-11.0 / 54, 2.5, -70.0 / 27, 35.0 / 27, 0.0},
+	{1631.0 / 55296, 175.0 / 512, 575.0 / 13824, 44275.0 / 110592, 253.0 / 4096}
+};
+
+}
+
 ////////////////////////////////////////////////
 lcs::Frame::Frame(double timePoint, const char *dataFile) {
 	vtkXMLUnstructuredGridReader *reader = vtkXMLUnstructuredGridReader::New();
@@ -19,6 +33,11 @@ lcs::Frame::Frame(double timePoint, const char *dataFile) {
 	reader->Delete();
 }
 
+lcs::Frame::Frame(double timePoint, TetrahedralGrid *tetrahedralGrid) {
+	this->tetrahedralGrid = tetrahedralGrid;
+	this->timePoint = timePoint;
+}
+
 lcs::Frame::~Frame() {
 	delete this->tetrahedralGrid;
 }
@@ -36,7 +55,11 @@ lcs::ParticleRecord::ParticleRecord(int stage, int gridPointID, void *data) {
 }
 
 lcs::ParticleRecord::~ParticleRecord() {
-	delete (ParticleRecordDataForRK4 *)this->data;
+	switch (lcs::ParticleRecord::dataType) {
+	case lcs::ParticleRecord::FE: delete (ParticleRecordDataForFE *)this->data; break;
+	case lcs::ParticleRecord::RK4: delete (ParticleRecordDataForRK4 *)this->data; break;
+	case lcs::ParticleRecord::RK45: delete (ParticleRecordDataForRK45 *)this->data; break;
+	}
 }
 
 int lcs::ParticleRecord::dataType = 0;
@@ -51,6 +74,9 @@ int lcs::ParticleRecord::GetDataType() {
 
 lcs::Vector lcs::ParticleRecord::GetPositionInInterest() const {
 	switch (lcs::ParticleRecord::dataType) {
+	case lcs::ParticleRecord::FE: {
+		return ((lcs::ParticleRecordDataForFE *)this->data)->GetLastPosition();
+								  } break;
 	case lcs::ParticleRecord::RK4: {
 		lcs::ParticleRecordDataForRK4 *data = (lcs::ParticleRecordDataForRK4 *)this->data;
 		switch (this->stage) {
@@ -68,6 +94,9 @@ lcs::Vector lcs::ParticleRecord::GetPositionInInterest() const {
 														  } break;
 		}
 								   } break;
+	case lcs::ParticleRecord::RK45: {
+		return ((lcs::ParticleRecordDataForRK45 *)this->data)->GetPositionOfStage(this->stage);
+									} break;
 	}
 }
 
@@ -87,6 +116,15 @@ void lcs::ParticleRecord::SetStage(int stage) {
 	this->stage = stage;
 }
 
+////////////////////////////////////////////////
+void lcs::ParticleRecordDataForFE::SetLastPosition(const lcs::Vector &lastPosition) {
+	this->lastPosition = lastPosition;
+}
+
+lcs::Vector lcs::ParticleRecordDataForFE::GetLastPosition() const {
+	return this->lastPosition;
+}
+
 ////////////////////////////////////////////////
 void lcs::ParticleRecordDataForRK4::SetLastPosition(const lcs::Vector &lastPosition) {
 	this->lastPosition = lastPosition;
@@ -169,6 +207,42 @@ lcs::Vector lcs::ParticleRecordDataForRK4::GetK3() const {
 	return this->k3;
 }
 
+////////////////////////////////////////////////
+lcs::ParticleRecordDataForRK45::ParticleRecordDataForRK45() {
+	this->stepSize = 0;
+}
+
+void lcs::ParticleRecordDataForRK45::SetLastPosition(const lcs::Vector &lastPosition) {
+	this->lastPosition = lastPosition;
+}
+
+void lcs::ParticleRecordDataForRK45::SetK(int index, const lcs::Vector &k) {
+	this->k[index] = k;
+}
+
+void lcs::ParticleRecordDataForRK45::SetStepSize(double stepSize) {
+	this->stepSize = stepSize;
+}
+
+lcs::Vector lcs::ParticleRecordDataForRK45::GetLastPosition() const {
+	return this->lastPosition;
+}
+
+lcs::Vector lcs::ParticleRecordDataForRK45::GetK(int index) const {
+	return this->k[index];
+}
+
+double lcs::ParticleRecordDataForRK45::GetStepSize() const {
+	return this->stepSize;
+}
+
+lcs::Vector lcs::ParticleRecordDataForRK45::GetPositionOfStage(int stage) const {
+	lcs::Vector position = this->lastPosition;
+	for (int i = 0; i < stage; i++)
+		position = position + this->k[i] * stageWeightsOfRK45[stage][i];
+	return position;
+}
+
 ////////////////////////////////////////////////
 lcs::BlockRecord::BlockRecord() {
 	this->globalCellIDs = NULL;
@@ -226,11 +300,11 @@ void lcs::BlockRecord::CreateLocalLinks(int *links) {
 	memcpy(this->localLinks, links, sizeof(int) * this->localNumOfCells * 4);
 }
 
-int lcs::BlockRecord::EvaluateNumOfBytes() const {
+int lcs::BlockRecord::EvaluateNumOfBytes(int sizeOfReal) const {
 	return this->localNumOfCells * sizeof(int) * 4 +		// this->localConnectivities
 		   this->localNumOfCells * sizeof(int) * 4 +		// this->localLinks
-		   this->localNumOfPoints * sizeof(double) * 3 +	// point positions
-		   this->localNumOfPoints * sizeof(double) * 3 * 2;	// point velocities (start and end)
+		   this->localNumOfPoints * sizeOfReal * 3 +		// point positions
+		   this->localNumOfPoints * sizeOfReal * 3 * 2;		// point velocities (start and end)
 }
 
 int lcs::BlockRecord::GetGlobalCellID(int localCellID) const {
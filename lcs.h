@@ -15,6 +15,9 @@ class Frame {
 public:
 	Frame(double timePoint, const char *dataFile);
 
+	// The frame takes the ownership of the grid.
+	Frame(double timePoint, TetrahedralGrid *tetrahedralGrid);
+
 	~Frame();
 
 	TetrahedralGrid *GetTetrahedralGrid() const {
@@ -57,6 +60,19 @@ private:
 	void *data;
 };
 
+// Forward Euler for a fast preview
+class ParticleRecordDataForFE {
+public:
+	static const int COMPUTING_K1 = 0;
+
+	void SetLastPosition(const lcs::Vector &lastPosition);
+
+	lcs::Vector GetLastPosition() const;
+
+private:
+	lcs::Vector lastPosition;
+};
+
 class ParticleRecordDataForRK4 {
 public:
 	static const int COMPUTING_K1 = 0;
@@ -88,6 +104,34 @@ private:
 	lcs::Vector lastPosition, k1, k2, k3;
 };
 
+// Cash-Karp Runge-Kutta 4(5). The step size is adapted per particle.
+class ParticleRecordDataForRK45 {
+public:
+	static const int COMPUTING_K1 = 0;
+	static const int COMPUTING_K2 = 1;
+	static const int COMPUTING_K3 = 2;
+	static const int COMPUTING_K4 = 3;
+	static const int COMPUTING_K5 = 4;
+	static const int COMPUTING_K6 = 5;
+
+	ParticleRecordDataForRK45();
+
+	void SetLastPosition(const lcs::Vector &lastPosition);
+	void SetK(int index, const lcs::Vector &k); // index is 0 for k1
+	void SetStepSize(double stepSize);
+
+	lcs::Vector GetLastPosition() const;
+	lcs::Vector GetK(int index) const;
+	double GetStepSize() const; // 0 means the initial step size
+
+	// The position where the velocity of the stage is sampled
+	lcs::Vector GetPositionOfStage(int stage) const;
+
+private:
+	lcs::Vector lastPosition, k[5];
+	double stepSize;
+};
+
 class BlockRecord {
 public:
 	BlockRecord();
@@ -104,7 +148,8 @@ public:
 	void CreateLocalConnectivities(int *connectivities);
 	void CreateLocalLinks(int *links);
 
-	int EvaluateNumOfBytes() const;
+	// Shared memory cost of the block. sizeOfReal is the size of a coordinate of the positions and velocities.
+	int EvaluateNumOfBytes(int sizeOfReal) const;
 
 	int GetGlobalCellID(int localCellID) const;
 	int GetGlobalPointID(int localPointID) const;
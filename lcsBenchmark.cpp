@@ -0,0 +1,311 @@
+/**********************************************
+File		:	lcsBenchmark.cpp
+Author		:	Mingcheng Chen
+Last Update	:	October 16th, 2012
+***********************************************/
+
+#include "lcsMeshCache.h"
+#include "lcsGeometry.h"
+#include "lcsUtility.h"
+#include "lcsPipeline.h"
+#include <vtkUnstructuredGrid.h>
+#include <vtkPoints.h>
+#include <vtkDoubleArray.h>
+#include <vtkPointData.h>
+#include <vtkCellType.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+// Usage: LCSBenchmark [ABC | DoubleGyre] [cells per axis] [number of frames] [seeds per axis] [output prefix]
+//                     [cell transform megabytes] [Native | OpenCL | OpenCLTransforms | OpenCLCompare]
+// It writes a synthetic mesh cache <prefix>.lcscache and a configure file <prefix>.conf for the native backend.
+// For the OpenCL backend, it also writes <prefix>-OpenCL.conf without and <prefix>-OpenCLTransforms.conf with
+// the cell transforms, whose tracing times compare the two.
+// Then it runs the pipeline on the configure file of the chosen backend (Native by default) and prints the
+// throughput of Division, InitialCellLocation, Tracing and GetFinalPositions. The pipeline can only run once in a
+// process, so OpenCLCompare runs the OpenCL one in a child process before the OpenCLTransforms one, and the two
+// reports give the kernel times without and with the cell transforms.
+
+namespace {
+
+const double PI = acos(-1.0);
+
+// The analytic flows are sampled at the integer time points 0, 1, ..., numOfFrames - 1.
+const double timeInterval = 1.0;
+const double timeStep = 0.01;
+
+// Interior grid points are moved by up to jitter * (cell size) in every direction.
+const double jitter = 0.1;
+
+// A block covers about cellsPerBlock cells in every direction.
+const int cellsPerBlock = 4;
+
+// The default device memory for the cell transforms
+const int defaultCellTransformMegabytes = 256;
+
+struct Flow {
+	const char *name;
+	double minCorner[3], maxCorner[3];
+	void (*velocity)(const double *point, double time, double *velocity);
+};
+
+// Arnold-Beltrami-Childress flow with an oscillating A
+void ABCFlow(const double *point, double time, double *velocity) {
+	double a = sqrt(3.0) + 0.5 * sin(PI * time), b = sqrt(2.0), c = 1.0;
+	velocity[0] = a * sin(point[2]) + c * cos(point[1]);
+	velocity[1] = b * sin(point[0]) + a * cos(point[2]);
+	velocity[2] = c * sin(point[1]) + b * cos(point[0]);
+}
+
+// The time-dependent double gyre in x and y, with a vertical oscillation in z
+void DoubleGyreFlow(const double *point, double time, double *velocity) {
+	double a = 0.1, epsilon = 0.25, omega = 2 * PI / 10;
+	double s = epsilon * sin(omega * time);
+	double f = s * point[0] * point[0] + (1 - 2 * s) * point[0];
+	double dfdx = 2 * s * point[0] + (1 - 2 * s);
+	velocity[0] = -PI * a * sin(PI * f) * cos(PI * point[1]);
+	velocity[1] = PI * a * cos(PI * f) * sin(PI * point[1]) * dfdx;
+	velocity[2] = a * s * sin(PI * point[2]);
+}
+
+const Flow flows[] = {
+	{"ABC", {0, 0, 0}, {2 * PI, 2 * PI, 2 * PI}, ABCFlow},
+	{"DoubleGyre", {0, 0, 0}, {2, 1, 1}, DoubleGyreFlow}
+};
+
+// A jittered lattice of n^3 cubes, each of which is split into the 6 tetrahedra of the Kuhn triangulation.
+// The tetrahedra of the neighbouring cubes share faces, and TetrahedralGrid fixes their orientation.
+vtkUnstructuredGrid *GenerateMesh(const Flow &flow, int n) {
+	int numOfPoints = (n + 1) * (n + 1) * (n + 1);
+
+	vtkPoints *points = vtkPoints::New();
+	points->SetDataTypeToDouble();
+	points->SetNumberOfPoints(numOfPoints);
+
+	srand(2012);
+
+	double spacing[3];
+	for (int d = 0; d < 3; d++)
+		spacing[d] = (flow.maxCorner[d] - flow.minCorner[d]) / n;
+
+	for (int i = 0; i <= n; i++)
+		for (int j = 0; j <= n; j++)
+			for (int k = 0; k <= n; k++) {
+				int indices[3] = {i, j, k};
+				double point[3];
+				for (int d = 0; d < 3; d++) {
+					point[d] = flow.minCorner[d] + spacing[d] * indices[d];
+					// Points on the boundary stay on it.
+					if (indices[d] > 0 && indices[d] < n)
+						point[d] += (2.0 * rand() / RAND_MAX - 1) * jitter * spacing[d];
+				}
+				points->SetPoint((i * (n + 1) + j) * (n + 1) + k, point);
+			}
+
+	vtkUnstructuredGrid *mesh = vtkUnstructuredGrid::New();
+	mesh->SetPoints(points);
+	mesh->Allocate((vtkIdType)n * n * n * 6);
+	points->Delete();
+
+	// Every Kuhn tetrahedron walks from corner 0 to corner 7 of the cube along the axes in a permutation.
+	static const int permutations[6][3] = {{0, 1, 2}, {0, 2, 1}, {1, 0, 2}, {1, 2, 0}, {2, 0, 1}, {2, 1, 0}};
+
+	for (int i = 0; i < n; i++)
+		for (int j = 0; j < n; j++)
+			for (int k = 0; k < n; k++)
+				for (int p = 0; p < 6; p++) {
+					int corner[3] = {i, j, k};
+					vtkIdType ids[4];
+					for (int v = 0; v < 4; v++) {
+						if (v) corner[permutations[p][v - 1]]++;
+						ids[v] = (corner[0] * (n + 1) + corner[1]) * (n + 1) + corner[2];
+					}
+					mesh->InsertNextCell(VTK_TETRA, 4, ids);
+				}
+
+	return mesh;
+}
+
+void SampleVelocities(const Flow &flow, const double *positions, int numOfPoints, double time, double *velocities) {
+	for (int i = 0; i < numOfPoints; i++)
+		flow.velocity(positions + i * 3, time, velocities + i * 3);
+}
+
+void WriteConfigureFile(const char *fileName, const Flow &flow, int n, int numOfFrames, int numOfSeeds,
+			const std::string &meshCacheFile, const char *tracingBackend, int cellTransformMegabytes) {
+	FILE *fout = fopen(fileName, "w");
+	if (fout == NULL) lcs::Error("Fail to create the configure file");
+
+	double spacing[3], seedMin[3], seedMax[3];
+	for (int d = 0; d < 3; d++) {
+		spacing[d] = (flow.maxCorner[d] - flow.minCorner[d]) / n;
+		// Keep the seeds off the boundary
+		seedMin[d] = flow.minCorner[d] + 0.5 * spacing[d];
+		seedMax[d] = flow.maxCorner[d] - 0.5 * spacing[d];
+	}
+	double blockSize = cellsPerBlock * std::max(spacing[0], std::max(spacing[1], spacing[2]));
+
+	fprintf(fout, "# This is a generated configure file for the %s benchmark.\n", flow.name);
+	fprintf(fout, "# %d cells per axis, %d frames, %d seeds per axis\n", n, numOfFrames, numOfSeeds);
+	fprintf(fout, "\n");
+
+	fprintf(fout, "numOfFrames\t\t\t\t\t\t=\t%d\n", numOfFrames);
+	fprintf(fout, "timePoints\t\t\t\t\t\t=\t[");
+	for (int i = 0; i < numOfFrames; i++)
+		fprintf(fout, i ? " %d" : "%d", i);
+	fprintf(fout, "]\n");
+	fprintf(fout, "dataFilePrefix\t\t\t\t\t=\t\"%s-\"\n", flow.name);
+	fprintf(fout, "dataFileSuffix\t\t\t\t\t=\t\"vtu\"\n");
+	fprintf(fout, "dataFileIndices\t\t\t\t\t=\t[");
+	for (int i = 0; i < numOfFrames; i++)
+		fprintf(fout, i ? " %d" : "%d", i);
+	fprintf(fout, "]\n");
+	fprintf(fout, "meshCacheFile\t\t\t\t\t=\t\"%s\"\n", meshCacheFile.c_str());
+	fprintf(fout, "\n");
+
+	fprintf(fout, "integration\t\t\t\t\t\t=\t\"RK4\"\n");
+	fprintf(fout, "timeStep\t\t\t\t\t\t=\t%lf\n", timeStep);
+	fprintf(fout, "timeInterval\t\t\t\t\t=\t%lf\n", timeInterval);
+	fprintf(fout, "blockSize\t\t\t\t\t\t=\t%lf\n", blockSize);
+	// The native backend walks along the scanlines, because the other location modes are OpenCL kernels.
+	fprintf(fout, "initialCellLocation\t\t\t\t=\t\"%s\"\n", strcmp(tracingBackend, "Native") ? "PointCentric" : "Walk");
+	fprintf(fout, "\n");
+
+	fprintf(fout, "tracingBackend\t\t\t\t\t=\t\"%s\"\n", tracingBackend);
+	fprintf(fout, "numOfThreads\t\t\t\t\t=\t0\n");
+	fprintf(fout, "cellTransformMegabytes\t\t\t=\t%d\n", cellTransformMegabytes);
+	fprintf(fout, "\n");
+
+	fprintf(fout, "epsilonForTetBlkIntersection\t=\t1e-8\n");
+	fprintf(fout, "epsilon\t\t\t\t\t\t\t=\t1e-5\n");
+	fprintf(fout, "\n");
+
+	fprintf(fout, "double\t\t\t\t\t\t\t=\tdisabled\n");
+	fprintf(fout, "unitTestForTetBlkIntersection\t=\tdisabled\n");
+	fprintf(fout, "unitTestForInitialCellLocation\t=\tdisabled\n");
+	fprintf(fout, "benchmark\t\t\t\t\t\t=\tenabled\n");
+	fprintf(fout, "\n");
+
+	fprintf(fout, "numOfBanks\t\t\t\t=\t16\n");
+	fprintf(fout, "sharedMemoryKilobytes\t\t\t=\t15\n");
+	fprintf(fout, "\n");
+
+	fprintf(fout, "boundingBoxMinX\t\t\t\t\t=\t%lf\n", seedMin[0]);
+	fprintf(fout, "boundingBoxMaxX\t\t\t\t\t=\t%lf\n", seedMax[0]);
+	fprintf(fout, "boundingBoxMinY\t\t\t\t\t=\t%lf\n", seedMin[1]);
+	fprintf(fout, "boundingBoxMaxY\t\t\t\t\t=\t%lf\n", seedMax[1]);
+	fprintf(fout, "boundingBoxMinZ\t\t\t\t\t=\t%lf\n", seedMin[2]);
+	fprintf(fout, "boundingBoxMaxZ\t\t\t\t\t=\t%lf\n", seedMax[2]);
+	fprintf(fout, "\n");
+
+	fprintf(fout, "boundingBoxXRes\t\t\t\t\t=\t%d\n", numOfSeeds);
+	fprintf(fout, "boundingBoxYRes\t\t\t\t\t=\t%d\n", numOfSeeds);
+	fprintf(fout, "boundingBoxZRes\t\t\t\t\t=\t%d\n", numOfSeeds);
+
+	fclose(fout);
+
+	printf("The configure file is written to %s.\n", fileName);
+}
+
+}
+
+int main(int argc, char **argv) {
+	std::string flowName = argc > 1 ? argv[1] : "ABC";
+	int n = argc > 2 ? atoi(argv[2]) : 32;
+	int numOfFrames = argc > 3 ? atoi(argv[3]) : 11;
+	int numOfSeeds = argc > 4 ? atoi(argv[4]) : n;
+	std::string prefix = argc > 5 ? argv[5] : "lcsBenchmark" + flowName;
+	int cellTransformMegabytes = argc > 6 ? atoi(argv[6]) : defaultCellTransformMegabytes;
+	std::string backend = argc > 7 ? argv[7] : "Native";
+
+	const Flow *flow = NULL;
+	for (int i = 0; i < (int)(sizeof(flows) / sizeof(Flow)); i++)
+		if (flowName == flows[i].name) flow = flows + i;
+	if (flow == NULL) lcs::Error("The flow should be \"ABC\" or \"DoubleGyre\"");
+
+	if (n < 1) lcs::Error("There should be at least one cell per axis");
+	if (numOfFrames < 2) lcs::Error("There should be at least two frames");
+	if (numOfSeeds < 1) lcs::Error("There should be at least one seed per axis");
+	if (cellTransformMegabytes < 1) lcs::Error("The cell transforms should have at least one megabyte");
+	if (backend != "Native" && backend != "OpenCL" && backend != "OpenCLTransforms" && backend != "OpenCLCompare")
+		lcs::Error("The backend should be \"Native\", \"OpenCL\", \"OpenCLTransforms\" or \"OpenCLCompare\"");
+
+	printf("Generating the %s mesh with %d tetrahedra ... ", flow->name, n * n * n * 6);
+	vtkUnstructuredGrid *mesh = GenerateMesh(*flow, n);
+
+	// TetrahedralGrid reads the velocities of frame 0 and builds the links.
+	int numOfPoints = (n + 1) * (n + 1) * (n + 1);
+	double *positions = new double [numOfPoints * 3];
+	for (int i = 0; i < numOfPoints; i++)
+		mesh->GetPoint(i, positions + i * 3);
+
+	double *velocities = new double [(long long)numOfPoints * 3 * numOfFrames];
+	std::vector<double> timePoints(numOfFrames);
+	for (int i = 0; i < numOfFrames; i++) {
+		timePoints[i] = i * timeInterval;
+		SampleVelocities(*flow, positions, numOfPoints, timePoints[i], velocities + (long long)numOfPoints * 3 * i);
+	}
+
+	vtkDoubleArray *velocityArray = vtkDoubleArray::New();
+	velocityArray->SetNumberOfComponents(3);
+	velocityArray->SetArray(velocities, numOfPoints * 3, 1);
+	mesh->GetPointData()->SetVectors(velocityArray);
+
+	lcs::TetrahedralGrid *grid = new lcs::TetrahedralGrid(mesh);
+	printf("Done.\n");
+
+	velocityArray->Delete();
+	mesh->Delete();
+
+	std::string meshCacheFile = prefix + ".lcscache";
+	std::string configurationFile = prefix + ".conf";
+	std::string openCLConfigurationFile = prefix + "-OpenCL.conf";
+	std::string transformConfigurationFile = prefix + "-OpenCLTransforms.conf";
+
+	lcs::MeshCache::Write(meshCacheFile.c_str(), grid, timePoints, velocities);
+	WriteConfigureFile(configurationFile.c_str(), *flow, n, numOfFrames, numOfSeeds, meshCacheFile, "Native", 0);
+	WriteConfigureFile(openCLConfigurationFile.c_str(), *flow, n, numOfFrames, numOfSeeds, meshCacheFile, "OpenCL", 0);
+	WriteConfigureFile(transformConfigurationFile.c_str(), *flow, n, numOfFrames, numOfSeeds, meshCacheFile, "OpenCL",
+			   cellTransformMegabytes);
+
+	delete grid;
+	delete [] positions;
+	delete [] velocities;
+
+	printf("\"LCSBenchmark ... OpenCLCompare\" compares the tracing kernel times without and with the cell transforms.\n");
+	printf("\n");
+
+	// The configure files enable the benchmark report, which follows the phases.
+	if (backend == "Native") lcs::RunPipeline(configurationFile.c_str());
+	if (backend == "OpenCL") lcs::RunPipeline(openCLConfigurationFile.c_str());
+	if (backend == "OpenCLTransforms") lcs::RunPipeline(transformConfigurationFile.c_str());
+
+	if (backend == "OpenCLCompare") {
+		fflush(stdout);
+
+		pid_t child = fork();
+		if (child == -1) lcs::Error("Fail to fork the run without the cell transforms");
+
+		if (!child) {
+			lcs::RunPipeline(openCLConfigurationFile.c_str());
+			fflush(stdout);
+			_exit(0);
+		}
+
+		int status;
+		if (waitpid(child, &status, 0) == -1 || !WIFEXITED(status) || WEXITSTATUS(status))
+			lcs::Error("The run without the cell transforms failed");
+
+		lcs::RunPipeline(transformConfigurationFile.c_str());
+	}
+
+	return 0;
+}
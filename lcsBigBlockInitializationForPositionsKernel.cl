@@ -4,14 +4,14 @@ Author		:	Mingcheng Chen
 Last Update	:	August 28th, 2012
 *******************************************************************/
 
-__kernel void BigBlockInitializationForPositions(__global double *globalVertexPositions,
+__kernel void BigBlockInitializationForPositions(__global gdouble *globalVertexPositions,
 			
 						 __global int *blockedGlobalPointIDs,
 
    						 __global int *startOffsetInPoint,
 
 						 __global int *startOffsetInPointForBig,
-						 __global double *vertexPositionsForBig,
+						 __global gdouble *vertexPositionsForBig,
 
 						 __global int *bigBlocks
 			     			 ) {
@@ -28,7 +28,7 @@ __kernel void BigBlockInitializationForPositions(__global double *globalVertexPo
 	int interestingBlockID = bigBlocks[workGroupID];
 
 	// Declare some work arrays
-	__global double *gVertexPositions;
+	__global gdouble *gVertexPositions;
 		
 	int startPoint = startOffsetInPoint[interestingBlockID];
 
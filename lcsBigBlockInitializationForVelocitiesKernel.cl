@@ -4,16 +4,16 @@ Author		:	Mingcheng Chen
 Last Update	:	August 29th, 2012
 *******************************************************************/
 
-__kernel void BigBlockInitializationForVelocities(__global double *globalStartVelocities,
-			     			  __global double *globalEndVelocities,
+__kernel void BigBlockInitializationForVelocities(__global gdouble *globalStartVelocities,
+			     			  __global gdouble *globalEndVelocities,
 			
 			     			  __global int *blockedGlobalPointIDs,
 
    			     			  __global int *startOffsetInPoint,
 
 			     			  __global int *startOffsetInPointForBig,
-			     			  __global double *startVelocitiesForBig,
-			     			  __global double *endVelocitiesForBig,
+			     			  __global gdouble *startVelocitiesForBig,
+			     			  __global gdouble *endVelocitiesForBig,
 
 			     			  __global int *bigBlocks
 			     			  ) {
@@ -30,8 +30,8 @@ __kernel void BigBlockInitializationForVelocities(__global double *globalStartVe
 	int interestingBlockID = bigBlocks[workGroupID];
 
 	// Declare some work arrays
-	__global double *gStartVelocities;
-	__global double *gEndVelocities;
+	__global gdouble *gStartVelocities;
+	__global gdouble *gEndVelocities;
 		
 	int startPoint = startOffsetInPoint[interestingBlockID];
 
@@ -0,0 +1,294 @@
+/*****************************************************
+File		:	lcsBlockedTracingKernelOfFE.cl
+Author		:	Mingcheng Chen
+Last Update	:	October 16th, 2012
+******************************************************/
+
+// Forward Euler for a fast preview. There is only one stage, so k1, k2 and k3 are not used.
+
+inline int globalFindCell(double4 particle, __global int *connectivities, __global int *links,
+			  __global gdouble *vertexPositions,
+			  double epsilon, int guess, double *coordinates) {
+	double tetX[4], tetY[4], tetZ[4];
+
+	while (true) {
+		for (int i = 0; i < 4; i++) {
+			int pointID = connectivities[(guess << 2) | i];
+
+			tetX[i] = vertexPositions[pointID * 3];
+			tetY[i] = vertexPositions[pointID * 3 + 1];
+			tetZ[i] = vertexPositions[pointID * 3 + 2];
+		}
+
+		CalculateNaturalCoordinates(particle.x, particle.y, particle.z, tetX, tetY, tetZ, coordinates);
+		
+		int index = 0;
+
+		for (int i = 1; i < 4; i++)
+			if (coordinates[i] < coordinates[index]) index = i;
+		if (coordinates[index] >= -epsilon) break;
+
+		guess = links[(guess << 2) | index];
+		
+		if (guess == -1) break;
+	}
+
+	return guess;
+}
+
+inline int localFindCell(double4 particle, __local int *connectivities, __local int *links,
+			 __local gdouble *vertexPositions,
+			 double epsilon, int guess, double *coordinates) {
+	double tetX[4], tetY[4], tetZ[4];
+
+	while (true) {
+		for (int i = 0; i < 4; i++) {
+			int pointID = connectivities[(guess << 2) | i];
+			tetX[i] = vertexPositions[pointID * 3];
+			tetY[i] = vertexPositions[pointID * 3 + 1];
+			tetZ[i] = vertexPositions[pointID * 3 + 2];
+		}
+
+		CalculateNaturalCoordinates(particle.x, particle.y, particle.z, tetX, tetY, tetZ, coordinates);
+
+		int index = 0;
+		for (int i = 1; i < 4; i++)
+			if (coordinates[i] < coordinates[index]) index = i;
+		if (coordinates[index] >= -epsilon) break;
+
+		guess = links[(guess << 2) | index];
+
+		if (guess == -1) break;
+	}
+
+	return guess;
+}
+
+__kernel void BlockedTracing(__global gdouble *globalVertexPositions,
+			     __global gdouble *globalStartVelocities,
+			     __global gdouble *globalEndVelocities,
+			     __global int *globalTetrahedralConnectivities,
+			     __global int *globalTetrahedralLinks,
+
+			     __global int *startOffsetInCell,
+			     __global int *startOffsetInPoint,
+
+			     __global int *startOffsetInCellForBig,
+			     __global int *startOffsetInPointForBig,
+			     __global gdouble *vertexPositionsForBig,
+			     __global gdouble *startVelocitiesForBig,
+			     __global gdouble *endVelocitiesForBig,
+
+			     __global bool *canFitInSharedMemory,
+
+			     __global int *blockedLocalConnectivities,
+			     __global int *blockedLocalLinks,
+			     __global int *blockedGlobalCellIDs,
+			     __global int *blockedGlobalPointIDs,
+
+			     __global int *activeBlockList, // Map active block ID to interesting block ID
+
+			     __global int *blockOfGroups,
+			     __global int *offsetInBlocks,
+
+			     __global int *stage,
+			     __global double4 *lastPosition, // The states are padded to 4 components for vector accesses.
+			     __global double4 *k1, // Unused
+			     __global double4 *k2, // Unused
+			     __global double4 *k3, // Unused
+			     __global double *pastTimes,
+
+			     __global double4 *placesOfInterest,
+
+			     __global int *startOffsetInParticle,
+			     __global int *blockedActiveParticleIDList,
+			     __global int *cellLocations,
+
+			     __global int *exitCells,
+
+			     __local void *sharedMemory,
+							 
+			     double startTime, double endTime, double timeStep,
+			     double epsilon,
+
+			     __global int *numOfGroupsForBlocks, // It is the prefix sum with the total at the end.
+			     int numOfActiveBlocks) {
+	// Get work group ID
+	int groupID = get_group_id(0);
+
+	// The host launches an upper bound of the number of groups.
+	if (groupID >= numOfGroupsForBlocks[numOfActiveBlocks]) return;
+	
+	// Get number of threads in a work group
+	int numOfThreads = get_local_size(0);
+
+	// Get local thread ID
+	int localID = get_local_id(0);
+
+	// Get active block ID
+	int activeBlockID = blockOfGroups[groupID];
+
+	// Get interesting block ID of the work group
+	int interestingBlockID = activeBlockList[activeBlockID];
+
+	// Declare some arrays
+	__local gdouble *vertexPositions;
+	__local gdouble *startVelocities;
+	__local gdouble *endVelocities;
+	__local int *connectivities;
+	__local int *links;
+
+	__global gdouble *gVertexPositions;
+	__global gdouble *gStartVelocities;
+	__global gdouble *gEndVelocities;
+	__global int *gConnectivities;
+	__global int *gLinks;
+
+	bool canFit = canFitInSharedMemory[interestingBlockID];
+
+	int startCell = startOffsetInCell[interestingBlockID];
+	int startPoint = startOffsetInPoint[interestingBlockID];
+
+	int numOfCells = startOffsetInCell[interestingBlockID + 1] - startCell;
+	int numOfPoints = startOffsetInPoint[interestingBlockID + 1] - startPoint;
+
+	int startCellForBig = startOffsetInCellForBig[interestingBlockID];
+	int startPointForBig = startOffsetInPointForBig[interestingBlockID];
+
+	if (canFit) { // This branch fills in the shared memory
+		// Initialize vertexPositions, startVelocities and endVelocities
+		vertexPositions = (__local gdouble *)sharedMemory;
+		startVelocities = vertexPositions + numOfPoints * 3;
+		endVelocities = startVelocities + numOfPoints * 3;
+
+		// Initialize connectivities and links
+		connectivities = (__local int *)(endVelocities + numOfPoints * 3);
+		links = connectivities + (numOfCells << 2);
+	} else { // This branch fills in the global memory
+		// Initialize vertexPositions, startVelocities and endVelocities
+		gVertexPositions = vertexPositionsForBig + startPointForBig * 3;
+		gStartVelocities = startVelocitiesForBig + startPointForBig * 3;
+		gEndVelocities = endVelocitiesForBig + startPointForBig * 3;
+
+		// Initialize connectivities and links
+		gConnectivities = blockedLocalConnectivities + (startCell << 2);
+		gLinks = blockedLocalLinks + (startCell << 2);
+	}
+
+	for (int i = localID; i < numOfPoints * 3; i += numOfThreads) {
+		int localPointID = i / 3;
+		int dimensionID = i % 3;
+		int globalPointID = blockedGlobalPointIDs[startPoint + localPointID];
+
+		if (canFit) {
+			vertexPositions[i] = globalVertexPositions[globalPointID * 3 + dimensionID];
+			startVelocities[i] = globalStartVelocities[globalPointID * 3 + dimensionID];
+			endVelocities[i] = globalEndVelocities[globalPointID * 3 + dimensionID];
+		}
+	}
+
+	if (canFit)
+		for (int i = localID; i < (numOfCells << 2); i += numOfThreads) {
+			connectivities[i] = *(blockedLocalConnectivities + (startCell << 2) + i);
+			links[i] = *(blockedLocalLinks + (startCell << 2) + i);
+		}
+
+	if (canFit)
+		barrier(CLK_LOCAL_MEM_FENCE);
+	else
+		barrier(CLK_GLOBAL_MEM_FENCE);
+	
+	int numOfActiveParticles = startOffsetInParticle[activeBlockID + 1] - startOffsetInParticle[activeBlockID];
+
+	int arrayIdx = offsetInBlocks[groupID] * numOfThreads + localID;
+
+	if (arrayIdx < numOfActiveParticles) {
+		arrayIdx += startOffsetInParticle[activeBlockID];
+
+#ifdef GATHERED_PARTICLES
+		// The particle states have been gathered in block order.
+		int activeParticleID = arrayIdx;
+#else
+		// activeParticleID here means the initial active particle ID
+		int activeParticleID = blockedActiveParticleIDList[arrayIdx];
+#endif
+
+		// Initialize the particle status
+		int currCell = cellLocations[activeParticleID];
+
+		double currTime = pastTimes[activeParticleID];
+
+		double4 currLastPosition = lastPosition[activeParticleID];
+
+		// At least one loop is executed.
+		while (true) {
+			double4 placeOfInterest = currLastPosition;
+
+			double coordinates[4];
+
+			int nextCell;
+
+			if (canFit)
+				nextCell = localFindCell(placeOfInterest, connectivities, links,
+							 vertexPositions, epsilon, currCell, coordinates);
+			else
+				nextCell = globalFindCell(placeOfInterest, gConnectivities, gLinks,
+							  gVertexPositions, epsilon, currCell, coordinates);
+
+			if (nextCell == -1 || currTime >= endTime) {
+				// Find the next cell globally
+				int globalCellID = blockedGlobalCellIDs[startCell + currCell];
+				int nextGlobalCell;
+				
+				if (nextCell != -1)
+					nextGlobalCell = blockedGlobalCellIDs[startCell + nextCell];
+				else
+					nextGlobalCell = globalFindCell(placeOfInterest, globalTetrahedralConnectivities,
+									globalTetrahedralLinks, globalVertexPositions,
+									epsilon, globalCellID, coordinates);
+
+				if (currTime >= endTime && nextGlobalCell != -1) nextGlobalCell = -2 - nextGlobalCell;
+
+				pastTimes[activeParticleID] = currTime;
+
+				stage[activeParticleID] = 0;
+
+				lastPosition[activeParticleID] = currLastPosition;
+
+				placesOfInterest[activeParticleID] = placeOfInterest;
+
+				exitCells[activeParticleID] = nextGlobalCell;
+				break;
+			}
+
+			currCell = nextCell;
+
+			double alpha = (endTime - currTime) / (endTime - startTime);
+			double beta = 1 - alpha;
+
+			double vecX[4], vecY[4], vecZ[4];
+
+			for (int i = 0; i < 4; i++)
+				if (canFit) {
+					int pointID = connectivities[(nextCell << 2) | i];
+					vecX[i] = startVelocities[pointID * 3] * alpha + endVelocities[pointID * 3] * beta;
+					vecY[i] = startVelocities[pointID * 3 + 1] * alpha + endVelocities[pointID * 3 + 1] * beta;
+					vecZ[i] = startVelocities[pointID * 3 + 2] * alpha + endVelocities[pointID * 3 + 2] * beta;
+				} else {
+					int pointID = gConnectivities[(nextCell << 2) | i];
+					vecX[i] = gStartVelocities[pointID * 3] * alpha + gEndVelocities[pointID * 3] * beta;
+					vecY[i] = gStartVelocities[pointID * 3 + 1] * alpha + gEndVelocities[pointID * 3 + 1] * beta;
+					vecZ[i] = gStartVelocities[pointID * 3 + 2] * alpha + gEndVelocities[pointID * 3 + 2] * beta;
+				}
+
+			double4 velocity = (double4)(0, 0, 0, 0);
+
+			for (int i = 0; i < 4; i++)
+				velocity += (double4)(vecX[i], vecY[i], vecZ[i], 0) * coordinates[i];
+
+			currLastPosition += velocity * timeStep;
+
+			currTime += timeStep;
+		}
+	}
+}
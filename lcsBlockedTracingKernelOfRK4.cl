@@ -4,67 +4,8 @@ Author		:	Mingcheng Chen
 Last Update	:	September 27th, 2012
 ******************************************************/
 
-inline double DeterminantThree(double *a) {
-	// a[0] a[1] a[2]
-	// a[3] a[4] a[5]
-	// a[6] a[7] a[8]
-	return a[0] * a[4] * a[8] + a[1] * a[5] * a[6] + a[2] * a[3] * a[7] -
-	       a[0] * a[5] * a[7] - a[1] * a[3] * a[8] - a[2] * a[4] * a[6];
-}
-
-inline void CalculateNaturalCoordinates(double X, double Y, double Z,
-					double *tetX, double *tetY, double *tetZ, double *coordinates) {
-	X -= tetX[0];
-	Y -= tetY[0];
-	Z -= tetZ[0];
-
-	double det[9] = {tetX[1] - tetX[0], tetY[1] - tetY[0], tetZ[1] - tetZ[0],
-			 tetX[2] - tetX[0], tetY[2] - tetY[0], tetZ[2] - tetZ[0],
-			 tetX[3] - tetX[0], tetY[3] - tetY[0], tetZ[3] - tetZ[0]};
-
-	double V = 1 / DeterminantThree(det);
-
-	double z41 = tetZ[3] - tetZ[0];
-	double y34 = tetY[2] - tetY[3];
-	double z34 = tetZ[2] - tetZ[3];
-	double y41 = tetY[3] - tetY[0];
-	double a11 = (z41 * y34 - z34 * y41) * V;
-
-	double x41 = tetX[3] - tetX[0];
-	double x34 = tetX[2] - tetX[3];
-	double a12 = (x41 * z34 - x34 * z41) * V;
-
-	double a13 = (y41 * x34 - y34 * x41) * V;
-
-	coordinates[1] = a11 * X + a12 * Y + a13 * Z;
-
-	double y12 = tetY[0] - tetY[1];
-	double z12 = tetZ[0] - tetZ[1];
-	double a21 = (z41 * y12 - z12 * y41) * V;
-
-	double x12 = tetX[0] - tetX[1];
-	double a22 = (x41 * z12 - x12 * z41) * V;
-
-	double a23 = (y41 * x12 - y12 * x41) * V;
-
-	coordinates[2] = a21 * X + a22 * Y + a23 * Z;
-
-	double z23 = tetZ[1] - tetZ[2];
-	double y23 = tetY[1] - tetY[2];
-	double a31 = (z23 * y12 - z12 * y23) * V;
-
-	double x23 = tetX[1] - tetX[2];
-	double a32 = (x23 * z12 - x12 * z23) * V;
-
-	double a33 = (y23 * x12 - y12 * x23) * V;
-
-	coordinates[3] = a31 * X + a32 * Y + a33 * Z;
-
-	coordinates[0] = 1 - coordinates[1] - coordinates[2] - coordinates[3];
-}
-
-inline int globalFindCell(double *particle, __global int *connectivities, __global int *links,
-			  __global double *vertexPositions,
+inline int globalFindCell(double4 particle, __global int *connectivities, __global int *links,
+			  __global gdouble *vertexPositions,
 			  double epsilon, int guess, double *coordinates) {
 	double tetX[4], tetY[4], tetZ[4];
 
@@ -77,7 +18,7 @@ inline int globalFindCell(double *particle, __global int *connectivities, __glob
 			tetZ[i] = vertexPositions[pointID * 3 + 2];
 		}
 
-		CalculateNaturalCoordinates(particle[0], particle[1], particle[2], tetX, tetY, tetZ, coordinates);
+		CalculateNaturalCoordinates(particle.x, particle.y, particle.z, tetX, tetY, tetZ, coordinates);
 		
 		int index = 0;
 
@@ -93,8 +34,8 @@ inline int globalFindCell(double *particle, __global int *connectivities, __glob
 	return guess;
 }
 
-inline int localFindCell(double *particle, __local int *connectivities, __local int *links,
-			 __local double *vertexPositions,
+inline int localFindCell(double4 particle, __local int *connectivities, __local int *links,
+			 __local gdouble *vertexPositions,
 			 double epsilon, int guess, double *coordinates) {
 	double tetX[4], tetY[4], tetZ[4];
 
@@ -106,7 +47,7 @@ inline int localFindCell(double *particle, __local int *connectivities, __local
 			tetZ[i] = vertexPositions[pointID * 3 + 2];
 		}
 
-		CalculateNaturalCoordinates(particle[0], particle[1], particle[2], tetX, tetY, tetZ, coordinates);
+		CalculateNaturalCoordinates(particle.x, particle.y, particle.z, tetX, tetY, tetZ, coordinates);
 
 		int index = 0;
 		for (int i = 1; i < 4; i++)
@@ -121,9 +62,74 @@ inline int localFindCell(double *particle, __local int *connectivities, __local
 	return guess;
 }
 
-__kernel void BlockedTracing(__global double *globalVertexPositions,
-			     __global double *globalStartVelocities,
-			     __global double *globalEndVelocities,
+#ifdef CELL_TRANSFORMS
+// The transform of a cell is its first vertex followed by the rows of the inverse of its edge matrix.
+inline void ApplyCellTransform(double4 particle, __global gdouble *transform, double *coordinates) {
+	double X = particle.x - transform[0];
+	double Y = particle.y - transform[1];
+	double Z = particle.z - transform[2];
+
+	coordinates[1] = transform[3] * X + transform[4] * Y + transform[5] * Z;
+	coordinates[2] = transform[6] * X + transform[7] * Y + transform[8] * Z;
+	coordinates[3] = transform[9] * X + transform[10] * Y + transform[11] * Z;
+
+	coordinates[0] = 1 - coordinates[1] - coordinates[2] - coordinates[3];
+}
+
+// Same walk as globalFindCell(), with one matrix-vector product per step
+inline int transformedFindCell(double4 particle, __global int *links, __global gdouble *transforms,
+			       double epsilon, int guess, double *coordinates) {
+	while (true) {
+		ApplyCellTransform(particle, transforms + guess * 12, coordinates);
+
+		int index = 0;
+		for (int i = 1; i < 4; i++)
+			if (coordinates[i] < coordinates[index]) index = i;
+		if (coordinates[index] >= -epsilon) break;
+
+		guess = links[(guess << 2) | index];
+
+		if (guess == -1) break;
+	}
+
+	return guess;
+}
+
+inline void localApplyCellTransform(double4 particle, __local gdouble *transform, double *coordinates) {
+	double X = particle.x - transform[0];
+	double Y = particle.y - transform[1];
+	double Z = particle.z - transform[2];
+
+	coordinates[1] = transform[3] * X + transform[4] * Y + transform[5] * Z;
+	coordinates[2] = transform[6] * X + transform[7] * Y + transform[8] * Z;
+	coordinates[3] = transform[9] * X + transform[10] * Y + transform[11] * Z;
+
+	coordinates[0] = 1 - coordinates[1] - coordinates[2] - coordinates[3];
+}
+
+// Same walk as localFindCell(), on the transforms in the shared memory
+inline int localTransformedFindCell(double4 particle, __local int *links, __local gdouble *transforms,
+				    double epsilon, int guess, double *coordinates) {
+	while (true) {
+		localApplyCellTransform(particle, transforms + guess * 12, coordinates);
+
+		int index = 0;
+		for (int i = 1; i < 4; i++)
+			if (coordinates[i] < coordinates[index]) index = i;
+		if (coordinates[index] >= -epsilon) break;
+
+		guess = links[(guess << 2) | index];
+
+		if (guess == -1) break;
+	}
+
+	return guess;
+}
+#endif
+
+__kernel void BlockedTracing(__global gdouble *globalVertexPositions,
+			     __global gdouble *globalStartVelocities,
+			     __global gdouble *globalEndVelocities,
 			     __global int *globalTetrahedralConnectivities,
 			     __global int *globalTetrahedralLinks,
 
@@ -132,9 +138,9 @@ __kernel void BlockedTracing(__global double *globalVertexPositions,
 
 			     __global int *startOffsetInCellForBig,
 			     __global int *startOffsetInPointForBig,
-			     __global double *vertexPositionsForBig,
-			     __global double *startVelocitiesForBig,
-			     __global double *endVelocitiesForBig,
+			     __global gdouble *vertexPositionsForBig,
+			     __global gdouble *startVelocitiesForBig,
+			     __global gdouble *endVelocitiesForBig,
 
 			     __global bool *canFitInSharedMemory,
 
@@ -149,13 +155,13 @@ __kernel void BlockedTracing(__global double *globalVertexPositions,
 			     __global int *offsetInBlocks,
 
 			     __global int *stage,
-			     __global double *lastPosition,
-			     __global double *k1,
-			     __global double *k2,
-			     __global double *k3,
+			     __global double4 *lastPosition, // The states are padded to 4 components for vector accesses.
+			     __global double4 *k1,
+			     __global double4 *k2,
+			     __global double4 *k3,
 			     __global double *pastTimes,
 
-			     __global double *placesOfInterest,
+			     __global double4 *placesOfInterest,
 
 			     __global int *startOffsetInParticle,
 			     __global int *blockedActiveParticleIDList,
@@ -166,9 +172,27 @@ __kernel void BlockedTracing(__global double *globalVertexPositions,
 			     __local void *sharedMemory,
 							 
 			     double startTime, double endTime, double timeStep,
-			     double epsilon) {
+			     double epsilon,
+
+			     __global int *numOfGroupsForBlocks, // It is the prefix sum with the total at the end.
+			     int numOfActiveBlocks
+#ifdef CELL_TRANSFORMS
+			     // 38 to 43 are the step control of RK45, which RK4 does not use,
+			     // so that the transforms have the same arguments in both kernels.
+			     , __global double4 *unusedK4, __global double4 *unusedK5, __global double *unusedStepSizes,
+			     double unusedTolerance, double unusedMinTimeStep, double unusedMaxTimeStep,
+
+			     __global gdouble *globalCellTransforms,
+			     __global gdouble *blockedCellTransforms,
+			     __global int *startOffsetInCellForTransforms, // -1 for the blocks without blocked transforms
+			     int useGlobalTransforms
+#endif
+			     ) {
 	// Get work group ID
 	int groupID = get_group_id(0);
+
+	// The host launches an upper bound of the number of groups.
+	if (groupID >= numOfGroupsForBlocks[numOfActiveBlocks]) return;
 	
 	// Get number of threads in a work group
 	int numOfThreads = get_local_size(0);
@@ -183,15 +207,15 @@ __kernel void BlockedTracing(__global double *globalVertexPositions,
 	int interestingBlockID = activeBlockList[activeBlockID];
 
 	// Declare some arrays
-	__local double *vertexPositions;
-	__local double *startVelocities;
-	__local double *endVelocities;
+	__local gdouble *vertexPositions;
+	__local gdouble *startVelocities;
+	__local gdouble *endVelocities;
 	__local int *connectivities;
 	__local int *links;
 
-	__global double *gVertexPositions;
-	__global double *gStartVelocities;
-	__global double *gEndVelocities;
+	__global gdouble *gVertexPositions;
+	__global gdouble *gStartVelocities;
+	__global gdouble *gEndVelocities;
 	__global int *gConnectivities;
 	__global int *gLinks;
 
@@ -206,15 +230,25 @@ __kernel void BlockedTracing(__global double *globalVertexPositions,
 	int startCellForBig = startOffsetInCellForBig[interestingBlockID];
 	int startPointForBig = startOffsetInPointForBig[interestingBlockID];
 
+#ifdef CELL_TRANSFORMS
+	int startCellForTransforms = startOffsetInCellForTransforms[interestingBlockID];
+	__local gdouble *transforms;
+#endif
+
 	if (canFit) { // This branch fills in the shared memory
 		// Initialize vertexPositions, startVelocities and endVelocities
-		vertexPositions = (__local double *)sharedMemory;
+		vertexPositions = (__local gdouble *)sharedMemory;
 		startVelocities = vertexPositions + numOfPoints * 3;
 		endVelocities = startVelocities + numOfPoints * 3;
 
 		// Initialize connectivities and links
 		connectivities = (__local int *)(endVelocities + numOfPoints * 3);
 		links = connectivities + (numOfCells << 2);
+
+#ifdef CELL_TRANSFORMS
+		// The host only gives transforms to a small block if they fit in the shared memory after its links.
+		transforms = (__local gdouble *)(links + (numOfCells << 2));
+#endif
 	} else { // This branch fills in the global memory
 		// Initialize vertexPositions, startVelocities and endVelocities
 		gVertexPositions = vertexPositionsForBig + startPointForBig * 3;
@@ -244,6 +278,12 @@ __kernel void BlockedTracing(__global double *globalVertexPositions,
 			links[i] = *(blockedLocalLinks + (startCell << 2) + i);
 		}
 
+#ifdef CELL_TRANSFORMS
+	if (canFit && startCellForTransforms != -1)
+		for (int i = localID; i < numOfCells * 12; i += numOfThreads)
+			transforms[i] = blockedCellTransforms[startCellForTransforms * 12 + i];
+#endif
+
 	if (canFit)
 		barrier(CLK_LOCAL_MEM_FENCE);
 	else
@@ -254,9 +294,15 @@ __kernel void BlockedTracing(__global double *globalVertexPositions,
 	int arrayIdx = offsetInBlocks[groupID] * numOfThreads + localID;
 
 	if (arrayIdx < numOfActiveParticles) {
-		// activeParticleID here means the initial active particle ID
 		arrayIdx += startOffsetInParticle[activeBlockID];
+
+#ifdef GATHERED_PARTICLES
+		// The particle states have been gathered in block order.
+		int activeParticleID = arrayIdx;
+#else
+		// activeParticleID here means the initial active particle ID
 		int activeParticleID = blockedActiveParticleIDList[arrayIdx];
+#endif
 
 		// Initialize the particle status
 		int currStage = stage[activeParticleID];
@@ -264,55 +310,38 @@ __kernel void BlockedTracing(__global double *globalVertexPositions,
 
 		double currTime = pastTimes[activeParticleID];
 
-		double currLastPosition[3];
-		currLastPosition[0] = lastPosition[activeParticleID * 3];
-		currLastPosition[1] = lastPosition[activeParticleID * 3 + 1];
-		currLastPosition[2] = lastPosition[activeParticleID * 3 + 2];
-		double currK1[3], currK2[3], currK3[3], currK4[3];
-		if (currStage > 0) {
-			currK1[0] = k1[activeParticleID * 3];
-			currK1[1] = k1[activeParticleID * 3 + 1];
-			currK1[2] = k1[activeParticleID * 3 + 2];
-		}
-		if (currStage > 1) {
-			currK2[0] = k2[activeParticleID * 3];
-			currK2[1] = k2[activeParticleID * 3 + 1];
-			currK2[2] = k2[activeParticleID * 3 + 2];
-		}
-		if (currStage > 2) {
-			currK3[0] = k3[activeParticleID * 3];
-			currK3[1] = k3[activeParticleID * 3 + 1];
-			currK3[2] = k3[activeParticleID * 3 + 2];
-		}
+		double4 currLastPosition = lastPosition[activeParticleID];
+		double4 currK1, currK2, currK3, currK4;
+		if (currStage > 0) currK1 = k1[activeParticleID];
+		if (currStage > 1) currK2 = k2[activeParticleID];
+		if (currStage > 2) currK3 = k3[activeParticleID];
+
+		// Only the ks computed in this kernel are written back.
+		int firstNewStage = currStage;
 
 		// At least one loop is executed.
 		while (true) {
-			double placeOfInterest[3];
-			placeOfInterest[0] = currLastPosition[0];
-			placeOfInterest[1] = currLastPosition[1];
-			placeOfInterest[2] = currLastPosition[2];
+			double4 placeOfInterest = currLastPosition;
 			switch (currStage) {
-			case 1: {
-				placeOfInterest[0] += 0.5 * currK1[0];
-				placeOfInterest[1] += 0.5 * currK1[1];
-				placeOfInterest[2] += 0.5 * currK1[2];
-					} break;
-			case 2: {
-				placeOfInterest[0] += 0.5 * currK2[0];
-				placeOfInterest[1] += 0.5 * currK2[1];
-				placeOfInterest[2] += 0.5 * currK2[2];
-					} break;
-			case 3: {
-				placeOfInterest[0] += currK3[0];
-				placeOfInterest[1] += currK3[1];
-				placeOfInterest[2] += currK3[2];
-					} break;
+			case 1: placeOfInterest += currK1 / 2; break;
+			case 2: placeOfInterest += currK2 / 2; break;
+			case 3: placeOfInterest += currK3; break;
 			}
 
 			double coordinates[4];
 
 			int nextCell;
 
+#ifdef CELL_TRANSFORMS
+			if (startCellForTransforms != -1 && canFit)
+				nextCell = localTransformedFindCell(placeOfInterest, links, transforms,
+								    epsilon, currCell, coordinates);
+			else if (startCellForTransforms != -1)
+				nextCell = transformedFindCell(placeOfInterest, gLinks,
+							       blockedCellTransforms + startCellForTransforms * 12,
+							       epsilon, currCell, coordinates);
+			else
+#endif
 			if (canFit)
 				nextCell = localFindCell(placeOfInterest, connectivities, links,
 							 vertexPositions, epsilon, currCell, coordinates);
@@ -327,6 +356,11 @@ __kernel void BlockedTracing(__global double *globalVertexPositions,
 				
 				if (nextCell != -1)
 					nextGlobalCell = blockedGlobalCellIDs[startCell + nextCell];
+#ifdef CELL_TRANSFORMS
+				else if (useGlobalTransforms)
+					nextGlobalCell = transformedFindCell(placeOfInterest, globalTetrahedralLinks, globalCellTransforms,
+									     epsilon, globalCellID, coordinates);
+#endif
 				else
 					nextGlobalCell = globalFindCell(placeOfInterest, globalTetrahedralConnectivities,
 									globalTetrahedralLinks, globalVertexPositions,
@@ -338,31 +372,15 @@ __kernel void BlockedTracing(__global double *globalVertexPositions,
 
 				stage[activeParticleID] = currStage;
 
-				lastPosition[activeParticleID * 3] = currLastPosition[0];
-				lastPosition[activeParticleID * 3 + 1] = currLastPosition[1];
-				lastPosition[activeParticleID * 3 + 2] = currLastPosition[2];
+				lastPosition[activeParticleID] = currLastPosition;
 
-				placesOfInterest[activeParticleID * 3] = placeOfInterest[0];
-				placesOfInterest[activeParticleID * 3 + 1] = placeOfInterest[1];
-				placesOfInterest[activeParticleID * 3 + 2] = placeOfInterest[2];
+				placesOfInterest[activeParticleID] = placeOfInterest;
 
 				exitCells[activeParticleID] = nextGlobalCell;
 		
-				if (currStage > 0) {
-					k1[activeParticleID * 3] = currK1[0];
-					k1[activeParticleID * 3 + 1] = currK1[1];
-					k1[activeParticleID * 3 + 2] = currK1[2];
-				}
-				if (currStage > 1) {
-					k2[activeParticleID * 3] = currK2[0];
-					k2[activeParticleID * 3 + 1] = currK2[1];
-					k2[activeParticleID * 3 + 2] = currK2[2];
-				}
-				if (currStage > 2) {
-					k3[activeParticleID * 3] = currK3[0];
-					k3[activeParticleID * 3 + 1] = currK3[1];
-					k3[activeParticleID * 3 + 2] = currK3[2];
-				}
+				if (currStage > 0 && firstNewStage <= 0) k1[activeParticleID] = currK1;
+				if (currStage > 1 && firstNewStage <= 1) k2[activeParticleID] = currK2;
+				if (currStage > 2 && firstNewStage <= 2) k3[activeParticleID] = currK3;
 				break;
 			}
 
@@ -386,35 +404,27 @@ __kernel void BlockedTracing(__global double *globalVertexPositions,
 					vecZ[i] = gStartVelocities[pointID * 3 + 2] * alpha + gEndVelocities[pointID * 3 + 2] * beta;
 				}
 
-			double *currK;
-			switch (currStage) {
-			case 0: currK = currK1; break;
-			case 1: currK = currK2; break;
-			case 2: currK = currK3; break;
-			case 3: currK = currK4; break;
-			}
+			double4 velocity = (double4)(0, 0, 0, 0);
 
-			currK[0] = currK[1] = currK[2] = 0;
+			for (int i = 0; i < 4; i++)
+				velocity += (double4)(vecX[i], vecY[i], vecZ[i], 0) * coordinates[i];
 
-			for (int i = 0; i < 4; i++) {
-				currK[0] += vecX[i] * coordinates[i];
-				currK[1] += vecY[i] * coordinates[i];
-				currK[2] += vecZ[i] * coordinates[i];
+			switch (currStage) {
+			case 0: currK1 = velocity * timeStep; break;
+			case 1: currK2 = velocity * timeStep; break;
+			case 2: currK3 = velocity * timeStep; break;
+			case 3: currK4 = velocity * timeStep; break;
 			}
 
-			currK[0] *= timeStep;
-			currK[1] *= timeStep;
-			currK[2] *= timeStep;
-
 			if (currStage == 3) {
 				currTime += timeStep;
 
-				for (int i = 0; i < 3; i++)
-					currLastPosition[i] += (currK1[i] + 2 * currK2[i] + 2 * currK3[i] + currK4[i]) / 6;
+				currLastPosition += (currK1 + 2 * currK2 + 2 * currK3 + currK4) / 6;
 
 				currStage = 0;
+				firstNewStage = 0;
 			} else
 				currStage++;
 		}
 	}
-}	
+}
@@ -0,0 +1,487 @@
+/*****************************************************
+File		:	lcsBlockedTracingKernelOfRK45.cl
+Author		:	Mingcheng Chen
+Last Update	:	October 16th, 2012
+******************************************************/
+
+// Cash-Karp embedded Runge-Kutta 4(5) with a step size per particle.
+// k1 to k5 are kept between runs, and k6 is consumed in the stage it is computed.
+// The stages are 0 to 5, the same as the index of the k under computation.
+
+// Nodes
+__constant double nodes[6] = {0.0, 0.2, 0.3, 0.6, 1.0, 0.875};
+
+// Coefficients of the stages, stageWeights[i][j] for k(j + 1) in the position of stage i
+__constant double stageWeights[6][5] = {
+	{0.0, 0.0, 0.0, 0.0, 0.0},
+	{0.2, 0.0, 0.0, 0.0, 0.0},
+	{3.0 / 40, 9.0 / 40, 0.0, 0.0, 0.0},
+	{0.3, -0.9, 1.2, 0.0, 0.0},
+	{-11.0 / 54, 2.5, -70.0 / 27, 35.0 / 27, 0.0},
+	{1631.0 / 55296, 175.0 / 512, 575.0 / 13824, 44275.0 / 110592, 253.0 / 4096}
+};
+
+// Weights of the 5th order solution
+__constant double weights[6] = {37.0 / 378, 0.0, 250.0 / 621, 125.0 / 594, 0.0, 512.0 / 1771};
+
+// Weights of the 5th order solution minus the ones of the embedded 4th order solution
+__constant double errorWeights[6] = {
+	37.0 / 378 - 2825.0 / 27648, 0.0, 250.0 / 621 - 18575.0 / 48384,
+	125.0 / 594 - 13525.0 / 55296, -277.0 / 14336, 512.0 / 1771 - 0.25
+};
+
+inline int globalFindCell(double4 particle, __global int *connectivities, __global int *links,
+			  __global gdouble *vertexPositions,
+			  double epsilon, int guess, double *coordinates) {
+	double tetX[4], tetY[4], tetZ[4];
+
+	while (true) {
+		for (int i = 0; i < 4; i++) {
+			int pointID = connectivities[(guess << 2) | i];
+
+			tetX[i] = vertexPositions[pointID * 3];
+			tetY[i] = vertexPositions[pointID * 3 + 1];
+			tetZ[i] = vertexPositions[pointID * 3 + 2];
+		}
+
+		CalculateNaturalCoordinates(particle.x, particle.y, particle.z, tetX, tetY, tetZ, coordinates);
+		
+		int index = 0;
+
+		for (int i = 1; i < 4; i++)
+			if (coordinates[i] < coordinates[index]) index = i;
+		if (coordinates[index] >= -epsilon) break;
+
+		guess = links[(guess << 2) | index];
+		
+		if (guess == -1) break;
+	}
+
+	return guess;
+}
+
+inline int localFindCell(double4 particle, __local int *connectivities, __local int *links,
+			 __local gdouble *vertexPositions,
+			 double epsilon, int guess, double *coordinates) {
+	double tetX[4], tetY[4], tetZ[4];
+
+	while (true) {
+		for (int i = 0; i < 4; i++) {
+			int pointID = connectivities[(guess << 2) | i];
+			tetX[i] = vertexPositions[pointID * 3];
+			tetY[i] = vertexPositions[pointID * 3 + 1];
+			tetZ[i] = vertexPositions[pointID * 3 + 2];
+		}
+
+		CalculateNaturalCoordinates(particle.x, particle.y, particle.z, tetX, tetY, tetZ, coordinates);
+
+		int index = 0;
+		for (int i = 1; i < 4; i++)
+			if (coordinates[i] < coordinates[index]) index = i;
+		if (coordinates[index] >= -epsilon) break;
+
+		guess = links[(guess << 2) | index];
+
+		if (guess == -1) break;
+	}
+
+	return guess;
+}
+
+#ifdef CELL_TRANSFORMS
+// The transform of a cell is its first vertex followed by the rows of the inverse of its edge matrix.
+inline void ApplyCellTransform(double4 particle, __global gdouble *transform, double *coordinates) {
+	double X = particle.x - transform[0];
+	double Y = particle.y - transform[1];
+	double Z = particle.z - transform[2];
+
+	coordinates[1] = transform[3] * X + transform[4] * Y + transform[5] * Z;
+	coordinates[2] = transform[6] * X + transform[7] * Y + transform[8] * Z;
+	coordinates[3] = transform[9] * X + transform[10] * Y + transform[11] * Z;
+
+	coordinates[0] = 1 - coordinates[1] - coordinates[2] - coordinates[3];
+}
+
+// Same walk as globalFindCell(), with one matrix-vector product per step
+inline int transformedFindCell(double4 particle, __global int *links, __global gdouble *transforms,
+			       double epsilon, int guess, double *coordinates) {
+	while (true) {
+		ApplyCellTransform(particle, transforms + guess * 12, coordinates);
+
+		int index = 0;
+		for (int i = 1; i < 4; i++)
+			if (coordinates[i] < coordinates[index]) index = i;
+		if (coordinates[index] >= -epsilon) break;
+
+		guess = links[(guess << 2) | index];
+
+		if (guess == -1) break;
+	}
+
+	return guess;
+}
+
+inline void localApplyCellTransform(double4 particle, __local gdouble *transform, double *coordinates) {
+	double X = particle.x - transform[0];
+	double Y = particle.y - transform[1];
+	double Z = particle.z - transform[2];
+
+	coordinates[1] = transform[3] * X + transform[4] * Y + transform[5] * Z;
+	coordinates[2] = transform[6] * X + transform[7] * Y + transform[8] * Z;
+	coordinates[3] = transform[9] * X + transform[10] * Y + transform[11] * Z;
+
+	coordinates[0] = 1 - coordinates[1] - coordinates[2] - coordinates[3];
+}
+
+// Same walk as localFindCell(), on the transforms in the shared memory
+inline int localTransformedFindCell(double4 particle, __local int *links, __local gdouble *transforms,
+				    double epsilon, int guess, double *coordinates) {
+	while (true) {
+		localApplyCellTransform(particle, transforms + guess * 12, coordinates);
+
+		int index = 0;
+		for (int i = 1; i < 4; i++)
+			if (coordinates[i] < coordinates[index]) index = i;
+		if (coordinates[index] >= -epsilon) break;
+
+		guess = links[(guess << 2) | index];
+
+		if (guess == -1) break;
+	}
+
+	return guess;
+}
+#endif
+
+__kernel void BlockedTracing(__global gdouble *globalVertexPositions,
+			     __global gdouble *globalStartVelocities,
+			     __global gdouble *globalEndVelocities,
+			     __global int *globalTetrahedralConnectivities,
+			     __global int *globalTetrahedralLinks,
+
+			     __global int *startOffsetInCell,
+			     __global int *startOffsetInPoint,
+
+			     __global int *startOffsetInCellForBig,
+			     __global int *startOffsetInPointForBig,
+			     __global gdouble *vertexPositionsForBig,
+			     __global gdouble *startVelocitiesForBig,
+			     __global gdouble *endVelocitiesForBig,
+
+			     __global bool *canFitInSharedMemory,
+
+			     __global int *blockedLocalConnectivities,
+			     __global int *blockedLocalLinks,
+			     __global int *blockedGlobalCellIDs,
+			     __global int *blockedGlobalPointIDs,
+
+			     __global int *activeBlockList, // Map active block ID to interesting block ID
+
+			     __global int *blockOfGroups,
+			     __global int *offsetInBlocks,
+
+			     __global int *stage,
+			     __global double4 *lastPosition, // The states are padded to 4 components for vector accesses.
+			     __global double4 *k1,
+			     __global double4 *k2,
+			     __global double4 *k3,
+			     __global double *pastTimes,
+
+			     __global double4 *placesOfInterest,
+
+			     __global int *startOffsetInParticle,
+			     __global int *blockedActiveParticleIDList,
+			     __global int *cellLocations,
+
+			     __global int *exitCells,
+
+			     __local void *sharedMemory,
+							 
+			     double startTime, double endTime, double timeStep,
+			     double epsilon,
+
+			     __global int *numOfGroupsForBlocks, // It is the prefix sum with the total at the end.
+			     int numOfActiveBlocks,
+
+			     __global double4 *k4,
+			     __global double4 *k5,
+			     __global double *stepSizes, // 0 means timeStep, the initial step size.
+
+			     double tolerance, double minTimeStep, double maxTimeStep
+#ifdef CELL_TRANSFORMS
+			     , __global gdouble *globalCellTransforms,
+			     __global gdouble *blockedCellTransforms,
+			     __global int *startOffsetInCellForTransforms, // -1 for the blocks without blocked transforms
+			     int useGlobalTransforms
+#endif
+			     ) {
+	// Get work group ID
+	int groupID = get_group_id(0);
+
+	// The host launches an upper bound of the number of groups.
+	if (groupID >= numOfGroupsForBlocks[numOfActiveBlocks]) return;
+	
+	// Get number of threads in a work group
+	int numOfThreads = get_local_size(0);
+
+	// Get local thread ID
+	int localID = get_local_id(0);
+
+	// Get active block ID
+	int activeBlockID = blockOfGroups[groupID];
+
+	// Get interesting block ID of the work group
+	int interestingBlockID = activeBlockList[activeBlockID];
+
+	// Declare some arrays
+	__local gdouble *vertexPositions;
+	__local gdouble *startVelocities;
+	__local gdouble *endVelocities;
+	__local int *connectivities;
+	__local int *links;
+
+	__global gdouble *gVertexPositions;
+	__global gdouble *gStartVelocities;
+	__global gdouble *gEndVelocities;
+	__global int *gConnectivities;
+	__global int *gLinks;
+
+	bool canFit = canFitInSharedMemory[interestingBlockID];
+
+	int startCell = startOffsetInCell[interestingBlockID];
+	int startPoint = startOffsetInPoint[interestingBlockID];
+
+	int numOfCells = startOffsetInCell[interestingBlockID + 1] - startCell;
+	int numOfPoints = startOffsetInPoint[interestingBlockID + 1] - startPoint;
+
+	int startCellForBig = startOffsetInCellForBig[interestingBlockID];
+	int startPointForBig = startOffsetInPointForBig[interestingBlockID];
+
+#ifdef CELL_TRANSFORMS
+	int startCellForTransforms = startOffsetInCellForTransforms[interestingBlockID];
+	__local gdouble *transforms;
+#endif
+
+	if (canFit) { // This branch fills in the shared memory
+		// Initialize vertexPositions, startVelocities and endVelocities
+		vertexPositions = (__local gdouble *)sharedMemory;
+		startVelocities = vertexPositions + numOfPoints * 3;
+		endVelocities = startVelocities + numOfPoints * 3;
+
+		// Initialize connectivities and links
+		connectivities = (__local int *)(endVelocities + numOfPoints * 3);
+		links = connectivities + (numOfCells << 2);
+
+#ifdef CELL_TRANSFORMS
+		// The host only gives transforms to a small block if they fit in the shared memory after its links.
+		transforms = (__local gdouble *)(links + (numOfCells << 2));
+#endif
+	} else { // This branch fills in the global memory
+		// Initialize vertexPositions, startVelocities and endVelocities
+		gVertexPositions = vertexPositionsForBig + startPointForBig * 3;
+		gStartVelocities = startVelocitiesForBig + startPointForBig * 3;
+		gEndVelocities = endVelocitiesForBig + startPointForBig * 3;
+
+		// Initialize connectivities and links
+		gConnectivities = blockedLocalConnectivities + (startCell << 2);
+		gLinks = blockedLocalLinks + (startCell << 2);
+	}
+
+	for (int i = localID; i < numOfPoints * 3; i += numOfThreads) {
+		int localPointID = i / 3;
+		int dimensionID = i % 3;
+		int globalPointID = blockedGlobalPointIDs[startPoint + localPointID];
+
+		if (canFit) {
+			vertexPositions[i] = globalVertexPositions[globalPointID * 3 + dimensionID];
+			startVelocities[i] = globalStartVelocities[globalPointID * 3 + dimensionID];
+			endVelocities[i] = globalEndVelocities[globalPointID * 3 + dimensionID];
+		}
+	}
+
+	if (canFit)
+		for (int i = localID; i < (numOfCells << 2); i += numOfThreads) {
+			connectivities[i] = *(blockedLocalConnectivities + (startCell << 2) + i);
+			links[i] = *(blockedLocalLinks + (startCell << 2) + i);
+		}
+
+#ifdef CELL_TRANSFORMS
+	if (canFit && startCellForTransforms != -1)
+		for (int i = localID; i < numOfCells * 12; i += numOfThreads)
+			transforms[i] = blockedCellTransforms[startCellForTransforms * 12 + i];
+#endif
+
+	if (canFit)
+		barrier(CLK_LOCAL_MEM_FENCE);
+	else
+		barrier(CLK_GLOBAL_MEM_FENCE);
+	
+	int numOfActiveParticles = startOffsetInParticle[activeBlockID + 1] - startOffsetInParticle[activeBlockID];
+
+	int arrayIdx = offsetInBlocks[groupID] * numOfThreads + localID;
+
+	if (arrayIdx < numOfActiveParticles) {
+		arrayIdx += startOffsetInParticle[activeBlockID];
+
+#ifdef GATHERED_PARTICLES
+		// The particle states have been gathered in block order.
+		int activeParticleID = arrayIdx;
+#else
+		// activeParticleID here means the initial active particle ID
+		int activeParticleID = blockedActiveParticleIDList[arrayIdx];
+#endif
+
+		// Initialize the particle status
+		int currStage = stage[activeParticleID];
+		int currCell = cellLocations[activeParticleID];
+
+		double currTime = pastTimes[activeParticleID];
+		double stepSize = stepSizes[activeParticleID];
+		if (stepSize == 0) stepSize = timeStep;
+
+		__global double4 *kArrays[5] = {k1, k2, k3, k4, k5};
+
+		double4 currLastPosition = lastPosition[activeParticleID];
+		double4 currK[6];
+		for (int i = 0; i < currStage; i++)
+			currK[i] = kArrays[i][activeParticleID];
+
+		// Only the ks computed in this kernel are written back.
+		int firstNewStage = currStage;
+
+		// At least one loop is executed.
+		while (true) {
+			// The step does not go beyond the end of the interval.
+			double currStep = min(stepSize, endTime - currTime);
+
+			double4 placeOfInterest = currLastPosition;
+			for (int i = 0; i < currStage; i++)
+				placeOfInterest += stageWeights[currStage][i] * currK[i];
+
+			double coordinates[4];
+
+			int nextCell;
+
+#ifdef CELL_TRANSFORMS
+			if (startCellForTransforms != -1 && canFit)
+				nextCell = localTransformedFindCell(placeOfInterest, links, transforms,
+								    epsilon, currCell, coordinates);
+			else if (startCellForTransforms != -1)
+				nextCell = transformedFindCell(placeOfInterest, gLinks,
+							       blockedCellTransforms + startCellForTransforms * 12,
+							       epsilon, currCell, coordinates);
+			else
+#endif
+			if (canFit)
+				nextCell = localFindCell(placeOfInterest, connectivities, links,
+							 vertexPositions, epsilon, currCell, coordinates);
+			else
+				nextCell = globalFindCell(placeOfInterest, gConnectivities, gLinks,
+							  gVertexPositions, epsilon, currCell, coordinates);
+
+			if (nextCell == -1 || currTime >= endTime) {
+				// Find the next cell globally
+				int globalCellID = blockedGlobalCellIDs[startCell + currCell];
+				int nextGlobalCell;
+				
+				if (nextCell != -1)
+					nextGlobalCell = blockedGlobalCellIDs[startCell + nextCell];
+#ifdef CELL_TRANSFORMS
+				else if (useGlobalTransforms)
+					nextGlobalCell = transformedFindCell(placeOfInterest, globalTetrahedralLinks, globalCellTransforms,
+									     epsilon, globalCellID, coordinates);
+#endif
+				else
+					nextGlobalCell = globalFindCell(placeOfInterest, globalTetrahedralConnectivities,
+									globalTetrahedralLinks, globalVertexPositions,
+									epsilon, globalCellID, coordinates);
+
+				if (currTime >= endTime && nextGlobalCell != -1) nextGlobalCell = -2 - nextGlobalCell;
+
+				pastTimes[activeParticleID] = currTime;
+				stepSizes[activeParticleID] = stepSize;
+
+				stage[activeParticleID] = currStage;
+
+				lastPosition[activeParticleID] = currLastPosition;
+
+				placesOfInterest[activeParticleID] = placeOfInterest;
+
+				exitCells[activeParticleID] = nextGlobalCell;
+
+				for (int i = firstNewStage; i < currStage; i++)
+					kArrays[i][activeParticleID] = currK[i];
+				break;
+			}
+
+			currCell = nextCell;
+
+			double alpha = (endTime - currTime - nodes[currStage] * currStep) / (endTime - startTime);
+			double beta = 1 - alpha;
+
+			double vecX[4], vecY[4], vecZ[4];
+
+			for (int i = 0; i < 4; i++)
+				if (canFit) {
+					int pointID = connectivities[(nextCell << 2) | i];
+					vecX[i] = startVelocities[pointID * 3] * alpha + endVelocities[pointID * 3] * beta;
+					vecY[i] = startVelocities[pointID * 3 + 1] * alpha + endVelocities[pointID * 3 + 1] * beta;
+					vecZ[i] = startVelocities[pointID * 3 + 2] * alpha + endVelocities[pointID * 3 + 2] * beta;
+				} else {
+					int pointID = gConnectivities[(nextCell << 2) | i];
+					vecX[i] = gStartVelocities[pointID * 3] * alpha + gEndVelocities[pointID * 3] * beta;
+					vecY[i] = gStartVelocities[pointID * 3 + 1] * alpha + gEndVelocities[pointID * 3 + 1] * beta;
+					vecZ[i] = gStartVelocities[pointID * 3 + 2] * alpha + gEndVelocities[pointID * 3 + 2] * beta;
+				}
+
+			double4 velocity = (double4)(0, 0, 0, 0);
+
+			for (int i = 0; i < 4; i++)
+				velocity += (double4)(vecX[i], vecY[i], vecZ[i], 0) * coordinates[i];
+
+			currK[currStage] = velocity * currStep;
+
+			if (currStage < 5) {
+				currStage++;
+				continue;
+			}
+
+			// Estimate the local error by the difference of the 5th and the 4th order solutions.
+			double4 delta = (double4)(0, 0, 0, 0);
+			for (int i = 0; i < 6; i++)
+				delta += errorWeights[i] * currK[i];
+			double error = max(fabs(delta.x), max(fabs(delta.y), fabs(delta.z))) / tolerance;
+
+			if (error <= 1 || currStep <= minTimeStep) {
+				// Accept the step with the 5th order solution
+				for (int i = 0; i < 6; i++)
+					currLastPosition += weights[i] * currK[i];
+
+				// Land on the end of the interval exactly
+				if (currStep < stepSize)
+					currTime = endTime;
+				else
+					currTime += currStep;
+
+				double factor = 5;
+				if (error > 0) factor = 0.9 * pow(error, (double)-0.2);
+				if (factor < 0.2) factor = 0.2;
+				if (factor > 5) factor = 5;
+
+				// A step cut by the end of the interval does not shrink the next one.
+				if (currStep * factor > stepSize || currStep == stepSize) stepSize = currStep * factor;
+			} else {
+				// Reject the step and retry with a smaller one
+				double factor = 0.9 * pow(error, (double)-0.25);
+				if (factor < 0.1) factor = 0.1;
+				stepSize = currStep * factor;
+			}
+
+			if (stepSize < minTimeStep) stepSize = minTimeStep;
+			if (stepSize > maxTimeStep) stepSize = maxTimeStep;
+
+			currStage = 0;
+			firstNewStage = 0;
+		}
+	}
+}
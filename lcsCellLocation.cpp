@@ -0,0 +1,223 @@
+/**********************************************
+File		:	lcsCellLocation.cpp
+Author		:	Mingcheng Chen
+Last Update	:	October 16th, 2012
+***********************************************/
+
+#include "lcsCellLocation.h"
+#include "lcsParallel.h"
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+namespace {
+
+class ScanlineLocationTask : public lcs::ParallelTask {
+public:
+	// Every task is a z scanline of the grid.
+	void Run(int scanlineID, int) {
+		int x = scanlineID / (yRes + 1);
+		int y = scanlineID % (yRes + 1);
+
+		int *locations = cellLocations + scanlineID * (zRes + 1);
+		int guess = -1;
+
+		for (int z = 0; z <= zRes; z++) {
+			lcs::Vector point(origin[0] + x * spacing[0], origin[1] + y * spacing[1], origin[2] + z * spacing[2]);
+
+			int cellID = guess == -1 ? -1 : grid->FindCell(point, epsilon, guess);
+			if (cellID == -1) cellID = lcs::FindCellInBlock(grid, *index, point, epsilon);
+
+			locations[z] = cellID;
+			if (cellID != -1) guess = cellID;
+		}
+	}
+
+	const lcs::TetrahedralGrid *grid;
+	const lcs::BlockIndex *index;
+	int xRes, yRes, zRes;
+	const double *origin, *spacing;
+	double epsilon;
+	int *cellLocations;
+};
+
+// Every task is a chunk of queryChunkSize queries.
+const int queryChunkSize = 1024;
+
+class IntersectionQueryTask : public lcs::ParallelTask {
+public:
+	void Run(int chunkID, int) {
+		int begin = chunkID * queryChunkSize;
+		int end = std::min(numOfQueries, begin + queryChunkSize);
+
+		for (int i = begin; i < end; i++) {
+			int z = queryBlock[i] % numOfBlocksInZ;
+			int y = queryBlock[i] / numOfBlocksInZ % numOfBlocksInY;
+			int x = queryBlock[i] / numOfBlocksInZ / numOfBlocksInY;
+
+			queryResults[i] = lcs::TetrahedronIntersectsBlock(grid->GetTetrahedron(queryTetrahedron[i]),
+									  globalMinX + x * blockSize,
+									  globalMinY + y * blockSize,
+									  globalMinZ + z * blockSize,
+									  blockSize, epsilon);
+		}
+	}
+
+	const lcs::TetrahedralGrid *grid;
+	double blockSize, globalMinX, globalMinY, globalMinZ;
+	int numOfBlocksInY, numOfBlocksInZ;
+	const int *queryTetrahedron, *queryBlock;
+	int numOfQueries;
+	double epsilon;
+	char *queryResults;
+};
+
+// Whether the plane through p1, p2 and p3 separates the tetrahedron from the block
+bool CheckPlane(const lcs::Vector &p1, const lcs::Vector &p2, const lcs::Vector &p3,
+		const lcs::Tetrahedron &tetrahedron,
+		double localMinX, double localMinY, double localMinZ,
+		double blockSize, double epsilon) {
+	if (!lcs::Sign(Cross(p1 - p2, p1 - p3).Length(), epsilon)) return false;
+	bool tetPos = 0, tetNeg = 0, blkPos = 0, blkNeg = 0;
+	for (int i = 0; i < 4; i++) {
+		lcs::Vector point = tetrahedron.GetVertex(i);
+		double directedVolume = lcs::Mixed(p1 - point, p2 - point, p3 - point);
+		if (lcs::Sign(directedVolume, epsilon) < 0) tetNeg = 1;
+		if (lcs::Sign(directedVolume, epsilon) > 0) tetPos = 1;
+		if (tetNeg && tetPos) return false;
+	}
+	for (int i = 0; i < 8; i++) {
+		lcs::Vector point(localMinX, localMinY, localMinZ);
+		if (i & 1) point.SetX(point.GetX() + blockSize);
+		if (i & 2) point.SetY(point.GetY() + blockSize);
+		if (i & 4) point.SetZ(point.GetZ() + blockSize);
+		double directedVolume = lcs::Mixed(p1 - point, p2 - point, p3 - point);
+		if (lcs::Sign(directedVolume, epsilon) < 0) blkNeg = 1;
+		if (lcs::Sign(directedVolume, epsilon) > 0) blkPos = 1;
+		if (blkNeg && blkPos) return false;
+	}
+	if ((tetNeg && blkNeg) || (tetPos && blkPos)) return false;
+	return true;
+}
+
+}
+
+////////////////////////////////////////////////
+void lcs::GetSortedCellsOfBlocks(lcs::BlockRecord **blocks, int numOfInterestingBlocks, int *&startOffsetInCell, int *&cellIDs) {
+	startOffsetInCell = new int [numOfInterestingBlocks + 1];
+	startOffsetInCell[0] = 0;
+	for (int i = 0; i < numOfInterestingBlocks; i++)
+		startOffsetInCell[i + 1] = startOffsetInCell[i] + blocks[i]->GetLocalNumOfCells();
+
+	cellIDs = new int [std::max(startOffsetInCell[numOfInterestingBlocks], 1)];
+	for (int i = 0; i < numOfInterestingBlocks; i++) {
+		int *cellsOfBlock = cellIDs + startOffsetInCell[i];
+		memcpy(cellsOfBlock, blocks[i]->GetGlobalCellIDs(), sizeof(int) * blocks[i]->GetLocalNumOfCells());
+		std::sort(cellsOfBlock, cellsOfBlock + blocks[i]->GetLocalNumOfCells());
+	}
+}
+
+int lcs::FindCellInBlock(const lcs::TetrahedralGrid *grid, const lcs::BlockIndex &index,
+			 const lcs::Vector &point, double epsilon) {
+	double position[3] = {point.GetX() - index.minX, point.GetY() - index.minY, point.GetZ() - index.minZ};
+	int numOfBlocks[3] = {index.numOfBlocksInX, index.numOfBlocksInY, index.numOfBlocksInZ};
+	int blockXYZ[3];
+
+	// Points within epsilon of the domain are clamped into the boundary blocks.
+	for (int i = 0; i < 3; i++) {
+		if (position[i] < -epsilon || position[i] > index.blockSize * numOfBlocks[i] + epsilon) return -1;
+		blockXYZ[i] = std::max(0, std::min(numOfBlocks[i] - 1, (int)floor(position[i] / index.blockSize)));
+	}
+
+	int blockID = (blockXYZ[0] * numOfBlocks[1] + blockXYZ[1]) * numOfBlocks[2] + blockXYZ[2];
+	int interestingBlockID = index.interestingBlockMap[blockID];
+	if (interestingBlockID == -1) return -1;
+
+	int begin = index.startOffsetInCell[interestingBlockID];
+	int end = index.startOffsetInCell[interestingBlockID + 1];
+	return grid->FindCellInList(point, epsilon, index.cellIDs + begin, end - begin);
+}
+
+void lcs::LocateGridPointsByWalking(const lcs::TetrahedralGrid *grid, const lcs::BlockIndex &index,
+				    int xRes, int yRes, int zRes, const double *origin, const double *spacing,
+				    double epsilon, int *cellLocations) {
+	ScanlineLocationTask task;
+	task.grid = grid;
+	task.index = &index;
+	task.xRes = xRes;
+	task.yRes = yRes;
+	task.zRes = zRes;
+	task.origin = origin;
+	task.spacing = spacing;
+	task.epsilon = epsilon;
+	task.cellLocations = cellLocations;
+
+	lcs::ParallelFor((xRes + 1) * (yRes + 1), &task);
+}
+
+bool lcs::TetrahedronIntersectsBlock(const lcs::Tetrahedron &tetrahedron,
+				     double localMinX, double localMinY, double localMinZ,
+				     double blockSize, double epsilon) {
+	// Test the planes through a tetrahedral edge and a block point
+	for (int p = 0; p < 3; p++)
+		for (int q = p + 1; q < 4; q++) {
+			lcs::Vector p1 = tetrahedron.GetVertex(p);
+			lcs::Vector p2 = tetrahedron.GetVertex(q);
+			for (int i = 0; i < 8; i++) {
+				lcs::Vector p3(localMinX + (i >> 2) * blockSize, localMinY + (i >> 1 & 1) * blockSize,
+					       localMinZ + (i & 1) * blockSize);
+				if (CheckPlane(p1, p2, p3, tetrahedron, localMinX, localMinY, localMinZ, blockSize, epsilon))
+					return false;
+			}
+		}
+
+	// Test the planes through a tetrahedral point and a block edge
+	for (int i = 0; i < 8; i++) {
+		int x1 = i >> 2, y1 = i >> 1 & 1, z1 = i & 1;
+		lcs::Vector p1(localMinX + x1 * blockSize, localMinY + y1 * blockSize, localMinZ + z1 * blockSize);
+		for (int k = 0; k < 3; k++) {
+			int x2 = x1, y2 = y1, z2 = z1;
+			if (k == 0) {
+				if (x1) continue;
+				x2++;
+			}
+			if (k == 1) {
+				if (y1) continue;
+				y2++;
+			}
+			if (k == 2) {
+				if (z1) continue;
+				z2++;
+			}
+			lcs::Vector p2(localMinX + x2 * blockSize, localMinY + y2 * blockSize, localMinZ + z2 * blockSize);
+			for (int j = 0; j < 4; j++)
+				if (CheckPlane(p1, p2, tetrahedron.GetVertex(j), tetrahedron,
+					       localMinX, localMinY, localMinZ, blockSize, epsilon))
+					return false;
+		}
+	}
+
+	return true;
+}
+
+void lcs::SolveTetrahedronBlockIntersectionQueries(const lcs::TetrahedralGrid *grid, double blockSize,
+						   double globalMinX, double globalMinY, double globalMinZ,
+						   int numOfBlocksInY, int numOfBlocksInZ,
+						   const int *queryTetrahedron, const int *queryBlock, int numOfQueries,
+						   double epsilon, char *queryResults) {
+	IntersectionQueryTask task;
+	task.grid = grid;
+	task.blockSize = blockSize;
+	task.globalMinX = globalMinX;
+	task.globalMinY = globalMinY;
+	task.globalMinZ = globalMinZ;
+	task.numOfBlocksInY = numOfBlocksInY;
+	task.numOfBlocksInZ = numOfBlocksInZ;
+	task.queryTetrahedron = queryTetrahedron;
+	task.queryBlock = queryBlock;
+	task.numOfQueries = numOfQueries;
+	task.epsilon = epsilon;
+	task.queryResults = queryResults;
+
+	lcs::ParallelFor((numOfQueries + queryChunkSize - 1) / queryChunkSize, &task);
+}
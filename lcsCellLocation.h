@@ -0,0 +1,55 @@
+/**********************************************
+File		:	lcsCellLocation.h
+Author		:	Mingcheng Chen
+Last Update	:	October 16th, 2012
+***********************************************/
+
+#ifndef __LCS_CELL_LOCATION_H
+#define __LCS_CELL_LOCATION_H
+
+#include "lcs.h"
+#include "lcsGeometry.h"
+
+namespace lcs {
+
+////////////////////////////////////////////////
+// The block division of the domain with the cells of every interesting block sorted by their global IDs
+struct BlockIndex {
+	double minX, minY, minZ, blockSize;
+	int numOfBlocksInX, numOfBlocksInY, numOfBlocksInZ;
+	const int *interestingBlockMap;
+	const int *startOffsetInCell;
+	const int *cellIDs;
+};
+
+// Concatenate the global cell IDs of the blocks, every block sorted. The arrays are allocated with new [].
+void GetSortedCellsOfBlocks(lcs::BlockRecord **blocks, int numOfInterestingBlocks, int *&startOffsetInCell, int *&cellIDs);
+
+// The smallest ID of the cells of the block containing point which contain point. It returns -1 if there is none.
+int FindCellInBlock(const lcs::TetrahedralGrid *grid, const lcs::BlockIndex &index,
+		    const lcs::Vector &point, double epsilon);
+
+// Locate the cells of the (xRes + 1) * (yRes + 1) * (zRes + 1) grid points (z varies fastest) on the host.
+// Every z scanline is a task. Its points are located by walking from the cell of the previous point, and the block
+// index is only searched for the first hit of the scanline or when the walk leaves the mesh.
+void LocateGridPointsByWalking(const lcs::TetrahedralGrid *grid, const lcs::BlockIndex &index,
+			       int xRes, int yRes, int zRes, const double *origin, const double *spacing,
+			       double epsilon, int *cellLocations);
+
+// Whether the tetrahedron intersects the cube of blockSize at (localMinX, localMinY, localMinZ). They are disjoint
+// if a plane through an edge of one and a vertex of the other separates them.
+bool TetrahedronIntersectsBlock(const lcs::Tetrahedron &tetrahedron,
+				double localMinX, double localMinY, double localMinZ,
+				double blockSize, double epsilon);
+
+// Solve the tetrahedron-block intersection queries on the host, which replaces the intersection kernel when
+// OpenCL is not used. Block IDs are (x * numOfBlocksInY + y) * numOfBlocksInZ + z.
+void SolveTetrahedronBlockIntersectionQueries(const lcs::TetrahedralGrid *grid, double blockSize,
+					      double globalMinX, double globalMinY, double globalMinZ,
+					      int numOfBlocksInY, int numOfBlocksInZ,
+					      const int *queryTetrahedron, const int *queryBlock, int numOfQueries,
+					      double epsilon, char *queryResults);
+
+}
+
+#endif
@@ -0,0 +1,204 @@
+/**********************************************
+File		:	lcsDivisionCache.cpp
+Author		:	Mingcheng Chen
+Last Update	:	October 16th, 2012
+***********************************************/
+
+#include "lcsDivisionCache.h"
+#include "lcsUtility.h"
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+
+namespace {
+
+const char cacheMagic[8] = {'L', 'C', 'S', 'D', 'I', 'V', 'I', 0};
+
+struct DivisionHeader {
+	char magic[8];
+	int version;
+	int numOfCells;
+	unsigned long long meshHash;
+	double blockSize, epsilon, epsilonForTetBlkIntersection;
+	int sharedMemoryKilobytes;
+	int numOfBlocks, numOfInterestingBlocks, sizeOfHashMap;
+};
+
+// 64-bit FNV-1a
+unsigned long long Hash(unsigned long long hash, const void *data, long long size) {
+	const unsigned char *bytes = (const unsigned char *)data;
+	for (long long i = 0; i < size; i++) {
+		hash ^= bytes[i];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+void WriteArray(FILE *fout, const void *data, size_t size) {
+	if (size && fwrite(data, 1, size, fout) != size) lcs::Error("Fail to write the division cache file");
+}
+
+void ReadArray(FILE *fin, void *data, size_t size) {
+	if (size && fread(data, 1, size, fin) != size) lcs::Error("The division cache file is defective");
+}
+
+}
+
+////////////////////////////////////////////////
+lcs::DivisionCache::DivisionCache(const std::string &directory,
+				  const int *connectivities, int numOfCells, const void *positions, long long sizeOfPositions,
+				  int numOfBlocks, double blockSize, double epsilon, double epsilonForTetBlkIntersection,
+				  int sharedMemoryKilobytes) {
+	this->numOfCells = numOfCells;
+	this->numOfBlocks = numOfBlocks;
+	this->blockSize = blockSize;
+	this->epsilon = epsilon;
+	this->epsilonForTetBlkIntersection = epsilonForTetBlkIntersection;
+	this->sharedMemoryKilobytes = sharedMemoryKilobytes;
+
+	this->meshHash = 14695981039346656037ULL;
+	this->meshHash = Hash(this->meshHash, connectivities, sizeof(int) * 4 * (long long)numOfCells);
+	this->meshHash = Hash(this->meshHash, positions, sizeOfPositions);
+
+	// The file name also covers the division parameters.
+	unsigned long long key = this->meshHash;
+	key = Hash(key, &numOfBlocks, sizeof(int));
+	key = Hash(key, &blockSize, sizeof(double));
+	key = Hash(key, &epsilon, sizeof(double));
+	key = Hash(key, &epsilonForTetBlkIntersection, sizeof(double));
+	key = Hash(key, &sharedMemoryKilobytes, sizeof(int));
+
+	char name[50];
+	sprintf(name, "lcsDivision-%016llx.bin", key);
+	this->fileName = directory + "/" + name;
+}
+
+std::string lcs::DivisionCache::GetFileName() const {
+	return this->fileName;
+}
+
+bool lcs::DivisionCache::Load(int &numOfInterestingBlocks, int *&interestingBlockMap,
+			      int *&startOffsetsInLocalIDMap, int *&blocksOfTets, int *&localIDsOfTets,
+			      lcs::BlockRecord **&blocks, bool *&canFitInSharedMemory) const {
+	FILE *fin = fopen(this->fileName.c_str(), "rb");
+	if (fin == NULL) return false;
+
+	DivisionHeader header;
+	if (fread(&header, sizeof(DivisionHeader), 1, fin) != 1
+	    || memcmp(header.magic, cacheMagic, sizeof(cacheMagic)) || header.version != VERSION
+	    || header.meshHash != this->meshHash || header.numOfCells != this->numOfCells
+	    || header.numOfBlocks != this->numOfBlocks || header.blockSize != this->blockSize
+	    || header.epsilon != this->epsilon || header.epsilonForTetBlkIntersection != this->epsilonForTetBlkIntersection
+	    || header.sharedMemoryKilobytes != this->sharedMemoryKilobytes) {
+		printf("The division cache %s does not match the current setting.\n", this->fileName.c_str());
+		fclose(fin);
+		return false;
+	}
+
+	numOfInterestingBlocks = header.numOfInterestingBlocks;
+
+	interestingBlockMap = new int [this->numOfBlocks];
+	ReadArray(fin, interestingBlockMap, sizeof(int) * this->numOfBlocks);
+
+	startOffsetsInLocalIDMap = new int [this->numOfCells + 1];
+	ReadArray(fin, startOffsetsInLocalIDMap, sizeof(int) * (this->numOfCells + 1));
+
+	blocksOfTets = new int [header.sizeOfHashMap];
+	ReadArray(fin, blocksOfTets, sizeof(int) * header.sizeOfHashMap);
+
+	localIDsOfTets = new int [header.sizeOfHashMap];
+	ReadArray(fin, localIDsOfTets, sizeof(int) * header.sizeOfHashMap);
+
+	char *marks = new char [numOfInterestingBlocks];
+	ReadArray(fin, marks, numOfInterestingBlocks);
+	canFitInSharedMemory = new bool [numOfInterestingBlocks];
+	for (int i = 0; i < numOfInterestingBlocks; i++)
+		canFitInSharedMemory[i] = marks[i];
+	delete [] marks;
+
+	blocks = new lcs::BlockRecord * [numOfInterestingBlocks];
+	for (int i = 0; i < numOfInterestingBlocks; i++) {
+		int sizes[2];
+		ReadArray(fin, sizes, sizeof(sizes));
+
+		blocks[i] = new lcs::BlockRecord();
+		blocks[i]->SetLocalNumOfCells(sizes[0]);
+		blocks[i]->SetLocalNumOfPoints(sizes[1]);
+
+		int *buffer = new int [std::max(sizes[0] * 4, sizes[1])];
+
+		ReadArray(fin, buffer, sizeof(int) * sizes[0]);
+		blocks[i]->CreateGlobalCellIDs(buffer);
+
+		ReadArray(fin, buffer, sizeof(int) * sizes[1]);
+		blocks[i]->CreateGlobalPointIDs(buffer);
+
+		ReadArray(fin, buffer, sizeof(int) * sizes[0] * 4);
+		blocks[i]->CreateLocalConnectivities(buffer);
+
+		ReadArray(fin, buffer, sizeof(int) * sizes[0] * 4);
+		blocks[i]->CreateLocalLinks(buffer);
+
+		delete [] buffer;
+	}
+
+	fclose(fin);
+
+	return true;
+}
+
+void lcs::DivisionCache::Save(int numOfInterestingBlocks, const int *interestingBlockMap,
+			      const int *startOffsetsInLocalIDMap, const int *blocksOfTets, const int *localIDsOfTets,
+			      lcs::BlockRecord * const *blocks, const bool *canFitInSharedMemory) const {
+	// Write to a temporary file first so that a broken run does not leave a defective cache.
+	std::string temporaryFileName = this->fileName + ".tmp";
+
+	FILE *fout = fopen(temporaryFileName.c_str(), "wb");
+	if (fout == NULL) {
+		printf("Warning: The division cache %s cannot be created.\n", temporaryFileName.c_str());
+		return;
+	}
+
+	DivisionHeader header;
+	memset(&header, 0, sizeof(DivisionHeader));
+	memcpy(header.magic, cacheMagic, sizeof(cacheMagic));
+	header.version = VERSION;
+	header.numOfCells = this->numOfCells;
+	header.meshHash = this->meshHash;
+	header.blockSize = this->blockSize;
+	header.epsilon = this->epsilon;
+	header.epsilonForTetBlkIntersection = this->epsilonForTetBlkIntersection;
+	header.sharedMemoryKilobytes = this->sharedMemoryKilobytes;
+	header.numOfBlocks = this->numOfBlocks;
+	header.numOfInterestingBlocks = numOfInterestingBlocks;
+	header.sizeOfHashMap = startOffsetsInLocalIDMap[this->numOfCells];
+
+	WriteArray(fout, &header, sizeof(DivisionHeader));
+	WriteArray(fout, interestingBlockMap, sizeof(int) * this->numOfBlocks);
+	WriteArray(fout, startOffsetsInLocalIDMap, sizeof(int) * (this->numOfCells + 1));
+	WriteArray(fout, blocksOfTets, sizeof(int) * header.sizeOfHashMap);
+	WriteArray(fout, localIDsOfTets, sizeof(int) * header.sizeOfHashMap);
+
+	char *marks = new char [numOfInterestingBlocks];
+	for (int i = 0; i < numOfInterestingBlocks; i++)
+		marks[i] = canFitInSharedMemory[i];
+	WriteArray(fout, marks, numOfInterestingBlocks);
+	delete [] marks;
+
+	for (int i = 0; i < numOfInterestingBlocks; i++) {
+		int sizes[2] = {blocks[i]->GetLocalNumOfCells(), blocks[i]->GetLocalNumOfPoints()};
+		WriteArray(fout, sizes, sizeof(sizes));
+		WriteArray(fout, blocks[i]->GetGlobalCellIDs(), sizeof(int) * sizes[0]);
+		WriteArray(fout, blocks[i]->GetGlobalPointIDs(), sizeof(int) * sizes[1]);
+		WriteArray(fout, blocks[i]->GetLocalConnectivities(), sizeof(int) * sizes[0] * 4);
+		WriteArray(fout, blocks[i]->GetLocalLinks(), sizeof(int) * sizes[0] * 4);
+	}
+
+	fclose(fout);
+
+	if (rename(temporaryFileName.c_str(), this->fileName.c_str()))
+		lcs::Error("Fail to rename the division cache file");
+
+	printf("The division is saved to %s.\n", this->fileName.c_str());
+	printf("\n");
+}
@@ -0,0 +1,49 @@
+/**********************************************
+File		:	lcsDivisionCache.h
+Author		:	Mingcheng Chen
+Last Update	:	October 16th, 2012
+***********************************************/
+
+#ifndef __LCS_DIVISION_CACHE_H
+#define __LCS_DIVISION_CACHE_H
+
+#include "lcs.h"
+#include <string>
+
+namespace lcs {
+
+////////////////////////////////////////////////
+// Saves and loads the block decomposition made by Division(). A cache file is named after a hash of the
+// connectivities, the positions and the division parameters, and its header repeats the full key.
+class DivisionCache {
+public:
+	static const int VERSION = 2;
+
+	DivisionCache(const std::string &directory,
+		      const int *connectivities, int numOfCells, const void *positions, long long sizeOfPositions,
+		      int numOfBlocks, double blockSize, double epsilon, double epsilonForTetBlkIntersection,
+		      int sharedMemoryKilobytes);
+
+	std::string GetFileName() const;
+
+	// Returns false if there is no cache file for the key. The arrays are allocated with new [].
+	bool Load(int &numOfInterestingBlocks, int *&interestingBlockMap,
+		  int *&startOffsetsInLocalIDMap, int *&blocksOfTets, int *&localIDsOfTets,
+		  lcs::BlockRecord **&blocks, bool *&canFitInSharedMemory) const;
+
+	void Save(int numOfInterestingBlocks, const int *interestingBlockMap,
+		  const int *startOffsetsInLocalIDMap, const int *blocksOfTets, const int *localIDsOfTets,
+		  lcs::BlockRecord * const *blocks, const bool *canFitInSharedMemory) const;
+
+private:
+	std::string fileName;
+
+	unsigned long long meshHash;
+	int numOfCells, numOfBlocks;
+	double blockSize, epsilon, epsilonForTetBlkIntersection;
+	int sharedMemoryKilobytes;
+};
+
+}
+
+#endif
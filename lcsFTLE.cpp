@@ -0,0 +1,147 @@
+/**********************************************
+File		:	lcsFTLE.cpp
+Author		:	Mingcheng Chen
+Last Update	:	October 16th, 2012
+***********************************************/
+
+#include "lcsFTLE.h"
+#include "lcsParallel.h"
+#include <cmath>
+#include <algorithm>
+
+namespace {
+
+class FTLETask : public lcs::ParallelTask {
+public:
+	// Every task is an x slab of the grid.
+	void Run(int x, int threadID) {
+		int sizes[3] = {xRes + 1, yRes + 1, zRes + 1};
+		int strides[3] = {(yRes + 1) * (zRes + 1), zRes + 1, 1};
+		double spacings[3] = {dx, dy, dz};
+
+		int numOfDefinedPoints = 0;
+
+		for (int y = 0; y <= yRes; y++)
+			for (int z = 0; z <= zRes; z++) {
+				int coordinates[3] = {x, y, z};
+				int pointID = x * strides[0] + y * strides[1] + z;
+
+				ftle[pointID] = 0;
+				ftleValid[pointID] = false;
+
+				if (!valid[pointID]) continue;
+
+				// Columns of the deformation gradient
+				double gradient[3][3];
+				bool defined = true;
+
+				for (int d = 0; defined && d < 3; d++) {
+					// A degenerate axis of the grid is not stretched.
+					if (sizes[d] == 1) {
+						for (int k = 0; k < 3; k++)
+							gradient[k][d] = k == d;
+						continue;
+					}
+
+					int lower = pointID, upper = pointID;
+					if (coordinates[d] > 0 && valid[pointID - strides[d]]) lower = pointID - strides[d];
+					if (coordinates[d] + 1 < sizes[d] && valid[pointID + strides[d]]) upper = pointID + strides[d];
+
+					if (lower == upper) {
+						defined = false;
+						break;
+					}
+
+					double distance = spacings[d] * ((upper - lower) / strides[d]);
+					for (int k = 0; k < 3; k++)
+						gradient[k][d] = (flowMap[upper * 3 + k] - flowMap[lower * 3 + k]) / distance;
+				}
+
+				if (!defined) continue;
+
+				// Right Cauchy-Green tensor
+				double tensor[3][3];
+				for (int i = 0; i < 3; i++)
+					for (int j = 0; j < 3; j++) {
+						tensor[i][j] = 0;
+						for (int k = 0; k < 3; k++)
+							tensor[i][j] += gradient[k][i] * gradient[k][j];
+					}
+
+				double lambda = lcs::LargestEigenvalueOfSymmetricMatrix(tensor);
+				if (lambda <= 0) continue;
+
+				ftle[pointID] = log(sqrt(lambda)) / fabs(integrationTime);
+				ftleValid[pointID] = true;
+				numOfDefinedPoints++;
+			}
+
+		numOfDefinedPointsInThreads[threadID] += numOfDefinedPoints;
+	}
+
+	int xRes, yRes, zRes;
+	double dx, dy, dz, integrationTime;
+	const double *flowMap;
+	const bool *valid;
+	double *ftle;
+	bool *ftleValid;
+	int *numOfDefinedPointsInThreads;
+};
+
+}
+
+////////////////////////////////////////////////
+double lcs::LargestEigenvalueOfSymmetricMatrix(const double matrix[3][3]) {
+	double p1 = matrix[0][1] * matrix[0][1] + matrix[0][2] * matrix[0][2] + matrix[1][2] * matrix[1][2];
+
+	// Diagonal matrix
+	if (p1 == 0) return std::max(matrix[0][0], std::max(matrix[1][1], matrix[2][2]));
+
+	double q = (matrix[0][0] + matrix[1][1] + matrix[2][2]) / 3;
+	double p2 = (matrix[0][0] - q) * (matrix[0][0] - q)
+		    + (matrix[1][1] - q) * (matrix[1][1] - q)
+		    + (matrix[2][2] - q) * (matrix[2][2] - q) + 2 * p1;
+	double p = sqrt(p2 / 6);
+
+	// B = (A - qI) / p, and the eigenvalues of A are q + 2p cos(phi + 2k pi / 3) with cos(3 phi) = det(B) / 2.
+	double b[3][3];
+	for (int i = 0; i < 3; i++)
+		for (int j = 0; j < 3; j++)
+			b[i][j] = (matrix[i][j] - (i == j ? q : 0)) / p;
+
+	double r = (b[0][0] * (b[1][1] * b[2][2] - b[1][2] * b[2][1])
+		    - b[0][1] * (b[1][0] * b[2][2] - b[1][2] * b[2][0])
+		    + b[0][2] * (b[1][0] * b[2][1] - b[1][1] * b[2][0])) / 2;
+	r = std::max(-1.0, std::min(1.0, r));
+
+	return q + 2 * p * cos(acos(r) / 3);
+}
+
+int lcs::ComputeFTLE(int xRes, int yRes, int zRes, double dx, double dy, double dz, double integrationTime,
+		     const double *flowMap, const bool *valid, double *ftle, bool *ftleValid) {
+	int numOfThreads = lcs::GetNumOfThreads();
+
+	FTLETask task;
+	task.xRes = xRes;
+	task.yRes = yRes;
+	task.zRes = zRes;
+	task.dx = dx;
+	task.dy = dy;
+	task.dz = dz;
+	task.integrationTime = integrationTime;
+	task.flowMap = flowMap;
+	task.valid = valid;
+	task.ftle = ftle;
+	task.ftleValid = ftleValid;
+	task.numOfDefinedPointsInThreads = new int [numOfThreads];
+	std::fill(task.numOfDefinedPointsInThreads, task.numOfDefinedPointsInThreads + numOfThreads, 0);
+
+	lcs::ParallelFor(xRes + 1, &task);
+
+	int numOfDefinedPoints = 0;
+	for (int i = 0; i < numOfThreads; i++)
+		numOfDefinedPoints += task.numOfDefinedPointsInThreads[i];
+	delete [] task.numOfDefinedPointsInThreads;
+
+	return numOfDefinedPoints;
+}
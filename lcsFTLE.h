@@ -0,0 +1,27 @@
+/**********************************************
+File		:	lcsFTLE.h
+Author		:	Mingcheng Chen
+Last Update	:	October 16th, 2012
+***********************************************/
+
+#ifndef __LCS_FTLE_H
+#define __LCS_FTLE_H
+
+namespace lcs {
+
+////////////////////////////////////////////////
+// The largest eigenvalue of a symmetric 3x3 matrix
+double LargestEigenvalueOfSymmetricMatrix(const double matrix[3][3]);
+
+// Compute the FTLE field on the seeding grid of (xRes + 1) * (yRes + 1) * (zRes + 1) points (z varies fastest).
+// flowMap has the final positions of the grid points. Points which are not valid, e.g. never seeded or left
+// the domain, are not used in the finite differences. A valid point uses the central difference if both of its
+// neighbours are valid and the one-sided difference if only one is. If neither is, its FTLE is undefined.
+// ftleValid marks the points whose FTLE is defined. The FTLE of the other points is 0.
+// It returns the number of points whose FTLE is defined.
+int ComputeFTLE(int xRes, int yRes, int zRes, double dx, double dy, double dz, double integrationTime,
+		const double *flowMap, const bool *valid, double *ftle, bool *ftleValid);
+
+}
+
+#endif
@@ -0,0 +1,230 @@
+/**********************************************
+File		:	lcsFrameStream.cpp
+Author		:	Mingcheng Chen
+Last Update	:	October 16th, 2012
+***********************************************/
+
+#include "lcsFrameStream.h"
+#include "lcsUtility.h"
+#include <vtkXMLUnstructuredGridReader.h>
+#include <cstdio>
+#include <cstring>
+
+namespace {
+
+void *LoaderEntry(void *stream) {
+	((lcs::FrameStream *)stream)->LoaderLoop();
+	return NULL;
+}
+
+}
+
+////////////////////////////////////////////////
+lcs::FrameStream::FrameStream(const std::vector<double> &timePoints, const std::vector<std::string> &dataFiles,
+			      bool renumbering) {
+	this->timePoints = timePoints;
+	this->dataFiles = dataFiles;
+	this->numOfFrames = dataFiles.size();
+	this->meshCache = NULL;
+
+	if (!this->numOfFrames) lcs::Error("There is no frame to load");
+	if (this->timePoints.size() < this->dataFiles.size()) lcs::Error("Some frames do not have time points");
+
+	printf("Loading frame 0 (file = %s) ... ", this->dataFiles[0].c_str());
+	this->firstFrame = new lcs::Frame(this->timePoints[0], this->dataFiles[0].c_str());
+	printf("Done.\n");
+	printf("\n");
+
+	// The loader thread reads the other frames through the renumbered grid.
+	if (renumbering) this->RenumberMesh();
+
+	this->numOfPoints = this->firstFrame->GetTetrahedralGrid()->GetNumOfVertices();
+
+	for (int i = 0; i < NUM_OF_SLOTS; i++) {
+		this->slots[i] = new double [this->numOfPoints * 3];
+		this->slotFrames[i] = -1;
+		this->slotReady[i] = false;
+	}
+
+	this->firstFrame->GetTetrahedralGrid()->ReadVelocities(this->slots[0]);
+	this->slotFrames[0] = 0;
+	this->slotReady[0] = true;
+
+	this->pendingFrame = -1;
+	this->shutDown = false;
+
+	pthread_mutex_init(&this->lock, NULL);
+	pthread_cond_init(&this->requestCondition, NULL);
+	pthread_cond_init(&this->readyCondition, NULL);
+
+	if (pthread_create(&this->loader, NULL, LoaderEntry, this))
+		lcs::Error("Fail to create the frame loader thread");
+
+	// Frame 1 is loaded while the blocks are built.
+	pthread_mutex_lock(&this->lock);
+	this->RequestFrame(1);
+	pthread_mutex_unlock(&this->lock);
+}
+
+lcs::FrameStream::FrameStream(lcs::MeshCache *meshCache, bool renumbering) {
+	this->meshCache = meshCache;
+	this->numOfFrames = meshCache->GetNumOfFrames();
+	this->numOfPoints = meshCache->GetNumOfPoints();
+
+	for (int i = 0; i < this->numOfFrames; i++)
+		this->timePoints.push_back(meshCache->GetTimePoint(i));
+
+	printf("Loading frame 0 from the mesh cache ... ");
+	this->firstFrame = new lcs::Frame(this->timePoints[0],
+					  new lcs::TetrahedralGrid(meshCache->GetNumOfPoints(), meshCache->GetNumOfCells(),
+								   meshCache->GetPositions(), meshCache->GetVelocities(0),
+								   meshCache->GetConnectivities(), meshCache->GetLinks()));
+	printf("Done.\n");
+	printf("\n");
+
+	// Without renumbering, the velocities are used in place.
+	for (int i = 0; i < NUM_OF_SLOTS; i++) {
+		this->slots[i] = NULL;
+		this->slotFrames[i] = -1;
+	}
+
+	if (renumbering) {
+		this->RenumberMesh();
+		for (int i = 0; i < NUM_OF_SLOTS; i++)
+			this->slots[i] = new double [this->numOfPoints * 3];
+	}
+
+	meshCache->Prefetch(1);
+}
+
+lcs::FrameStream::~FrameStream() {
+	if (!this->meshCache) {
+		pthread_mutex_lock(&this->lock);
+		this->shutDown = true;
+		pthread_cond_signal(&this->requestCondition);
+		pthread_mutex_unlock(&this->lock);
+
+		pthread_join(this->loader, NULL);
+
+		pthread_mutex_destroy(&this->lock);
+		pthread_cond_destroy(&this->requestCondition);
+		pthread_cond_destroy(&this->readyCondition);
+	}
+
+	for (int i = 0; i < NUM_OF_SLOTS; i++)
+		delete [] this->slots[i];
+
+	delete this->firstFrame;
+	delete this->meshCache;
+}
+
+int lcs::FrameStream::GetNumOfFrames() const {
+	return this->numOfFrames;
+}
+
+double lcs::FrameStream::GetTimePoint(int frameIdx) const {
+	return this->timePoints[frameIdx];
+}
+
+lcs::TetrahedralGrid *lcs::FrameStream::GetTetrahedralGrid() const {
+	return this->firstFrame->GetTetrahedralGrid();
+}
+
+// It should be called with this->lock held.
+void lcs::FrameStream::RequestFrame(int frameIdx) {
+	if (frameIdx < 0 || frameIdx >= this->numOfFrames) return;
+
+	int slot = frameIdx % NUM_OF_SLOTS;
+
+	while (this->slotFrames[slot] != frameIdx) {
+		// Wait until the loader takes the last request and the slot is not being loaded.
+		if (this->pendingFrame != -1 || (this->slotFrames[slot] != -1 && !this->slotReady[slot])) {
+			pthread_cond_wait(&this->readyCondition, &this->lock);
+			continue;
+		}
+
+		this->slotFrames[slot] = frameIdx;
+		this->slotReady[slot] = false;
+		this->pendingFrame = frameIdx;
+		pthread_cond_signal(&this->requestCondition);
+	}
+}
+
+const double *lcs::FrameStream::GetVelocities(int frameIdx) {
+	if (frameIdx < 0 || frameIdx >= this->numOfFrames) lcs::Error("The frame index is out of range");
+
+	int slot = frameIdx % NUM_OF_SLOTS;
+
+	if (this->meshCache) {
+		this->meshCache->Prefetch(frameIdx + 1);
+		if (!this->GetTetrahedralGrid()->IsRenumbered()) return this->meshCache->GetVelocities(frameIdx);
+
+		if (this->slotFrames[slot] != frameIdx) {
+			this->GetTetrahedralGrid()->PermuteVelocities(this->meshCache->GetVelocities(frameIdx), this->slots[slot]);
+			this->slotFrames[slot] = frameIdx;
+		}
+		return this->slots[slot];
+	}
+
+	pthread_mutex_lock(&this->lock);
+
+	this->RequestFrame(frameIdx);
+	while (!this->slotReady[slot])
+		pthread_cond_wait(&this->readyCondition, &this->lock);
+
+	double *velocities = this->slots[slot];
+
+	this->RequestFrame(frameIdx + 1);
+
+	pthread_mutex_unlock(&this->lock);
+
+	return velocities;
+}
+
+void lcs::FrameStream::ReadVelocities(int frameIdx, double *destination) {
+	memcpy(destination, this->GetVelocities(frameIdx), sizeof(double) * 3 * this->numOfPoints);
+}
+
+void lcs::FrameStream::ReadVelocities(int frameIdx, float *destination) {
+	lcs::ConvertToFloat(this->GetVelocities(frameIdx), destination, this->numOfPoints * 3);
+}
+
+void lcs::FrameStream::RenumberMesh() {
+	printf("Renumbering the mesh along the Morton curve ... ");
+	this->GetTetrahedralGrid()->Renumber();
+	printf("Done.\n");
+	printf("\n");
+}
+
+void lcs::FrameStream::LoaderLoop() {
+	while (1) {
+		pthread_mutex_lock(&this->lock);
+		while (!this->shutDown && this->pendingFrame == -1)
+			pthread_cond_wait(&this->requestCondition, &this->lock);
+		if (this->shutDown) {
+			pthread_mutex_unlock(&this->lock);
+			break;
+		}
+		int frameIdx = this->pendingFrame;
+		int slot = frameIdx % NUM_OF_SLOTS;
+		this->pendingFrame = -1;
+		pthread_cond_broadcast(&this->readyCondition);
+		pthread_mutex_unlock(&this->lock);
+
+		// Nobody reads the slot until it is ready.
+		// The mesh is static, so only the point vectors are extracted after checking the topology against frame 0.
+		vtkXMLUnstructuredGridReader *reader = vtkXMLUnstructuredGridReader::New();
+		reader->SetFileName(this->dataFiles[frameIdx].c_str());
+		reader->Update();
+		if (!this->firstFrame->GetTetrahedralGrid()->ReadVelocities(reader->GetOutput(), this->slots[slot]))
+			lcs::Error("The topology of a frame is not the same as frame 0");
+		reader->Delete();
+
+		printf("Frame %d (file = %s) is loaded.\n", frameIdx, this->dataFiles[frameIdx].c_str());
+
+		pthread_mutex_lock(&this->lock);
+		this->slotReady[slot] = true;
+		pthread_cond_broadcast(&this->readyCondition);
+		pthread_mutex_unlock(&this->lock);
+	}
+}
@@ -0,0 +1,77 @@
+/**********************************************
+File		:	lcsFrameStream.h
+Author		:	Mingcheng Chen
+Last Update	:	October 16th, 2012
+***********************************************/
+
+#ifndef __LCS_FRAME_STREAM_H
+#define __LCS_FRAME_STREAM_H
+
+#include "lcs.h"
+#include "lcsMeshCache.h"
+#include <vector>
+#include <string>
+#include <pthread.h>
+
+namespace lcs {
+
+////////////////////////////////////////////////
+// A sliding window over the frames. Frame 0 is loaded entirely and provides the topology and geometry.
+// For the other frames only the velocities are kept, in three slots: the two frames of the current
+// interval and the next frame, which is prefetched by a background thread.
+// With a mesh cache, the velocities are used in place from the mapped file instead.
+// With renumbering, the mesh of frame 0 is renumbered (see TetrahedralGrid::Renumber()) before anything else
+// and the velocities of every frame follow the new vertex order. A mesh cache is then copied into the slots.
+class FrameStream {
+public:
+	FrameStream(const std::vector<double> &timePoints, const std::vector<std::string> &dataFiles,
+		    bool renumbering = false);
+
+	// The stream takes the ownership of the cache.
+	FrameStream(lcs::MeshCache *meshCache, bool renumbering = false);
+	~FrameStream();
+
+	int GetNumOfFrames() const;
+	double GetTimePoint(int frameIdx) const;
+
+	lcs::TetrahedralGrid *GetTetrahedralGrid() const;
+
+	// Returns 3 * (number of points) velocities of the frame, waiting for it to be loaded if necessary,
+	// and starts to prefetch frame frameIdx + 1. The array stays valid until frame frameIdx + 3 is requested.
+	const double *GetVelocities(int frameIdx);
+
+	void ReadVelocities(int frameIdx, double *destination);
+	void ReadVelocities(int frameIdx, float *destination);
+
+	// Called by the loader thread
+	void LoaderLoop();
+
+private:
+	static const int NUM_OF_SLOTS = 3;
+
+	void RequestFrame(int frameIdx);
+	void RenumberMesh();
+
+	std::vector<double> timePoints;
+	std::vector<std::string> dataFiles;
+	int numOfFrames;
+	int numOfPoints;
+
+	lcs::Frame *firstFrame;
+	lcs::MeshCache *meshCache;
+
+	double *slots[NUM_OF_SLOTS];
+	int slotFrames[NUM_OF_SLOTS];
+	bool slotReady[NUM_OF_SLOTS];
+
+	int pendingFrame;
+	bool shutDown;
+
+	pthread_t loader;
+	pthread_mutex_t lock;
+	pthread_cond_t requestCondition, readyCondition;
+};
+
+}
+
+#endif
@@ -0,0 +1,107 @@
+/**********************************************
+File		:	lcsGatherParticlesKernels.cl
+Author		:	Mingcheng Chen
+Last Update	:	October 16th, 2012
+***********************************************/
+
+// Copy the states of the blocked active particles into block-contiguous arrays, so that the tracing kernel
+// accesses them without the indirection of blockedActiveParticleIDList.
+// numOfKs is 0 for FE, 3 for RK4 and 5 for RK45. Only RK45 has step sizes.
+__kernel void GatherParticles(__global int *blockedActiveParticleIDList,
+
+			      __global int *stages,
+			      __global double *pastTimes,
+			      __global double4 *lastPositions,
+			      __global double4 *k1,
+			      __global double4 *k2,
+			      __global double4 *k3,
+			      __global double4 *k4,
+			      __global double4 *k5,
+			      __global double *stepSizes,
+			      __global int *localTetIDs,
+
+			      __global int *gatheredStages,
+			      __global double *gatheredPastTimes,
+			      __global double4 *gatheredLastPositions,
+			      __global double4 *gatheredK1,
+			      __global double4 *gatheredK2,
+			      __global double4 *gatheredK3,
+			      __global double4 *gatheredK4,
+			      __global double4 *gatheredK5,
+			      __global double *gatheredStepSizes,
+			      __global int *gatheredLocalTetIDs,
+
+			      int numOfKs, int numOfActiveParticles) {
+	int globalID = get_global_id(0);
+
+	if (globalID < numOfActiveParticles) {
+		int particleID = blockedActiveParticleIDList[globalID];
+
+		int stage = stages[particleID];
+
+		gatheredStages[globalID] = stage;
+		gatheredPastTimes[globalID] = pastTimes[particleID];
+		gatheredLastPositions[globalID] = lastPositions[particleID];
+		gatheredLocalTetIDs[globalID] = localTetIDs[particleID];
+
+		// Only the ks of the finished stages are valid.
+		__global double4 *ks[5] = {k1, k2, k3, k4, k5};
+		__global double4 *gatheredKs[5] = {gatheredK1, gatheredK2, gatheredK3, gatheredK4, gatheredK5};
+
+		for (int i = 0; i < numOfKs && i < stage; i++)
+			gatheredKs[i][globalID] = ks[i][particleID];
+
+		if (numOfKs > 3) gatheredStepSizes[globalID] = stepSizes[particleID];
+	}
+}
+
+// Copy the states written by the tracing kernel back to the particle arrays.
+__kernel void ScatterParticles(__global int *blockedActiveParticleIDList,
+
+			       __global int *gatheredStages,
+			       __global double *gatheredPastTimes,
+			       __global double4 *gatheredLastPositions,
+			       __global double4 *gatheredK1,
+			       __global double4 *gatheredK2,
+			       __global double4 *gatheredK3,
+			       __global double4 *gatheredK4,
+			       __global double4 *gatheredK5,
+			       __global double *gatheredStepSizes,
+			       __global double4 *gatheredPlacesOfInterest,
+			       __global int *gatheredExitCells,
+
+			       __global int *stages,
+			       __global double *pastTimes,
+			       __global double4 *lastPositions,
+			       __global double4 *k1,
+			       __global double4 *k2,
+			       __global double4 *k3,
+			       __global double4 *k4,
+			       __global double4 *k5,
+			       __global double *stepSizes,
+			       __global double4 *placesOfInterest,
+			       __global int *exitCells,
+
+			       int numOfKs, int numOfActiveParticles) {
+	int globalID = get_global_id(0);
+
+	if (globalID < numOfActiveParticles) {
+		int particleID = blockedActiveParticleIDList[globalID];
+
+		int stage = gatheredStages[globalID];
+
+		stages[particleID] = stage;
+		pastTimes[particleID] = gatheredPastTimes[globalID];
+		lastPositions[particleID] = gatheredLastPositions[globalID];
+		placesOfInterest[particleID] = gatheredPlacesOfInterest[globalID];
+		exitCells[particleID] = gatheredExitCells[globalID];
+
+		__global double4 *ks[5] = {k1, k2, k3, k4, k5};
+		__global double4 *gatheredKs[5] = {gatheredK1, gatheredK2, gatheredK3, gatheredK4, gatheredK5};
+
+		for (int i = 0; i < numOfKs && i < stage; i++)
+			ks[i][particleID] = gatheredKs[i][globalID];
+
+		if (numOfKs > 3) stepSizes[particleID] = gatheredStepSizes[globalID];
+	}
+}
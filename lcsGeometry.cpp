@@ -5,12 +5,434 @@ Last Update		:		May 20th, 2012
 ***********************************************/
 
 #include "lcsGeometry.h"
+#include "lcsParallel.h"
 #include <cmath>
+#include <cstdio>
 #include <cstring>
 #include <algorithm>
+#include <vector>
+#include <utility>
+#include <new>
 #include <vtkIdList.h>
 #include <vtkPointData.h>
 
+// The SIMD versions are compiled for their instruction sets by target attributes and chosen at run time, so the
+// build needs no -mavx flags and the binary still runs on CPUs without them.
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define LCS_X86_SIMD
+#include <immintrin.h>
+#endif
+
+namespace {
+
+// Spread the lower 21 bits of a so that there are two zero bits between every two of them.
+unsigned long long SpreadBits(unsigned int a) {
+	unsigned long long x = a & 0x1fffff;
+	x = (x | x << 32) & 0x1f00000000ffffULL;
+	x = (x | x << 16) & 0x1f0000ff0000ffULL;
+	x = (x | x << 8) & 0x100f00f00f00f00fULL;
+	x = (x | x << 4) & 0x10c30c30c30c30c3ULL;
+	x = (x | x << 2) & 0x1249249249249249ULL;
+	return x;
+}
+
+// The flat vertex arrays and the barycentric transforms are aligned to cache lines.
+const size_t arrayAlignment = 64;
+
+#ifdef LCS_X86_SIMD
+bool SupportsAVX() {
+	return __builtin_cpu_supports("avx");
+}
+
+bool SupportsAVX2() {
+	return __builtin_cpu_supports("avx2");
+}
+
+bool SupportsAVX512() {
+	return __builtin_cpu_supports("avx512f");
+}
+
+__attribute__((target("avx")))
+void ConvertToFloatAVX(const double *source, float *destination, int size) {
+	int i = 0;
+	for (; i + 4 <= size; i += 4)
+		_mm_storeu_ps(destination + i, _mm256_cvtpd_ps(_mm256_loadu_pd(source + i)));
+	_mm256_zeroupper();
+
+	for (; i < size; i++)
+		destination[i] = (float)source[i];
+}
+
+__attribute__((target("avx512f")))
+void ConvertToFloatAVX512(const double *source, float *destination, int size) {
+	int i = 0;
+	for (; i + 8 <= size; i += 8)
+		_mm256_storeu_ps(destination + i, _mm512_cvtpd_ps(_mm512_loadu_pd(source + i)));
+	_mm256_zeroupper();
+
+	for (; i < size; i++)
+		destination[i] = (float)source[i];
+}
+#endif
+
+// The natural coordinates of the point in the cells of the list, in the order of operations of ApplyBarycentricTransform()
+void ApplyBarycentricTransformsInScalar(const double *transforms, const int *cellIDs, int numOfCells,
+					double x, double y, double z, double *c0, double *c1, double *c2, double *c3) {
+	for (int i = 0; i < numOfCells; i++) {
+		const double *transform = transforms + cellIDs[i] * 12LL;
+		double dx = x - transform[0];
+		double dy = y - transform[1];
+		double dz = z - transform[2];
+
+		c1[i] = transform[3] * dx + transform[4] * dy + transform[5] * dz;
+		c2[i] = transform[6] * dx + transform[7] * dy + transform[8] * dz;
+		c3[i] = transform[9] * dx + transform[10] * dy + transform[11] * dz;
+		c0[i] = 1 - c1[i] - c2[i] - c3[i];
+	}
+}
+
+// The position of the first cell of the list which contains the point, or -1 if there is none
+int FindContainingCellInScalar(const double *transforms, const int *cellIDs, int numOfCells,
+			       double x, double y, double z, double epsilon) {
+	for (int i = 0; i < numOfCells; i++) {
+		double c0, c1, c2, c3;
+		ApplyBarycentricTransformsInScalar(transforms, cellIDs + i, 1, x, y, z, &c0, &c1, &c2, &c3);
+		if (std::min(std::min(c0, c1), std::min(c2, c3)) >= -epsilon) return i;
+	}
+	return -1;
+}
+
+#ifdef LCS_X86_SIMD
+// Every lane is a cell of the list. The transforms of 4 cells are loaded as rows of 4 doubles and transposed,
+// which is faster than the gather instructions. The SIMD functions clear the upper halves of the registers before
+// they return, because the callers are SSE code.
+__attribute__((target("avx2")))
+inline void TransposeInAVX2(__m256d r0, __m256d r1, __m256d r2, __m256d r3, __m256d *columns) {
+	__m256d t0 = _mm256_unpacklo_pd(r0, r1), t1 = _mm256_unpackhi_pd(r0, r1);
+	__m256d t2 = _mm256_unpacklo_pd(r2, r3), t3 = _mm256_unpackhi_pd(r2, r3);
+	columns[0] = _mm256_permute2f128_pd(t0, t2, 0x20);
+	columns[1] = _mm256_permute2f128_pd(t1, t3, 0x20);
+	columns[2] = _mm256_permute2f128_pd(t0, t2, 0x31);
+	columns[3] = _mm256_permute2f128_pd(t1, t3, 0x31);
+}
+
+__attribute__((target("avx2")))
+inline void LoadTransformsInAVX2(const double *transforms, const int *cellIDs, __m256d *t) {
+	const double *rows[4];
+	for (int j = 0; j < 4; j++)
+		rows[j] = transforms + cellIDs[j] * 12LL;
+	for (int k = 0; k < 12; k += 4)
+		TransposeInAVX2(_mm256_loadu_pd(rows[0] + k), _mm256_loadu_pd(rows[1] + k),
+				_mm256_loadu_pd(rows[2] + k), _mm256_loadu_pd(rows[3] + k), t + k);
+}
+
+__attribute__((target("avx2")))
+inline void ApplyTransformsInAVX2(const __m256d *t, __m256d x, __m256d y, __m256d z, __m256d *c) {
+	__m256d dx = _mm256_sub_pd(x, t[0]);
+	__m256d dy = _mm256_sub_pd(y, t[1]);
+	__m256d dz = _mm256_sub_pd(z, t[2]);
+
+	c[1] = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(t[3], dx), _mm256_mul_pd(t[4], dy)), _mm256_mul_pd(t[5], dz));
+	c[2] = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(t[6], dx), _mm256_mul_pd(t[7], dy)), _mm256_mul_pd(t[8], dz));
+	c[3] = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(t[9], dx), _mm256_mul_pd(t[10], dy)), _mm256_mul_pd(t[11], dz));
+	c[0] = _mm256_sub_pd(_mm256_sub_pd(_mm256_sub_pd(_mm256_set1_pd(1), c[1]), c[2]), c[3]);
+}
+
+__attribute__((target("avx2")))
+void ApplyBarycentricTransformsInAVX2(const double *transforms, const int *cellIDs, int numOfCells,
+				      double x, double y, double z, double *c0, double *c1, double *c2, double *c3) {
+	__m256d px = _mm256_set1_pd(x), py = _mm256_set1_pd(y), pz = _mm256_set1_pd(z);
+
+	int i = 0;
+	for (; i + 4 <= numOfCells; i += 4) {
+		__m256d t[12], c[4];
+		LoadTransformsInAVX2(transforms, cellIDs + i, t);
+		ApplyTransformsInAVX2(t, px, py, pz, c);
+
+		_mm256_storeu_pd(c0 + i, c[0]);
+		_mm256_storeu_pd(c1 + i, c[1]);
+		_mm256_storeu_pd(c2 + i, c[2]);
+		_mm256_storeu_pd(c3 + i, c[3]);
+	}
+	_mm256_zeroupper();
+
+	ApplyBarycentricTransformsInScalar(transforms, cellIDs + i, numOfCells - i, x, y, z, c0 + i, c1 + i, c2 + i, c3 + i);
+}
+
+__attribute__((target("avx2")))
+int FindContainingCellInAVX2(const double *transforms, const int *cellIDs, int numOfCells,
+			     double x, double y, double z, double epsilon) {
+	__m256d px = _mm256_set1_pd(x), py = _mm256_set1_pd(y), pz = _mm256_set1_pd(z);
+	__m256d lowerBound = _mm256_set1_pd(-epsilon);
+
+	int i = 0, mask = 0;
+	for (; i + 4 <= numOfCells; i += 4) {
+		__m256d t[12], c[4];
+		LoadTransformsInAVX2(transforms, cellIDs + i, t);
+		ApplyTransformsInAVX2(t, px, py, pz, c);
+
+		__m256d minimum = _mm256_min_pd(_mm256_min_pd(c[0], c[1]), _mm256_min_pd(c[2], c[3]));
+		mask = _mm256_movemask_pd(_mm256_cmp_pd(minimum, lowerBound, _CMP_GE_OQ));
+		if (mask) break;
+	}
+	_mm256_zeroupper();
+
+	if (mask) return i + __builtin_ctz(mask);
+	int result = FindContainingCellInScalar(transforms, cellIDs + i, numOfCells - i, x, y, z, epsilon);
+	return result == -1 ? -1 : i + result;
+}
+
+// The same with 8 cells in the lanes. Row j and row j + 4 share a register, whose halves are transposed together.
+__attribute__((target("avx512f")))
+inline void LoadTransformsInAVX512(const double *transforms, const int *cellIDs, __m512d *t) {
+	const double *rows[8];
+	for (int j = 0; j < 8; j++)
+		rows[j] = transforms + cellIDs[j] * 12LL;
+
+	const __m512i lowerColumns = _mm512_set_epi64(13, 12, 5, 4, 9, 8, 1, 0);
+	const __m512i upperColumns = _mm512_set_epi64(15, 14, 7, 6, 11, 10, 3, 2);
+
+	for (int k = 0; k < 12; k += 4) {
+		__m512d r[4];
+		for (int j = 0; j < 4; j++)
+			r[j] = _mm512_insertf64x4(_mm512_castpd256_pd512(_mm256_loadu_pd(rows[j] + k)),
+						  _mm256_loadu_pd(rows[j + 4] + k), 1);
+
+		__m512d t0 = _mm512_unpacklo_pd(r[0], r[1]), t1 = _mm512_unpackhi_pd(r[0], r[1]);
+		__m512d t2 = _mm512_unpacklo_pd(r[2], r[3]), t3 = _mm512_unpackhi_pd(r[2], r[3]);
+		t[k] = _mm512_permutex2var_pd(t0, lowerColumns, t2);
+		t[k + 1] = _mm512_permutex2var_pd(t1, lowerColumns, t3);
+		t[k + 2] = _mm512_permutex2var_pd(t0, upperColumns, t2);
+		t[k + 3] = _mm512_permutex2var_pd(t1, upperColumns, t3);
+	}
+}
+
+__attribute__((target("avx512f")))
+inline void ApplyTransformsInAVX512(const __m512d *t, __m512d x, __m512d y, __m512d z, __m512d *c) {
+	__m512d dx = _mm512_sub_pd(x, t[0]);
+	__m512d dy = _mm512_sub_pd(y, t[1]);
+	__m512d dz = _mm512_sub_pd(z, t[2]);
+
+	c[1] = _mm512_add_pd(_mm512_add_pd(_mm512_mul_pd(t[3], dx), _mm512_mul_pd(t[4], dy)), _mm512_mul_pd(t[5], dz));
+	c[2] = _mm512_add_pd(_mm512_add_pd(_mm512_mul_pd(t[6], dx), _mm512_mul_pd(t[7], dy)), _mm512_mul_pd(t[8], dz));
+	c[3] = _mm512_add_pd(_mm512_add_pd(_mm512_mul_pd(t[9], dx), _mm512_mul_pd(t[10], dy)), _mm512_mul_pd(t[11], dz));
+	c[0] = _mm512_sub_pd(_mm512_sub_pd(_mm512_sub_pd(_mm512_set1_pd(1), c[1]), c[2]), c[3]);
+}
+
+__attribute__((target("avx512f")))
+void ApplyBarycentricTransformsInAVX512(const double *transforms, const int *cellIDs, int numOfCells,
+					double x, double y, double z, double *c0, double *c1, double *c2, double *c3) {
+	__m512d px = _mm512_set1_pd(x), py = _mm512_set1_pd(y), pz = _mm512_set1_pd(z);
+
+	int i = 0;
+	for (; i + 8 <= numOfCells; i += 8) {
+		__m512d t[12], c[4];
+		LoadTransformsInAVX512(transforms, cellIDs + i, t);
+		ApplyTransformsInAVX512(t, px, py, pz, c);
+
+		_mm512_storeu_pd(c0 + i, c[0]);
+		_mm512_storeu_pd(c1 + i, c[1]);
+		_mm512_storeu_pd(c2 + i, c[2]);
+		_mm512_storeu_pd(c3 + i, c[3]);
+	}
+	_mm256_zeroupper();
+
+	ApplyBarycentricTransformsInScalar(transforms, cellIDs + i, numOfCells - i, x, y, z, c0 + i, c1 + i, c2 + i, c3 + i);
+}
+
+__attribute__((target("avx512f")))
+int FindContainingCellInAVX512(const double *transforms, const int *cellIDs, int numOfCells,
+			       double x, double y, double z, double epsilon) {
+	__m512d px = _mm512_set1_pd(x), py = _mm512_set1_pd(y), pz = _mm512_set1_pd(z);
+	__m512d lowerBound = _mm512_set1_pd(-epsilon);
+
+	int i = 0, mask = 0;
+	for (; i + 8 <= numOfCells; i += 8) {
+		__m512d t[12], c[4];
+		LoadTransformsInAVX512(transforms, cellIDs + i, t);
+		ApplyTransformsInAVX512(t, px, py, pz, c);
+
+		__m512d minimum = _mm512_min_pd(_mm512_min_pd(c[0], c[1]), _mm512_min_pd(c[2], c[3]));
+		mask = _mm512_cmp_pd_mask(minimum, lowerBound, _CMP_GE_OQ);
+		if (mask) break;
+	}
+	_mm256_zeroupper();
+
+	if (mask) return i + __builtin_ctz(mask);
+	int result = FindContainingCellInScalar(transforms, cellIDs + i, numOfCells - i, x, y, z, epsilon);
+	return result == -1 ? -1 : i + result;
+}
+#endif
+
+int FindContainingCell(const double *transforms, const int *cellIDs, int numOfCells, const lcs::Vector &point,
+		       double epsilon) {
+#ifdef LCS_X86_SIMD
+	if (SupportsAVX512())
+		return FindContainingCellInAVX512(transforms, cellIDs, numOfCells, point.GetX(), point.GetY(), point.GetZ(),
+						  epsilon);
+	if (SupportsAVX2())
+		return FindContainingCellInAVX2(transforms, cellIDs, numOfCells, point.GetX(), point.GetY(), point.GetZ(),
+						epsilon);
+#endif
+	return FindContainingCellInScalar(transforms, cellIDs, numOfCells, point.GetX(), point.GetY(), point.GetZ(),
+					  epsilon);
+}
+
+double *AllocateAlignedArray(long long size) {
+	void *array;
+	if (posix_memalign(&array, arrayAlignment, sizeof(double) * std::max(size, 1LL)))
+		throw std::bad_alloc();
+	return (double *)array;
+}
+
+class BarycentricTransformTask : public lcs::ParallelTask {
+public:
+	void Run(int chunkID, int) {
+		int begin = (long long)grid->GetNumOfCells() * chunkID / numOfChunks;
+		int end = (long long)grid->GetNumOfCells() * (chunkID + 1) / numOfChunks;
+		for (int i = begin; i < end; i++)
+			grid->GetTetrahedron(i).CalculateBarycentricTransform(transforms + i * 12LL);
+	}
+
+	const lcs::TetrahedralGrid *grid;
+	double *transforms;
+	int numOfChunks;
+};
+
+// Map a coordinate in [lower, upper] to 21 bits.
+unsigned int Quantize(double a, double lower, double upper) {
+	if (upper <= lower) return 0;
+	double ratio = (a - lower) / (upper - lower);
+	return (unsigned int)(std::max(0.0, std::min(1.0, ratio)) * 0x1fffff);
+}
+
+// A face of a tetrahedron with its vertex IDs sorted. The face opposite to vertex j of cell i is (i << 2) + j.
+struct FaceRecord {
+	int vertices[3];
+	int face;
+};
+
+int GetKey(const FaceRecord &record, int field) {
+	return record.vertices[field];
+}
+
+const int radixBits = 11;
+const int radix = 1 << radixBits;
+
+// A pass of the LSD radix sort on a digit of a key. The records are cut into chunks, which are
+// counted first and then scattered stably to the offsets of their digits.
+template <class Record>
+class RadixPassTask : public lcs::ParallelTask {
+public:
+	void Run(int chunkID, int) {
+		int begin = (long long)numOfRecords * chunkID / numOfChunks;
+		int end = (long long)numOfRecords * (chunkID + 1) / numOfChunks;
+		int *histogram = histograms + chunkID * radix;
+
+		if (counting) {
+			std::fill(histogram, histogram + radix, 0);
+			for (int i = begin; i < end; i++)
+				histogram[Digit(source[i])]++;
+		} else
+			for (int i = begin; i < end; i++)
+				destination[histogram[Digit(source[i])]++] = source[i];
+	}
+
+	int Digit(const Record &record) const {
+		return (GetKey(record, field) >> shift) & (radix - 1);
+	}
+
+	const Record *source;
+	Record *destination;
+	int numOfRecords, numOfChunks;
+	int field, shift;
+	bool counting;
+	int *histograms;
+};
+
+// Scatter the cells of a chunk to the incidence lists of their vertices. In the counting mode, only the sizes
+// of the lists are counted. The order within a list depends on the threads.
+class IncidenceFillTask : public lcs::ParallelTask {
+public:
+	void Run(int chunkID, int) {
+		int begin = (long long)numOfCells * chunkID / numOfChunks;
+		int end = (long long)numOfCells * (chunkID + 1) / numOfChunks;
+		for (int i = begin; i < end; i++)
+			for (int j = 0; j < 4; j++) {
+				int vertexID = connectivities[(i << 2) + j];
+				if (counting)
+					__sync_fetch_and_add(offsets + vertexID + 1, 1);
+				else
+					cells[__sync_fetch_and_add(cursors + vertexID, 1)] = i;
+			}
+	}
+
+	const int *connectivities;
+	int *offsets, *cursors, *cells;
+	int numOfCells, numOfChunks;
+	bool counting;
+};
+
+// Sort the incidence lists of a chunk of vertices into increasing order.
+class IncidenceSortTask : public lcs::ParallelTask {
+public:
+	void Run(int chunkID, int) {
+		int begin = (long long)numOfVertices * chunkID / numOfChunks;
+		int end = (long long)numOfVertices * (chunkID + 1) / numOfChunks;
+		for (int i = begin; i < end; i++)
+			std::sort(cells + offsets[i], cells + offsets[i + 1]);
+	}
+
+	const int *offsets;
+	int *cells;
+	int numOfVertices, numOfChunks;
+};
+
+// Sort the records by their keys in [0, maxKey), comparing the fields lexicographically from field 0.
+// The sort is stable. The sorted records end up in either array, which is returned.
+template <class Record>
+Record *RadixSort(Record *records, Record *buffer, int numOfRecords, int numOfFields, int maxKey) {
+	int numOfBits = 1;
+	while (numOfBits < 31 && (1 << numOfBits) < maxKey) numOfBits++;
+
+	RadixPassTask<Record> task;
+	task.numOfRecords = numOfRecords;
+	task.numOfChunks = lcs::GetNumOfThreads();
+	task.histograms = new int [task.numOfChunks * radix];
+
+	// The last field is the least significant one.
+	for (int field = numOfFields - 1; field >= 0; field--)
+		for (int shift = 0; shift < numOfBits; shift += radixBits) {
+			task.source = records;
+			task.destination = buffer;
+			task.field = field;
+			task.shift = shift;
+
+			task.counting = true;
+			lcs::ParallelFor(task.numOfChunks, &task);
+
+			// The offsets are ordered by digits first and chunks second.
+			int offset = 0;
+			for (int digit = 0; digit < radix; digit++)
+				for (int chunk = 0; chunk < task.numOfChunks; chunk++) {
+					int count = task.histograms[chunk * radix + digit];
+					task.histograms[chunk * radix + digit] = offset;
+					offset += count;
+				}
+
+			task.counting = false;
+			lcs::ParallelFor(task.numOfChunks, &task);
+
+			std::swap(records, buffer);
+		}
+
+	delete [] task.histograms;
+
+	return records;
+}
+
+}
+
 namespace lcs {
 
 ////////////////////////////////////////////////
@@ -22,6 +444,25 @@ double Sqr(double a) {
 	return a * a;
 }
 
+unsigned long long MortonCode(unsigned int x, unsigned int y, unsigned int z) {
+	return SpreadBits(x) << 2 | SpreadBits(y) << 1 | SpreadBits(z);
+}
+
+void ConvertToFloat(const double *source, float *destination, int size) {
+#ifdef LCS_X86_SIMD
+	if (SupportsAVX512()) {
+		ConvertToFloatAVX512(source, destination, size);
+		return;
+	}
+	if (SupportsAVX()) {
+		ConvertToFloatAVX(source, destination, size);
+		return;
+	}
+#endif
+	for (int i = 0; i < size; i++)
+		destination[i] = (float)source[i];
+}
+
 ////////////////////////////////////////////////
 double Vector::Length() const {
 	return sqrt(Sqr(this->x) + Sqr(this->y) + Sqr(this->z));
@@ -60,6 +501,44 @@ Tetrahedron::Tetrahedron(const Vector *arr) {
 	memcpy(this->vertices, arr, sizeof(Vector) * 4);
 }
 
+void Tetrahedron::CalculateBarycentricTransform(double *transform) const {
+	transform[0] = this->vertices[0].GetX();
+	transform[1] = this->vertices[0].GetY();
+	transform[2] = this->vertices[0].GetZ();
+
+	double V = 1 / Mixed(vertices[1] - vertices[0], vertices[2] - vertices[0], vertices[3] - vertices[0]);
+
+	double z41 = this->vertices[3].GetZ() - this->vertices[0].GetZ();
+	double y34 = this->vertices[2].GetY() - this->vertices[3].GetY();
+	double z34 = this->vertices[2].GetZ() - this->vertices[3].GetZ();
+	double y41 = this->vertices[3].GetY() - this->vertices[0].GetY();
+	transform[3] = (z41 * y34 - z34 * y41) * V;
+
+	double x41 = this->vertices[3].GetX() - this->vertices[0].GetX();
+	double x34 = this->vertices[2].GetX() - this->vertices[3].GetX();
+	transform[4] = (x41 * z34 - x34 * z41) * V;
+
+	transform[5] = (y41 * x34 - y34 * x41) * V;
+
+	double y12 = this->vertices[0].GetY() - this->vertices[1].GetY();
+	double z12 = this->vertices[0].GetZ() - this->vertices[1].GetZ();
+	transform[6] = (z41 * y12 - z12 * y41) * V;
+
+	double x12 = this->vertices[0].GetX() - this->vertices[1].GetX();
+	transform[7] = (x41 * z12 - x12 * z41) * V;
+
+	transform[8] = (y41 * x12 - y12 * x41) * V;
+
+	double z23 = this->vertices[1].GetZ() - this->vertices[2].GetZ();
+	double y23 = this->vertices[1].GetY() - this->vertices[2].GetY();
+	transform[9] = (z23 * y12 - z12 * y23) * V;
+
+	double x23 = this->vertices[1].GetX() - this->vertices[2].GetX();
+	transform[10] = (x23 * z12 - x12 * z23) * V;
+
+	transform[11] = (y23 * x12 - y12 * x23) * V;
+}
+
 void Tetrahedron::CalculateNaturalCoordinates(const Vector &point, double *coordinates) const {
 	Vector diff(point - this->vertices[0]);
 
@@ -107,110 +586,322 @@ void Tetrahedron::CalculateNaturalCoordinates(const Vector &point, double *coord
 	coordinates[0] = 1 - coordinates[1] - coordinates[2] - coordinates[3];
 }
 
+void ApplyBarycentricTransform(const double *transforms, const int *cellIDs, int numOfCells, const Vector &point,
+			       double *c0, double *c1, double *c2, double *c3) {
+#ifdef LCS_X86_SIMD
+	if (SupportsAVX512()) {
+		ApplyBarycentricTransformsInAVX512(transforms, cellIDs, numOfCells, point.GetX(), point.GetY(), point.GetZ(),
+						   c0, c1, c2, c3);
+		return;
+	}
+	if (SupportsAVX2()) {
+		ApplyBarycentricTransformsInAVX2(transforms, cellIDs, numOfCells, point.GetX(), point.GetY(), point.GetZ(),
+						 c0, c1, c2, c3);
+		return;
+	}
+#endif
+	ApplyBarycentricTransformsInScalar(transforms, cellIDs, numOfCells, point.GetX(), point.GetY(), point.GetZ(),
+					   c0, c1, c2, c3);
+}
+
 ////////////////////////////////////////////////
 TetrahedralGrid::TetrahedralGrid(vtkUnstructuredGrid *unstructuredGrid) {
+	this->originalVertexIDs = this->originalCellIDs = NULL;
+	this->newVertexIDs = this->newCellIDs = NULL;
+	this->vertexCellOffsets = this->vertexCells = NULL;
+	this->barycentricTransforms = NULL;
+	this->ownsGeometry = true;
+
 	if (!unstructuredGrid) return;
 	
 	this->numOfVertices = unstructuredGrid->GetNumberOfPoints();
 	this->numOfCells = unstructuredGrid->GetNumberOfCells();
 	
-	this->vertices = new Vector [this->numOfVertices];
-	this->velocities = new Vector [this->numOfVertices];
+	this->positions = AllocateAlignedArray(this->numOfVertices * 3LL);
+	this->velocities = AllocateAlignedArray(this->numOfVertices * 3LL);
 	this->tetrahedralConnectivities = new int [this->numOfCells * 4];
 	this->tetrahedralLinks = new int [this->numOfCells * 4];
 
-	double point[3], velocity[3];
+	vtkDataArray *vectors = unstructuredGrid->GetPointData()->GetVectors();
 	for (int i = 0; i < this->numOfVertices; i++) {
-		unstructuredGrid->GetPoint(i, point);
-		this->vertices[i] = Vector(point);
-		unstructuredGrid->GetPointData()->GetVectors()->GetTuple(i, velocity);
-		this->velocities[i] = Vector(velocity);
+		unstructuredGrid->GetPoint(i, this->positions + i * 3);
+		vectors->GetTuple(i, this->velocities + i * 3);
 	}
 
-	int **vertexLinks = new int *[this->numOfVertices];
-	int *vertexDegrees = new int [this->numOfVertices];
-	memset(vertexDegrees, 0, sizeof(int) * this->numOfVertices);
-	
 	vtkIdList *idList = vtkIdList::New();
 	for (int i = 0; i < this->numOfCells; i++) {
 		unstructuredGrid->GetCellPoints(i, idList);
-		for (int j = 0; j < 4; j++) {
+		for (int j = 0; j < 4; j++)
 			this->tetrahedralConnectivities[(i << 2) + j] = idList->GetId(j);
-			vertexDegrees[idList->GetId(j)]++;
-		}
-		Vector a = this->vertices[this->tetrahedralConnectivities[(i << 2) + 0]];
-		Vector b = this->vertices[this->tetrahedralConnectivities[(i << 2) + 1]];
-		Vector c = this->vertices[this->tetrahedralConnectivities[(i << 2) + 2]];
-		Vector d = this->vertices[this->tetrahedralConnectivities[(i << 2) + 3]];
+		Vector a = this->GetVertex(this->tetrahedralConnectivities[(i << 2) + 0]);
+		Vector b = this->GetVertex(this->tetrahedralConnectivities[(i << 2) + 1]);
+		Vector c = this->GetVertex(this->tetrahedralConnectivities[(i << 2) + 2]);
+		Vector d = this->GetVertex(this->tetrahedralConnectivities[(i << 2) + 3]);
 		if (Mixed(b - a, c - a, d - a) < 0) std::swap(this->tetrahedralConnectivities[(i << 2) + 1], this->tetrahedralConnectivities[(i << 2) + 2]);
 	}
 	idList->Delete();
 
+	this->BuildLinks();
+}
+
+void TetrahedralGrid::BuildLinks() {
+	int numOfFaces = this->numOfCells * 4;
+
+	FaceRecord *records = new FaceRecord [numOfFaces];
+	FaceRecord *buffer = new FaceRecord [numOfFaces];
+
+	for (int i = 0; i < numOfFaces; i++) {
+		int cellID = i >> 2, vertex = i & 3;
+		for (int k = 1; k <= 3; k++)
+			records[i].vertices[k - 1] = this->tetrahedralConnectivities[(cellID << 2) + ((vertex + k) & 3)];
+		std::sort(records[i].vertices, records[i].vertices + 3);
+		records[i].face = i;
+	}
+
+	FaceRecord *sorted = RadixSort(records, buffer, numOfFaces, 3, this->numOfVertices);
+
+	// Equal triples are adjacent now. An interior face appears twice. A face which appears more than twice
+	// is non-manifold, and it is left unlinked like a boundary face.
+	memset(this->tetrahedralLinks, 255, sizeof(int) * numOfFaces);
+
+	int numOfInteriorFaces = 0, numOfBoundaryFaces = 0, numOfNonManifoldFaces = 0;
+
+	for (int i = 0, j; i < numOfFaces; i = j) {
+		for (j = i + 1; j < numOfFaces && !memcmp(sorted[j].vertices, sorted[i].vertices, sizeof(int) * 3); j++);
+
+		switch (j - i) {
+		case 1: numOfBoundaryFaces++; break;
+		case 2: {
+			this->tetrahedralLinks[sorted[i].face] = sorted[i + 1].face >> 2;
+			this->tetrahedralLinks[sorted[i + 1].face] = sorted[i].face >> 2;
+			numOfInteriorFaces++;
+		} break;
+		default: numOfNonManifoldFaces++;
+		}
+	}
+
+	delete [] records;
+	delete [] buffer;
+
+	printf("Face adjacency: %d interior, %d boundary and %d non-manifold faces.\n",
+	       numOfInteriorFaces, numOfBoundaryFaces, numOfNonManifoldFaces);
+	if (numOfNonManifoldFaces) printf("The non-manifold faces are left unlinked.\n");
+}
+
+void TetrahedralGrid::BuildVertexIncidence() {
+	if (this->vertexCellOffsets) return;
+
+	this->vertexCellOffsets = new int [this->numOfVertices + 1];
+	this->vertexCells = new int [std::max(this->numOfCells * 4, 1)];
+	memset(this->vertexCellOffsets, 0, sizeof(int) * (this->numOfVertices + 1));
+
+	IncidenceFillTask fillTask;
+	fillTask.connectivities = this->tetrahedralConnectivities;
+	fillTask.offsets = this->vertexCellOffsets;
+	fillTask.cells = this->vertexCells;
+	fillTask.numOfCells = this->numOfCells;
+	fillTask.numOfChunks = lcs::GetNumOfThreads();
+
+	// Count the cells of every vertex
+	fillTask.counting = true;
+	fillTask.cursors = NULL;
+	lcs::ParallelFor(fillTask.numOfChunks, &fillTask);
+
+	for (int i = 0; i < this->numOfVertices; i++)
+		this->vertexCellOffsets[i + 1] += this->vertexCellOffsets[i];
+
+	// Scatter the cells to the precomputed offsets with a cursor per vertex
+	fillTask.counting = false;
+	fillTask.cursors = new int [std::max(this->numOfVertices, 1)];
+	memcpy(fillTask.cursors, this->vertexCellOffsets, sizeof(int) * this->numOfVertices);
+	lcs::ParallelFor(fillTask.numOfChunks, &fillTask);
+	delete [] fillTask.cursors;
+
+	IncidenceSortTask sortTask;
+	sortTask.offsets = this->vertexCellOffsets;
+	sortTask.cells = this->vertexCells;
+	sortTask.numOfVertices = this->numOfVertices;
+	sortTask.numOfChunks = lcs::GetNumOfThreads();
+	lcs::ParallelFor(sortTask.numOfChunks, &sortTask);
+}
+
+void TetrahedralGrid::ReleaseVertexIncidence() {
+	if (this->vertexCellOffsets) delete [] this->vertexCellOffsets;
+	if (this->vertexCells) delete [] this->vertexCells;
+	this->vertexCellOffsets = this->vertexCells = NULL;
+}
+
+void TetrahedralGrid::BuildBarycentricTransforms() {
+	if (this->barycentricTransforms) return;
+
+	BarycentricTransformTask task;
+	task.grid = this;
+	task.transforms = AllocateAlignedArray(this->numOfCells * 12LL);
+	task.numOfChunks = lcs::GetNumOfThreads();
+	lcs::ParallelFor(task.numOfChunks, &task);
+
+	this->barycentricTransforms = task.transforms;
+}
+
+void TetrahedralGrid::ReleaseBarycentricTransforms() {
+	if (this->barycentricTransforms) free(this->barycentricTransforms);
+	this->barycentricTransforms = NULL;
+}
+
+bool TetrahedralGrid::ReadVelocities(vtkUnstructuredGrid *unstructuredGrid, double *destination) const {
+	if (unstructuredGrid->GetNumberOfPoints() != this->numOfVertices) return false;
+	if (unstructuredGrid->GetNumberOfCells() != this->numOfCells) return false;
+
+	// The second and the third vertices may have been swapped for the orientation.
+	// The cells and vertices of the file are mapped through the renumbering.
+	vtkIdList *idList = vtkIdList::New();
+	bool sameTopology = true;
+	for (int i = 0; sameTopology && i < this->numOfCells; i++) {
+		unstructuredGrid->GetCellPoints(i, idList);
+		if (idList->GetNumberOfIds() != 4) {
+			sameTopology = false;
+			break;
+		}
+
+		int ids[4];
+		for (int j = 0; sameTopology && j < 4; j++) {
+			ids[j] = idList->GetId(j);
+			if (ids[j] < 0 || ids[j] >= this->numOfVertices) sameTopology = false;
+			else if (this->newVertexIDs) ids[j] = this->newVertexIDs[ids[j]];
+		}
+		if (!sameTopology) break;
+
+		int cellID = this->newCellIDs ? this->newCellIDs[i] : i;
+		const int *connectivity = this->tetrahedralConnectivities + (cellID << 2);
+		sameTopology = ids[0] == connectivity[0] && ids[3] == connectivity[3]
+			       && ((ids[1] == connectivity[1] && ids[2] == connectivity[2])
+				   || (ids[1] == connectivity[2] && ids[2] == connectivity[1]));
+	}
+	idList->Delete();
+	if (!sameTopology) return false;
+
+	vtkDataArray *vectors = unstructuredGrid->GetPointData()->GetVectors();
+	for (int i = 0; i < this->numOfVertices; i++)
+		vectors->GetTuple(i, destination + (this->newVertexIDs ? this->newVertexIDs[i] : i) * 3);
+
+	return true;
+}
+
+TetrahedralGrid::TetrahedralGrid(int numOfVertices, int numOfCells, const double *positions, const double *velocities,
+				 const int *connectivities, const int *links) {
+	this->numOfVertices = numOfVertices;
+	this->numOfCells = numOfCells;
+
+	// The borrowed arrays are only read.
+	this->positions = const_cast<double *>(positions);
+	this->velocities = const_cast<double *>(velocities);
+	this->tetrahedralConnectivities = const_cast<int *>(connectivities);
+	this->tetrahedralLinks = const_cast<int *>(links);
+	this->ownsGeometry = false;
+
+	this->originalVertexIDs = this->originalCellIDs = NULL;
+	this->newVertexIDs = this->newCellIDs = NULL;
+	this->vertexCellOffsets = this->vertexCells = NULL;
+	this->barycentricTransforms = NULL;
+}
+
+void TetrahedralGrid::Renumber() {
+	if (this->IsRenumbered()) return;
+
+	// The incidence and the transforms are in the old numbering.
+	this->ReleaseVertexIncidence();
+	this->ReleaseBarycentricTransforms();
+
+	// Bounding box of the vertices
+	double lower[3], upper[3];
+	for (int i = 0; i < this->numOfVertices; i++) {
+		const double *point = this->positions + i * 3;
+		for (int j = 0; j < 3; j++)
+			if (!i) lower[j] = upper[j] = point[j];
+			else {
+				lower[j] = std::min(lower[j], point[j]);
+				upper[j] = std::max(upper[j], point[j]);
+			}
+	}
+
+	// Sort the vertices by the Morton codes
+	std::vector<std::pair<unsigned long long, int> > keys(this->numOfVertices);
+	for (int i = 0; i < this->numOfVertices; i++) {
+		Vector point = this->GetVertex(i);
+		keys[i] = std::make_pair(MortonCode(Quantize(point.GetX(), lower[0], upper[0]),
+						    Quantize(point.GetY(), lower[1], upper[1]),
+						    Quantize(point.GetZ(), lower[2], upper[2])), i);
+	}
+	std::sort(keys.begin(), keys.end());
+
+	this->originalVertexIDs = new int [this->numOfVertices];
+	this->newVertexIDs = new int [this->numOfVertices];
+	for (int i = 0; i < this->numOfVertices; i++) {
+		this->originalVertexIDs[i] = keys[i].second;
+		this->newVertexIDs[keys[i].second] = i;
+	}
+
+	// Sort the cells by the Morton codes of the centroids
+	keys.resize(this->numOfCells);
+	for (int i = 0; i < this->numOfCells; i++) {
+		Vector centroid;
+		for (int j = 0; j < 4; j++)
+			centroid = centroid + this->GetVertex(this->tetrahedralConnectivities[(i << 2) + j]);
+		centroid = centroid / 4;
+		keys[i] = std::make_pair(MortonCode(Quantize(centroid.GetX(), lower[0], upper[0]),
+						    Quantize(centroid.GetY(), lower[1], upper[1]),
+						    Quantize(centroid.GetZ(), lower[2], upper[2])), i);
+	}
+	std::sort(keys.begin(), keys.end());
+
+	this->originalCellIDs = new int [this->numOfCells];
+	this->newCellIDs = new int [this->numOfCells];
+	for (int i = 0; i < this->numOfCells; i++) {
+		this->originalCellIDs[i] = keys[i].second;
+		this->newCellIDs[keys[i].second] = i;
+	}
+
+	// Permute the vertices and the velocities
+	double *newPositions = AllocateAlignedArray(this->numOfVertices * 3LL);
+	double *newVelocities = AllocateAlignedArray(this->numOfVertices * 3LL);
 	for (int i = 0; i < this->numOfVertices; i++) {
-		vertexLinks[i] = new int [vertexDegrees[i]];
-		vertexDegrees[i] = 0;
+		memcpy(newPositions + i * 3, this->positions + this->originalVertexIDs[i] * 3, sizeof(double) * 3);
+		memcpy(newVelocities + i * 3, this->velocities + this->originalVertexIDs[i] * 3, sizeof(double) * 3);
 	}
-	for (int i = 0; i < this->numOfCells; i++)
+	if (this->ownsGeometry) {
+		free(this->positions);
+		free(this->velocities);
+	}
+	this->positions = newPositions;
+	this->velocities = newVelocities;
+
+	// Permute the connectivities and the links. The orientation of every cell is kept.
+	int *newConnectivities = new int [this->numOfCells * 4];
+	int *newLinks = new int [this->numOfCells * 4];
+	for (int i = 0; i < this->numOfCells; i++) {
+		int cellID = this->originalCellIDs[i];
 		for (int j = 0; j < 4; j++) {
-			int idx = this->tetrahedralConnectivities[(i << 2) + j];
-			vertexLinks[idx][vertexDegrees[idx]++] = i;
+			newConnectivities[(i << 2) + j] = this->newVertexIDs[this->tetrahedralConnectivities[(cellID << 2) + j]];
+			int neighbor = this->tetrahedralLinks[(cellID << 2) + j];
+			newLinks[(i << 2) + j] = neighbor < 0 ? neighbor : this->newCellIDs[neighbor];
 		}
+	}
+	if (this->ownsGeometry) {
+		delete [] this->tetrahedralConnectivities;
+		delete [] this->tetrahedralLinks;
+	}
+	this->tetrahedralConnectivities = newConnectivities;
+	this->tetrahedralLinks = newLinks;
 
-	memset(this->tetrahedralLinks, 255, sizeof(int) * this->numOfCells * 4);
-	for (int i = 0; i < this->numOfCells; i++)
-		for (int j = 0; j < 4; j++)
-			if (this->tetrahedralLinks[(i << 2) + j] < 0) {
-				int idx = this->tetrahedralConnectivities[(i << 2) + ((j + 1) & 3)];
-				for (int k = 2; k <= 3; k++) {
-					int tmp = this->tetrahedralConnectivities[(i << 2) + ((j + k) & 3)];
-					if (vertexDegrees[tmp] < vertexDegrees[idx]) idx = tmp;
-				}
-				int v1 = -1, v2 = -1;
-				for (int k = 1; k <= 3; k++) {
-					int tmp = this->tetrahedralConnectivities[(i << 2) + ((j + k) & 3)];
-					if (tmp != idx)
-						if (v1 == -1) v1 = tmp;
-						else {
-							v2 = tmp;
-							break;
-						}
-				}
-				for (int k = 0; k < vertexDegrees[idx]; k++) {
-					int tet = vertexLinks[idx][k];
-					if (tet == i) continue;
-					int cnt = 0, v3 = -1;
-					for (int l = 0; l < 4; l++) {
-						int v = this->tetrahedralConnectivities[(tet << 2) + l];
-						if (v == v1) {
-							cnt++;
-							continue;
-						}
-						if (v == v2) {
-							cnt++;
-							continue;
-						}
-						if (v != idx) v3 = l;
-					}
-					if (cnt == 2) {
-						this->tetrahedralLinks[(i << 2) + j] = tet;
-						if (this->tetrahedralLinks[(tet << 2) + v3] != -1) {
-							printf("bug!\n");
-							printf("i = %d, j = %d\n", i, j);
-							printf("v3 = %d\n", v3);
-							printf("tet : %d, %d\n", tet, this->tetrahedralLinks[(tet << 2) + v3]);
-							printf("idx = %d, v1 = %d, v2 = %d\n", idx, v1, v2);
-							while (1);
-						}
-						this->tetrahedralLinks[(tet << 2) + v3] = i;
-						break;
-					}
-				}
-			}
+	// The permuted arrays belong to the grid even if the old ones were borrowed.
+	this->ownsGeometry = true;
+}
 
-	delete [] vertexDegrees;
-	for (int i = 0; i < this->numOfVertices; i++)
-		delete [] vertexLinks[i];
-	delete [] vertexLinks;
+void TetrahedralGrid::PermuteVelocities(const double *source, double *destination) const {
+	for (int i = 0; i < this->numOfVertices; i++) {
+		int vertexID = this->newVertexIDs ? this->newVertexIDs[i] : i;
+		memcpy(destination + vertexID * 3, source + i * 3, sizeof(double) * 3);
+	}
 }
 
 Tetrahedron TetrahedralGrid::GetTetrahedron(int index) const {
@@ -218,16 +909,46 @@ Tetrahedron TetrahedralGrid::GetTetrahedron(int index) const {
 	int b = this->tetrahedralConnectivities[(index << 2) + 1];
 	int c = this->tetrahedralConnectivities[(index << 2) + 2];
 	int d = this->tetrahedralConnectivities[(index << 2) + 3];
-	return Tetrahedron(this->vertices[a], this->vertices[b], this->vertices[c], this->vertices[d]);
+	return Tetrahedron(this->GetVertex(a), this->GetVertex(b), this->GetVertex(c), this->GetVertex(d));
+}
+
+void TetrahedralGrid::CalculateNaturalCoordinates(int cellID, const Vector &point, double *coordinates) const {
+	if (this->barycentricTransforms)
+		ApplyBarycentricTransform(this->barycentricTransforms + cellID * 12LL, point, coordinates);
+	else
+		this->GetTetrahedron(cellID).CalculateNaturalCoordinates(point, coordinates);
+}
+
+int TetrahedralGrid::FindCellInVertexStars(const Vector &point, double epsilon, int cellID) const {
+	for (int i = 0; i < 4; i++) {
+		int vertexID = this->tetrahedralConnectivities[(cellID << 2) + i];
+		int begin = this->vertexCellOffsets[vertexID];
+		int result = this->FindCellInList(point, epsilon, this->vertexCells + begin,
+						  this->vertexCellOffsets[vertexID + 1] - begin);
+		if (result != -1) return result;
+	}
+	return -1;
+}
+
+int TetrahedralGrid::FindCellInList(const Vector &point, double epsilon, const int *cellIDs, int numOfCells) const {
+	if (!this->barycentricTransforms) {
+		double coordinates[4];
+		for (int i = 0; i < numOfCells; i++) {
+			this->CalculateNaturalCoordinates(cellIDs[i], point, coordinates);
+			if (*std::min_element(coordinates, coordinates + 4) >= -epsilon) return cellIDs[i];
+		}
+		return -1;
+	}
+
+	int position = FindContainingCell(this->barycentricTransforms, cellIDs, numOfCells, point, epsilon);
+	return position == -1 ? -1 : cellIDs[position];
 }
 
 int TetrahedralGrid::FindCell(const Vector &point, const double &epsilon, int guess) const {
-	Tetrahedron tet;
 	double coordinates[4];
 	int curr = guess, violator;
 	while (1) {
-		tet = this->GetTetrahedron(curr);
-		tet.CalculateNaturalCoordinates(point, coordinates);
+		this->CalculateNaturalCoordinates(curr, point, coordinates);
 		violator = 0;
 		for (int i = 1; i < 4; i++)
 			if (coordinates[i] < coordinates[violator]) violator = i;
@@ -238,13 +959,11 @@ int TetrahedralGrid::FindCell(const Vector &point, const double &epsilon, int gu
 }
 
 int TetrahedralGrid::ProfiledFindCell(const Vector &point, const double &epsilon, int guess) {
-	Tetrahedron tet;
 	double coordinates[4];
 	int curr = guess, violator;
 	this->lastFindCellCost = 0;
 	while (1) {
-		tet = this->GetTetrahedron(curr);
-		tet.CalculateNaturalCoordinates(point, coordinates);
+		this->CalculateNaturalCoordinates(curr, point, coordinates);
 		violator = 0;
 		for (int i = 1; i < 4; i++)
 			if (coordinates[i] < coordinates[violator]) violator = i;
@@ -255,33 +974,16 @@ int TetrahedralGrid::ProfiledFindCell(const Vector &point, const double &epsilon
 	}
 }
 
-int TetrahedralGrid::FindCell(const Vector &point, const double &epsilon) const {
-	Tetrahedron tet;
-	double coordinates[4];
-	for (int i = 0; i < this->numOfCells; i++) {
-		tet = this->GetTetrahedron(i);
-		tet.CalculateNaturalCoordinates(point, coordinates);
-		bool flag = true;
-		for (int j = 0; j < 4; j++)
-			if (coordinates[j] < -epsilon) {
-				flag = false;
-				break;
-			}
-		if (flag) return i;
-	}
-	return -1;
-}
-
 void TetrahedralGrid::GetInterpolatedVelocity(const Vector &point, int cellId, double *velocity) const {
 	double coordinates[4];
 	double tempV[3];
-	this->GetTetrahedron(cellId).CalculateNaturalCoordinates(point, coordinates);
+	this->CalculateNaturalCoordinates(cellId, point, coordinates);
 	memset(velocity, 0, sizeof(double) * 3);
 	for (int i = 0; i < 4; i++) {
 		int vtx = this->tetrahedralConnectivities[(cellId << 2) + i];
-		velocity[0] += this->velocities[vtx].GetX() * coordinates[i];
-		velocity[1] += this->velocities[vtx].GetY() * coordinates[i];
-		velocity[2] += this->velocities[vtx].GetZ() * coordinates[i];
+		velocity[0] += this->velocities[vtx * 3] * coordinates[i];
+		velocity[1] += this->velocities[vtx * 3 + 1] * coordinates[i];
+		velocity[2] += this->velocities[vtx * 3 + 2] * coordinates[i];
 	}
 }
 
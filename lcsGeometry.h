@@ -8,6 +8,7 @@ Last Update		:		June 13th, 2012
 #define __LCS_Geometry_H
 
 #include <vtkUnstructuredGrid.h>
+#include <cstdlib>
 
 namespace lcs {
 
@@ -16,8 +17,22 @@ int Sign(double a, double epsilon);
 
 double Sqr(double a);
 
+// Interleave the lower 21 bits of x, y and z into a Morton code. x takes the highest bit of every triple.
+unsigned long long MortonCode(unsigned int x, unsigned int y, unsigned int z);
+
+// Convert size doubles to floats in one contiguous pass. On x86 it uses AVX-512 or AVX if the CPU has them.
+void ConvertToFloat(const double *source, float *destination, int size);
+
 class Vector;
 
+// The barycentric transform of a tetrahedron is 12 doubles: its first vertex and the rows of the inverse
+// of its edge matrix. The natural coordinates of a point are then one 3 x 3 matrix-vector product.
+// This version evaluates one point against the transforms of numOfCells cells, transforms + cellIDs[i] * 12, and
+// writes the coordinates in cell i of the list to c0[i], c1[i], c2[i] and c3[i]. On x86 it evaluates 8 or 4 cells
+// at a time with AVX-512 or AVX2 if the CPU has them.
+void ApplyBarycentricTransform(const double *transforms, const int *cellIDs, int numOfCells, const Vector &point,
+			       double *c0, double *c1, double *c2, double *c3);
+
 lcs::Vector operator + (const lcs::Vector &, const lcs::Vector &);
 lcs::Vector operator - (const lcs::Vector &, const lcs::Vector &);
 lcs::Vector operator * (const lcs::Vector &, const double &);
@@ -39,7 +54,7 @@ public:
 		this->z = z;
 	}
 
-	Vector(double *arr) {
+	Vector(const double *arr) {
 		this->x = arr[0];
 		this->y = arr[1];
 		this->z = arr[2];
@@ -114,40 +129,151 @@ public:
 
 	void CalculateNaturalCoordinates(const Vector &, double *) const;
 
+	void CalculateBarycentricTransform(double *transform) const;
+
 private:
 	Vector vertices[4];
 };
 
+////////////////////////////////////////////////
+inline void ApplyBarycentricTransform(const double *transform, const lcs::Vector &point, double *coordinates) {
+	double dx = point.GetX() - transform[0];
+	double dy = point.GetY() - transform[1];
+	double dz = point.GetZ() - transform[2];
+
+	coordinates[1] = transform[3] * dx + transform[4] * dy + transform[5] * dz;
+	coordinates[2] = transform[6] * dx + transform[7] * dy + transform[8] * dz;
+	coordinates[3] = transform[9] * dx + transform[10] * dy + transform[11] * dz;
+	coordinates[0] = 1 - coordinates[1] - coordinates[2] - coordinates[3];
+}
+
 ////////////////////////////////////////////////
 class TetrahedralGrid {
 public:
 	TetrahedralGrid() {
 		numOfVertices = 0;
 		numOfCells = 0;
-		vertices = NULL;
+		positions = NULL;
+		velocities = NULL;
 		tetrahedralConnectivities = NULL;
 		tetrahedralLinks = NULL;
+		originalVertexIDs = originalCellIDs = NULL;
+		newVertexIDs = newCellIDs = NULL;
+		vertexCellOffsets = vertexCells = NULL;
+		barycentricTransforms = NULL;
+		ownsGeometry = true;
 	}
 
 	TetrahedralGrid(vtkUnstructuredGrid *);
 
+	// Build the grid on arrays which already have the links, e.g. the mapping of a mesh cache.
+	// The grid borrows the arrays without copying them, so they must outlive it and are never written.
+	// Renumber() replaces them with permuted copies that the grid owns.
+	TetrahedralGrid(int numOfVertices, int numOfCells, const double *positions, const double *velocities,
+			const int *connectivities, const int *links);
+
 	~TetrahedralGrid() {
-		if (vertices) delete [] vertices;
-		if (tetrahedralConnectivities) delete [] tetrahedralConnectivities;
-		if (tetrahedralLinks) delete [] tetrahedralLinks;
+		if (ownsGeometry) {
+			if (positions) free(positions);
+			if (velocities) free(velocities);
+			if (tetrahedralConnectivities) delete [] tetrahedralConnectivities;
+			if (tetrahedralLinks) delete [] tetrahedralLinks;
+		}
+		if (originalVertexIDs) delete [] originalVertexIDs;
+		if (originalCellIDs) delete [] originalCellIDs;
+		if (newVertexIDs) delete [] newVertexIDs;
+		if (newCellIDs) delete [] newCellIDs;
+		ReleaseVertexIncidence();
+		ReleaseBarycentricTransforms();
+	}
+
+	// Renumber the vertices and the cells along the Morton curve of the vertices and the cell centroids,
+	// so that cells and vertices which are close in space are close in memory as well.
+	// The velocities, connectivities and links are permuted consistently.
+	void Renumber();
+
+	bool IsRenumbered() const {
+		return this->originalVertexIDs != NULL;
+	}
+
+	// IDs in the order of the data files
+	int GetOriginalVertexID(int index) const {
+		return this->originalVertexIDs ? this->originalVertexIDs[index] : index;
+	}
+
+	int GetOriginalCellID(int index) const {
+		return this->originalCellIDs ? this->originalCellIDs[index] : index;
+	}
+
+	// Permute the velocities of a frame from the vertex order of the data files.
+	void PermuteVelocities(const double *source, double *destination) const;
+
+	// The vertex-to-cell incidence in CSR form. The cells of vertex v are
+	// GetVertexCells()[GetVertexCellOffsets()[v] .. GetVertexCellOffsets()[v + 1]) in increasing order.
+	// It is built on demand and released by Renumber().
+	void BuildVertexIncidence();
+	void ReleaseVertexIncidence();
+
+	bool HasVertexIncidence() const {
+		return this->vertexCellOffsets != NULL;
+	}
+
+	const int *GetVertexCellOffsets() const {
+		return this->vertexCellOffsets;
+	}
+
+	const int *GetVertexCells() const {
+		return this->vertexCells;
 	}
 
+	// Cache the barycentric transforms of all the cells, so that FindCell and the interpolation evaluate a cell
+	// without the cofactor expansion. It takes 96 bytes per cell and is released by Renumber().
+	void BuildBarycentricTransforms();
+	void ReleaseBarycentricTransforms();
+
+	// NULL if they are not built
+	const double *GetBarycentricTransforms() const {
+		return this->barycentricTransforms;
+	}
+
+	// Natural coordinates of a point in a cell, through the cached transform when there is one
+	void CalculateNaturalCoordinates(int cellID, const Vector &point, double *coordinates) const;
+
+	// The first cell of the list which contains the point. It returns -1 if there is none.
+	// With the cached transforms, it tests the point against several cells at a time like ApplyBarycentricTransform().
+	int FindCellInList(const Vector &point, double epsilon, const int *cellIDs, int numOfCells) const;
+
+	// The first cell incident to a vertex of cellID which contains the point, or -1 if there is none.
+	// It catches the points that a walk from cellID misses at concave boundaries. It needs BuildVertexIncidence().
+	int FindCellInVertexStars(const Vector &point, double epsilon, int cellID) const;
+
 	Tetrahedron GetTetrahedron(int) const;
 
 	Vector GetVertex(int index) const {
-		return vertices[index];
+		return Vector(this->positions + index * 3);
 	}
 
 	Vector GetVelocity(int index) const {
-		return velocities[index];
+		return Vector(this->velocities + index * 3);
 	}
 
-	int FindCell(const Vector &, const double &) const;
+	// The flat x, y, z arrays of the vertices. They are aligned for CL_MEM_USE_HOST_PTR and stay valid until Renumber().
+	const double *GetPositions() const {
+		return this->positions;
+	}
+
+	const double *GetVelocities() const {
+		return this->velocities;
+	}
+
+	// 4 vertex IDs and 4 neighbor cell IDs per cell. They stay valid until Renumber().
+	const int *GetConnectivities() const {
+		return this->tetrahedralConnectivities;
+	}
+
+	const int *GetLinks() const {
+		return this->tetrahedralLinks;
+	}
 
 	int FindCell(const Vector &, const double &, int) const;
 
@@ -184,44 +310,48 @@ public:
 	}
 
 	void ReadPositions(double *destination) const {
-		for (int i = 0; i < this->numOfVertices; i++) {
-			destination[i * 3] = this->vertices[i].GetX();
-			destination[i * 3 + 1] = this->vertices[i].GetY();
-			destination[i * 3 + 2] = this->vertices[i].GetZ();
-		}
+		memcpy(destination, this->positions, sizeof(double) * 3 * this->numOfVertices);
 	}
 
 	void ReadPositions(float *destination) const {
-		for (int i = 0; i < this->numOfVertices; i++) {
-			destination[i * 3] = this->vertices[i].GetX();
-			destination[i * 3 + 1] = this->vertices[i].GetY();
-			destination[i * 3 + 2] = this->vertices[i].GetZ();
-		}
+		ConvertToFloat(this->positions, destination, this->numOfVertices * 3);
 	}
 
 	void ReadVelocities(double *destination) const {
-		for (int i = 0; i < this->numOfVertices; i++) {
-			destination[i * 3] = this->velocities[i].GetX();
-			destination[i * 3 + 1] = this->velocities[i].GetY();
-			destination[i * 3 + 2] = this->velocities[i].GetZ();
-		}
+		memcpy(destination, this->velocities, sizeof(double) * 3 * this->numOfVertices);
 	}
 
 	void ReadVelocities(float *destination) const {
-		for (int i = 0; i < this->numOfVertices; i++) {
-			destination[i * 3] = this->velocities[i].GetX();
-			destination[i * 3 + 1] = this->velocities[i].GetY();
-			destination[i * 3 + 2] = this->velocities[i].GetZ();
-		}
+		ConvertToFloat(this->velocities, destination, this->numOfVertices * 3);
 	}
 
+	// Read the velocities of another frame on the same mesh without rebuilding the links.
+	// It returns false if the frame does not have the same topology. The velocities follow the renumbering.
+	bool ReadVelocities(vtkUnstructuredGrid *, double *destination) const;
+
 private:
+	// Link the cells across their shared faces. The faces are matched by sorting their vertex triples in parallel.
+	void BuildLinks();
+
 	int numOfVertices;
 	int numOfCells;
-	Vector *vertices, *velocities;
+	double *positions, *velocities;
 	int *tetrahedralConnectivities;
 	int *tetrahedralLinks;
 
+	// Whether the positions, velocities, connectivities and links are freed with the grid (false if they are borrowed)
+	bool ownsGeometry;
+
+	// Permutations of the renumbering (NULL if it is not renumbered)
+	int *originalVertexIDs, *originalCellIDs;
+	int *newVertexIDs, *newCellIDs;
+
+	// Vertex-to-cell incidence (NULL if it is not built)
+	int *vertexCellOffsets, *vertexCells;
+
+	// Barycentric transforms of the cells (NULL if they are not built)
+	double *barycentricTransforms;
+
 // Profiling Result
 	int lastFindCellCost;
 };
@@ -10,7 +10,7 @@ __kernel void GetNumOfGroupsForBlocks(__global int *startOffsetInParticles,
 	int globalID = get_global_id(0);
 	if (globalID < numOfActiveBlocks) {
 		int numOfParticles = startOffsetInParticles[globalID + 1] - startOffsetInParticles[globalID];
-		numOfGroupsForBlocks[globalID] = (numOfParticles - 1) / groupSize + 1;
+		numOfGroupsForBlocks[globalID] = numOfParticles ? (numOfParticles - 1) / groupSize + 1 : 0;
 	}
 }
 
@@ -71,7 +71,7 @@ inline bool Inside(double X, double Y, double Z, double *tetX, double *tetY, dou
 	return true;
 }
 
-__kernel void InitialCellLocation(__global double *vertexPositions,
+__kernel void InitialCellLocation(__global gdouble *vertexPositions,
 								  __global int *tetrahedralConnectivities,
 								  volatile __global int *cellLocations,
 								  int xRes, int yRes, int zRes,
@@ -161,4 +161,70 @@ __kernel void InitialCellLocation(__global double *vertexPositions,
 			}
 		}
 	}
-}
\ No newline at end of file
+}
+
+// One thread per grid point. The point only tests the tetrahedra of the block containing it, which are sorted
+// by their global IDs, so the first hit is the smallest cell ID containing the point and no atomics are needed.
+__kernel void PointCentricCellLocation(__global gdouble *vertexPositions,
+									   __global int *tetrahedralConnectivities,
+									   __global int *interestingBlockMap,
+									   __global int *startOffsetInCell,
+									   __global int *cellIDs,
+									   __global int *cellLocations,
+									   int xRes, int yRes, int zRes,
+									   double minX, double minY, double minZ,
+									   double dx, double dy, double dz,
+									   double globalMinX, double globalMinY, double globalMinZ,
+									   double blockSize,
+									   double epsilon,
+									   int numOfBlocksInX, int numOfBlocksInY, int numOfBlocksInZ
+									   ) {
+	int globalID = get_global_id(0);
+
+	int numOfGridPoints = (xRes + 1) * (yRes + 1) * (zRes + 1);
+
+	if (globalID < numOfGridPoints) {
+		int zIdx = globalID % (zRes + 1);
+		int temp = globalID / (zRes + 1);
+		int yIdx = temp % (yRes + 1);
+		int xIdx = temp / (yRes + 1);
+
+		double X = minX + dx * xIdx;
+		double Y = minY + dy * yIdx;
+		double Z = minZ + dz * zIdx;
+
+		cellLocations[globalID] = -1;
+
+		// Points within epsilon of the domain are clamped into the boundary blocks.
+		if (Sign(X - globalMinX, epsilon) < 0 || Sign(X - globalMinX - blockSize * numOfBlocksInX, epsilon) > 0) return;
+		if (Sign(Y - globalMinY, epsilon) < 0 || Sign(Y - globalMinY - blockSize * numOfBlocksInY, epsilon) > 0) return;
+		if (Sign(Z - globalMinZ, epsilon) < 0 || Sign(Z - globalMinZ - blockSize * numOfBlocksInZ, epsilon) > 0) return;
+
+		int x = clamp((int)floor((X - globalMinX) / blockSize), 0, numOfBlocksInX - 1);
+		int y = clamp((int)floor((Y - globalMinY) / blockSize), 0, numOfBlocksInY - 1);
+		int z = clamp((int)floor((Z - globalMinZ) / blockSize), 0, numOfBlocksInZ - 1);
+
+		int interestingBlockID = interestingBlockMap[(x * numOfBlocksInY + y) * numOfBlocksInZ + z];
+		if (interestingBlockID == -1) return;
+
+		int startOffset = startOffsetInCell[interestingBlockID];
+		int endOffset = startOffsetInCell[interestingBlockID + 1];
+
+		for (int i = startOffset; i < endOffset; i++) {
+			int cellID = cellIDs[i];
+
+			double tetX[4], tetY[4], tetZ[4];
+			for (int j = 0; j < 4; j++) {
+				int point = tetrahedralConnectivities[(cellID << 2) + j];
+				tetX[j] = vertexPositions[point * 3];
+				tetY[j] = vertexPositions[point * 3 + 1];
+				tetZ[j] = vertexPositions[point * 3 + 2];
+			}
+
+			if (Inside(X, Y, Z, tetX, tetY, tetZ, epsilon)) {
+				cellLocations[globalID] = cellID;
+				return;
+			}
+		}
+	}
+}
@@ -0,0 +1,14 @@
+/**********************************************
+File		:	lcsMain.cpp
+Author		:	Mingcheng Chen
+Last Update	:	October 16th, 2012
+***********************************************/
+
+#include "lcsPipeline.h"
+
+int main(int argc, char **argv) {
+	// The configure file can be given in the command line.
+	lcs::RunPipeline(argc > 1 ? argv[1] : "RungeKutta4.conf");
+
+	return 0;
+}
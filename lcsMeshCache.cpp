@@ -0,0 +1,235 @@
+/**********************************************
+File		:	lcsMeshCache.cpp
+Author		:	Mingcheng Chen
+Last Update	:	October 16th, 2012
+***********************************************/
+
+#include "lcsMeshCache.h"
+#include "lcs.h"
+#include "lcsUtility.h"
+#include <vtkXMLUnstructuredGridReader.h>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace {
+
+const char cacheMagic[8] = {'L', 'C', 'S', 'M', 'E', 'S', 'H', 0};
+const long long alignment = 64;
+
+struct CacheHeader {
+	char magic[8];
+	int version;
+	int numOfPoints, numOfCells, numOfFrames;
+	long long connectivityOffset, linkOffset, positionOffset, timePointOffset, velocityOffset;
+	long long frameStride;
+	long long fileSize;
+};
+
+long long Align(long long offset) {
+	return (offset + alignment - 1) / alignment * alignment;
+}
+
+// Fill the offsets from the numbers of points, cells and frames.
+void ComputeLayout(CacheHeader &header) {
+	long long numOfPoints = header.numOfPoints, numOfCells = header.numOfCells;
+	header.connectivityOffset = Align(sizeof(CacheHeader));
+	header.linkOffset = Align(header.connectivityOffset + sizeof(int) * 4 * numOfCells);
+	header.positionOffset = Align(header.linkOffset + sizeof(int) * 4 * numOfCells);
+	header.timePointOffset = Align(header.positionOffset + sizeof(double) * 3 * numOfPoints);
+	header.velocityOffset = Align(header.timePointOffset + sizeof(double) * header.numOfFrames);
+	header.frameStride = Align(sizeof(double) * 3 * numOfPoints);
+	header.fileSize = header.velocityOffset + header.frameStride * header.numOfFrames;
+}
+
+void WriteBlock(FILE *fout, long long offset, const void *data, size_t size) {
+	if (fseek(fout, offset, SEEK_SET)) lcs::Error("Fail to seek in the mesh cache file");
+	if (fwrite(data, 1, size, fout) != size) lcs::Error("Fail to write the mesh cache file");
+}
+
+// Write everything but the velocities
+FILE *CreateCacheFile(const char *cacheFile, const lcs::TetrahedralGrid *grid, const double *timePoints, int numOfFrames,
+		      CacheHeader &header) {
+	memset(&header, 0, sizeof(CacheHeader));
+	memcpy(header.magic, cacheMagic, sizeof(cacheMagic));
+	header.version = lcs::MeshCache::VERSION;
+	header.numOfPoints = grid->GetNumOfVertices();
+	header.numOfCells = grid->GetNumOfCells();
+	header.numOfFrames = numOfFrames;
+	ComputeLayout(header);
+
+	FILE *fout = fopen(cacheFile, "wb");
+	if (fout == NULL) lcs::Error("Fail to create the mesh cache file");
+
+	WriteBlock(fout, 0, &header, sizeof(CacheHeader));
+
+	int *intArray = new int [header.numOfCells * 4];
+	grid->ReadConnectivities(intArray);
+	WriteBlock(fout, header.connectivityOffset, intArray, sizeof(int) * 4 * header.numOfCells);
+	grid->ReadLinks(intArray);
+	WriteBlock(fout, header.linkOffset, intArray, sizeof(int) * 4 * header.numOfCells);
+	delete [] intArray;
+
+	double *doubleArray = new double [header.numOfPoints * 3];
+	grid->ReadPositions(doubleArray);
+	WriteBlock(fout, header.positionOffset, doubleArray, sizeof(double) * 3 * header.numOfPoints);
+	delete [] doubleArray;
+
+	WriteBlock(fout, header.timePointOffset, timePoints, sizeof(double) * numOfFrames);
+
+	return fout;
+}
+
+void WriteFrame(FILE *fout, const CacheHeader &header, int frameIdx, const double *velocities) {
+	WriteBlock(fout, header.velocityOffset + header.frameStride * frameIdx, velocities, sizeof(double) * 3 * header.numOfPoints);
+}
+
+void CloseCacheFile(FILE *fout, const CacheHeader &header, const char *cacheFile) {
+	// Pad the last frame to the full stride
+	if (ftell(fout) < header.fileSize) {
+		char zero = 0;
+		WriteBlock(fout, header.fileSize - 1, &zero, 1);
+	}
+
+	fclose(fout);
+
+	printf("The mesh cache is written to %s.\n", cacheFile);
+	printf("\n");
+}
+
+}
+
+////////////////////////////////////////////////
+void lcs::MeshCache::Convert(const char *cacheFile,
+			     const std::vector<double> &timePoints, const std::vector<std::string> &dataFiles) {
+	int numOfFrames = dataFiles.size();
+	if (!numOfFrames) lcs::Error("There is no frame to convert");
+	if (timePoints.size() < dataFiles.size()) lcs::Error("Some frames do not have time points");
+
+	printf("Loading frame 0 (file = %s) ... ", dataFiles[0].c_str());
+	lcs::Frame firstFrame(timePoints[0], dataFiles[0].c_str());
+	printf("Done.\n");
+
+	const lcs::TetrahedralGrid *grid = firstFrame.GetTetrahedralGrid();
+
+	CacheHeader header;
+	FILE *fout = CreateCacheFile(cacheFile, grid, &timePoints[0], numOfFrames, header);
+
+	double *doubleArray = new double [header.numOfPoints * 3];
+
+	for (int i = 0; i < numOfFrames; i++) {
+		if (!i)
+			grid->ReadVelocities(doubleArray);
+		else {
+			vtkXMLUnstructuredGridReader *reader = vtkXMLUnstructuredGridReader::New();
+			reader->SetFileName(dataFiles[i].c_str());
+			reader->Update();
+			if (!grid->ReadVelocities(reader->GetOutput(), doubleArray))
+				lcs::Error("The topology of a frame is not the same as frame 0");
+			reader->Delete();
+		}
+		WriteFrame(fout, header, i, doubleArray);
+		printf("Frame %d (file = %s) is converted.\n", i, dataFiles[i].c_str());
+	}
+
+	delete [] doubleArray;
+
+	CloseCacheFile(fout, header, cacheFile);
+}
+
+void lcs::MeshCache::Write(const char *cacheFile, const lcs::TetrahedralGrid *grid,
+			   const std::vector<double> &timePoints, const double *velocities) {
+	int numOfFrames = timePoints.size();
+	if (!numOfFrames) lcs::Error("There is no frame to write");
+
+	CacheHeader header;
+	FILE *fout = CreateCacheFile(cacheFile, grid, &timePoints[0], numOfFrames, header);
+
+	for (int i = 0; i < numOfFrames; i++)
+		WriteFrame(fout, header, i, velocities + (long long)header.numOfPoints * 3 * i);
+
+	CloseCacheFile(fout, header, cacheFile);
+}
+
+lcs::MeshCache::MeshCache(const char *cacheFile) {
+	this->fileDescriptor = open(cacheFile, O_RDONLY);
+	if (this->fileDescriptor < 0) lcs::Error("Fail to open the mesh cache file");
+
+	struct stat status;
+	if (fstat(this->fileDescriptor, &status)) lcs::Error("Fail to get the size of the mesh cache file");
+	if (status.st_size < (long long)sizeof(CacheHeader)) lcs::Error("The mesh cache file is defective");
+	this->mappingSize = status.st_size;
+
+	void *mapping = mmap(NULL, this->mappingSize, PROT_READ, MAP_SHARED, this->fileDescriptor, 0);
+	if (mapping == MAP_FAILED) lcs::Error("Fail to map the mesh cache file");
+	this->mapping = (char *)mapping;
+
+	const CacheHeader *header = (const CacheHeader *)this->mapping;
+	if (memcmp(header->magic, cacheMagic, sizeof(cacheMagic))) lcs::Error("The file is not a mesh cache");
+	if (header->version != VERSION) lcs::Error("The version of the mesh cache file is not supported");
+
+	CacheHeader expected = *header;
+	ComputeLayout(expected);
+	if (memcmp(&expected, header, sizeof(CacheHeader)) || header->fileSize != this->mappingSize)
+		lcs::Error("The mesh cache file is defective");
+
+	this->numOfPoints = header->numOfPoints;
+	this->numOfCells = header->numOfCells;
+	this->numOfFrames = header->numOfFrames;
+
+	this->connectivities = (const int *)(this->mapping + header->connectivityOffset);
+	this->links = (const int *)(this->mapping + header->linkOffset);
+	this->positions = (const double *)(this->mapping + header->positionOffset);
+	this->timePoints = (const double *)(this->mapping + header->timePointOffset);
+	this->velocityOffset = header->velocityOffset;
+	this->frameStride = header->frameStride;
+}
+
+lcs::MeshCache::~MeshCache() {
+	munmap(this->mapping, this->mappingSize);
+	close(this->fileDescriptor);
+}
+
+int lcs::MeshCache::GetNumOfPoints() const {
+	return this->numOfPoints;
+}
+
+int lcs::MeshCache::GetNumOfCells() const {
+	return this->numOfCells;
+}
+
+int lcs::MeshCache::GetNumOfFrames() const {
+	return this->numOfFrames;
+}
+
+double lcs::MeshCache::GetTimePoint(int frameIdx) const {
+	return this->timePoints[frameIdx];
+}
+
+const int *lcs::MeshCache::GetConnectivities() const {
+	return this->connectivities;
+}
+
+const int *lcs::MeshCache::GetLinks() const {
+	return this->links;
+}
+
+const double *lcs::MeshCache::GetPositions() const {
+	return this->positions;
+}
+
+const double *lcs::MeshCache::GetVelocities(int frameIdx) const {
+	return (const double *)(this->mapping + this->velocityOffset + this->frameStride * frameIdx);
+}
+
+void lcs::MeshCache::Prefetch(int frameIdx) const {
+	if (frameIdx < 0 || frameIdx >= this->numOfFrames) return;
+
+	long long pageSize = sysconf(_SC_PAGESIZE);
+	long long begin = this->velocityOffset + this->frameStride * frameIdx;
+	long long alignedBegin = begin / pageSize * pageSize;
+	madvise(this->mapping + alignedBegin, begin + this->frameStride - alignedBegin, MADV_WILLNEED);
+}
@@ -0,0 +1,63 @@
+/**********************************************
+File		:	lcsMeshCache.h
+Author		:	Mingcheng Chen
+Last Update	:	October 16th, 2012
+***********************************************/
+
+#ifndef __LCS_MESH_CACHE_H
+#define __LCS_MESH_CACHE_H
+
+#include "lcsGeometry.h"
+#include <vector>
+#include <string>
+
+namespace lcs {
+
+////////////////////////////////////////////////
+// A binary cache of the mesh and all the frame velocities. After a versioned header, the file stores
+// tetrahedralConnectivities, tetrahedralLinks, vertex positions, time points and the velocities of
+// every frame as flat arrays in native byte order, each starting at a 64-byte aligned offset.
+// The file is mapped into memory and the arrays are used without copying.
+class MeshCache {
+public:
+	static const int VERSION = 1;
+
+	// Load the VTU frames and write them into a cache file.
+	static void Convert(const char *cacheFile,
+			    const std::vector<double> &timePoints, const std::vector<std::string> &dataFiles);
+
+	// Write a grid and the velocities of all the frames, 3 * (number of vertices) doubles per frame, into a cache file.
+	static void Write(const char *cacheFile, const lcs::TetrahedralGrid *grid,
+			  const std::vector<double> &timePoints, const double *velocities);
+
+	MeshCache(const char *cacheFile);
+	~MeshCache();
+
+	int GetNumOfPoints() const;
+	int GetNumOfCells() const;
+	int GetNumOfFrames() const;
+	double GetTimePoint(int frameIdx) const;
+
+	const int *GetConnectivities() const;
+	const int *GetLinks() const;
+	const double *GetPositions() const;
+	const double *GetVelocities(int frameIdx) const;
+
+	// Ask the kernel to read in the velocities of a frame ahead of use.
+	void Prefetch(int frameIdx) const;
+
+private:
+	int fileDescriptor;
+	char *mapping;
+	long long mappingSize;
+
+	int numOfPoints, numOfCells, numOfFrames;
+
+	const int *connectivities, *links;
+	const double *positions, *timePoints;
+	long long velocityOffset, frameStride;
+};
+
+}
+
+#endif
@@ -0,0 +1,38 @@
+/**********************************************
+File		:	lcsMeshCacheConverter.cpp
+Author		:	Mingcheng Chen
+Last Update	:	October 16th, 2012
+***********************************************/
+
+#include "lcsMeshCache.h"
+#include "lcsUtility.h"
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Usage: LCSMeshCacheConverter [configure file] [mesh cache file]
+// The frames are the ones in the configure file. The mesh cache file defaults to meshCacheFile in it.
+int main(int argc, char **argv) {
+	const char *configurationFile = argc > 1 ? argv[1] : "RungeKutta4.conf";
+
+	lcs::Configure configure(configurationFile);
+	printf("\n");
+
+	std::string meshCacheFile = argc > 2 ? argv[2] : configure.GetMeshCacheFile();
+	if (meshCacheFile == "") lcs::Error("No mesh cache file is given");
+
+	int numOfFrames = configure.GetNumOfFrames();
+
+	std::vector<double> timePoints(numOfFrames);
+	std::vector<std::string> dataFileNames(numOfFrames);
+
+	for (int i = 0; i < numOfFrames; i++) {
+		timePoints[i] = configure.GetTimePoints()[i];
+		dataFileNames[i] = configure.GetDataFilePrefix() + configure.GetDataFileIndices()[i] + 
+				   "." + configure.GetDataFileSuffix();
+	}
+
+	lcs::MeshCache::Convert(meshCacheFile.c_str(), timePoints, dataFileNames);
+
+	return 0;
+}
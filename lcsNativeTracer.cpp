@@ -0,0 +1,574 @@
+/**********************************************
+File		:	lcsNativeTracer.cpp
+Author		:	Mingcheng Chen
+Last Update	:	October 16th, 2012
+***********************************************/
+
+#include "lcsNativeTracer.h"
+#include "lcsParallel.h"
+#include "lcsUtility.h"
+#include "lcsTelemetry.h"
+#include <cstring>
+#include <algorithm>
+
+namespace {
+
+const int particleChunkSize = 4096;
+
+// Same walk as localFindCell() in the tracing kernels, on a block-local copy of the geometry.
+// The cached barycentric transforms of the grid are used when there are any.
+int LocalFindCell(const double *particle, const int *connectivities, const int *links,
+		  const double *vertexPositions, const double *transforms, const int *globalCellIDs,
+		  double epsilon, int guess, double *coordinates, int &numOfSteps) {
+	lcs::Vector point(particle);
+
+	numOfSteps = 0;
+	while (true) {
+		if (transforms)
+			lcs::ApplyBarycentricTransform(transforms + globalCellIDs[guess] * 12LL, point, coordinates);
+		else {
+			lcs::Vector tetVertices[4];
+			for (int i = 0; i < 4; i++) {
+				int pointID = connectivities[(guess << 2) | i];
+				tetVertices[i] = lcs::Vector(vertexPositions + pointID * 3);
+			}
+
+			lcs::Tetrahedron(tetVertices).CalculateNaturalCoordinates(point, coordinates);
+		}
+
+		int index = 0;
+		for (int i = 1; i < 4; i++)
+			if (coordinates[i] < coordinates[index]) index = i;
+		if (coordinates[index] >= -epsilon) break;
+
+		guess = links[(guess << 2) | index];
+		numOfSteps++;
+
+		if (guess == -1) break;
+	}
+
+	return guess;
+}
+
+class LocateParticlesTask : public lcs::ParallelTask {
+public:
+	LocateParticlesTask(lcs::NativeTracer *tracer) {
+		this->tracer = tracer;
+	}
+
+	void Run(int taskID, int) {
+		this->tracer->LocateParticles(taskID);
+	}
+
+private:
+	lcs::NativeTracer *tracer;
+};
+
+class BlockedTracingTask : public lcs::ParallelTask {
+public:
+	BlockedTracingTask(lcs::NativeTracer *tracer) {
+		this->tracer = tracer;
+	}
+
+	void Run(int taskID, int threadID) {
+		this->tracer->TraceBlock(taskID, threadID);
+	}
+
+private:
+	lcs::NativeTracer *tracer;
+};
+
+class CompareBlocksByPopulation {
+public:
+	CompareBlocksByPopulation(const int *numOfParticlesInBlocks) {
+		this->numOfParticlesInBlocks = numOfParticlesInBlocks;
+	}
+
+	bool operator () (int a, int b) const {
+		return this->numOfParticlesInBlocks[a] > this->numOfParticlesInBlocks[b];
+	}
+
+private:
+	const int *numOfParticlesInBlocks;
+};
+
+}
+
+////////////////////////////////////////////////
+lcs::NativeTracer::NativeTracer(const lcs::TetrahedralGrid *grid,
+				lcs::BlockRecord **blocks, int numOfInterestingBlocks,
+				const int *interestingBlockMap,
+				const int *startOffsetsInLocalIDMap, const int *blocksOfTets, const int *localIDsOfTets,
+				int numOfBlocksInX, int numOfBlocksInY, int numOfBlocksInZ,
+				double globalMinX, double globalMinY, double globalMinZ, double blockSize,
+				double timeStep, double epsilon) {
+	this->grid = grid;
+	this->blocks = blocks;
+	this->numOfInterestingBlocks = numOfInterestingBlocks;
+	this->interestingBlockMap = interestingBlockMap;
+	this->startOffsetsInLocalIDMap = startOffsetsInLocalIDMap;
+	this->blocksOfTets = blocksOfTets;
+	this->localIDsOfTets = localIDsOfTets;
+	this->numOfBlocksInX = numOfBlocksInX;
+	this->numOfBlocksInY = numOfBlocksInY;
+	this->numOfBlocksInZ = numOfBlocksInZ;
+	this->globalMinX = globalMinX;
+	this->globalMinY = globalMinY;
+	this->globalMinZ = globalMinZ;
+	this->blockSize = blockSize;
+	this->timeStep = timeStep;
+	this->epsilon = epsilon;
+
+	lcs::GetSortedCellsOfBlocks(blocks, numOfInterestingBlocks, this->startOffsetInCell, this->sortedCellIDs);
+	this->blockIndex.minX = globalMinX;
+	this->blockIndex.minY = globalMinY;
+	this->blockIndex.minZ = globalMinZ;
+	this->blockIndex.blockSize = blockSize;
+	this->blockIndex.numOfBlocksInX = numOfBlocksInX;
+	this->blockIndex.numOfBlocksInY = numOfBlocksInY;
+	this->blockIndex.numOfBlocksInZ = numOfBlocksInZ;
+	this->blockIndex.interestingBlockMap = interestingBlockMap;
+	this->blockIndex.startOffsetInCell = this->startOffsetInCell;
+	this->blockIndex.cellIDs = this->sortedCellIDs;
+
+	this->numOfParticles = 0;
+	this->stages = NULL;
+	this->lastPositions = NULL;
+	this->k1 = this->k2 = this->k3 = NULL;
+	this->pastTimes = NULL;
+	this->placesOfInterest = NULL;
+	this->exitCells = NULL;
+	this->localTetIDs = NULL;
+	this->blockLocations = NULL;
+	this->activeParticles = NULL;
+	this->blockedActiveParticles = NULL;
+
+	this->numOfActiveParticles = 0;
+	this->numOfActiveBlocks = 0;
+	this->activeBlocks = new int [numOfInterestingBlocks];
+	this->startOffsetInParticles = new int [numOfInterestingBlocks + 1];
+	this->numOfParticlesInBlocks = new int [numOfInterestingBlocks];
+	this->interestingBlockMarks = new int [numOfInterestingBlocks];
+	memset(this->interestingBlockMarks, 0, sizeof(int) * numOfInterestingBlocks);
+	this->markCount = 0;
+
+	this->maxLocalNumOfPoints = 0;
+	for (int i = 0; i < numOfInterestingBlocks; i++)
+		this->maxLocalNumOfPoints = std::max(this->maxLocalNumOfPoints, blocks[i]->GetLocalNumOfPoints());
+
+	this->numOfThreads = lcs::GetNumOfThreads();
+	this->localBlockData = new double * [this->numOfThreads];
+	for (int i = 0; i < this->numOfThreads; i++)
+		this->localBlockData[i] = new double [this->maxLocalNumOfPoints * 9];
+
+	this->numOfWalksInThreads = new long long [this->numOfThreads];
+	this->numOfStepsInThreads = new long long [this->numOfThreads];
+	this->maxNumOfStepsInThreads = new int [this->numOfThreads];
+	this->ResetWalkStatistics();
+
+	this->startVelocities = this->endVelocities = NULL;
+	this->startTime = this->endTime = 0;
+}
+
+lcs::NativeTracer::~NativeTracer() {
+	delete [] this->stages;
+	delete [] this->lastPositions;
+	delete [] this->k1;
+	delete [] this->k2;
+	delete [] this->k3;
+	delete [] this->pastTimes;
+	delete [] this->placesOfInterest;
+	delete [] this->exitCells;
+	delete [] this->localTetIDs;
+	delete [] this->blockLocations;
+	delete [] this->activeParticles;
+	delete [] this->blockedActiveParticles;
+
+	delete [] this->activeBlocks;
+	delete [] this->startOffsetInParticles;
+	delete [] this->numOfParticlesInBlocks;
+	delete [] this->interestingBlockMarks;
+
+	for (int i = 0; i < this->numOfThreads; i++)
+		delete [] this->localBlockData[i];
+	delete [] this->localBlockData;
+
+	delete [] this->numOfWalksInThreads;
+	delete [] this->numOfStepsInThreads;
+	delete [] this->maxNumOfStepsInThreads;
+
+	delete [] this->startOffsetInCell;
+	delete [] this->sortedCellIDs;
+}
+
+void lcs::NativeTracer::InitializeParticles(int numOfParticles, const double *initialPositions, const int *initialCells) {
+	this->numOfParticles = numOfParticles;
+
+	this->stages = new int [numOfParticles];
+	this->lastPositions = new double [numOfParticles * 3];
+	this->k1 = new double [numOfParticles * 3];
+	this->k2 = new double [numOfParticles * 3];
+	this->k3 = new double [numOfParticles * 3];
+	this->pastTimes = new double [numOfParticles];
+	this->placesOfInterest = new double [numOfParticles * 3];
+	this->exitCells = new int [numOfParticles];
+	this->localTetIDs = new int [numOfParticles];
+	this->blockLocations = new int [numOfParticles];
+	this->activeParticles = new int [numOfParticles];
+	this->blockedActiveParticles = new int [numOfParticles];
+
+	memset(this->stages, 0, sizeof(int) * numOfParticles);
+	memset(this->pastTimes, 0, sizeof(double) * numOfParticles);
+	memcpy(this->lastPositions, initialPositions, sizeof(double) * 3 * numOfParticles);
+	memcpy(this->placesOfInterest, initialPositions, sizeof(double) * 3 * numOfParticles);
+	memcpy(this->exitCells, initialCells, sizeof(int) * numOfParticles);
+}
+
+void lcs::NativeTracer::SetVelocities(const double *startVelocities, const double *endVelocities) {
+	this->startVelocities = startVelocities;
+	this->endVelocities = endVelocities;
+}
+
+int lcs::NativeTracer::GetNumOfParticles() const {
+	return this->numOfParticles;
+}
+
+const double *lcs::NativeTracer::GetLastPositions() const {
+	return this->lastPositions;
+}
+
+const int *lcs::NativeTracer::GetExitCells() const {
+	return this->exitCells;
+}
+
+const double *lcs::NativeTracer::GetPastTimes() const {
+	return this->pastTimes;
+}
+
+void lcs::NativeTracer::GetWalkStatistics(long long &numOfWalks, long long &numOfSteps, int &maxNumOfSteps) const {
+	numOfWalks = numOfSteps = 0;
+	maxNumOfSteps = 0;
+	for (int i = 0; i < this->numOfThreads; i++) {
+		numOfWalks += this->numOfWalksInThreads[i];
+		numOfSteps += this->numOfStepsInThreads[i];
+		maxNumOfSteps = std::max(maxNumOfSteps, this->maxNumOfStepsInThreads[i]);
+	}
+}
+
+void lcs::NativeTracer::ResetWalkStatistics() {
+	memset(this->numOfWalksInThreads, 0, sizeof(long long) * this->numOfThreads);
+	memset(this->numOfStepsInThreads, 0, sizeof(long long) * this->numOfThreads);
+	memset(this->maxNumOfStepsInThreads, 0, sizeof(int) * this->numOfThreads);
+}
+
+int lcs::NativeTracer::TraceInterval(double startTime, double endTime) {
+	this->startTime = startTime;
+	this->endTime = endTime;
+
+	// Collect active particles for the new interval
+	this->numOfActiveParticles = 0;
+	for (int i = 0; i < this->numOfParticles; i++) {
+		if (this->exitCells[i] < -1) this->exitCells[i] = -(this->exitCells[i] + 2);
+		if (this->exitCells[i] != -1) this->activeParticles[this->numOfActiveParticles++] = i;
+	}
+
+	int numOfRuns = 0;
+
+	LocateParticlesTask locateTask(this);
+	BlockedTracingTask tracingTask(this);
+
+	while (this->CollectActiveParticles()) {
+		numOfRuns++;
+
+		lcs::Telemetry::BeginPass();
+		lcs::Telemetry::RecordPass("activeParticles", this->numOfActiveParticles);
+
+		lcs::ParallelFor((this->numOfActiveParticles - 1) / particleChunkSize + 1, &locateTask);
+
+		this->RedistributeParticles();
+
+		lcs::Telemetry::RecordPass("activeBlocks", this->numOfActiveBlocks);
+
+		lcs::ParallelFor(this->numOfActiveBlocks, &tracingTask);
+	}
+
+	return numOfRuns;
+}
+
+int lcs::NativeTracer::CollectActiveParticles() {
+	int count = 0;
+	for (int i = 0; i < this->numOfActiveParticles; i++)
+		if (this->exitCells[this->activeParticles[i]] >= 0)
+			this->activeParticles[count++] = this->activeParticles[i];
+	return this->numOfActiveParticles = count;
+}
+
+int lcs::NativeTracer::GetLocalTetID(int blockID, int tetID) const {
+	for (int i = this->startOffsetsInLocalIDMap[tetID]; i < this->startOffsetsInLocalIDMap[tetID + 1]; i++)
+		if (this->blocksOfTets[i] == blockID) return this->localIDsOfTets[i];
+	return -1;
+}
+
+void lcs::NativeTracer::LocateParticles(int chunkID) {
+	int start = chunkID * particleChunkSize;
+	int finish = std::min(start + particleChunkSize, this->numOfActiveParticles);
+
+	for (int idx = start; idx < finish; idx++) {
+		int particleID = this->activeParticles[idx];
+		double posX = this->placesOfInterest[particleID * 3];
+		double posY = this->placesOfInterest[particleID * 3 + 1];
+		double posZ = this->placesOfInterest[particleID * 3 + 2];
+
+		int x = (int)((posX - this->globalMinX) / this->blockSize);
+		int y = (int)((posY - this->globalMinY) / this->blockSize);
+		int z = (int)((posZ - this->globalMinZ) / this->blockSize);
+
+		// Intuitive block ID
+		int blockID = (x * this->numOfBlocksInY + y) * this->numOfBlocksInZ + z;
+		int tetID = this->exitCells[particleID];
+
+		int localTetID = -1;
+		if (x >= 0 && y >= 0 && z >= 0 && x < this->numOfBlocksInX && y < this->numOfBlocksInY && z < this->numOfBlocksInZ)
+			localTetID = this->GetLocalTetID(blockID, tetID);
+
+		// Check the neighbors if the particle is on the boundary of the intuitive block
+		if (localTetID == -1) {
+			int dx[3], dy[3], dz[3];
+			int lx = 1, ly = 1, lz = 1;
+			dx[0] = dy[0] = dz[0] = 0;
+
+			double xLower = this->globalMinX + x * this->blockSize;
+			double yLower = this->globalMinY + y * this->blockSize;
+			double zLower = this->globalMinZ + z * this->blockSize;
+
+			if (!Sign(xLower - posX, 2 * this->epsilon)) dx[lx++] = -1;
+			if (!Sign(yLower - posY, 2 * this->epsilon)) dy[ly++] = -1;
+			if (!Sign(zLower - posZ, 2 * this->epsilon)) dz[lz++] = -1;
+
+			if (!Sign(xLower + this->blockSize - posX, 2 * this->epsilon)) dx[lx++] = 1;
+			if (!Sign(yLower + this->blockSize - posY, 2 * this->epsilon)) dy[ly++] = 1;
+			if (!Sign(zLower + this->blockSize - posZ, 2 * this->epsilon)) dz[lz++] = 1;
+
+			for (int i = 0; localTetID == -1 && i < lx; i++)
+				for (int j = 0; localTetID == -1 && j < ly; j++)
+					for (int k = 0; localTetID == -1 && k < lz; k++) {
+						if (i + j + k == 0) continue;
+						int _x = x + dx[i];
+						int _y = y + dy[j];
+						int _z = z + dz[k];
+
+						if (_x < 0 || _y < 0 || _z < 0 ||
+						    _x >= this->numOfBlocksInX || _y >= this->numOfBlocksInY || _z >= this->numOfBlocksInZ)
+							continue;
+
+						blockID = (_x * this->numOfBlocksInY + _y) * this->numOfBlocksInZ + _z;
+						localTetID = this->GetLocalTetID(blockID, tetID);
+					}
+		}
+
+		// Any block intersecting the cell is a valid place to restart the walk.
+		if (localTetID == -1) {
+			int offset = this->startOffsetsInLocalIDMap[tetID];
+			blockID = this->blocksOfTets[offset];
+			localTetID = this->localIDsOfTets[offset];
+		}
+
+		this->localTetIDs[particleID] = localTetID;
+		this->blockLocations[particleID] = this->interestingBlockMap[blockID];
+	}
+}
+
+int lcs::NativeTracer::RedistributeParticles() {
+	// Count particles in blocks and collect active blocks
+	this->markCount++;
+	this->numOfActiveBlocks = 0;
+	for (int i = 0; i < this->numOfActiveParticles; i++) {
+		int interestingBlockID = this->blockLocations[this->activeParticles[i]];
+		if (this->interestingBlockMarks[interestingBlockID] != this->markCount) {
+			this->interestingBlockMarks[interestingBlockID] = this->markCount;
+			this->numOfParticlesInBlocks[interestingBlockID] = 0;
+			this->activeBlocks[this->numOfActiveBlocks++] = interestingBlockID;
+		}
+		this->numOfParticlesInBlocks[interestingBlockID]++;
+	}
+
+	// Crowded blocks go first so that the tail of the parallel loop consists of small blocks.
+	std::sort(this->activeBlocks, this->activeBlocks + this->numOfActiveBlocks,
+		  CompareBlocksByPopulation(this->numOfParticlesInBlocks));
+
+	// Reuse numOfParticlesInBlocks as the tops of blocks
+	int offset = 0;
+	for (int i = 0; i < this->numOfActiveBlocks; i++) {
+		int interestingBlockID = this->activeBlocks[i];
+		this->startOffsetInParticles[i] = offset;
+		offset += this->numOfParticlesInBlocks[interestingBlockID];
+		this->numOfParticlesInBlocks[interestingBlockID] = this->startOffsetInParticles[i];
+	}
+	this->startOffsetInParticles[this->numOfActiveBlocks] = offset;
+
+	for (int i = 0; i < this->numOfActiveParticles; i++) {
+		int particleID = this->activeParticles[i];
+		this->blockedActiveParticles[this->numOfParticlesInBlocks[this->blockLocations[particleID]]++] = particleID;
+	}
+
+	return this->numOfActiveBlocks;
+}
+
+void lcs::NativeTracer::TraceBlock(int activeBlockID, int threadID) {
+	int interestingBlockID = this->activeBlocks[activeBlockID];
+	const lcs::BlockRecord *block = this->blocks[interestingBlockID];
+
+	int numOfPoints = block->GetLocalNumOfPoints();
+	const int *globalPointIDs = block->GetGlobalPointIDs();
+	const int *globalCellIDs = block->GetGlobalCellIDs();
+	const int *connectivities = block->GetLocalConnectivities();
+	const int *links = block->GetLocalLinks();
+	const double *transforms = this->grid->GetBarycentricTransforms();
+
+	// Fill in the local copy of the block
+	double *vertexPositions = this->localBlockData[threadID];
+	double *startVelocities = vertexPositions + numOfPoints * 3;
+	double *endVelocities = startVelocities + numOfPoints * 3;
+
+	for (int i = 0; i < numOfPoints; i++) {
+		int globalPointID = globalPointIDs[i];
+		lcs::Vector point = this->grid->GetVertex(globalPointID);
+		vertexPositions[i * 3] = point.GetX();
+		vertexPositions[i * 3 + 1] = point.GetY();
+		vertexPositions[i * 3 + 2] = point.GetZ();
+		for (int j = 0; j < 3; j++) {
+			startVelocities[i * 3 + j] = this->startVelocities[globalPointID * 3 + j];
+			endVelocities[i * 3 + j] = this->endVelocities[globalPointID * 3 + j];
+		}
+	}
+
+	double startTime = this->startTime, endTime = this->endTime;
+	double timeStep = this->timeStep, epsilon = this->epsilon;
+
+	long long numOfWalks = 0, numOfSteps = 0;
+	int maxNumOfSteps = 0;
+
+	for (int arrayIdx = this->startOffsetInParticles[activeBlockID];
+	     arrayIdx < this->startOffsetInParticles[activeBlockID + 1]; arrayIdx++) {
+		int activeParticleID = this->blockedActiveParticles[arrayIdx];
+
+		// Initialize the particle status
+		int currStage = this->stages[activeParticleID];
+		int currCell = this->localTetIDs[activeParticleID];
+
+		double currTime = this->pastTimes[activeParticleID];
+
+		double *currLastPosition = this->lastPositions + activeParticleID * 3;
+		double *currK1 = this->k1 + activeParticleID * 3;
+		double *currK2 = this->k2 + activeParticleID * 3;
+		double *currK3 = this->k3 + activeParticleID * 3;
+		double currK4[3];
+
+		// At least one loop is executed.
+		while (true) {
+			double placeOfInterest[3];
+			placeOfInterest[0] = currLastPosition[0];
+			placeOfInterest[1] = currLastPosition[1];
+			placeOfInterest[2] = currLastPosition[2];
+			switch (currStage) {
+			case 1: {
+				placeOfInterest[0] += 0.5 * currK1[0];
+				placeOfInterest[1] += 0.5 * currK1[1];
+				placeOfInterest[2] += 0.5 * currK1[2];
+			} break;
+			case 2: {
+				placeOfInterest[0] += 0.5 * currK2[0];
+				placeOfInterest[1] += 0.5 * currK2[1];
+				placeOfInterest[2] += 0.5 * currK2[2];
+			} break;
+			case 3: {
+				placeOfInterest[0] += currK3[0];
+				placeOfInterest[1] += currK3[1];
+				placeOfInterest[2] += currK3[2];
+			} break;
+			}
+
+			double coordinates[4];
+
+			int walkLength;
+			int nextCell = LocalFindCell(placeOfInterest, connectivities, links,
+						     vertexPositions, transforms, globalCellIDs,
+						     epsilon, currCell, coordinates, walkLength);
+
+			numOfWalks++;
+			numOfSteps += walkLength;
+			maxNumOfSteps = std::max(maxNumOfSteps, walkLength);
+
+			if (nextCell == -1 || currTime >= endTime) {
+				// Find the next cell globally
+				int globalCellID = globalCellIDs[currCell];
+				int nextGlobalCell;
+
+				if (nextCell != -1)
+					nextGlobalCell = globalCellIDs[nextCell];
+				else {
+					nextGlobalCell = this->grid->FindCell(lcs::Vector(placeOfInterest), epsilon, globalCellID);
+					if (nextGlobalCell == -1 && this->grid->HasVertexIncidence())
+						nextGlobalCell = this->grid->FindCellInVertexStars(lcs::Vector(placeOfInterest), epsilon,
+												   globalCellID);
+					if (nextGlobalCell == -1)
+						nextGlobalCell = lcs::FindCellInBlock(this->grid, this->blockIndex,
+										      lcs::Vector(placeOfInterest), epsilon);
+				}
+
+				if (currTime >= endTime && nextGlobalCell != -1) nextGlobalCell = -2 - nextGlobalCell;
+
+				this->pastTimes[activeParticleID] = currTime;
+				this->stages[activeParticleID] = currStage;
+
+				this->placesOfInterest[activeParticleID * 3] = placeOfInterest[0];
+				this->placesOfInterest[activeParticleID * 3 + 1] = placeOfInterest[1];
+				this->placesOfInterest[activeParticleID * 3 + 2] = placeOfInterest[2];
+
+				this->exitCells[activeParticleID] = nextGlobalCell;
+				break;
+			}
+
+			currCell = nextCell;
+
+			double alpha = (endTime - currTime) / (endTime - startTime);
+			double beta = 1 - alpha;
+
+			double *currK = NULL;
+			switch (currStage) {
+			case 0: currK = currK1; break;
+			case 1: currK = currK2; break;
+			case 2: currK = currK3; break;
+			case 3: currK = currK4; break;
+			default: lcs::Error("The RK4 stage of a particle should be in [0, 3]");
+			}
+
+			currK[0] = currK[1] = currK[2] = 0;
+
+			for (int i = 0; i < 4; i++) {
+				int pointID = connectivities[(nextCell << 2) | i];
+				for (int j = 0; j < 3; j++)
+					currK[j] += (startVelocities[pointID * 3 + j] * alpha + endVelocities[pointID * 3 + j] * beta) *
+						    coordinates[i];
+			}
+
+			currK[0] *= timeStep;
+			currK[1] *= timeStep;
+			currK[2] *= timeStep;
+
+			if (currStage == 3) {
+				currTime += timeStep;
+
+				for (int i = 0; i < 3; i++)
+					currLastPosition[i] += (currK1[i] + 2 * currK2[i] + 2 * currK3[i] + currK4[i]) / 6;
+
+				currStage = 0;
+			} else
+				currStage++;
+		}
+	}
+
+	this->numOfWalksInThreads[threadID] += numOfWalks;
+	this->numOfStepsInThreads[threadID] += numOfSteps;
+	this->maxNumOfStepsInThreads[threadID] = std::max(this->maxNumOfStepsInThreads[threadID], maxNumOfSteps);
+}
@@ -0,0 +1,105 @@
+/**********************************************
+File		:	lcsNativeTracer.h
+Author		:	Mingcheng Chen
+Last Update	:	October 16th, 2012
+***********************************************/
+
+#ifndef __LCS_NATIVE_TRACER_H
+#define __LCS_NATIVE_TRACER_H
+
+#include "lcs.h"
+#include "lcsGeometry.h"
+#include "lcsCellLocation.h"
+
+namespace lcs {
+
+////////////////////////////////////////////////
+// The CPU counterpart of the blocked tracing kernels. Active particles are redistributed into
+// interesting blocks in every run, and the blocks are traced by a thread pool with work stealing.
+class NativeTracer {
+public:
+	NativeTracer(const lcs::TetrahedralGrid *grid,
+		     lcs::BlockRecord **blocks, int numOfInterestingBlocks,
+		     const int *interestingBlockMap,
+		     const int *startOffsetsInLocalIDMap, const int *blocksOfTets, const int *localIDsOfTets,
+		     int numOfBlocksInX, int numOfBlocksInY, int numOfBlocksInZ,
+		     double globalMinX, double globalMinY, double globalMinZ, double blockSize,
+		     double timeStep, double epsilon);
+	~NativeTracer();
+
+	void InitializeParticles(int numOfParticles, const double *initialPositions, const int *initialCells);
+
+	// Velocities are arrays of 3 * (number of grid points) doubles and are not copied.
+	void SetVelocities(const double *startVelocities, const double *endVelocities);
+
+	// Returns the number of tracing runs in the interval.
+	int TraceInterval(double startTime, double endTime);
+
+	int GetNumOfParticles() const;
+	const double *GetLastPositions() const;
+	const int *GetExitCells() const;
+	const double *GetPastTimes() const;
+
+	// Lengths of the cell walks inside blocks since the last reset
+	void GetWalkStatistics(long long &numOfWalks, long long &numOfSteps, int &maxNumOfSteps) const;
+	void ResetWalkStatistics();
+
+	// Called by the worker threads
+	void LocateParticles(int chunkID);
+	void TraceBlock(int activeBlockID, int threadID);
+
+private:
+	int CollectActiveParticles();
+	int RedistributeParticles();
+	int GetLocalTetID(int blockID, int tetID) const;
+
+	const lcs::TetrahedralGrid *grid;
+	lcs::BlockRecord **blocks;
+	int numOfInterestingBlocks;
+	const int *interestingBlockMap;
+	const int *startOffsetsInLocalIDMap, *blocksOfTets, *localIDsOfTets;
+	int numOfBlocksInX, numOfBlocksInY, numOfBlocksInZ;
+	double globalMinX, globalMinY, globalMinZ, blockSize;
+	double timeStep, epsilon;
+
+	// Locates the particles whose walks leave the mesh at concave boundaries
+	lcs::BlockIndex blockIndex;
+	int *startOffsetInCell, *sortedCellIDs;
+
+	// Particle status, indexed by initial active particle ID
+	int numOfParticles;
+	int *stages;
+	double *lastPositions;
+	double *k1, *k2, *k3;
+	double *pastTimes;
+	double *placesOfInterest;
+	int *exitCells;
+	int *localTetIDs;
+	int *blockLocations;
+
+	// Work arrays of a tracing run
+	int numOfActiveParticles, numOfActiveBlocks;
+	int *activeParticles;
+	int *blockedActiveParticles;
+	int *activeBlocks;
+	int *startOffsetInParticles;
+	int *numOfParticlesInBlocks;
+	int *interestingBlockMarks;
+	int markCount;
+
+	// Per-thread copies of block geometry and velocities, like the shared memory of a work group
+	int numOfThreads;
+	int maxLocalNumOfPoints;
+	double **localBlockData;
+
+	// Per-thread walk statistics
+	long long *numOfWalksInThreads, *numOfStepsInThreads;
+	int *maxNumOfStepsInThreads;
+
+	const double *startVelocities, *endVelocities;
+	double startTime, endTime;
+};
+
+}
+
+#endif
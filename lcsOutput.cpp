@@ -0,0 +1,328 @@
+/**********************************************
+File		:	lcsOutput.cpp
+Author		:	Mingcheng Chen
+Last Update	:	October 16th, 2012
+***********************************************/
+
+#include "lcsOutput.h"
+#include "lcsUtility.h"
+#include "lcsParallel.h"
+#include <vtkImageData.h>
+#include <vtkPointData.h>
+#include <vtkDoubleArray.h>
+#include <vtkUnsignedCharArray.h>
+#include <vtkXMLImageDataWriter.h>
+#include <zlib.h>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <algorithm>
+
+namespace {
+
+const char positionMagic[8] = {'L', 'C', 'S', 'P', 'O', 'S', 0, 0};
+const long long chunkSize = 1 << 22;
+const int bufferSize = 1 << 22;
+
+bool IsLittleEndian() {
+	int one = 1;
+	return *(char *)&one == 1;
+}
+
+void SwapBytes(void *data, int sizeOfElement, long long numOfElements) {
+	char *bytes = (char *)data;
+	for (long long i = 0; i < numOfElements; i++, bytes += sizeOfElement)
+		for (int j = 0; j < sizeOfElement / 2; j++) {
+			char temp = bytes[j];
+			bytes[j] = bytes[sizeOfElement - 1 - j];
+			bytes[sizeOfElement - 1 - j] = temp;
+		}
+}
+
+void WriteArray(FILE *fout, const void *data, size_t size) {
+	if (size && fwrite(data, 1, size, fout) != size) lcs::Error("Fail to write the final positions");
+}
+
+int GetStatus(int exitCell) {
+	return exitCell == -1 ? lcs::FinalPositionHeader::LEFT_DOMAIN : lcs::FinalPositionHeader::IN_DOMAIN;
+}
+
+class CompressionTask : public lcs::ParallelTask {
+public:
+	void Run(int chunkID, int) {
+		long long begin = chunkID * chunkSize;
+		uLong sourceSize = std::min(chunkSize, payloadSize - begin);
+		uLongf destinationSize = compressBound(sourceSize);
+		compressedChunks[chunkID] = new char [destinationSize];
+		if (compress2((Bytef *)compressedChunks[chunkID], &destinationSize,
+			      (const Bytef *)(payload + begin), sourceSize, Z_DEFAULT_COMPRESSION) != Z_OK)
+			lcs::Error("Fail to compress the final positions");
+		compressedSizes[chunkID] = destinationSize;
+	}
+
+	const char *payload;
+	long long payloadSize;
+	char **compressedChunks;
+	long long *compressedSizes;
+};
+
+// Compress the payload in chunks of chunkSize bytes in parallel. The chunks are allocated with new [].
+int CompressInChunks(const char *payload, long long payloadSize, char **&compressedChunks, long long *&compressedSizes) {
+	int numOfChunks = (payloadSize + chunkSize - 1) / chunkSize;
+
+	CompressionTask task;
+	task.payload = payload;
+	task.payloadSize = payloadSize;
+	task.compressedChunks = compressedChunks = new char * [std::max(numOfChunks, 1)];
+	task.compressedSizes = compressedSizes = new long long [std::max(numOfChunks, 1)];
+
+	lcs::ParallelFor(numOfChunks, &task);
+
+	return numOfChunks;
+}
+
+// An array of the appended data of a VTK XML file, compressed in the layout of vtkZLibDataCompressor with UInt32
+// headers: the number of blocks, the uncompressed block size, the uncompressed size of a partial last block (0 if
+// there is none) and the compressed size of every block, followed by the blocks.
+struct CompressedVTKArray {
+	CompressedVTKArray(const char *data, long long size) {
+		this->size = size;
+		this->numOfChunks = CompressInChunks(data, size, this->compressedChunks, this->compressedSizes);
+	}
+
+	~CompressedVTKArray() {
+		for (int i = 0; i < this->numOfChunks; i++)
+			delete [] this->compressedChunks[i];
+		delete [] this->compressedChunks;
+		delete [] this->compressedSizes;
+	}
+
+	long long GetNumOfBytes() const {
+		long long numOfBytes = sizeof(unsigned int) * (this->numOfChunks + 3);
+		for (int i = 0; i < this->numOfChunks; i++)
+			numOfBytes += this->compressedSizes[i];
+		return numOfBytes;
+	}
+
+	void Write(FILE *fout) const {
+		unsigned int *header = new unsigned int [this->numOfChunks + 3];
+		header[0] = this->numOfChunks;
+		header[1] = chunkSize;
+		header[2] = this->size % chunkSize;
+		for (int i = 0; i < this->numOfChunks; i++)
+			header[i + 3] = this->compressedSizes[i];
+		WriteArray(fout, header, sizeof(unsigned int) * (this->numOfChunks + 3));
+		delete [] header;
+
+		for (int i = 0; i < this->numOfChunks; i++)
+			WriteArray(fout, this->compressedChunks[i], this->compressedSizes[i]);
+	}
+
+	long long size;
+	int numOfChunks;
+	char **compressedChunks;
+	long long *compressedSizes;
+};
+
+// vtkZLibDataCompressor compresses on a single thread, so the compressed image is written here instead of by
+// vtkXMLImageDataWriter, with the blocks of both arrays compressed in parallel. The arrays are in the native byte order.
+void WriteCompressedImage(const char *fileName, int xRes, int yRes, int zRes,
+			  const double *origin, const double *spacing,
+			  const double *gridPositions, const unsigned char *status) {
+	long long numOfGridPoints = (long long)(xRes + 1) * (yRes + 1) * (zRes + 1);
+
+	CompressedVTKArray positionArray((const char *)gridPositions, numOfGridPoints * sizeof(double) * 3);
+	CompressedVTKArray statusArray((const char *)status, numOfGridPoints);
+
+	FILE *fout = fopen(fileName, "wb");
+	if (fout == NULL) lcs::Error("Fail to create the final position file");
+	setvbuf(fout, NULL, _IOFBF, bufferSize);
+
+	fprintf(fout, "<?xml version=\"1.0\"?>\n");
+	fprintf(fout, "<VTKFile type=\"ImageData\" version=\"0.1\" byte_order=\"%s\" compressor=\"vtkZLibDataCompressor\">\n",
+		IsLittleEndian() ? "LittleEndian" : "BigEndian");
+	fprintf(fout, "  <ImageData WholeExtent=\"0 %d 0 %d 0 %d\" Origin=\"%.17g %.17g %.17g\" Spacing=\"%.17g %.17g %.17g\">\n",
+		xRes, yRes, zRes, origin[0], origin[1], origin[2], spacing[0], spacing[1], spacing[2]);
+	fprintf(fout, "    <Piece Extent=\"0 %d 0 %d 0 %d\">\n", xRes, yRes, zRes);
+	fprintf(fout, "      <PointData Vectors=\"FinalPosition\">\n");
+	fprintf(fout, "        <DataArray type=\"Float64\" Name=\"FinalPosition\" NumberOfComponents=\"3\" format=\"appended\" offset=\"0\"/>\n");
+	fprintf(fout, "        <DataArray type=\"UInt8\" Name=\"Status\" format=\"appended\" offset=\"%lld\"/>\n",
+		positionArray.GetNumOfBytes());
+	fprintf(fout, "      </PointData>\n");
+	fprintf(fout, "      <CellData>\n");
+	fprintf(fout, "      </CellData>\n");
+	fprintf(fout, "    </Piece>\n");
+	fprintf(fout, "  </ImageData>\n");
+	fprintf(fout, "  <AppendedData encoding=\"raw\">\n");
+	fprintf(fout, "   _");
+
+	positionArray.Write(fout);
+	statusArray.Write(fout);
+
+	fprintf(fout, "\n  </AppendedData>\n");
+	fprintf(fout, "</VTKFile>\n");
+
+	fclose(fout);
+}
+
+}
+
+////////////////////////////////////////////////
+void lcs::WriteFinalPositionsInText(const char *fileName, int, int yRes, int zRes,
+				    int numOfParticles, const int *gridPointIDs, const double *positions) {
+	FILE *fout = fopen(fileName, "w");
+	if (fout == NULL) lcs::Error("Fail to create the final position file");
+	setvbuf(fout, NULL, _IOFBF, bufferSize);
+
+	for (int i = 0; i < numOfParticles; i++) {
+		int z = gridPointIDs[i] % (zRes + 1);
+		int temp = gridPointIDs[i] / (zRes + 1);
+		int y = temp % (yRes + 1);
+		int x = temp / (yRes + 1);
+		fprintf(fout, "%d %d %d: %lf %lf %lf\n", x, y, z, positions[i * 3], positions[i * 3 + 1], positions[i * 3 + 2]);
+	}
+
+	fclose(fout);
+}
+
+void lcs::WriteFinalPositionsInBinary(const char *fileName, int xRes, int yRes, int zRes,
+				      const double *origin, const double *spacing,
+				      int numOfParticles, const int *gridPointIDs, const double *positions, const int *exitCells,
+				      bool compression) {
+	long long numOfGridPoints = (long long)(xRes + 1) * (yRes + 1) * (zRes + 1);
+
+	// The payload is the positions followed by the status of all the grid points.
+	long long payloadSize = numOfGridPoints * (sizeof(double) * 3 + 1);
+	char *payload = new char [payloadSize];
+
+	double *gridPositions = (double *)payload;
+	unsigned char *status = (unsigned char *)(payload + numOfGridPoints * sizeof(double) * 3);
+
+	std::fill(gridPositions, gridPositions + numOfGridPoints * 3, std::numeric_limits<double>::quiet_NaN());
+	memset(status, FinalPositionHeader::NOT_SEEDED, numOfGridPoints);
+
+	for (int i = 0; i < numOfParticles; i++) {
+		memcpy(gridPositions + gridPointIDs[i] * 3LL, positions + i * 3, sizeof(double) * 3);
+		status[gridPointIDs[i]] = GetStatus(exitCells[i]);
+	}
+
+	FinalPositionHeader header;
+	memset(&header, 0, sizeof(FinalPositionHeader));
+	memcpy(header.magic, positionMagic, sizeof(positionMagic));
+	header.version = FinalPositionHeader::VERSION;
+	header.compression = compression;
+	header.xRes = xRes;
+	header.yRes = yRes;
+	header.zRes = zRes;
+	header.numOfChunks = compression ? (payloadSize + chunkSize - 1) / chunkSize : 0;
+	header.chunkSize = chunkSize;
+	header.payloadSize = payloadSize;
+	for (int i = 0; i < 3; i++) {
+		header.origin[i] = origin[i];
+		header.spacing[i] = spacing[i];
+	}
+
+	if (!IsLittleEndian()) {
+		SwapBytes(gridPositions, sizeof(double), numOfGridPoints * 3);
+		SwapBytes(&header.version, sizeof(int), 6);
+		SwapBytes(&header.chunkSize, sizeof(long long), 2);
+		SwapBytes(header.origin, sizeof(double), 6);
+	}
+
+	FILE *fout = fopen(fileName, "wb");
+	if (fout == NULL) lcs::Error("Fail to create the final position file");
+
+	WriteArray(fout, &header, sizeof(FinalPositionHeader));
+
+	if (!compression)
+		WriteArray(fout, payload, payloadSize);
+	else {
+		char **compressedChunks;
+		long long *compressedSizes;
+		int numOfChunks = CompressInChunks(payload, payloadSize, compressedChunks, compressedSizes);
+
+		long long *sizeTable = new long long [numOfChunks];
+		memcpy(sizeTable, compressedSizes, sizeof(long long) * numOfChunks);
+		if (!IsLittleEndian()) SwapBytes(sizeTable, sizeof(long long), numOfChunks);
+		WriteArray(fout, sizeTable, sizeof(long long) * numOfChunks);
+		delete [] sizeTable;
+
+		for (int i = 0; i < numOfChunks; i++) {
+			WriteArray(fout, compressedChunks[i], compressedSizes[i]);
+			delete [] compressedChunks[i];
+		}
+
+		delete [] compressedChunks;
+		delete [] compressedSizes;
+	}
+
+	fclose(fout);
+
+	delete [] payload;
+}
+
+void lcs::WriteFinalPositionsInVTK(const char *fileName, int xRes, int yRes, int zRes,
+				   const double *origin, const double *spacing,
+				   int numOfParticles, const int *gridPointIDs, const double *positions, const int *exitCells,
+				   bool compression) {
+	long long numOfGridPoints = (long long)(xRes + 1) * (yRes + 1) * (zRes + 1);
+
+	double *gridPositions = new double [numOfGridPoints * 3];
+	unsigned char *status = new unsigned char [numOfGridPoints];
+
+	std::fill(gridPositions, gridPositions + numOfGridPoints * 3, std::numeric_limits<double>::quiet_NaN());
+	memset(status, FinalPositionHeader::NOT_SEEDED, numOfGridPoints);
+
+	// The points of an image vary fastest in x.
+	for (int i = 0; i < numOfParticles; i++) {
+		int z = gridPointIDs[i] % (zRes + 1);
+		int temp = gridPointIDs[i] / (zRes + 1);
+		int y = temp % (yRes + 1);
+		int x = temp / (yRes + 1);
+		long long imagePointID = ((long long)z * (yRes + 1) + y) * (xRes + 1) + x;
+		memcpy(gridPositions + imagePointID * 3, positions + i * 3, sizeof(double) * 3);
+		status[imagePointID] = GetStatus(exitCells[i]);
+	}
+
+	if (compression) {
+		WriteCompressedImage(fileName, xRes, yRes, zRes, origin, spacing, gridPositions, status);
+		delete [] gridPositions;
+		delete [] status;
+		return;
+	}
+
+	vtkDoubleArray *positionArray = vtkDoubleArray::New();
+	positionArray->SetName("FinalPosition");
+	positionArray->SetNumberOfComponents(3);
+	positionArray->SetArray(gridPositions, numOfGridPoints * 3, 1);
+
+	vtkUnsignedCharArray *statusArray = vtkUnsignedCharArray::New();
+	statusArray->SetName("Status");
+	statusArray->SetNumberOfComponents(1);
+	statusArray->SetArray(status, numOfGridPoints, 1);
+
+	vtkImageData *image = vtkImageData::New();
+	image->SetDimensions(xRes + 1, yRes + 1, zRes + 1);
+	image->SetOrigin(origin[0], origin[1], origin[2]);
+	image->SetSpacing(spacing[0], spacing[1], spacing[2]);
+	image->GetPointData()->SetVectors(positionArray);
+	image->GetPointData()->AddArray(statusArray);
+
+	// Raw appended data is written in bulk instead of base64.
+	vtkXMLImageDataWriter *writer = vtkXMLImageDataWriter::New();
+	writer->SetFileName(fileName);
+	writer->SetInput(image);
+	writer->SetDataModeToAppended();
+	writer->EncodeAppendedDataOff();
+	writer->SetCompressor(NULL);
+
+	if (!writer->Write()) lcs::Error("Fail to write the final positions");
+
+	writer->Delete();
+	image->Delete();
+	positionArray->Delete();
+	statusArray->Delete();
+
+	delete [] gridPositions;
+	delete [] status;
+}
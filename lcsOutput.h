@@ -0,0 +1,56 @@
+/**********************************************
+File		:	lcsOutput.h
+Author		:	Mingcheng Chen
+Last Update	:	October 16th, 2012
+***********************************************/
+
+#ifndef __LCS_OUTPUT_H
+#define __LCS_OUTPUT_H
+
+namespace lcs {
+
+////////////////////////////////////////////////
+// Writers of the final positions of the particles seeded on the grid of (xRes + 1) * (yRes + 1) * (zRes + 1)
+// points (z varies fastest). gridPointIDs, positions and exitCells are per particle.
+
+// One "x y z: px py pz" line per particle
+void WriteFinalPositionsInText(const char *fileName, int xRes, int yRes, int zRes,
+			       int numOfParticles, const int *gridPointIDs, const double *positions);
+
+// A little-endian binary file of a FinalPositionHeader followed by the final positions (3 doubles per grid point,
+// NaN if not seeded) and the status of every grid point (one byte, see FinalPositionHeader). With compression,
+// the payload is split into chunks which are compressed in parallel with zlib, and the compressed sizes
+// (8-byte integers) precede the chunks.
+void WriteFinalPositionsInBinary(const char *fileName, int xRes, int yRes, int zRes,
+				 const double *origin, const double *spacing,
+				 int numOfParticles, const int *gridPointIDs, const double *positions, const int *exitCells,
+				 bool compression);
+
+// A VTK image (.vti) aligned with the seeding grid, with the point arrays "FinalPosition" and "Status"
+// With compression, the zlib blocks of the appended data are compressed in parallel.
+void WriteFinalPositionsInVTK(const char *fileName, int xRes, int yRes, int zRes,
+			      const double *origin, const double *spacing,
+			      int numOfParticles, const int *gridPointIDs, const double *positions, const int *exitCells,
+			      bool compression);
+
+struct FinalPositionHeader {
+	static const int VERSION = 1;
+
+	// Status of grid points
+	static const int NOT_SEEDED = 0;
+	static const int IN_DOMAIN = 1;
+	static const int LEFT_DOMAIN = 2;
+
+	char magic[8];				// "LCSPOS"
+	int version;
+	int compression;			// 0 or 1
+	int xRes, yRes, zRes;
+	int numOfChunks;			// 0 if not compressed
+	long long chunkSize;			// Uncompressed bytes per chunk
+	long long payloadSize;			// Uncompressed bytes of positions and status
+	double origin[3], spacing[3];
+};
+
+}
+
+#endif
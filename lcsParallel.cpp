@@ -0,0 +1,208 @@
+/**********************************************
+File		:	lcsParallel.cpp
+Author		:	Mingcheng Chen
+Last Update	:	October 16th, 2012
+***********************************************/
+
+#include "lcsParallel.h"
+#include "lcsUtility.h"
+#include <pthread.h>
+#include <unistd.h>
+
+namespace {
+
+struct TaskRange {
+	pthread_mutex_t lock;
+	int begin, end;
+};
+
+int numOfThreads = 0;
+bool poolIsReady = false;
+
+pthread_t *workers = NULL;
+TaskRange *ranges = NULL;
+
+pthread_mutex_t poolLock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t startCondition = PTHREAD_COND_INITIALIZER;
+pthread_cond_t doneCondition = PTHREAD_COND_INITIALIZER;
+
+int generation = 0;
+int numOfBusyWorkers = 0;
+bool shutDown = false;
+
+lcs::ParallelTask *currTask = NULL;
+
+bool PopOwnTask(int threadID, int &taskID) {
+	TaskRange *range = ranges + threadID;
+	bool found = false;
+	pthread_mutex_lock(&range->lock);
+	if (range->begin < range->end) {
+		taskID = range->begin++;
+		found = true;
+	}
+	pthread_mutex_unlock(&range->lock);
+	return found;
+}
+
+bool StealTask(int threadID, int &taskID) {
+	while (1) {
+		// Pick the victim with the largest remaining range. The range may shrink before it is locked again below.
+		int victim = -1, maxRemaining = 0;
+		for (int i = 0; i < numOfThreads; i++) {
+			if (i == threadID) continue;
+			pthread_mutex_lock(&ranges[i].lock);
+			int remaining = ranges[i].end - ranges[i].begin;
+			pthread_mutex_unlock(&ranges[i].lock);
+			if (remaining > maxRemaining) {
+				maxRemaining = remaining;
+				victim = i;
+			}
+		}
+		if (victim == -1) return false;
+
+		int stolenBegin, stolenEnd;
+		pthread_mutex_lock(&ranges[victim].lock);
+		int remaining = ranges[victim].end - ranges[victim].begin;
+		if (remaining <= 0) {
+			pthread_mutex_unlock(&ranges[victim].lock);
+			continue;
+		}
+		stolenEnd = ranges[victim].end;
+		stolenBegin = stolenEnd - (remaining + 1) / 2;
+		ranges[victim].end = stolenBegin;
+		pthread_mutex_unlock(&ranges[victim].lock);
+
+		taskID = stolenBegin;
+
+		pthread_mutex_lock(&ranges[threadID].lock);
+		ranges[threadID].begin = stolenBegin + 1;
+		ranges[threadID].end = stolenEnd;
+		pthread_mutex_unlock(&ranges[threadID].lock);
+
+		return true;
+	}
+}
+
+void DrainTasks(int threadID) {
+	int taskID;
+	while (PopOwnTask(threadID, taskID) || StealTask(threadID, taskID))
+		currTask->Run(taskID, threadID);
+}
+
+void *WorkerLoop(void *arg) {
+	int threadID = (int)(long)arg;
+	int lastGeneration = 0;
+
+	while (1) {
+		pthread_mutex_lock(&poolLock);
+		while (!shutDown && generation == lastGeneration)
+			pthread_cond_wait(&startCondition, &poolLock);
+		if (shutDown) {
+			pthread_mutex_unlock(&poolLock);
+			break;
+		}
+		lastGeneration = generation;
+		pthread_mutex_unlock(&poolLock);
+
+		DrainTasks(threadID);
+
+		pthread_mutex_lock(&poolLock);
+		if (!--numOfBusyWorkers) pthread_cond_signal(&doneCondition);
+		pthread_mutex_unlock(&poolLock);
+	}
+
+	return NULL;
+}
+
+void ReleasePool() {
+	if (!poolIsReady) return;
+
+	pthread_mutex_lock(&poolLock);
+	shutDown = true;
+	pthread_cond_broadcast(&startCondition);
+	pthread_mutex_unlock(&poolLock);
+
+	for (int i = 1; i < numOfThreads; i++)
+		pthread_join(workers[i], NULL);
+
+	for (int i = 0; i < numOfThreads; i++)
+		pthread_mutex_destroy(&ranges[i].lock);
+
+	delete [] workers;
+	delete [] ranges;
+	workers = NULL;
+	ranges = NULL;
+
+	shutDown = false;
+	generation = 0;
+	poolIsReady = false;
+}
+
+void InitializePool() {
+	if (poolIsReady) return;
+
+	if (numOfThreads <= 0) lcs::SetNumOfThreads(0);
+
+	workers = new pthread_t [numOfThreads];
+	ranges = new TaskRange [numOfThreads];
+	for (int i = 0; i < numOfThreads; i++) {
+		pthread_mutex_init(&ranges[i].lock, NULL);
+		ranges[i].begin = ranges[i].end = 0;
+	}
+
+	// Thread 0 is the calling thread.
+	for (int i = 1; i < numOfThreads; i++)
+		if (pthread_create(workers + i, NULL, WorkerLoop, (void *)(long)i))
+			lcs::Error("Fail to create a worker thread");
+
+	poolIsReady = true;
+}
+
+}
+
+void lcs::SetNumOfThreads(int numOfThreads) {
+	ReleasePool();
+
+	if (numOfThreads <= 0) numOfThreads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+	if (numOfThreads <= 0) numOfThreads = 1;
+
+	::numOfThreads = numOfThreads;
+}
+
+int lcs::GetNumOfThreads() {
+	if (numOfThreads <= 0) lcs::SetNumOfThreads(0);
+	return numOfThreads;
+}
+
+void lcs::ParallelFor(int numOfTasks, lcs::ParallelTask *task) {
+	if (numOfTasks <= 0) return;
+
+	InitializePool();
+
+	if (numOfThreads == 1) {
+		for (int i = 0; i < numOfTasks; i++)
+			task->Run(i, 0);
+		return;
+	}
+
+	// Deal contiguous ranges of task IDs to the threads
+	for (int i = 0; i < numOfThreads; i++) {
+		ranges[i].begin = (long long)numOfTasks * i / numOfThreads;
+		ranges[i].end = (long long)numOfTasks * (i + 1) / numOfThreads;
+	}
+
+	pthread_mutex_lock(&poolLock);
+	currTask = task;
+	numOfBusyWorkers = numOfThreads - 1;
+	generation++;
+	pthread_cond_broadcast(&startCondition);
+	pthread_mutex_unlock(&poolLock);
+
+	DrainTasks(0);
+
+	pthread_mutex_lock(&poolLock);
+	while (numOfBusyWorkers)
+		pthread_cond_wait(&doneCondition, &poolLock);
+	currTask = NULL;
+	pthread_mutex_unlock(&poolLock);
+}
@@ -0,0 +1,33 @@
+/**********************************************
+File		:	lcsParallel.h
+Author		:	Mingcheng Chen
+Last Update	:	October 16th, 2012
+***********************************************/
+
+#ifndef __LCS_PARALLEL_H
+#define __LCS_PARALLEL_H
+
+namespace lcs {
+
+////////////////////////////////////////////////
+// A task of a parallel loop. Run() is called once for every task ID in [0, numOfTasks).
+class ParallelTask {
+public:
+	virtual ~ParallelTask() {
+	}
+
+	virtual void Run(int taskID, int threadID) = 0;
+};
+
+// numOfThreads <= 0 means using all the online processors.
+void SetNumOfThreads(int numOfThreads);
+
+int GetNumOfThreads();
+
+// Task IDs are dealt to the threads in contiguous ranges. A thread which runs out of its own range
+// steals the second half of the largest remaining range of another thread.
+void ParallelFor(int numOfTasks, lcs::ParallelTask *task);
+
+}
+
+#endif
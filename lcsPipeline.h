@@ -0,0 +1,18 @@
+/**********************************************
+File		:	lcsPipeline.h
+Author		:	Mingcheng Chen
+Last Update	:	October 16th, 2012
+***********************************************/
+
+#ifndef __LCS_PIPELINE_H
+#define __LCS_PIPELINE_H
+
+namespace lcs {
+
+// Run Division, InitialCellLocation, Tracing and GetFinalPositions, and then the benchmark report and FTLE if the
+// configure file enables them. The state of a run is global, so a process can only run it once.
+void RunPipeline(const char *configurationFile);
+
+}
+
+#endif
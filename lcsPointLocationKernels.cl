@@ -0,0 +1,66 @@
+/*****************************************************
+File		:	lcsPointLocationKernels.cl
+Author		:	Mingcheng Chen
+Last Update	:	October 16th, 2012
+******************************************************/
+
+// Shared by the tracing and relocation kernels. CreateProgram() puts it in front of their code.
+
+inline double DeterminantThree(double *a) {
+	// a[0] a[1] a[2]
+	// a[3] a[4] a[5]
+	// a[6] a[7] a[8]
+	return a[0] * a[4] * a[8] + a[1] * a[5] * a[6] + a[2] * a[3] * a[7] -
+	       a[0] * a[5] * a[7] - a[1] * a[3] * a[8] - a[2] * a[4] * a[6];
+}
+
+inline void CalculateNaturalCoordinates(double X, double Y, double Z,
+					double *tetX, double *tetY, double *tetZ, double *coordinates) {
+	X -= tetX[0];
+	Y -= tetY[0];
+	Z -= tetZ[0];
+
+	double det[9] = {tetX[1] - tetX[0], tetY[1] - tetY[0], tetZ[1] - tetZ[0],
+			 tetX[2] - tetX[0], tetY[2] - tetY[0], tetZ[2] - tetZ[0],
+			 tetX[3] - tetX[0], tetY[3] - tetY[0], tetZ[3] - tetZ[0]};
+
+	double V = 1 / DeterminantThree(det);
+
+	double z41 = tetZ[3] - tetZ[0];
+	double y34 = tetY[2] - tetY[3];
+	double z34 = tetZ[2] - tetZ[3];
+	double y41 = tetY[3] - tetY[0];
+	double a11 = (z41 * y34 - z34 * y41) * V;
+
+	double x41 = tetX[3] - tetX[0];
+	double x34 = tetX[2] - tetX[3];
+	double a12 = (x41 * z34 - x34 * z41) * V;
+
+	double a13 = (y41 * x34 - y34 * x41) * V;
+
+	coordinates[1] = a11 * X + a12 * Y + a13 * Z;
+
+	double y12 = tetY[0] - tetY[1];
+	double z12 = tetZ[0] - tetZ[1];
+	double a21 = (z41 * y12 - z12 * y41) * V;
+
+	double x12 = tetX[0] - tetX[1];
+	double a22 = (x41 * z12 - x12 * z41) * V;
+
+	double a23 = (y41 * x12 - y12 * x41) * V;
+
+	coordinates[2] = a21 * X + a22 * Y + a23 * Z;
+
+	double z23 = tetZ[1] - tetZ[2];
+	double y23 = tetY[1] - tetY[2];
+	double a31 = (z23 * y12 - z12 * y23) * V;
+
+	double x23 = tetX[1] - tetX[2];
+	double a32 = (x23 * z12 - x12 * z23) * V;
+
+	double a33 = (y23 * x12 - y12 * x23) * V;
+
+	coordinates[3] = a31 * X + a32 * Y + a33 * Z;
+
+	coordinates[0] = 1 - coordinates[1] - coordinates[2] - coordinates[3];
+}
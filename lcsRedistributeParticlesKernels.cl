@@ -30,7 +30,7 @@ inline int GetBlockID(int x, int y, int z, int numOfBlocksInY, int numOfBlocksIn
 __kernel void CollectActiveBlocks(__global int *activeParticles,
 				  __global int *exitCells,
 				  //__global int *stages,
-				  __global double *placesOfInterest,
+				  __global double4 *placesOfInterest,
 
 				  //__global int *particleOrders,
 				  __global int *localTetIDs,
@@ -61,9 +61,10 @@ __kernel void CollectActiveBlocks(__global int *activeParticles,
 
 	if (globalID < numOfActiveParticles) {
 		int particleID = activeParticles[globalID];
-		double posX = placesOfInterest[particleID * 3];
-		double posY = placesOfInterest[particleID * 3 + 1];
-		double posZ = placesOfInterest[particleID * 3 + 2];
+		double4 place = placesOfInterest[particleID];
+		double posX = place.x;
+		double posY = place.y;
+		double posZ = place.z;
 
 		int x = (int)((posX - globalMinX) / blockSize);
 		int y = (int)((posY - globalMinY) / blockSize);
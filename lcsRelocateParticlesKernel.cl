@@ -0,0 +1,74 @@
+/******************************************************************
+File		:	lcsRelocateParticlesKernel.cl
+Author		:	Mingcheng Chen
+Last Update	:	October 16th, 2012
+*******************************************************************/
+
+// The walk of the tracing kernel returns -1 when it leaves the mesh, which also happens at concave boundaries
+// while the particle is still inside. Such a particle is located again among the cells of the block containing it,
+// and it is only marked as exited if none of them contains it.
+__kernel void RelocateParticles(__global int *blockedActiveParticleIDList,
+				__global double4 *placesOfInterest,
+				__global double *pastTimes,
+				__global int *exitCells,
+
+				__global gdouble *vertexPositions,
+				__global int *tetrahedralConnectivities,
+
+				__global int *interestingBlockMap,
+				__global int *startOffsetInCell,
+				__global int *blockedGlobalCellIDs,
+
+				double globalMinX, double globalMinY, double globalMinZ,
+				double blockSize,
+				double epsilon,
+				int numOfBlocksInX, int numOfBlocksInY, int numOfBlocksInZ,
+
+				double endTime,
+				int numOfActiveParticles) {
+	int globalID = get_global_id(0);
+
+	if (globalID < numOfActiveParticles) {
+		int particleID = blockedActiveParticleIDList[globalID];
+
+		if (exitCells[particleID] != -1) return;
+
+		double4 point = placesOfInterest[particleID];
+
+		// Points within epsilon of the domain are clamped into the boundary blocks.
+		if (point.x < globalMinX - epsilon || point.x > globalMinX + blockSize * numOfBlocksInX + epsilon) return;
+		if (point.y < globalMinY - epsilon || point.y > globalMinY + blockSize * numOfBlocksInY + epsilon) return;
+		if (point.z < globalMinZ - epsilon || point.z > globalMinZ + blockSize * numOfBlocksInZ + epsilon) return;
+
+		int x = clamp((int)floor((point.x - globalMinX) / blockSize), 0, numOfBlocksInX - 1);
+		int y = clamp((int)floor((point.y - globalMinY) / blockSize), 0, numOfBlocksInY - 1);
+		int z = clamp((int)floor((point.z - globalMinZ) / blockSize), 0, numOfBlocksInZ - 1);
+
+		int interestingBlockID = interestingBlockMap[(x * numOfBlocksInY + y) * numOfBlocksInZ + z];
+		if (interestingBlockID == -1) return;
+
+		int startOffset = startOffsetInCell[interestingBlockID];
+		int endOffset = startOffsetInCell[interestingBlockID + 1];
+
+		for (int i = startOffset; i < endOffset; i++) {
+			int cellID = blockedGlobalCellIDs[i];
+
+			double tetX[4], tetY[4], tetZ[4];
+			for (int j = 0; j < 4; j++) {
+				int pointID = tetrahedralConnectivities[(cellID << 2) | j];
+				tetX[j] = vertexPositions[pointID * 3];
+				tetY[j] = vertexPositions[pointID * 3 + 1];
+				tetZ[j] = vertexPositions[pointID * 3 + 2];
+			}
+
+			double coordinates[4];
+			CalculateNaturalCoordinates(point.x, point.y, point.z, tetX, tetY, tetZ, coordinates);
+
+			if (min(min(coordinates[0], coordinates[1]), min(coordinates[2], coordinates[3])) >= -epsilon) {
+				// Same encoding as the tracing kernels for a particle which has finished the interval
+				exitCells[particleID] = pastTimes[particleID] >= endTime ? -2 - cellID : cellID;
+				return;
+			}
+		}
+	}
+}
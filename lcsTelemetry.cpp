@@ -0,0 +1,123 @@
+/**********************************************
+File		:	lcsTelemetry.cpp
+Author		:	Mingcheng Chen
+Last Update	:	October 16th, 2012
+***********************************************/
+
+#include "lcsTelemetry.h"
+#include "lcsUtility.h"
+#include <cstring>
+
+FILE *lcs::Telemetry::fout = NULL;
+int lcs::Telemetry::intervalIdx = -1;
+int lcs::Telemetry::passIdx = -1;
+std::vector<lcs::Telemetry::PendingRecord> lcs::Telemetry::pendingRecords;
+std::vector<lcs::Telemetry::KernelSummary> lcs::Telemetry::kernelSummaries;
+
+void lcs::Telemetry::Open(const char *fileName) {
+	fout = fopen(fileName, "w");
+	if (fout == NULL) lcs::Error("Fail to create the telemetry file");
+	setvbuf(fout, NULL, _IOFBF, 1 << 20);
+	fprintf(fout, "record,interval,pass,name,value\n");
+}
+
+void lcs::Telemetry::Close() {
+	if (!fout) return;
+	Flush();
+	fclose(fout);
+	fout = NULL;
+}
+
+bool lcs::Telemetry::IsEnabled() {
+	return fout != NULL;
+}
+
+void lcs::Telemetry::BeginInterval(int intervalIdx) {
+	Telemetry::intervalIdx = intervalIdx;
+	Telemetry::passIdx = -1;
+}
+
+void lcs::Telemetry::BeginPass() {
+	passIdx++;
+}
+
+void lcs::Telemetry::RecordInterval(const char *name, double value) {
+	if (!fout) return;
+	Write("interval", intervalIdx, -1, name, value);
+}
+
+void lcs::Telemetry::RecordPass(const char *name, double value) {
+	if (!fout) return;
+	Write("pass", intervalIdx, passIdx, name, value);
+}
+
+void lcs::Telemetry::RecordKernel(const char *name, cl_event event) {
+	if (!fout) return;
+	clRetainEvent(event);
+
+	PendingRecord pendingRecord = {"kernel", name, intervalIdx, passIdx, event, NULL};
+	pendingRecords.push_back(pendingRecord);
+}
+
+void lcs::Telemetry::RecordPassLater(const char *name, const int *value) {
+	if (!fout) return;
+
+	PendingRecord pendingRecord = {"pass", name, intervalIdx, passIdx, NULL, value};
+	pendingRecords.push_back(pendingRecord);
+}
+
+void lcs::Telemetry::Flush() {
+	for (size_t i = 0; i < pendingRecords.size(); i++) {
+		PendingRecord &pendingRecord = pendingRecords[i];
+
+		if (!pendingRecord.event) {
+			Write(pendingRecord.record, pendingRecord.intervalIdx, pendingRecord.passIdx, pendingRecord.name,
+			      *pendingRecord.value);
+			continue;
+		}
+
+		cl_ulong startTime, endTime;
+		cl_int err;
+
+		err = clGetEventProfilingInfo(pendingRecord.event, CL_PROFILING_COMMAND_START, sizeof(cl_ulong), &startTime, NULL);
+		if (err) lcs::Error("Fail to get the start time of a kernel");
+
+		err = clGetEventProfilingInfo(pendingRecord.event, CL_PROFILING_COMMAND_END, sizeof(cl_ulong), &endTime, NULL);
+		if (err) lcs::Error("Fail to get the end time of a kernel");
+
+		clReleaseEvent(pendingRecord.event);
+
+		double kernelTime = (endTime - startTime) * 1e-9;
+		Write(pendingRecord.record, pendingRecord.intervalIdx, pendingRecord.passIdx, pendingRecord.name, kernelTime);
+
+		size_t j = 0;
+		for (; j < kernelSummaries.size(); j++)
+			if (!strcmp(kernelSummaries[j].name, pendingRecord.name)) break;
+		if (j == kernelSummaries.size()) {
+			KernelSummary kernelSummary = {pendingRecord.name, 0, 0};
+			kernelSummaries.push_back(kernelSummary);
+		}
+		kernelSummaries[j].numOfLaunches++;
+		kernelSummaries[j].totalTime += kernelTime;
+	}
+
+	pendingRecords.clear();
+}
+
+void lcs::Telemetry::PrintSummary() {
+	if (!fout) return;
+	Flush();
+
+	for (size_t i = 0; i < kernelSummaries.size(); i++)
+		printf("Kernel %s: %d launch(es), %lf sec on the device.\n",
+		       kernelSummaries[i].name, kernelSummaries[i].numOfLaunches, kernelSummaries[i].totalTime);
+	printf("\n");
+}
+
+void lcs::Telemetry::Write(const char *record, int intervalIdx, int passIdx, const char *name, double value) {
+	fprintf(fout, "%s,", record);
+	if (intervalIdx >= 0) fprintf(fout, "%d", intervalIdx);
+	fprintf(fout, ",");
+	if (passIdx >= 0) fprintf(fout, "%d", passIdx);
+	fprintf(fout, ",%s,%.9g\n", name, value);
+}
@@ -0,0 +1,70 @@
+/**********************************************
+File		:	lcsTelemetry.h
+Author		:	Mingcheng Chen
+Last Update	:	October 16th, 2012
+***********************************************/
+
+#ifndef __LCS_TELEMETRY_H
+#define __LCS_TELEMETRY_H
+
+#include <CL/opencl.h>
+#include <cstdio>
+#include <vector>
+
+namespace lcs {
+
+////////////////////////////////////////////////
+// A CSV trace of the tracing loop. Every line is "record,interval,pass,name,value", where record is "kernel"
+// (device seconds of one launch), "pass" or "interval". Nothing is recorded and no event is retained unless
+// Open() is called, so callers only check IsEnabled() before gathering data that is not free.
+// The lengths of the cell walks are only counted by the native backend; the OpenCL kernels do not report them.
+class Telemetry {
+public:
+	static void Open(const char *fileName);
+	static void Close();
+
+	static bool IsEnabled();
+
+	static void BeginInterval(int intervalIdx);
+	static void BeginPass();
+
+	static void RecordInterval(const char *name, double value);
+	static void RecordPass(const char *name, double value);
+
+	// The event is retained, and the device time of the kernel is recorded by Flush().
+	static void RecordKernel(const char *name, cl_event event);
+
+	// The value is read by Flush(), e.g. after a non-blocking read from the device has finished.
+	static void RecordPassLater(const char *name, const int *value);
+
+	// All the events in the pending records must have finished.
+	static void Flush();
+
+	// Print the total device time and the number of launches of every kernel
+	static void PrintSummary();
+
+private:
+	struct PendingRecord {
+		const char *record, *name;
+		int intervalIdx, passIdx;
+		cl_event event;
+		const int *value;
+	};
+
+	struct KernelSummary {
+		const char *name;
+		int numOfLaunches;
+		double totalTime;
+	};
+
+	static void Write(const char *record, int intervalIdx, int passIdx, const char *name, double value);
+
+	static FILE *fout;
+	static int intervalIdx, passIdx;
+	static std::vector<PendingRecord> pendingRecords;
+	static std::vector<KernelSummary> kernelSummaries;
+};
+
+}
+
+#endif
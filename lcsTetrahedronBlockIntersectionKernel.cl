@@ -146,7 +146,7 @@ inline bool CheckPlane(double x1, double y1, double z1,
 	return 1;
 }
 
-__kernel void TetrahedronBlockIntersection(__global double *vertexPositions,
+__kernel void TetrahedronBlockIntersection(__global gdouble *vertexPositions,
 										   __global int *tetrahedralConnectivities,
 										   __global int *queryTetrahedron,
 										   __global int *queryBlock,
@@ -6,6 +6,12 @@ Last Update		:		June 3rd, 2012
 
 #include "lcsUnitTest.h"
 #include "lcsUtility.h"
+#include "lcsFTLE.h"
+#include <cmath>
+#include <cstdlib>
+#include <map>
+#include <vector>
+#include <algorithm>
 
 ////////////////////////////////////////////////
 bool CheckPlane(const lcs::Vector &p1, const lcs::Vector &p2, const lcs::Vector &p3,
@@ -43,6 +49,59 @@ bool TetrahedronContainsPoint(const lcs::Tetrahedron &tet, const lcs::Vector &pt
 	return true;
 }
 
+// Trace a point with RK4 in the velocities of the grid. It returns the cell of the final position, or -1 if it leaves.
+int TracePoint(const lcs::TetrahedralGrid *grid, lcs::Vector &point, int cellID,
+			   double timeStep, int numOfSteps, double epsilon) {
+	for (int i = 0; i < numOfSteps; i++) {
+		lcs::Vector k[4];
+		for (int j = 0; j < 4; j++) {
+			lcs::Vector stagePoint = point;
+			if (j) stagePoint = point + k[j - 1] * (j == 3 ? timeStep : timeStep / 2);
+			cellID = grid->FindCell(stagePoint, epsilon, cellID);
+			if (cellID == -1) return -1;
+			double velocity[3];
+			grid->GetInterpolatedVelocity(stagePoint, cellID, velocity);
+			k[j] = lcs::Vector(velocity);
+		}
+		point = point + (k[0] + k[1] * 2 + k[2] * 2 + k[3]) * (timeStep / 6);
+	}
+	return grid->FindCell(point, epsilon, cellID);
+}
+
+int ComputeTracedFTLE(const lcs::TetrahedralGrid *grid,
+					  int xRes, int yRes, int zRes,
+					  double minX, double minY, double minZ,
+					  double dx, double dy, double dz,
+					  const int *initialCells,
+					  double timeStep, int numOfSteps,
+					  double epsilon,
+					  double *ftle, bool *ftleValid) {
+	int numOfGridPoints = (xRes + 1) * (yRes + 1) * (zRes + 1);
+	double *flowMap = new double [numOfGridPoints * 3];
+	bool *valid = new bool [numOfGridPoints];
+
+	int idx = -1;
+	for (int i = 0; i <= xRes; i++)
+		for (int j = 0; j <= yRes; j++)
+			for (int k = 0; k <= zRes; k++) {
+				idx++;
+				lcs::Vector point(minX + dx * i, minY + dy * j, minZ + dz * k);
+				valid[idx] = initialCells[idx] != -1 &&
+					     TracePoint(grid, point, initialCells[idx], timeStep, numOfSteps, epsilon) != -1;
+				flowMap[idx * 3] = point.GetX();
+				flowMap[idx * 3 + 1] = point.GetY();
+				flowMap[idx * 3 + 2] = point.GetZ();
+			}
+
+	int numOfValidPoints = lcs::ComputeFTLE(xRes, yRes, zRes, dx, dy, dz, timeStep * numOfSteps,
+						flowMap, valid, ftle, ftleValid);
+
+	delete [] flowMap;
+	delete [] valid;
+
+	return numOfValidPoints;
+}
+
 ////////////////////////////////////////////////
 void lcs::UnitTestForTetBlkIntersection(lcs::TetrahedralGrid *grid, double blockSize,
 								   double globalMinX, double globalMinY, double globalMinZ,
@@ -198,4 +257,308 @@ void lcs::UnitTestForInitialCellLocations(lcs::TetrahedralGrid *grid,
 			}
 
 	printf("Passed\n");
-}
\ No newline at end of file
+}
+
+void lcs::UnitTestForTetrahedralLinks(lcs::TetrahedralGrid *grid) {
+	printf("Unit test for tetrahedral links ... ");
+
+	int numOfCells = grid->GetNumOfCells();
+	int *links = new int [numOfCells * 4];
+	memset(links, 255, sizeof(int) * numOfCells * 4);
+
+	// The face opposite to vertex j of cell i is (i << 2) + j.
+	std::map<std::pair<int, std::pair<int, int> >, int> faces;
+	for (int i = 0; i < numOfCells; i++) {
+		int connectivity[4];
+		grid->GetCellConnectivity(i, connectivity);
+
+		for (int j = 0; j < 4; j++) {
+			int vertices[3];
+			for (int k = 1; k <= 3; k++)
+				vertices[k - 1] = connectivity[(j + k) & 3];
+			std::sort(vertices, vertices + 3);
+
+			std::pair<int, std::pair<int, int> > key =
+				std::make_pair(vertices[0], std::make_pair(vertices[1], vertices[2]));
+			std::map<std::pair<int, std::pair<int, int> >, int>::iterator itr = faces.find(key);
+
+			if (itr == faces.end()) {
+				faces[key] = (i << 2) + j;
+				continue;
+			}
+
+			int face = itr->second;
+			if (face < 0 || links[face] != -1) {
+				char str[100];
+				sprintf(str, "Face (%d, %d, %d) is shared by more than two cells", vertices[0], vertices[1], vertices[2]);
+				lcs::Error(str);
+			}
+			links[face] = i;
+			links[(i << 2) + j] = face >> 2;
+			itr->second = -1;
+		}
+	}
+
+	for (int i = 0; i < numOfCells; i++) {
+		int link[4];
+		grid->GetCellLink(i, link);
+		for (int j = 0; j < 4; j++)
+			if (link[j] != links[(i << 2) + j]) {
+				char str[100];
+				sprintf(str, "Link %d of cell %d is %d instead of %d", j, i, link[j], links[(i << 2) + j]);
+				lcs::Error(str);
+			}
+	}
+
+	delete [] links;
+
+	printf("Passed\n");
+}
+
+void lcs::UnitTestForVertexIncidence(lcs::TetrahedralGrid *grid) {
+	printf("Unit test for vertex incidence ... ");
+
+	bool isBuilt = grid->HasVertexIncidence();
+	grid->BuildVertexIncidence();
+
+	// The cells are visited in increasing order, so every list is sorted.
+	std::vector<std::vector<int> > cellsOfVertices(grid->GetNumOfVertices());
+	for (int i = 0; i < grid->GetNumOfCells(); i++) {
+		int connectivity[4];
+		grid->GetCellConnectivity(i, connectivity);
+		for (int j = 0; j < 4; j++)
+			cellsOfVertices[connectivity[j]].push_back(i);
+	}
+
+	const int *offsets = grid->GetVertexCellOffsets();
+	const int *cells = grid->GetVertexCells();
+
+	if (offsets[0] != 0) lcs::Error("The incidence lists do not start from 0");
+
+	for (int i = 0; i < grid->GetNumOfVertices(); i++) {
+		int numOfCells = offsets[i + 1] - offsets[i];
+		if (numOfCells != (int)cellsOfVertices[i].size()) {
+			char str[100];
+			sprintf(str, "Vertex %d has %d incident cells instead of %d", i, numOfCells, (int)cellsOfVertices[i].size());
+			lcs::Error(str);
+		}
+		for (int j = 0; j < numOfCells; j++)
+			if (cells[offsets[i] + j] != cellsOfVertices[i][j]) {
+				char str[100];
+				sprintf(str, "Incident cell %d of vertex %d is %d instead of %d",
+						j, i, cells[offsets[i] + j], cellsOfVertices[i][j]);
+				lcs::Error(str);
+			}
+	}
+
+	if (!isBuilt) grid->ReleaseVertexIncidence();
+
+	printf("Passed\n");
+}
+
+void lcs::UnitTestForNaturalCoordinates(lcs::TetrahedralGrid *grid, double epsilon) {
+	printf("Unit test for natural coordinates ... ");
+
+	const int numOfPoints = 10000;
+	const int maxListSize = 64;
+
+	bool isBuilt = grid->GetBarycentricTransforms() != NULL;
+	grid->BuildBarycentricTransforms();
+
+	int numOfCells = grid->GetNumOfCells();
+
+	const double *positions = grid->GetPositions();
+	double minCorner[3], maxCorner[3];
+	for (int d = 0; d < 3; d++) {
+		minCorner[d] = maxCorner[d] = positions[d];
+		for (int i = 1; i < grid->GetNumOfVertices(); i++) {
+			minCorner[d] = std::min(minCorner[d], positions[i * 3 + d]);
+			maxCorner[d] = std::max(maxCorner[d], positions[i * 3 + d]);
+		}
+	}
+
+	srand(2012);
+
+	int cellIDs[maxListSize];
+	double c[4][maxListSize];
+	int numOfHits = 0;
+
+	for (int p = 0; p < numOfPoints; p++) {
+		int listSize = rand() % maxListSize + 1;
+		for (int i = 0; i < listSize; i++)
+			cellIDs[i] = rand() % numOfCells;
+
+		// Half of the points are inside a cell of the list, and the others are anywhere in the bounding box.
+		lcs::Vector point;
+		if (p & 1) {
+			lcs::Tetrahedron tetrahedron = grid->GetTetrahedron(cellIDs[rand() % listSize]);
+			double weights[4], sum = 0;
+			for (int j = 0; j < 4; j++)
+				sum += weights[j] = (double)rand() / RAND_MAX + 1e-3;
+			for (int j = 0; j < 4; j++)
+				point = point + tetrahedron.GetVertex(j) * (weights[j] / sum);
+		} else
+			point = lcs::Vector(minCorner[0] + (maxCorner[0] - minCorner[0]) * rand() / RAND_MAX,
+					    minCorner[1] + (maxCorner[1] - minCorner[1]) * rand() / RAND_MAX,
+					    minCorner[2] + (maxCorner[2] - minCorner[2]) * rand() / RAND_MAX);
+
+		lcs::ApplyBarycentricTransform(grid->GetBarycentricTransforms(), cellIDs, listSize, point, c[0], c[1], c[2], c[3]);
+
+		// The SIMD versions may contract the products into FMAs, so the coordinates agree up to the rounding.
+		const double tolerance = 1e-9;
+		double minCoordinates[maxListSize];
+		for (int i = 0; i < listSize; i++) {
+			double single[4];
+			grid->GetTetrahedron(cellIDs[i]).CalculateNaturalCoordinates(point, single);
+			for (int j = 0; j < 4; j++)
+				if (fabs(c[j][i] - single[j]) > tolerance * (1 + fabs(single[j]))) {
+					char str[200];
+					sprintf(str, "Coordinate %d of point %d in cell %d is %lf instead of %lf",
+						j, p, cellIDs[i], c[j][i], single[j]);
+					lcs::Error(str);
+				}
+			minCoordinates[i] = *std::min_element(single, single + 4);
+		}
+
+		// FindCellInList() has to return the first cell of the list which contains the point.
+		int cellID = grid->FindCellInList(point, epsilon, cellIDs, listSize);
+		int position = std::find(cellIDs, cellIDs + listSize, cellID) - cellIDs;
+		if (cellID != -1 && (position == listSize || minCoordinates[position] < -epsilon - tolerance)) {
+			char str[100];
+			sprintf(str, "FindCellInList() finds cell %d which does not contain point %d", cellID, p);
+			lcs::Error(str);
+		}
+		for (int i = 0; i < position; i++)
+			if (minCoordinates[i] >= -epsilon + tolerance) {
+				char str[100];
+				sprintf(str, "FindCellInList() misses cell %d for point %d", cellIDs[i], p);
+				lcs::Error(str);
+			}
+		if (cellID != -1) numOfHits++;
+	}
+
+	if (!isBuilt) grid->ReleaseBarycentricTransforms();
+
+	printf("Passed (%d of %d points are in their lists)\n", numOfHits, numOfPoints);
+}
+
+void lcs::UnitTestForMeshRenumbering(lcs::TetrahedralGrid *grid,
+									 int xRes, int yRes, int zRes,
+									 double minX, double minY, double minZ,
+									 double dx, double dy, double dz,
+									 int *initialCellLocations,
+									 double timeStep, int numOfSteps,
+									 double epsilon) {
+	printf("Unit test for mesh renumbering ");
+
+	int numOfVertices = grid->GetNumOfVertices();
+	int numOfCells = grid->GetNumOfCells();
+
+	// Two grids on a copy in the order of the grid, so that neither of them uses the cached transforms of the grid.
+	// Both borrow the copy until the renumbering replaces the arrays of one of them.
+	double *positions = new double [numOfVertices * 3];
+	double *velocities = new double [numOfVertices * 3];
+	int *connectivities = new int [numOfCells * 4];
+	int *links = new int [numOfCells * 4];
+
+	grid->ReadPositions(positions);
+	grid->ReadVelocities(velocities);
+	grid->ReadConnectivities(connectivities);
+	grid->ReadLinks(links);
+
+	lcs::TetrahedralGrid original(numOfVertices, numOfCells, positions, velocities, connectivities, links);
+	lcs::TetrahedralGrid renumbered(numOfVertices, numOfCells, positions, velocities, connectivities, links);
+	renumbered.Renumber();
+
+	// The permutations must be bijections.
+	int *newVertexIDs = new int [numOfVertices];
+	int *newCellIDs = new int [numOfCells];
+	memset(newVertexIDs, 255, sizeof(int) * numOfVertices);
+	memset(newCellIDs, 255, sizeof(int) * numOfCells);
+
+	for (int i = 0; i < numOfVertices; i++) {
+		int vertexID = renumbered.GetOriginalVertexID(i);
+		if (vertexID < 0 || vertexID >= numOfVertices || newVertexIDs[vertexID] != -1) {
+			char str[100];
+			sprintf(str, "Vertex %d is not mapped to a unique original vertex", i);
+			lcs::Error(str);
+		}
+		newVertexIDs[vertexID] = i;
+
+		lcs::Vector difference = renumbered.GetVertex(i) - original.GetVertex(vertexID);
+		lcs::Vector velocityDifference = renumbered.GetVelocity(i) - original.GetVelocity(vertexID);
+		if (difference.Length() > 0 || velocityDifference.Length() > 0) {
+			char str[100];
+			sprintf(str, "Vertex %d does not match original vertex %d", i, vertexID);
+			lcs::Error(str);
+		}
+	}
+
+	for (int i = 0; i < numOfCells; i++) {
+		int cellID = renumbered.GetOriginalCellID(i);
+		if (cellID < 0 || cellID >= numOfCells || newCellIDs[cellID] != -1) {
+			char str[100];
+			sprintf(str, "Cell %d is not mapped to a unique original cell", i);
+			lcs::Error(str);
+		}
+		newCellIDs[cellID] = i;
+	}
+
+	// The connectivities and the links map back to the original ones.
+	for (int i = 0; i < numOfCells; i++) {
+		int cellID = renumbered.GetOriginalCellID(i);
+		int connectivity[4], link[4];
+		renumbered.GetCellConnectivity(i, connectivity);
+		renumbered.GetCellLink(i, link);
+
+		for (int j = 0; j < 4; j++) {
+			int vertexID = renumbered.GetOriginalVertexID(connectivity[j]);
+			int neighbor = link[j] < 0 ? link[j] : renumbered.GetOriginalCellID(link[j]);
+			if (vertexID != connectivities[cellID * 4 + j] || neighbor != links[cellID * 4 + j]) {
+				char str[100];
+				sprintf(str, "Cell %d does not match original cell %d", i, cellID);
+				lcs::Error(str);
+			}
+		}
+	}
+
+	// The FTLE does not depend on the numbering.
+	int numOfGridPoints = (xRes + 1) * (yRes + 1) * (zRes + 1);
+	int *renumberedCellLocations = new int [numOfGridPoints];
+	for (int i = 0; i < numOfGridPoints; i++)
+		renumberedCellLocations[i] = initialCellLocations[i] == -1 ? -1 : newCellIDs[initialCellLocations[i]];
+
+	double *ftle = new double [numOfGridPoints];
+	double *renumberedFTLE = new double [numOfGridPoints];
+	bool *ftleValid = new bool [numOfGridPoints];
+	bool *renumberedFTLEValid = new bool [numOfGridPoints];
+
+	int numOfValidPoints = ComputeTracedFTLE(&original, xRes, yRes, zRes, minX, minY, minZ, dx, dy, dz,
+						 initialCellLocations, timeStep, numOfSteps, epsilon, ftle, ftleValid);
+	ComputeTracedFTLE(&renumbered, xRes, yRes, zRes, minX, minY, minZ, dx, dy, dz,
+			  renumberedCellLocations, timeStep, numOfSteps, epsilon, renumberedFTLE, renumberedFTLEValid);
+
+	for (int i = 0; i < numOfGridPoints; i++)
+		if (ftleValid[i] != renumberedFTLEValid[i] || lcs::Sign(ftle[i] - renumberedFTLE[i], epsilon)) {
+			char str[100];
+			sprintf(str, "The FTLE of grid point %d changes with the renumbering (%lf, %lf)",
+					i, ftle[i], renumberedFTLE[i]);
+			lcs::Error(str);
+		}
+
+	printf("(FTLE points: %d) ... ", numOfValidPoints);
+
+	delete [] positions;
+	delete [] velocities;
+	delete [] connectivities;
+	delete [] links;
+	delete [] newVertexIDs;
+	delete [] newCellIDs;
+	delete [] renumberedCellLocations;
+	delete [] ftle;
+	delete [] renumberedFTLE;
+	delete [] ftleValid;
+	delete [] renumberedFTLEValid;
+
+	printf("Passed\n");
+}
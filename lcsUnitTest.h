@@ -26,6 +26,26 @@ void UnitTestForInitialCellLocations(lcs::TetrahedralGrid *grid,
 									 int *initialCellLocations,
 									 double epsilon);
 
+// Compare the links of the grid with the ones matched through a map of the faces.
+void UnitTestForTetrahedralLinks(lcs::TetrahedralGrid *grid);
+
+// Compare the vertex-to-cell incidence of the grid with the one collected vertex by vertex.
+void UnitTestForVertexIncidence(lcs::TetrahedralGrid *grid);
+
+// Compare the natural coordinates of random points in random lists of cells through the batched
+// ApplyBarycentricTransform() with the ones of every single cell, and FindCellInList() with a scan of the list.
+void UnitTestForNaturalCoordinates(lcs::TetrahedralGrid *grid, double epsilon);
+
+// Renumber a copy of the grid and map it back through GetOriginalVertexID() and GetOriginalCellID().
+// Then trace the grid points for numOfSteps RK4 steps in the velocities of both copies and compare the FTLE.
+void UnitTestForMeshRenumbering(lcs::TetrahedralGrid *grid,
+								int xRes, int yRes, int zRes,
+								double minX, double minY, double minZ,
+								double dx, double dy, double dz,
+								int *initialCellLocations,
+								double timeStep, int numOfSteps,
+								double epsilon);
+
 }
 
 #endif
\ No newline at end of file
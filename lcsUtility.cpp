@@ -5,10 +5,12 @@ Last Update	:	September 25th, 2012
 ***********************************************/
 
 #include "lcsUtility.h"
+#include "lcsTelemetry.h"
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
 #include <cctype>
+#include <sys/time.h>
 #include <vector>
 #include <algorithm>
 
@@ -28,10 +30,24 @@ bool lcs::IsFloatChar(char ch) {
 	return isdigit(ch) || ch == '.' || ch == '-' || ch == '+';
 }
 
-int lcs::GPUExclusiveScanForInt(int workGroupSize, int numOfBanks,
-				cl_kernel scanKernel, cl_kernel reverseUpdateKernel, cl_mem d_arr, cl_int length,
-				cl_command_queue commandQueue) {
+void lcs::ChainEvent(cl_event &chain, cl_event event) {
+	if (chain) clReleaseEvent(chain);
+	chain = event;
+}
+
+cl_uint lcs::GetNumOfWaitEvents(const cl_event &chain) {
+	return chain != NULL;
+}
+
+const cl_event *lcs::GetWaitList(const cl_event &chain) {
+	return chain != NULL ? &chain : NULL;
+}
+
+void lcs::GPUExclusiveScanForInt(int workGroupSize, int numOfBanks,
+				 cl_kernel scanKernel, cl_kernel reverseUpdateKernel, cl_mem d_arr, cl_int length,
+				 cl_mem d_sum, int sumOffset, cl_command_queue commandQueue, cl_event &chain) {
 	cl_int err;
+	cl_event event;
 
 	// Get the work group size
 	size_t localWorkSize = workGroupSize;
@@ -48,9 +64,6 @@ int lcs::GPUExclusiveScanForInt(int workGroupSize, int numOfBanks,
 
 	cl_int d_step = 1;
 
-	/// DEBUG ///
-	printf("length = %d\n", length);
-
 	for (; problemSize > 1; problemSize = (problemSize - 1) / (localWorkSize * 2) + 1) {
 		if (numOfRecords) d_step *= localWorkSize * 2;
 		records[numOfRecords++] = problemSize;
@@ -59,23 +72,26 @@ int lcs::GPUExclusiveScanForInt(int workGroupSize, int numOfBanks,
 		size_t globalWorkSize = ((problemSize - 1) / (localWorkSize * 2) + 1) * localWorkSize;
 
 		err = clEnqueueNDRangeKernel(commandQueue, scanKernel, 1, NULL, &globalWorkSize, &localWorkSize,
-					     0, NULL, NULL);
+					     GetNumOfWaitEvents(chain), GetWaitList(chain), &event);
 		if (err) lcs::Error("Fail to enqueue scan");
-
-		/// DEBUG ///
-		err = clFinish(commandQueue);
-
-		printf("err = %d\n", err);
-
-		if (err) lcs::Error("Non-zero err in pre-scan");
+		if (lcs::Telemetry::IsEnabled()) lcs::Telemetry::RecordKernel("Scan", event);
+		ChainEvent(chain, event);
 	}
 
-	int zero = 0, sum;
-	err = clEnqueueReadBuffer(commandQueue, d_arr, CL_TRUE, 0, sizeof(int), &sum, 0, NULL, NULL);
-	if (err) lcs::Error("Fail to read d_arr[0]");
+	// The sum is in d_arr[0] after the up-sweep.
+	if (d_sum) {
+		err = clEnqueueCopyBuffer(commandQueue, d_arr, d_sum, 0, sizeof(int) * sumOffset, sizeof(int),
+					  GetNumOfWaitEvents(chain), GetWaitList(chain), &event);
+		if (err) lcs::Error("Fail to copy d_arr[0]");
+		ChainEvent(chain, event);
+	}
 
-	err = clEnqueueWriteBuffer(commandQueue, d_arr, CL_TRUE, 0, sizeof(int), &zero, 0, NULL, NULL);
+	// The write is not blocking, so the source has to outlive it.
+	static const int zero = 0;
+	err = clEnqueueWriteBuffer(commandQueue, d_arr, CL_FALSE, 0, sizeof(int), &zero,
+				   GetNumOfWaitEvents(chain), GetWaitList(chain), &event);
 	if (err) lcs::Error("Fail to clean d_arr[0]");
+	ChainEvent(chain, event);
 
 	// Reverse updates
 	clSetKernelArg(reverseUpdateKernel, 0, sizeof(cl_mem), &d_arr);
@@ -87,12 +103,11 @@ int lcs::GPUExclusiveScanForInt(int workGroupSize, int numOfBanks,
 		clSetKernelArg(reverseUpdateKernel, 2, sizeof(cl_int), &d_step);
 		globalWorkSize = ((records[i] - 1) / (localWorkSize * 2) + 1) * localWorkSize;
 		err = clEnqueueNDRangeKernel(commandQueue, reverseUpdateKernel, 1, NULL, &globalWorkSize, &localWorkSize,
-					     0, NULL, NULL);
+					     GetNumOfWaitEvents(chain), GetWaitList(chain), &event);
 		if (err) lcs::Error("Fail to enqueue scan");
-		clFinish(commandQueue);
+		if (lcs::Telemetry::IsEnabled()) lcs::Telemetry::RecordKernel("ReverseUpdate", event);
+		ChainEvent(chain, event);
 	}
-
-	return sum;
 }
 
 void lcs::CheckIntArrayInDevice(const char *fileName, cl_command_queue commandQueue, cl_mem intArr, int length) {
@@ -137,6 +152,12 @@ void lcs::GetOrignalUnorderedIntArrayFromPartialSum(const char *fileName, cl_com
 
 	fclose(fout);
 }
+
+double lcs::GetWallTime() {
+	timeval now;
+	gettimeofday(&now, NULL);
+	return now.tv_sec + now.tv_usec * 1e-6;
+}
 	
 ////////////////////////////////////////////////
 lcs::Configure::Configure(const char *fileName) {
@@ -306,6 +327,108 @@ lcs::Configure::Configure(const char *fileName) {
 				printf("Done. integration = %s\n", integration.c_str());
 				continue;
 			}
+			if (!strcmp(name, "tracingBackend")) {
+				printf("read tracingBackend ... ");
+				lcs::ConsumeChar('\"', fin);
+				this->tracingBackend = "";
+				while (1) {
+					ch = fgetc(fin);
+					if (ch == EOF) lcs::Error("The configure file is defective.");
+					if (ch == '\"') break;
+					this->tracingBackend += ch;
+				}
+				if (this->tracingBackend != "OpenCL" && this->tracingBackend != "Native")
+					lcs::Error("\"tracingBackend\" should be either \"OpenCL\" or \"Native\"");
+				printf("Done. tracingBackend = %s\n", tracingBackend.c_str());
+				continue;
+			}
+			if (!strcmp(name, "initialCellLocation")) {
+				printf("read initialCellLocation ... ");
+				lcs::ConsumeChar('\"', fin);
+				this->initialCellLocation = "";
+				while (1) {
+					ch = fgetc(fin);
+					if (ch == EOF) lcs::Error("The configure file is defective.");
+					if (ch == '\"') break;
+					this->initialCellLocation += ch;
+				}
+				if (this->initialCellLocation != "PointCentric" && this->initialCellLocation != "CellCentric" &&
+				    this->initialCellLocation != "Walk")
+					lcs::Error("\"initialCellLocation\" should be \"PointCentric\", \"CellCentric\" or \"Walk\"");
+				printf("Done. initialCellLocation = %s\n", initialCellLocation.c_str());
+				continue;
+			}
+			if (!strcmp(name, "meshCacheFile")) {
+				printf("read meshCacheFile ... ");
+				lcs::ConsumeChar('\"', fin);
+				this->meshCacheFile = "";
+				while (1) {
+					ch = fgetc(fin);
+					if (ch == EOF) lcs::Error("The configure file is defective.");
+					if (ch == '\"') break;
+					this->meshCacheFile += ch;
+				}
+				printf("Done. meshCacheFile = %s\n", meshCacheFile.c_str());
+				continue;
+			}
+			if (!strcmp(name, "telemetryFile")) {
+				printf("read telemetryFile ... ");
+				lcs::ConsumeChar('\"', fin);
+				this->telemetryFile = "";
+				while (1) {
+					ch = fgetc(fin);
+					if (ch == EOF) lcs::Error("The configure file is defective.");
+					if (ch == '\"') break;
+					this->telemetryFile += ch;
+				}
+				printf("Done. telemetryFile = %s\n", telemetryFile.c_str());
+				continue;
+			}
+			if (!strcmp(name, "divisionCacheDirectory")) {
+				printf("read divisionCacheDirectory ... ");
+				lcs::ConsumeChar('\"', fin);
+				this->divisionCacheDirectory = "";
+				while (1) {
+					ch = fgetc(fin);
+					if (ch == EOF) lcs::Error("The configure file is defective.");
+					if (ch == '\"') break;
+					this->divisionCacheDirectory += ch;
+				}
+				printf("Done. divisionCacheDirectory = %s\n", divisionCacheDirectory.c_str());
+				continue;
+			}
+			if (!strcmp(name, "outputFormat")) {
+				printf("read outputFormat ... ");
+				lcs::ConsumeChar('\"', fin);
+				this->outputFormat = "";
+				while (1) {
+					ch = fgetc(fin);
+					if (ch == EOF) lcs::Error("The configure file is defective.");
+					if (ch == '\"') break;
+					this->outputFormat += ch;
+				}
+				if (this->outputFormat != "Text" && this->outputFormat != "Binary" && this->outputFormat != "VTK")
+					lcs::Error("\"outputFormat\" should be \"Text\", \"Binary\" or \"VTK\"");
+				printf("Done. outputFormat = %s\n", outputFormat.c_str());
+				continue;
+			}
+			if (!strcmp(name, "numOfThreads")) {
+				printf("read numOfThreads ... ");
+				int value;
+				if (fscanf(fin, "%d", &value) != 1) lcs::Error("Fail to read \"numOfThreads\"");
+				this->numOfThreads = value;
+				printf("Done. numOfThreads = %d\n", value);
+				continue;
+			}
+			if (!strcmp(name, "cellTransformMegabytes")) {
+				printf("read cellTransformMegabytes ... ");
+				int value;
+				if (fscanf(fin, "%d", &value) != 1) lcs::Error("Fail to read \"cellTransformMegabytes\"");
+				if (value < 0) lcs::Error("\"cellTransformMegabytes\" should not be negative");
+				this->cellTransformMegabytes = value;
+				printf("Done. cellTransformMegabytes = %d\n", value);
+				continue;
+			}
 			if (!strcmp(name, "timeStep")) {
 				printf("read timeStep ... ");
 				double timeStep;
@@ -330,6 +453,30 @@ lcs::Configure::Configure(const char *fileName) {
 				printf("Done. timeInterval = %lf\n", timeInterval);
 				continue;
 			}
+			if (!strcmp(name, "tolerance")) {
+				printf("read tolerance ... ");
+				double tolerance;
+				if (fscanf(fin, "%lf", &tolerance) != 1) lcs::Error("Fail to read \"tolerance\"");
+				this->tolerance = tolerance;
+				printf("Done. tolerance = %le\n", tolerance);
+				continue;
+			}
+			if (!strcmp(name, "minTimeStep")) {
+				printf("read minTimeStep ... ");
+				double minTimeStep;
+				if (fscanf(fin, "%lf", &minTimeStep) != 1) lcs::Error("Fail to read \"minTimeStep\"");
+				this->minTimeStep = minTimeStep;
+				printf("Done. minTimeStep = %le\n", minTimeStep);
+				continue;
+			}
+			if (!strcmp(name, "maxTimeStep")) {
+				printf("read maxTimeStep ... ");
+				double maxTimeStep;
+				if (fscanf(fin, "%lf", &maxTimeStep) != 1) lcs::Error("Fail to read \"maxTimeStep\"");
+				this->maxTimeStep = maxTimeStep;
+				printf("Done. maxTimeStep = %lf\n", maxTimeStep);
+				continue;
+			}
 			if (!strcmp(name, "epsilonForTetBlkIntersection")) {
 				printf("read epsilonForTetBlkIntersection ... ");
 				double epsilonForTetBlkIntersection;
@@ -417,9 +564,106 @@ lcs::Configure::Configure(const char *fileName) {
 				this->unitTestForInitialCellLocation = tolower(status[0]) == 'e';
 				printf("Done. unitTestForInitialCellLocation = %s\n", status);
 				continue;
+			}
+			if (!strcmp(name, "unitTestForNaturalCoordinates")) {
+				printf("read unitTestForNaturalCoordinates ... ");
+				char status[50];
+				if (fscanf(fin, "%s", status) != 1) lcs::Error("Fail to read \"unitTestForNaturalCoordinates\"");
+				this->unitTestForNaturalCoordinates = tolower(status[0]) == 'e';
+				printf("Done. unitTestForNaturalCoordinates = %s\n", status);
+				continue;
+			}
+			if (!strcmp(name, "unitTestForVertexIncidence")) {
+				printf("read unitTestForVertexIncidence ... ");
+				char status[50];
+				if (fscanf(fin, "%s", status) != 1) lcs::Error("Fail to read \"unitTestForVertexIncidence\"");
+				this->unitTestForVertexIncidence = tolower(status[0]) == 'e';
+				printf("Done. unitTestForVertexIncidence = %s\n", status);
+				continue;
+			}
+			if (!strcmp(name, "unitTestForTetrahedralLinks")) {
+				printf("read unitTestForTetrahedralLinks ... ");
+				char status[50];
+				if (fscanf(fin, "%s", status) != 1) lcs::Error("Fail to read \"unitTestForTetrahedralLinks\"");
+				this->unitTestForTetrahedralLinks = tolower(status[0]) == 'e';
+				printf("Done. unitTestForTetrahedralLinks = %s\n", status);
+				continue;
+			}
+			if (!strcmp(name, "unitTestForMeshRenumbering")) {
+				printf("read unitTestForMeshRenumbering ... ");
+				char status[50];
+				if (fscanf(fin, "%s", status) != 1) lcs::Error("Fail to read \"unitTestForMeshRenumbering\"");
+				this->unitTestForMeshRenumbering = tolower(status[0]) == 'e';
+				printf("Done. unitTestForMeshRenumbering = %s\n", status);
+				continue;
+			}
+			if (!strcmp(name, "ftle")) {
+				printf("read ftle ... ");
+				char status[50];
+				if (fscanf(fin, "%s", status) != 1) lcs::Error("Fail to read \"ftle\"");
+				this->ftle = tolower(status[0]) == 'e';
+				printf("Done. ftle = %s\n", status);
+				continue;
+			}
+			if (!strcmp(name, "outputCompression")) {
+				printf("read outputCompression ... ");
+				char status[50];
+				if (fscanf(fin, "%s", status) != 1) lcs::Error("Fail to read \"outputCompression\"");
+				this->outputCompression = tolower(status[0]) == 'e';
+				printf("Done. outputCompression = %s\n", status);
+				continue;
+			}
+			if (!strcmp(name, "benchmark")) {
+				printf("read benchmark ... ");
+				char status[50];
+				if (fscanf(fin, "%s", status) != 1) lcs::Error("Fail to read \"benchmark\"");
+				this->benchmark = tolower(status[0]) == 'e';
+				printf("Done. benchmark = %s\n", status);
+				continue;
+			}
+			if (!strcmp(name, "particleGathering")) {
+				printf("read particleGathering ... ");
+				char status[50];
+				if (fscanf(fin, "%s", status) != 1) lcs::Error("Fail to read \"particleGathering\"");
+				this->particleGathering = tolower(status[0]) == 'e';
+				printf("Done. particleGathering = %s\n", status);
+				continue;
+			}
+			if (!strcmp(name, "mixedPrecision")) {
+				printf("read mixedPrecision ... ");
+				char status[50];
+				if (fscanf(fin, "%s", status) != 1) lcs::Error("Fail to read \"mixedPrecision\"");
+				this->mixedPrecision = tolower(status[0]) == 'e';
+				printf("Done. mixedPrecision = %s\n", status);
+				continue;
+			}
+			if (!strcmp(name, "meshRenumbering")) {
+				printf("read meshRenumbering ... ");
+				char status[50];
+				if (fscanf(fin, "%s", status) != 1) lcs::Error("Fail to read \"meshRenumbering\"");
+				this->meshRenumbering = tolower(status[0]) == 'e';
+				printf("Done. meshRenumbering = %s\n", status);
+				continue;
 			}	
 		}
 	}
+
+	// The adaptive step size of RK45 is bounded by [minTimeStep, maxTimeStep], where 0 for maxTimeStep stands for timeInterval.
+	if (this->integration == "RK45") {
+		double maxTimeStep = this->maxTimeStep > 0 ? this->maxTimeStep : this->timeInterval;
+		if (this->tolerance <= 0) lcs::Error("\"tolerance\" should be positive");
+		if (this->minTimeStep <= 0) lcs::Error("\"minTimeStep\" should be positive");
+		if (this->maxTimeStep < 0 || maxTimeStep <= 0) lcs::Error("\"maxTimeStep\" should be positive");
+		if (this->minTimeStep > maxTimeStep) lcs::Error("\"minTimeStep\" should not be larger than \"maxTimeStep\"");
+	}
+
+	// The native backend runs without OpenCL, so it cannot use the options which only have kernels.
+	if (this->tracingBackend == "Native") {
+		if (this->integration != "RK4")
+			lcs::Error("The native tracing backend only supports \"RK4\" integration");
+		if (this->initialCellLocation != "Walk")
+			lcs::Error("The native tracing backend needs \"Walk\" for \"initialCellLocation\", because the others are OpenCL kernels");
+	}
 }
 
 void lcs::Configure::DefaultSetting() {
@@ -431,8 +675,29 @@ void lcs::Configure::DefaultSetting() {
 	this->timePoints.clear();
 	this->dataFileIndices.clear();
 	this->timeStep = 0.1;
+	this->tolerance = 1e-5;
+	this->minTimeStep = 1e-6;
+	this->maxTimeStep = 0;
 	this->blockSize = 1.0;
 	this->epsilon = 1e-8;
+	this->tracingBackend = "OpenCL";
+	this->initialCellLocation = "PointCentric";
+	this->numOfThreads = 0;
+	this->cellTransformMegabytes = 0;
+	this->meshCacheFile = "";
+	this->divisionCacheDirectory = "";
+	this->ftle = false;
+	this->outputFormat = "Text";
+	this->outputCompression = false;
+	this->telemetryFile = "";
+	this->benchmark = false;
+	this->particleGathering = false;
+	this->mixedPrecision = false;
+	this->meshRenumbering = false;
+	this->unitTestForNaturalCoordinates = false;
+	this->unitTestForVertexIncidence = false;
+	this->unitTestForTetrahedralLinks = false;
+	this->unitTestForMeshRenumbering = false;
 	// TODO: May add more default settings
 }
 
@@ -460,6 +725,14 @@ int lcs::Configure::GetNumOfBanks() const {
 	return this->numOfBanks;
 }
 
+int lcs::Configure::GetNumOfThreads() const {
+	return this->numOfThreads;
+}
+
+int lcs::Configure::GetCellTransformMegabytes() const {
+	return this->cellTransformMegabytes;
+}
+
 double lcs::Configure::GetTimeStep() const {
 	return this->timeStep;
 }
@@ -472,6 +745,18 @@ double lcs::Configure::GetTimeInterval() const {
 	return this->timeInterval;
 }
 
+double lcs::Configure::GetTolerance() const {
+	return this->tolerance;
+}
+
+double lcs::Configure::GetMinTimeStep() const {
+	return this->minTimeStep;
+}
+
+double lcs::Configure::GetMaxTimeStep() const {
+	return this->maxTimeStep;
+}
+
 double lcs::Configure::GetEpsilonForTetBlkIntersection() const {
 	return this->epsilonForTetBlkIntersection;
 }
@@ -520,6 +805,30 @@ std::string lcs::Configure::GetIntegration() const {
 	return this->integration;
 }
 
+std::string lcs::Configure::GetTracingBackend() const {
+	return this->tracingBackend;
+}
+
+std::string lcs::Configure::GetInitialCellLocation() const {
+	return this->initialCellLocation;
+}
+
+std::string lcs::Configure::GetMeshCacheFile() const {
+	return this->meshCacheFile;
+}
+
+std::string lcs::Configure::GetDivisionCacheDirectory() const {
+	return this->divisionCacheDirectory;
+}
+
+std::string lcs::Configure::GetOutputFormat() const {
+	return this->outputFormat;
+}
+
+std::string lcs::Configure::GetTelemetryFile() const {
+	return this->telemetryFile;
+}
+
 std::vector<double> lcs::Configure::GetTimePoints() const {
 	return this->timePoints;
 }
@@ -540,3 +849,43 @@ bool lcs::Configure::UseUnitTestForInitialCellLocation() const {
 	return this->unitTestForInitialCellLocation;
 }
 
+bool lcs::Configure::UseUnitTestForNaturalCoordinates() const {
+	return this->unitTestForNaturalCoordinates;
+}
+
+bool lcs::Configure::UseUnitTestForVertexIncidence() const {
+	return this->unitTestForVertexIncidence;
+}
+
+bool lcs::Configure::UseUnitTestForTetrahedralLinks() const {
+	return this->unitTestForTetrahedralLinks;
+}
+
+bool lcs::Configure::UseUnitTestForMeshRenumbering() const {
+	return this->unitTestForMeshRenumbering;
+}
+
+bool lcs::Configure::UseFTLE() const {
+	return this->ftle;
+}
+
+bool lcs::Configure::UseOutputCompression() const {
+	return this->outputCompression;
+}
+
+bool lcs::Configure::UseBenchmark() const {
+	return this->benchmark;
+}
+
+bool lcs::Configure::UseParticleGathering() const {
+	return this->particleGathering;
+}
+
+bool lcs::Configure::UseMixedPrecision() const {
+	return this->mixedPrecision;
+}
+
+bool lcs::Configure::UseMeshRenumbering() const {
+	return this->meshRenumbering;
+}
+
@@ -21,9 +21,18 @@ void ConsumeChar(char goal, FILE *fin);
 
 bool IsFloatChar(char ch);
 
-int GPUExclusiveScanForInt(int workGroupSize, int numOfBanks,
-			   cl_kernel scanKernel, cl_kernel reverseUpdateKernel, cl_mem globalArray, int length,
-			   cl_command_queue commandQueue);
+// Commands in an out-of-order queue are ordered by an event chain. A chained command waits for the event in the chain,
+// and its own event replaces it. A NULL chain means there is nothing to wait for.
+void ChainEvent(cl_event &chain, cl_event event);
+
+cl_uint GetNumOfWaitEvents(const cl_event &chain);
+
+const cl_event *GetWaitList(const cl_event &chain);
+
+// The sum of globalArray is copied to sum[sumOffset] in the device if sum is not NULL.
+void GPUExclusiveScanForInt(int workGroupSize, int numOfBanks,
+			    cl_kernel scanKernel, cl_kernel reverseUpdateKernel, cl_mem globalArray, int length,
+			    cl_mem sum, int sumOffset, cl_command_queue commandQueue, cl_event &chain);
 
 void CheckIntArrayInDevice(const char *fileName, cl_command_queue commandQueue, cl_mem intArr, int length);
 
@@ -31,6 +40,8 @@ void CheckFloatArrayInDevice(const char *fileName, cl_command_queue commandQueue
 
 void GetOrignalUnorderedIntArrayFromPartialSum(const char *fileName, cl_command_queue commandQueue,
 					       cl_mem intArr, int length);
+
+double GetWallTime();
 	
 ////////////////////////////////////////////////
 class Configure {
@@ -42,9 +53,14 @@ public:
 	int GetBoundingBoxYRes() const;
 	int GetBoundingBoxZRes() const;
 	int GetNumOfBanks() const;
+	int GetNumOfThreads() const;
+	int GetCellTransformMegabytes() const;
 	double GetTimeStep() const;
 	double GetBlockSize() const;
 	double GetTimeInterval() const;
+	double GetTolerance() const;
+	double GetMinTimeStep() const;
+	double GetMaxTimeStep() const;
 	double GetEpsilonForTetBlkIntersection() const;
 	double GetEpsilon() const;
 	double GetBoundingBoxMinX() const;
@@ -57,11 +73,27 @@ public:
 	std::string GetDataFilePrefix() const;
 	std::string GetDataFileSuffix() const;
 	std::string GetIntegration() const;
+	std::string GetTracingBackend() const;
+	std::string GetInitialCellLocation() const;
+	std::string GetMeshCacheFile() const;
+	std::string GetDivisionCacheDirectory() const;
+	std::string GetOutputFormat() const;
+	std::string GetTelemetryFile() const;
 	std::vector<double> GetTimePoints() const;
 	std::vector<std::string> GetDataFileIndices() const;
 	bool UseDouble() const;
 	bool UseUnitTestForTetBlkIntersection() const;
 	bool UseUnitTestForInitialCellLocation() const;
+	bool UseUnitTestForNaturalCoordinates() const;
+	bool UseUnitTestForVertexIncidence() const;
+	bool UseUnitTestForTetrahedralLinks() const;
+	bool UseUnitTestForMeshRenumbering() const;
+	bool UseFTLE() const;
+	bool UseOutputCompression() const;
+	bool UseBenchmark() const;
+	bool UseParticleGathering() const;
+	bool UseMixedPrecision() const;
+	bool UseMeshRenumbering() const;
 
 private:
 	void DefaultSetting();
@@ -73,14 +105,25 @@ private:
 	int boundingBoxYRes;
 	int boundingBoxZRes;
 	int numOfBanks;
+	int numOfThreads;
+	int cellTransformMegabytes;
 	std::vector<double> timePoints;
 	std::string dataFilePrefix;
 	std::string dataFileSuffix;
 	std::vector<std::string> dataFileIndices;
 	std::string integration;
+	std::string tracingBackend;
+	std::string initialCellLocation;
+	std::string meshCacheFile;
+	std::string divisionCacheDirectory;
+	std::string outputFormat;
+	std::string telemetryFile;
 	double timeStep;
 	double blockSize;
 	double timeInterval;
+	double tolerance;
+	double minTimeStep;
+	double maxTimeStep;
 	double epsilonForTetBlkIntersection;
 	double epsilon;
 	double boundingBoxMinX;
@@ -92,6 +135,16 @@ private:
 	bool useDouble;
 	bool unitTestForTetBlkIntersection;
 	bool unitTestForInitialCellLocation;
+	bool unitTestForNaturalCoordinates;
+	bool unitTestForVertexIncidence;
+	bool unitTestForTetrahedralLinks;
+	bool unitTestForMeshRenumbering;
+	bool ftle;
+	bool outputCompression;
+	bool benchmark;
+	bool particleGathering;
+	bool mixedPrecision;
+	bool meshRenumbering;
 };
 
 }
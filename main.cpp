@@ -8,13 +8,31 @@ Last Update	:	September 28th, 2012
 #include "lcsUtility.h"
 #include "lcsUnitTest.h"
 #include "lcsGeometry.h"
+#include "lcsNativeTracer.h"
+#include "lcsParallel.h"
+#include "lcsFrameStream.h"
+#include "lcsMeshCache.h"
+#include "lcsDivisionCache.h"
+#include "lcsFTLE.h"
+#include "lcsOutput.h"
+#include "lcsTelemetry.h"
+#include "lcsCellLocation.h"
+#include "lcsPipeline.h"
+
+#include <vtkImageData.h>
+#include <vtkPointData.h>
+#include <vtkDoubleArray.h>
+#include <vtkUnsignedCharArray.h>
+#include <vtkXMLImageDataWriter.h>
 
 #include <CL/opencl.h>
 #include <ctime>
+#include <cmath>
 #include <string>
 #include <algorithm>
+#include <vector>
 
-const char *configurationFile = "RungeKutta4.conf";
+const char *configurationFile;
 
 const char *tetrahedronBlockIntersectionKernel = "lcsTetrahedronBlockIntersectionKernel.cl";
 const char *initialCellLocationKernel = "lcsInitialCellLocationKernel.cl";
@@ -26,15 +44,21 @@ const char *collectActiveParticlesForNewRunKernels = "lcsCollectActiveParticlesF
 const char *redistributeParticlesKernels = "lcsRedistributeParticlesKernels.cl";
 const char *collectEveryKElementKernel = "lcsGetStartOffsetInParticlesKernel.cl";
 const char *assignWorkGroupsKernels = "lcsGetGroupsForBlocksKernels.cl";
+const char *gatherParticlesKernels = "lcsGatherParticlesKernels.cl";
+const char *relocateParticlesKernel = "lcsRelocateParticlesKernel.cl";
+const char *pointLocationKernels = "lcsPointLocationKernels.cl";
 
 const char *blockedTracingKernelPrefix = "lcsBlockedTracingKernelOf";
 const char *blockedTracingKernelSuffix = ".cl";
 
 const char *lastPositionFile = "lcsLastPositions.txt";
+const char *binaryLastPositionFile = "lcsLastPositions.bin";
+const char *vtkLastPositionFile = "lcsLastPositions.vti";
+const char *ftleFile = "lcsFTLE.vti";
 
 lcs::Configure *configure;
 
-lcs::Frame **frames;
+lcs::FrameStream *frameStream;
 int numOfFrames;
 
 int *tetrahedralConnectivities, *tetrahedralLinks;
@@ -58,6 +82,10 @@ bool *canFitInSharedMemory;
 int *startOffsetInCell, *startOffsetInPoint;
 int *startOffsetInCellForBig, *startOffsetInPointForBig;
 
+// Host copies of the interesting block map and the (tet, blk) to local tet ID map
+int *interestingBlockMap;
+int *startOffsetsInLocalIDMap, *blocksOfTets, *localIDsOfTets;
+
 // For initial cell location
 int *initialCellLocations;
 
@@ -66,6 +94,24 @@ lcs::ParticleRecord **particleRecords;
 int *exitCells;
 int numOfInitialActiveParticles;
 
+// The particles are seeded along the Morton curve of the grid. seedRanks[i] is the rank of particle i among
+// the initial active particles in the x-major order of the grid.
+int *seedRanks;
+
+// For native tracing
+lcs::NativeTracer *nativeTracer;
+
+// Final states of initial active particles
+double *finalPositions;
+int *finalExitCells;
+double *finalPastTimes;
+
+// Wall times of the main phases for the benchmark report
+double divisionTime, initialCellLocationTime, tracingTime, finalPositionTime;
+
+// The events of the tracing kernels, kept for the benchmark report to sum their device times
+std::vector<cl_event> tracingKernelEvents;
+
 // OpenCL variables
 
 // error, platform, device, context and command queue
@@ -123,6 +169,8 @@ int currActiveParticleArray;
 cl_mem d_stages;
 cl_mem d_lastPositionForRK4;
 cl_mem d_k1ForRK4, d_k2ForRK4, d_k3ForRK4;
+// FE and RK45 share the last positions with RK4, and RK45 shares k1 to k3 as well.
+cl_mem d_k4ForRK45, d_k5ForRK45, d_stepSizesForRK45;
 cl_mem d_pastTimes;
 cl_mem d_placesOfInterest;
 
@@ -137,10 +185,18 @@ cl_mem d_vertexPositionsForBig, d_startVelocitiesForBig, d_endVelocitiesForBig;
 // Device memory for canFitInSharedMemory flags
 cl_mem d_canFitInSharedMemory;
 
+// Device memory for the precomputed barycentric transforms of the cells (12 reals each).
+// startOffsetInCellForTransforms is -1 for the blocks without blocked transforms.
+cl_mem d_cellTransforms, d_blockedCellTransforms, d_startOffsetInCellForTransforms;
+int *startOffsetInCellForTransforms;
+int useGlobalTransforms;
+long long cellTransformBytes;
+
 // Device memory for active block list
 cl_mem d_activeBlocks;
 cl_mem d_activeBlockIndices;
 cl_mem d_numOfActiveBlocks;
+cl_mem d_numOfActiveParticles;
 
 // Device memory for tracing work groups distribution
 cl_mem d_numOfGroupsForBlocks;
@@ -153,6 +209,20 @@ cl_mem d_startOffsetInParticles;
 // Device memory for particles grouped in blocks
 cl_mem d_blockedActiveParticles;
 
+// Device memory for particle states gathered in block order (only with particleGathering)
+cl_mem d_gatheredStages, d_gatheredPastTimes, d_gatheredLastPositions, d_gatheredPlacesOfInterest;
+cl_mem d_gatheredKs[5], d_gatheredStepSizes;
+cl_mem d_gatheredLocalTetIDs, d_gatheredExitCells;
+
+// The vertex positions and velocities are in float under the mixed precision.
+bool UseDoubleGeometry() {
+	return configure->UseDouble() && !configure->UseMixedPrecision();
+}
+
+int GetSizeOfGeometryReal() {
+	return UseDoubleGeometry() ? sizeof(double) : sizeof(float);
+}
+
 int GetBlockID(int x, int y, int z) {
 	return (x * numOfBlocksInY + y) * numOfBlocksInZ + z;
 }
@@ -188,54 +258,75 @@ void ReadConfFile() {
 	if (configure->GetIntegration() == "FE") lcs::ParticleRecord::SetDataType(lcs::ParticleRecord::FE);
 	if (configure->GetIntegration() == "RK4") lcs::ParticleRecord::SetDataType(lcs::ParticleRecord::RK4);
 	if (configure->GetIntegration() == "RK45") lcs::ParticleRecord::SetDataType(lcs::ParticleRecord::RK45);
+	lcs::SetNumOfThreads(configure->GetNumOfThreads());
+	if (configure->UseMixedPrecision() && !configure->UseDouble())
+		lcs::Error("The mixed precision keeps the particle states in double, so double has to be enabled");
 	printf("\n");
 }
 
 void LoadFrames() {
 	numOfFrames = configure->GetNumOfFrames();
-	frames = new lcs::Frame *[numOfFrames];
+
+	std::vector<double> timePoints(numOfFrames);
+	std::vector<std::string> dataFileNames(numOfFrames);
 
 	for (int i = 0; i < numOfFrames; i++) {
-		double timePoint = configure->GetTimePoints()[i];
-		std::string dataFileName = configure->GetDataFilePrefix() + configure->GetDataFileIndices()[i] + 
-					   "." + configure->GetDataFileSuffix();
-		printf("Loading frame %d (file = %s) ... ", i, dataFileName.c_str());
-		frames[i] = new lcs::Frame(timePoint, dataFileName.c_str());
-		printf("Done.\n");
+		timePoints[i] = configure->GetTimePoints()[i];
+		dataFileNames[i] = configure->GetDataFilePrefix() + configure->GetDataFileIndices()[i] + 
+				   "." + configure->GetDataFileSuffix();
 	}
-	printf("\n");
+
+	if (configure->GetMeshCacheFile() == "") {
+		// Only frame 0 is loaded here. The velocities of the other frames are streamed in during tracing.
+		frameStream = new lcs::FrameStream(timePoints, dataFileNames, configure->UseMeshRenumbering());
+		return;
+	}
+
+	std::string meshCacheFile = configure->GetMeshCacheFile();
+
+	FILE *fin = fopen(meshCacheFile.c_str(), "rb");
+	if (fin == NULL) {
+		printf("Mesh cache %s is not found. Build it from the data files.\n", meshCacheFile.c_str());
+		lcs::MeshCache::Convert(meshCacheFile.c_str(), timePoints, dataFileNames);
+	} else
+		fclose(fin);
+
+	lcs::MeshCache *meshCache = new lcs::MeshCache(meshCacheFile.c_str());
+
+	bool sameFrames = meshCache->GetNumOfFrames() == numOfFrames;
+	for (int i = 0; sameFrames && i < numOfFrames; i++)
+		sameFrames = meshCache->GetTimePoint(i) == timePoints[i];
+	if (!sameFrames) lcs::Error("The mesh cache does not have the frames in the configure file");
+
+	frameStream = new lcs::FrameStream(meshCache, configure->UseMeshRenumbering());
 }
 
 void GetTopologyAndGeometry() {
-	globalNumOfCells = frames[0]->GetTetrahedralGrid()->GetNumOfCells();
-	globalNumOfPoints = frames[0]->GetTetrahedralGrid()->GetNumOfVertices();
+	globalNumOfCells = frameStream->GetTetrahedralGrid()->GetNumOfCells();
+	globalNumOfPoints = frameStream->GetTetrahedralGrid()->GetNumOfVertices();
 
-	tetrahedralConnectivities = new int [globalNumOfCells * 4];
-	tetrahedralLinks = new int [globalNumOfCells * 4];
+	// The topology and the double positions of the grid are used in place, so the arrays of a mesh cache stay
+	// in its mapping. They are only read, and the mesh is not renumbered after this point.
+	tetrahedralConnectivities = (int *)frameStream->GetTetrahedralGrid()->GetConnectivities();
+	tetrahedralLinks = (int *)frameStream->GetTetrahedralGrid()->GetLinks();
 
-	if (configure->UseDouble())
-		vertexPositions = new double [globalNumOfPoints * 3];
-	else
+	if (UseDoubleGeometry())
+		vertexPositions = (void *)frameStream->GetTetrahedralGrid()->GetPositions();
+	else {
 		vertexPositions = new float [globalNumOfPoints * 3];
-
-	frames[0]->GetTetrahedralGrid()->ReadConnectivities(tetrahedralConnectivities);
-	frames[0]->GetTetrahedralGrid()->ReadLinks(tetrahedralLinks);
-
-	if (configure->UseDouble())
-		frames[0]->GetTetrahedralGrid()->ReadPositions((double *)vertexPositions);
-	else
-		frames[0]->GetTetrahedralGrid()->ReadPositions((float *)vertexPositions);
+		frameStream->GetTetrahedralGrid()->ReadPositions((float *)vertexPositions);
+	}
 }
 
 void GetGlobalBoundingBox() {
-	lcs::Vector firstPoint = frames[0]->GetTetrahedralGrid()->GetVertex(0);
+	lcs::Vector firstPoint = frameStream->GetTetrahedralGrid()->GetVertex(0);
 
 	globalMaxX = globalMinX = firstPoint.GetX();
 	globalMaxY = globalMinY = firstPoint.GetY();
 	globalMaxZ = globalMinZ = firstPoint.GetZ();
 
 	for (int i = 1; i < globalNumOfPoints; i++) {
-		lcs::Vector point = frames[0]->GetTetrahedralGrid()->GetVertex(i);
+		lcs::Vector point = frameStream->GetTetrahedralGrid()->GetVertex(i);
 
 		globalMaxX = std::max(globalMaxX, point.GetX());
 		globalMinX = std::min(globalMinX, point.GetX());
@@ -273,7 +364,7 @@ void PrepareTetrahedronBlockIntersectionQueries() {
 
 	numOfQueries = 0;
 	for (int i = 0; i < globalNumOfCells; i++) {
-		lcs::Tetrahedron tetrahedron = frames[0]->GetTetrahedralGrid()->GetTetrahedron(i);
+		lcs::Tetrahedron tetrahedron = frameStream->GetTetrahedralGrid()->GetTetrahedron(i);
 		lcs::Vector firstPoint = tetrahedron.GetVertex(0);
 		double localMinX, localMaxX, localMinY, localMaxY, localMinZ, localMaxZ;
 		localMaxX = localMinX = firstPoint.GetX();
@@ -326,28 +417,40 @@ void PrepareTetrahedronBlockIntersectionQueries() {
 	delete [] zRightBound;
 }
 
-cl_program CreateProgram(const char *kernelFile, const char *kernelName) {
+// The code of headerFile, if any, is put in front of the code of kernelFile.
+cl_program CreateProgram(const char *kernelFile, const char *kernelName, const char *options = "",
+			 const char *headerFile = NULL) {
 
 	/// DEBUG ///
 	bool debug = !strcmp(kernelName, "blocked tracing");
 
 
-	// Load the kernel code
-	FILE *fin = fopen(kernelFile, "r");
-	if (fin == NULL) {
-		char str[100];
-		sprintf(str, "Fail to load the %s kernel", kernelName);
-		lcs::Error(str);
-	}
-
 	std::string kernelCode = "";
 
-	if (!configure->UseDouble()) kernelCode = "#define double float\n\n";
+	if (!configure->UseDouble()) kernelCode = "#define double float\n#define double4 float4\n";
+
+	// gdouble is the type of the vertex positions and velocities.
+	if (UseDoubleGeometry()) kernelCode += "#define gdouble double\n\n";
+	else kernelCode += "#define gdouble float\n\n";
+
+	// Load the kernel code
+	const char *files[] = {headerFile, kernelFile};
+	for (int i = 0; i < 2; i++) {
+		if (files[i] == NULL) continue;
+
+		FILE *fin = fopen(files[i], "r");
+		if (fin == NULL) {
+			char str[100];
+			sprintf(str, "Fail to load the %s kernel", kernelName);
+			lcs::Error(str);
+		}
 
-	char ch;
-	for (; (ch = fgetc(fin)) != EOF; kernelCode += ch);
+		char ch;
+		for (; (ch = fgetc(fin)) != EOF; kernelCode += ch);
+		kernelCode += "\n";
 
-	fclose(fin);
+		fclose(fin);
+	}
 
 	size_t codeLength = kernelCode.length() + 1; // Consider the tailing 0
 	const char *codeString = kernelCode.c_str();
@@ -366,7 +469,7 @@ cl_program CreateProgram(const char *kernelFile, const char *kernelName) {
 	/*if (debug)
 		err = clBuildProgram(program, 0, NULL, "-cl-opt-disable", NULL, NULL);
 	else*/
-		err = clBuildProgram(program, 0, NULL, "", NULL, NULL);
+		err = clBuildProgram(program, 0, NULL, options, NULL, NULL);
 
 
 	bool compilationFailure = err;
@@ -396,12 +499,7 @@ cl_program CreateProgram(const char *kernelFile, const char *kernelName) {
 	return program;
 }
 
-void LaunchGPUforIntersectionQueries() {
-	printf("Start to use GPU to process tetrahedron-block intersection queries ...\n");
-	printf("\n");
-
-	int startTime = clock();
-
+void InitializeOpenCL() {
 	// Get platform information
 	err = clGetPlatformIDs(0, NULL, &numOfPlatforms);
 	if (err) lcs::Error("Fail to get the number of platforms");
@@ -411,33 +509,48 @@ void LaunchGPUforIntersectionQueries() {
 	err = clGetPlatformIDs(numOfPlatforms, platformIDs, NULL);
 	if (err) lcs::Error("Fail to get the platform list");
 
-	int cudaPlatformID = -1;
+	int chosenPlatformID = -1;
 
 	for (int i = 0; i < numOfPlatforms; i++) {
-		char platformName[50];
-		err = clGetPlatformInfo(platformIDs[i], CL_PLATFORM_NAME, 50, platformName, NULL);
+		char platformName[100];
+		err = clGetPlatformInfo(platformIDs[i], CL_PLATFORM_NAME, 100, platformName, NULL);
 		if (err) lcs::Error("Fail to get the platform name");
 		printf("Platform %d is %s\n", i + 1, platformName);
-		if (!strcmp(platformName, "NVIDIA CUDA")) cudaPlatformID = i;
+		if (!strcmp(platformName, "NVIDIA CUDA")) chosenPlatformID = i;
 	}
 	printf("\n");
 
-	if (cudaPlatformID == -1) lcs::Error("Fail to find an NVIDIA CUDA platform");
+	// Without an NVIDIA CUDA platform (e.g. on GPU-less nodes), use the first platform which has any device.
+	cl_device_type deviceType = CL_DEVICE_TYPE_GPU;
 
-	printf("Platform %d (NVIDIA CUDA) is chosen for use.\n", cudaPlatformID + 1);
+	if (chosenPlatformID == -1) {
+		deviceType = CL_DEVICE_TYPE_ALL;
+		for (int i = 0; chosenPlatformID == -1 && i < (int)numOfPlatforms; i++) {
+			cl_uint count;
+			if (!clGetDeviceIDs(platformIDs[i], deviceType, 0, NULL, &count) && count) chosenPlatformID = i;
+		}
+	}
+
+	if (chosenPlatformID == -1) lcs::Error("Fail to find an OpenCL platform with a device");
+
+	char chosenPlatformName[100];
+	err = clGetPlatformInfo(platformIDs[chosenPlatformID], CL_PLATFORM_NAME, 100, chosenPlatformName, NULL);
+	if (err) lcs::Error("Fail to get the platform name");
+
+	printf("Platform %d (%s) is chosen for use.\n", chosenPlatformID + 1, chosenPlatformName);
 	printf("\n");
 
 	// Get device information
-	err = clGetDeviceIDs(platformIDs[cudaPlatformID], CL_DEVICE_TYPE_GPU, 0, NULL, &numOfDevices);
+	err = clGetDeviceIDs(platformIDs[chosenPlatformID], deviceType, 0, NULL, &numOfDevices);
 	if (err) lcs::Error("Fail to get the number of devices");
-	printf("CUDA platform has %d device(s).\n", numOfDevices);
+	printf("The platform has %d device(s).\n", numOfDevices);
 
 	deviceIDs = new cl_device_id [numOfDevices];
-	err = clGetDeviceIDs(platformIDs[cudaPlatformID], CL_DEVICE_TYPE_GPU, numOfDevices, deviceIDs, NULL);
+	err = clGetDeviceIDs(platformIDs[chosenPlatformID], deviceType, numOfDevices, deviceIDs, NULL);
 	if (err) lcs::Error("Fail to get the device list");
 	for (int i = 0; i < numOfDevices; i++) {
-		char deviceName[50];
-		err = clGetDeviceInfo(deviceIDs[i], CL_DEVICE_NAME, 50, deviceName, NULL);
+		char deviceName[100];
+		err = clGetDeviceInfo(deviceIDs[i], CL_DEVICE_NAME, 100, deviceName, NULL);
 		if (err) lcs::Error("Fail to get the device name");
 		printf("Device %d is %s\n", i + 1, deviceName);
 	}
@@ -454,10 +567,9 @@ void LaunchGPUforIntersectionQueries() {
 	commandQueue = clCreateCommandQueue(context, deviceIDs[0],
 					    CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE | CL_QUEUE_PROFILING_ENABLE, &err);
 	if (err) lcs::Error("Fail to create a command queue");
+}
 
-	// create the program
-	cl_program program = CreateProgram(tetrahedronBlockIntersectionKernel, "tetrahedron-block intersection");
-	
+void StoreGeometryInDevice() {
 	// Create OpenCL buffer pointing to the host tetrahedralConnectivities
 	h_tetrahedralConnectivities = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_USE_HOST_PTR,
 						     sizeof(int) * globalNumOfCells * 4, tetrahedralConnectivities, &err);
@@ -469,7 +581,7 @@ void LaunchGPUforIntersectionQueries() {
 	if (err) lcs::Error("Fail to create a buffer for host tetrahedralLinks");
 
 	// Create OpenCL buffer pointing to the host vertexPositions
-	if (configure->UseDouble())
+	if (UseDoubleGeometry())
 		h_vertexPositions = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_USE_HOST_PTR,
 						   sizeof(double) * globalNumOfPoints * 3, vertexPositions, &err);
 	else
@@ -477,23 +589,13 @@ void LaunchGPUforIntersectionQueries() {
 						   sizeof(float) * globalNumOfPoints * 3, vertexPositions, &err);
 	if (err) lcs::Error("Fail to create a buffer for host vertexPositions");
 
-	// Create OpenCL buffer pointing to the host queryTetrahedron
-	h_queryTetrahedron = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_USE_HOST_PTR,
-					    sizeof(int) * numOfQueries, queryTetrahedron, &err);
-	if (err) lcs::Error("Fail to create a buffer for host queryTetrahedron");
-
-	// Create OpenCL buffer pointing to the host queryBlock
-	h_queryBlock = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_USE_HOST_PTR,
-				      sizeof(int) * numOfQueries, queryBlock, &err);
-	if (err) lcs::Error("Fail to create a buffer for host queryBlock");
-
 	// Create OpenCL buffer pointing to the device tetrahedralConnectivities
 	d_tetrahedralConnectivities = clCreateBuffer(context, CL_MEM_READ_ONLY,
 						     sizeof(int) * globalNumOfCells * 4, NULL, &err);
 	if (err) lcs::Error("Fail to create a buffer for device tetrahedralConnectivities");
 
 	// Create OpenCL buffer pointing to the device vertexPositions
-	if (configure->UseDouble())
+	if (UseDoubleGeometry())
 		d_vertexPositions = clCreateBuffer(context, CL_MEM_READ_ONLY,
 						   sizeof(double) * globalNumOfPoints * 3, NULL, &err);
 	else
@@ -501,6 +603,41 @@ void LaunchGPUforIntersectionQueries() {
 						   sizeof(float) * globalNumOfPoints * 3, NULL, &err);
 	if (err) lcs::Error("Fail to create a buffer for device vertexPositions");
 
+	// Copy from host to device
+	err = clEnqueueCopyBuffer(commandQueue, h_tetrahedralConnectivities, d_tetrahedralConnectivities, 0, 0,
+				  sizeof(int) * globalNumOfCells * 4, 0, NULL, NULL);
+	if (err) lcs::Error("Fail to enqueue copyHConnToDConn");
+	
+	if (UseDoubleGeometry())
+		err = clEnqueueCopyBuffer(commandQueue, h_vertexPositions, d_vertexPositions, 0, 0,
+					  sizeof(double) * globalNumOfPoints * 3, 0, NULL, NULL);
+	else
+		err = clEnqueueCopyBuffer(commandQueue, h_vertexPositions, d_vertexPositions, 0, 0,
+					  sizeof(float) * globalNumOfPoints * 3, 0, NULL, NULL);
+	if (err) lcs::Error("Fail to enqueue copyHPosiToDPosi");
+
+	clFinish(commandQueue);
+}
+
+void LaunchGPUforIntersectionQueries() {
+	printf("Start to use GPU to process tetrahedron-block intersection queries ...\n");
+	printf("\n");
+
+	int startTime = clock();
+
+	// create the program
+	cl_program program = CreateProgram(tetrahedronBlockIntersectionKernel, "tetrahedron-block intersection");
+	
+	// Create OpenCL buffer pointing to the host queryTetrahedron
+	h_queryTetrahedron = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_USE_HOST_PTR,
+					    sizeof(int) * numOfQueries, queryTetrahedron, &err);
+	if (err) lcs::Error("Fail to create a buffer for host queryTetrahedron");
+
+	// Create OpenCL buffer pointing to the host queryBlock
+	h_queryBlock = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_USE_HOST_PTR,
+				      sizeof(int) * numOfQueries, queryBlock, &err);
+	if (err) lcs::Error("Fail to create a buffer for host queryBlock");
+
 	// Create OpenCL buffer pointing to the device queryTetrahedron
 	d_queryTetrahedron = clCreateBuffer(context, CL_MEM_READ_ONLY,
 					    sizeof(int) * numOfQueries, NULL, &err);
@@ -517,23 +654,9 @@ void LaunchGPUforIntersectionQueries() {
 	if (err) lcs::Error("Fail to create a buffer for device queryResults");
 
 	// Copy from host to device
-	cl_event copyHConnToDConn;
-	cl_event copyHPosiToDPosi;
 	cl_event copyHqueryTetToDqueryTet;
 	cl_event copyHqueryBlkToDqueryBlk;
 
-	err = clEnqueueCopyBuffer(commandQueue, h_tetrahedralConnectivities, d_tetrahedralConnectivities, 0, 0,
-				  sizeof(int) * globalNumOfCells * 4, 0, NULL, &copyHConnToDConn);
-	if (err) lcs::Error("Fail to enqueue copyHConnToDConn");
-	
-	if (configure->UseDouble())
-		err = clEnqueueCopyBuffer(commandQueue, h_vertexPositions, d_vertexPositions, 0, 0,
-					  sizeof(double) * globalNumOfPoints * 3, 0, NULL, &copyHPosiToDPosi);
-	else
-		err = clEnqueueCopyBuffer(commandQueue, h_vertexPositions, d_vertexPositions, 0, 0,
-					  sizeof(float) * globalNumOfPoints * 3, 0, NULL, &copyHPosiToDPosi);
-	if (err) lcs::Error("Fail to enqueue copyHPosiToDPosi");
-
 	err = clEnqueueCopyBuffer(commandQueue, h_queryTetrahedron, d_queryTetrahedron, 0, 0,
 				  sizeof(int) * numOfQueries, 0, NULL, &copyHqueryTetToDqueryTet);
 	if (err) lcs::Error("Fail to enqueue copyHqueryTetToDqueryTet");
@@ -606,7 +729,7 @@ void LaunchGPUforIntersectionQueries() {
 
 	// Enqueue the kernel event
 	cl_event kernelEvent;
-	cl_event eventList[] = {copyHConnToDConn, copyHPosiToDPosi, copyHqueryTetToDqueryTet, copyHqueryBlkToDqueryBlk};
+	cl_event eventList[] = {copyHqueryTetToDqueryTet, copyHqueryBlkToDqueryBlk};
 
 	err = clEnqueueNDRangeKernel(commandQueue, kernel, 1, NULL, globalWorkSize, localWorkSize,
 				     sizeof(eventList) / sizeof(cl_event), eventList, &kernelEvent);
@@ -627,8 +750,6 @@ void LaunchGPUforIntersectionQueries() {
 	clReleaseMemObject(d_queryBlock);
 	clReleaseMemObject(d_queryResults);
 
-	clReleaseEvent(copyHConnToDConn);
-	clReleaseEvent(copyHPosiToDPosi);
 	clReleaseEvent(copyHqueryTetToDqueryTet);
 	clReleaseEvent(copyHqueryBlkToDqueryBlk);
 	clReleaseEvent(kernelEvent);
@@ -649,7 +770,7 @@ void LaunchGPUforIntersectionQueries() {
 	startTime = clock();
 
 	if (configure->UseUnitTestForTetBlkIntersection()) {
-		lcs::UnitTestForTetBlkIntersection(frames[0]->GetTetrahedralGrid(),
+		lcs::UnitTestForTetBlkIntersection(frameStream->GetTetrahedralGrid(),
 						   blockSize, globalMinX, globalMinY, globalMinZ,
 						   numOfBlocksInY, numOfBlocksInZ,
 						   queryTetrahedron, queryBlock, queryResults,
@@ -663,15 +784,61 @@ void LaunchGPUforIntersectionQueries() {
 	printf("\n");
 }
 
+void SolveIntersectionQueriesInHost() {
+	printf("Start to use %d CPU thread(s) to process tetrahedron-block intersection queries ...\n", lcs::GetNumOfThreads());
+	printf("\n");
+
+	double startTime = lcs::GetWallTime();
+
+	lcs::SolveTetrahedronBlockIntersectionQueries(frameStream->GetTetrahedralGrid(),
+						      blockSize, globalMinX, globalMinY, globalMinZ,
+						      numOfBlocksInY, numOfBlocksInZ,
+						      queryTetrahedron, queryBlock, numOfQueries,
+						      configure->GetEpsilon(), queryResults);
+
+	printf("The host tetrahedron-block intersection queries cost %lf sec.\n", lcs::GetWallTime() - startTime);
+	printf("\n");
+}
+
+void UnitTestForLoadedDivision() {
+	// The intersection queries are not solved for a cached division,
+	// so rebuild them and take the answers from the loaded maps.
+	PrepareTetrahedronBlockIntersectionQueries();
+
+	for (int i = 0; i < numOfQueries; i++) {
+		int tetrahedronID = queryTetrahedron[i];
+		queryResults[i] = 0;
+		for (int j = startOffsetsInLocalIDMap[tetrahedronID]; j < startOffsetsInLocalIDMap[tetrahedronID + 1]; j++)
+			if (blocksOfTets[j] == queryBlock[i]) {
+				queryResults[i] = 1;
+				break;
+			}
+	}
+
+	int startTime = clock();
+
+	lcs::UnitTestForTetBlkIntersection(frameStream->GetTetrahedralGrid(),
+					   blockSize, globalMinX, globalMinY, globalMinZ,
+					   numOfBlocksInY, numOfBlocksInZ,
+					   queryTetrahedron, queryBlock, queryResults,
+					   numOfQueries, configure->GetEpsilon());
+	printf("\n");
+
+	int endTime = clock();
+
+	printf("The unit test cost %lf sec.\n", (endTime - startTime) * 1.0 / CLOCKS_PER_SEC);
+	printf("\n");
+
+	delete [] queryTetrahedron;
+	delete [] queryBlock;
+	delete [] queryResults;
+}
+
 void DivisionProcess() {
 	// Filter out empty blocks and build interestingBlockMap
-	numOfBlocks = numOfBlocksInX * numOfBlocksInY * numOfBlocksInZ;
-	int *interestingBlockMap = new int [numOfBlocks];
+	interestingBlockMap = new int [numOfBlocks];
 	memset(interestingBlockMap, 255, sizeof(int) * numOfBlocks);
 
-	d_interestingBlockMap = clCreateBuffer(context, CL_MEM_READ_ONLY, sizeof(int) * numOfBlocks, NULL, &err);
-	if (err) lcs::Error("Fail to create device interestingBlockMap");
-
 	numOfInterestingBlocks = 0;
 	for (int i = 0; i < numOfQueries; i++)
 		if (queryResults[i]) {
@@ -680,10 +847,6 @@ void DivisionProcess() {
 			interestingBlockMap[blockID] = numOfInterestingBlocks++;
 		}
 
-	err = clEnqueueWriteBuffer(commandQueue, d_interestingBlockMap, CL_TRUE, 0, sizeof(int) * numOfBlocks,
-				   interestingBlockMap, 0, NULL, NULL);
-	if (err) lcs::Error("Fail to write to device interestingBlockMap");
-
 	// Count the numbers of tetrahedrons in non-empty blocks and the numbers of blocks of tetrahedrons
 	int sizeOfHashMap = 0;
 
@@ -703,18 +866,8 @@ void DivisionProcess() {
 			sizeOfHashMap++;
 		}
 
-	// Initialize device arrays
-	d_startOffsetsInLocalIDMap = clCreateBuffer(context, CL_MEM_READ_ONLY, sizeof(int) * (globalNumOfCells + 1), NULL, &err);
-	if (err) lcs::Error("Fail to create device startOffsetsInLocalMap");
-
-	d_blocksOfTets = clCreateBuffer(context, CL_MEM_READ_ONLY, sizeof(int) * sizeOfHashMap, NULL, &err);
-	if (err) lcs::Error("Fail to create device blocksOfTets");
-
-	d_localIDsOfTets = clCreateBuffer(context, CL_MEM_READ_ONLY, sizeof(int) * sizeOfHashMap, NULL, &err);
-	if (err) lcs::Error("Fail to create device localIDsOfTets");
-
 	// Initialize some work arrays
-	int *startOffsetsInLocalIDMap = new int [globalNumOfCells + 1];
+	startOffsetsInLocalIDMap = new int [globalNumOfCells + 1];
 	
 	startOffsetsInLocalIDMap[0] = 0;
 	for (int i = 1; i <= globalNumOfCells; i++)
@@ -723,8 +876,8 @@ void DivisionProcess() {
 	int *topOfCells = new int [globalNumOfCells];
 	memset(topOfCells, 0, sizeof(int) * globalNumOfCells);
 
-	int *blocksOfTets = new int [sizeOfHashMap];
-	int *localIDsOfTets = new int [sizeOfHashMap];
+	blocksOfTets = new int [sizeOfHashMap];
+	localIDsOfTets = new int [sizeOfHashMap];
 
 	// Fill cellsInblock and build local cell ID map
 	cellsInBlock = new int * [numOfInterestingBlocks];
@@ -758,25 +911,8 @@ void DivisionProcess() {
 
 	printf("globalNumOfCells = %d\n", globalNumOfCells);
 
-	// Fill some device arrays
-	err = clEnqueueWriteBuffer(commandQueue, d_startOffsetsInLocalIDMap, CL_TRUE, 0, sizeof(int) * (globalNumOfCells + 1),
-				   startOffsetsInLocalIDMap, 0, NULL, NULL);
-	if (err) lcs::Error("Fail to write to device startOffsetsInLocalIDMap");
-
-	err = clEnqueueWriteBuffer(commandQueue, d_blocksOfTets, CL_TRUE, 0, sizeof(int) * sizeOfHashMap,
-				   blocksOfTets, 0, NULL, NULL);
-	if (err) lcs::Error("Fail to write to device blocksOfTets");
-
-	err = clEnqueueWriteBuffer(commandQueue, d_localIDsOfTets, CL_TRUE, 0, sizeof(int) * sizeOfHashMap,
-				   localIDsOfTets, 0, NULL, NULL);
-	if (err) lcs::Error("Fail to write to device localIDsOfTets");
-
-	// Delete some work arrays
-	delete [] startOffsetsInLocalIDMap;
+	// Delete some work arrays (the maps are kept in host for native tracing)
 	delete [] topOfCells;
-	delete [] blocksOfTets;
-	delete [] localIDsOfTets;
-	delete [] interestingBlockMap;
 
 	// Initialize blocks and release cellsInBlock and numOfTetrahedronsInBlock
 	blocks = new lcs::BlockRecord * [numOfInterestingBlocks];
@@ -830,7 +966,7 @@ void DivisionProcess() {
 		blocks[i]->CreateGlobalPointIDs(pointList);
 
 		// Mark whether the block can fit into the shared memory
-		int currentBlockMemoryCost = blocks[i]->EvaluateNumOfBytes();
+		int currentBlockMemoryCost = blocks[i]->EvaluateNumOfBytes(GetSizeOfGeometryReal());
 
 		if (currentBlockMemoryCost <= configure->GetSharedMemoryKilobytes() * 1024) {
 			smallEnoughBlocks++;
@@ -870,21 +1006,6 @@ void DivisionProcess() {
 	printf("Division is done. smallEnoughBlocks = %d\n", smallEnoughBlocks);
 	printf("\n");
 
-	// Select big blocks
-	int *bigBlocks = new int [numOfInterestingBlocks];
-	numOfBigBlocks = 0;
-	for (int i = 0; i < numOfInterestingBlocks; i++)
-		if (!canFitInSharedMemory[i])
-			bigBlocks[numOfBigBlocks++] = i;
-
-	d_bigBlocks = clCreateBuffer(context, CL_MEM_READ_ONLY, sizeof(int) * numOfBigBlocks, NULL, &err);
-	if (err) lcs::Error("Fail to create device bigBlocks");
-
-	err = clEnqueueWriteBuffer(commandQueue, d_bigBlocks, CL_TRUE, 0, sizeof(int) * numOfBigBlocks, bigBlocks, 0, NULL, NULL);
-	if (err) lcs::Error("Fail to write to d_bigBlockFail to write to d_bigBlocks");
-
-	delete [] bigBlocks;
-
 	// Release work arrays
 	delete [] cellMarks;
 	delete [] pointMarks;
@@ -915,72 +1036,273 @@ void DivisionProcess() {
 	printf("\n");
 }
 
-void StoreBlocksInDevice() {
-	// Initialize start offsets in cells and points
-	startOffsetInCell = new int [numOfInterestingBlocks + 1];
-	startOffsetInPoint = new int [numOfInterestingBlocks + 1];
-	startOffsetInCell[0] = 0;
-	startOffsetInPoint[0] = 0;
-
-	// Initialize startOffsetInCellForBig and startOffsetInPointForBig
-	startOffsetInCellForBig = new int [numOfInterestingBlocks + 1];
-	startOffsetInPointForBig = new int [numOfInterestingBlocks + 1];
-	startOffsetInCellForBig[0] = 0;
-	startOffsetInPointForBig[0] = 0;
+void StoreDivisionMapsInDevice() {
+	int sizeOfHashMap = startOffsetsInLocalIDMap[globalNumOfCells];
 
-	// Calculate start offsets
-	int maxNumOfCells = 0, maxNumOfPoints = 0;
-	for (int i = 0; i < numOfInterestingBlocks; i++) {
-		startOffsetInCell[i + 1] = startOffsetInCell[i] + blocks[i]->GetLocalNumOfCells();
-		startOffsetInPoint[i + 1] = startOffsetInPoint[i] + blocks[i]->GetLocalNumOfPoints();
+	// Initialize device arrays
+	d_interestingBlockMap = clCreateBuffer(context, CL_MEM_READ_ONLY, sizeof(int) * numOfBlocks, NULL, &err);
+	if (err) lcs::Error("Fail to create device interestingBlockMap");
 
-		if (blocks[i]->EvaluateNumOfBytes() > configure->GetSharedMemoryKilobytes() * 1024) {
-			startOffsetInCellForBig[i + 1] = startOffsetInCellForBig[i] + blocks[i]->GetLocalNumOfCells();
-			startOffsetInPointForBig[i + 1] = startOffsetInPointForBig[i] + blocks[i]->GetLocalNumOfPoints();
+	d_startOffsetsInLocalIDMap = clCreateBuffer(context, CL_MEM_READ_ONLY, sizeof(int) * (globalNumOfCells + 1), NULL, &err);
+	if (err) lcs::Error("Fail to create device startOffsetsInLocalMap");
 
-			maxNumOfCells += blocks[i]->GetLocalNumOfCells();
-			maxNumOfPoints += blocks[i]->GetLocalNumOfPoints();
-		} else {
-			startOffsetInCellForBig[i + 1] = startOffsetInCellForBig[i];
-			startOffsetInPointForBig[i + 1] = startOffsetInPointForBig[i];
-		}
-	}
+	d_blocksOfTets = clCreateBuffer(context, CL_MEM_READ_ONLY, sizeof(int) * sizeOfHashMap, NULL, &err);
+	if (err) lcs::Error("Fail to create device blocksOfTets");
 
-	printf("Total number of cells in all the blocks is %d.\n", startOffsetInCell[numOfInterestingBlocks]);
-	printf("Total number of points in all the blocks is %d.\n", startOffsetInPoint[numOfInterestingBlocks]);
-	printf("\n");
+	d_localIDsOfTets = clCreateBuffer(context, CL_MEM_READ_ONLY, sizeof(int) * sizeOfHashMap, NULL, &err);
+	if (err) lcs::Error("Fail to create device localIDsOfTets");
 
-	//Create d_canFitInSharedMemory
-	d_canFitInSharedMemory = clCreateBuffer(context, CL_MEM_READ_ONLY,
-						sizeof(bool) * numOfInterestingBlocks, NULL, &err);
-	if (err) lcs::Error("Fail to create a buffer for device canFitInSharedMemory");
+	// Fill some device arrays
+	err = clEnqueueWriteBuffer(commandQueue, d_interestingBlockMap, CL_TRUE, 0, sizeof(int) * numOfBlocks,
+				   interestingBlockMap, 0, NULL, NULL);
+	if (err) lcs::Error("Fail to write to device interestingBlockMap");
 
-	// Create d_vertexPositionsForBig
-	if (configure->UseDouble())
-		d_vertexPositionsForBig = clCreateBuffer(context, CL_MEM_READ_WRITE,
-							 sizeof(double) * 3 * maxNumOfPoints, NULL, &err);
-	else
-		d_vertexPositionsForBig = clCreateBuffer(context, CL_MEM_READ_WRITE,
-							 sizeof(float) * 3 * maxNumOfPoints, NULL, &err);
-	if (err) lcs::Error("Fail to create a buffer for device vertexPositionsForBig");
-	
-	// Create d_startVelocitiesForBig
-	if (configure->UseDouble())
-		d_startVelocitiesForBig = clCreateBuffer(context, CL_MEM_READ_WRITE,
-							 sizeof(double) * 3 * maxNumOfPoints, NULL, &err);
-	else
-		d_startVelocitiesForBig = clCreateBuffer(context, CL_MEM_READ_WRITE,
-							 sizeof(float) * 3 * maxNumOfPoints, NULL, &err);
-	if (err) lcs::Error("Fail to create a buffer for device startVelocitiesForBig");
+	err = clEnqueueWriteBuffer(commandQueue, d_startOffsetsInLocalIDMap, CL_TRUE, 0, sizeof(int) * (globalNumOfCells + 1),
+				   startOffsetsInLocalIDMap, 0, NULL, NULL);
+	if (err) lcs::Error("Fail to write to device startOffsetsInLocalIDMap");
 
-	// Create d_endVelocitiesForBig
-	if (configure->UseDouble())
-		d_endVelocitiesForBig = clCreateBuffer(context, CL_MEM_READ_WRITE,
-						       sizeof(double) * 3 * maxNumOfPoints, NULL, &err);
-	else
-		d_endVelocitiesForBig = clCreateBuffer(context, CL_MEM_READ_WRITE,
-						       sizeof(float) * 3 * maxNumOfPoints, NULL, &err);
-	if (err) lcs::Error("Fail to create a buffer for device endVelocitiesForBig");
+	err = clEnqueueWriteBuffer(commandQueue, d_blocksOfTets, CL_TRUE, 0, sizeof(int) * sizeOfHashMap,
+				   blocksOfTets, 0, NULL, NULL);
+	if (err) lcs::Error("Fail to write to device blocksOfTets");
+
+	err = clEnqueueWriteBuffer(commandQueue, d_localIDsOfTets, CL_TRUE, 0, sizeof(int) * sizeOfHashMap,
+				   localIDsOfTets, 0, NULL, NULL);
+	if (err) lcs::Error("Fail to write to device localIDsOfTets");
+
+	// Select big blocks
+	int *bigBlocks = new int [numOfInterestingBlocks];
+	numOfBigBlocks = 0;
+	for (int i = 0; i < numOfInterestingBlocks; i++)
+		if (!canFitInSharedMemory[i])
+			bigBlocks[numOfBigBlocks++] = i;
+
+	d_bigBlocks = clCreateBuffer(context, CL_MEM_READ_ONLY, sizeof(int) * numOfBigBlocks, NULL, &err);
+	if (err) lcs::Error("Fail to create device bigBlocks");
+
+	err = clEnqueueWriteBuffer(commandQueue, d_bigBlocks, CL_TRUE, 0, sizeof(int) * numOfBigBlocks, bigBlocks, 0, NULL, NULL);
+	if (err) lcs::Error("Fail to write to d_bigBlockFail to write to d_bigBlocks");
+
+	delete [] bigBlocks;
+}
+
+cl_mem CreateTransformBuffer(const double *transforms, int numOfCells) {
+	cl_mem buffer;
+
+	if (!numOfCells) {
+		buffer = clCreateBuffer(context, CL_MEM_READ_ONLY, GetSizeOfGeometryReal() * 12, NULL, &err);
+		if (err) lcs::Error("Fail to create a buffer for device cell transforms");
+		return buffer;
+	}
+
+	if (UseDoubleGeometry())
+		buffer = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+					sizeof(double) * 12 * numOfCells, (void *)transforms, &err);
+	else {
+		float *floatTransforms = new float [numOfCells * 12];
+		lcs::ConvertToFloat(transforms, floatTransforms, numOfCells * 12);
+		buffer = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+					sizeof(float) * 12 * numOfCells, floatTransforms, &err);
+		delete [] floatTransforms;
+	}
+	if (err) lcs::Error("Fail to create a buffer for device cell transforms");
+
+	return buffer;
+}
+
+// The number of seeds in [lowerBound, upperBound) of the grid points seedMin + i * seedStep (0 <= i <= res)
+int CountSeedsInRange(double seedMin, double seedStep, int res, double lowerBound, double upperBound) {
+	if (seedStep <= 0) return lowerBound <= seedMin && seedMin < upperBound ? res + 1 : 0;
+
+	int first = std::max(0, (int)ceil((lowerBound - seedMin) / seedStep));
+	int last = std::min(res, (int)ceil((upperBound - seedMin) / seedStep) - 1);
+
+	return std::max(last - first + 1, 0);
+}
+
+// Precompute the barycentric transforms within the budget of cellTransformMegabytes, so that a walk step is one
+// small matrix-vector product instead of reloading four vertices. The global transforms serve the walks which leave
+// the blocks. A block which fits in the shared memory can only get blocked transforms if they fit there as well,
+// since every work group of the block copies them in.
+// A block gets them if the walk steps they save pay for them. A particle which crosses a block walks through about
+// the cubic root of its cells, and the seeds in the box of the block estimate the particles. A saved step counts
+// as one transform in a big block, which no longer reloads four vertices from the global memory, and as half of one
+// in a small block, whose vertices are in the shared memory already. The blocks pay back the most per byte first.
+void StoreCellTransformsInDevice() {
+	if (lcs::ParticleRecord::GetDataType() == lcs::ParticleRecord::FE)
+		lcs::Error("The cell transforms only support RK4 and RK45");
+
+	long long budget = (long long)configure->GetCellTransformMegabytes() << 20;
+	long long bytesPerCell = GetSizeOfGeometryReal() * 12LL;
+
+	useGlobalTransforms = bytesPerCell * globalNumOfCells <= budget;
+	if (useGlobalTransforms) budget -= bytesPerCell * globalNumOfCells;
+
+	double seedMinX = configure->GetBoundingBoxMinX();
+	double seedMinY = configure->GetBoundingBoxMinY();
+	double seedMinZ = configure->GetBoundingBoxMinZ();
+
+	int xRes = configure->GetBoundingBoxXRes();
+	int yRes = configure->GetBoundingBoxYRes();
+	int zRes = configure->GetBoundingBoxZRes();
+
+	double dx = (configure->GetBoundingBoxMaxX() - seedMinX) / xRes;
+	double dy = (configure->GetBoundingBoxMaxY() - seedMinY) / yRes;
+	double dz = (configure->GetBoundingBoxMaxZ() - seedMinZ) / zRes;
+
+	startOffsetInCellForTransforms = new int [numOfInterestingBlocks];
+	for (int i = 0; i < numOfInterestingBlocks; i++)
+		startOffsetInCellForTransforms[i] = -1;
+
+	// Rate the blocks by the walk steps saved per cell
+	std::vector<std::pair<double, int> > candidates;
+	for (int blockID = 0; blockID < numOfBlocks; blockID++) {
+		int i = interestingBlockMap[blockID];
+		if (i == -1) continue;
+
+		int numOfCells = blocks[i]->GetLocalNumOfCells();
+
+		if (canFitInSharedMemory[i] && blocks[i]->EvaluateNumOfBytes(GetSizeOfGeometryReal()) +
+					       bytesPerCell * numOfCells > configure->GetSharedMemoryKilobytes() * 1024)
+			continue;
+
+		int x, y, z;
+		GetXYZFromBlockID(blockID, x, y, z);
+
+		double numOfSeeds = (double)CountSeedsInRange(seedMinX, dx, xRes, globalMinX + x * blockSize,
+							      globalMinX + (x + 1) * blockSize) *
+				    CountSeedsInRange(seedMinY, dy, yRes, globalMinY + y * blockSize,
+						      globalMinY + (y + 1) * blockSize) *
+				    CountSeedsInRange(seedMinZ, dz, zRes, globalMinZ + z * blockSize,
+						      globalMinZ + (z + 1) * blockSize);
+
+		double savedSteps = numOfSeeds * pow((double)numOfCells, 1.0 / 3);
+		if (canFitInSharedMemory[i]) savedSteps *= 0.5;
+
+		if (savedSteps > numOfCells)
+			candidates.push_back(std::make_pair(-savedSteps / numOfCells, i));
+	}
+
+	std::sort(candidates.begin(), candidates.end());
+
+	int numOfSmallBlocksWithTransforms = 0, numOfBigBlocksWithTransforms = 0, numOfBlockedCells = 0;
+	for (int j = 0; j < (int)candidates.size(); j++) {
+		int i = candidates[j].second;
+
+		long long cost = bytesPerCell * blocks[i]->GetLocalNumOfCells();
+		if (cost > budget) continue;
+
+		budget -= cost;
+		startOffsetInCellForTransforms[i] = numOfBlockedCells;
+		numOfBlockedCells += blocks[i]->GetLocalNumOfCells();
+
+		if (canFitInSharedMemory[i]) numOfSmallBlocksWithTransforms++;
+		else numOfBigBlocksWithTransforms++;
+	}
+
+	lcs::TetrahedralGrid *grid = frameStream->GetTetrahedralGrid();
+	grid->BuildBarycentricTransforms();
+	const double *transforms = grid->GetBarycentricTransforms();
+
+	d_cellTransforms = CreateTransformBuffer(transforms, useGlobalTransforms ? globalNumOfCells : 0);
+
+	// Gather the transforms of the chosen blocks in the order of their local cells
+	double *blockedTransforms = new double [std::max(numOfBlockedCells, 1) * 12];
+	for (int i = 0; i < numOfInterestingBlocks; i++) {
+		if (startOffsetInCellForTransforms[i] == -1) continue;
+
+		const int *globalCellIDs = blocks[i]->GetGlobalCellIDs();
+		for (int j = 0; j < blocks[i]->GetLocalNumOfCells(); j++)
+			memcpy(blockedTransforms + (startOffsetInCellForTransforms[i] + j) * 12,
+			       transforms + globalCellIDs[j] * 12LL, sizeof(double) * 12);
+	}
+
+	d_blockedCellTransforms = CreateTransformBuffer(blockedTransforms, numOfBlockedCells);
+	delete [] blockedTransforms;
+
+	d_startOffsetInCellForTransforms = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+							  sizeof(int) * std::max(numOfInterestingBlocks, 1),
+							  startOffsetInCellForTransforms, &err);
+	if (err) lcs::Error("Fail to create a buffer for device startOffsetInCellForTransforms");
+
+	cellTransformBytes = bytesPerCell * ((useGlobalTransforms ? globalNumOfCells : 0) + numOfBlockedCells);
+
+	double megabytes = 1.0 / (1 << 20);
+	printf("Cell transforms: global transforms are %s (%.2lf MB), %d of %d big blocks and %d of %d small blocks ",
+	       useGlobalTransforms ? "used" : "skipped", bytesPerCell * globalNumOfCells * megabytes,
+	       numOfBigBlocksWithTransforms, numOfBigBlocks,
+	       numOfSmallBlocksWithTransforms, numOfInterestingBlocks - numOfBigBlocks);
+	printf("have blocked transforms (%.2lf MB).\n", bytesPerCell * numOfBlockedCells * megabytes);
+	printf("The vertex positions of the big blocks take %.2lf MB for comparison.\n",
+	       GetSizeOfGeometryReal() * 3.0 * startOffsetInPointForBig[numOfInterestingBlocks] * megabytes);
+	printf("\n");
+}
+
+void StoreBlocksInDevice() {
+	// Initialize start offsets in cells and points
+	startOffsetInCell = new int [numOfInterestingBlocks + 1];
+	startOffsetInPoint = new int [numOfInterestingBlocks + 1];
+	startOffsetInCell[0] = 0;
+	startOffsetInPoint[0] = 0;
+
+	// Initialize startOffsetInCellForBig and startOffsetInPointForBig
+	startOffsetInCellForBig = new int [numOfInterestingBlocks + 1];
+	startOffsetInPointForBig = new int [numOfInterestingBlocks + 1];
+	startOffsetInCellForBig[0] = 0;
+	startOffsetInPointForBig[0] = 0;
+
+	// Calculate start offsets
+	int maxNumOfCells = 0, maxNumOfPoints = 0;
+	for (int i = 0; i < numOfInterestingBlocks; i++) {
+		startOffsetInCell[i + 1] = startOffsetInCell[i] + blocks[i]->GetLocalNumOfCells();
+		startOffsetInPoint[i + 1] = startOffsetInPoint[i] + blocks[i]->GetLocalNumOfPoints();
+
+		if (blocks[i]->EvaluateNumOfBytes(GetSizeOfGeometryReal()) > configure->GetSharedMemoryKilobytes() * 1024) {
+			startOffsetInCellForBig[i + 1] = startOffsetInCellForBig[i] + blocks[i]->GetLocalNumOfCells();
+			startOffsetInPointForBig[i + 1] = startOffsetInPointForBig[i] + blocks[i]->GetLocalNumOfPoints();
+
+			maxNumOfCells += blocks[i]->GetLocalNumOfCells();
+			maxNumOfPoints += blocks[i]->GetLocalNumOfPoints();
+		} else {
+			startOffsetInCellForBig[i + 1] = startOffsetInCellForBig[i];
+			startOffsetInPointForBig[i + 1] = startOffsetInPointForBig[i];
+		}
+	}
+
+	printf("Total number of cells in all the blocks is %d.\n", startOffsetInCell[numOfInterestingBlocks]);
+	printf("Total number of points in all the blocks is %d.\n", startOffsetInPoint[numOfInterestingBlocks]);
+	printf("\n");
+
+	//Create d_canFitInSharedMemory
+	d_canFitInSharedMemory = clCreateBuffer(context, CL_MEM_READ_ONLY,
+						sizeof(bool) * numOfInterestingBlocks, NULL, &err);
+	if (err) lcs::Error("Fail to create a buffer for device canFitInSharedMemory");
+
+	// Create d_vertexPositionsForBig
+	if (UseDoubleGeometry())
+		d_vertexPositionsForBig = clCreateBuffer(context, CL_MEM_READ_WRITE,
+							 sizeof(double) * 3 * maxNumOfPoints, NULL, &err);
+	else
+		d_vertexPositionsForBig = clCreateBuffer(context, CL_MEM_READ_WRITE,
+							 sizeof(float) * 3 * maxNumOfPoints, NULL, &err);
+	if (err) lcs::Error("Fail to create a buffer for device vertexPositionsForBig");
+	
+	// Create d_startVelocitiesForBig
+	if (UseDoubleGeometry())
+		d_startVelocitiesForBig = clCreateBuffer(context, CL_MEM_READ_WRITE,
+							 sizeof(double) * 3 * maxNumOfPoints, NULL, &err);
+	else
+		d_startVelocitiesForBig = clCreateBuffer(context, CL_MEM_READ_WRITE,
+							 sizeof(float) * 3 * maxNumOfPoints, NULL, &err);
+	if (err) lcs::Error("Fail to create a buffer for device startVelocitiesForBig");
+
+	// Create d_endVelocitiesForBig
+	if (UseDoubleGeometry())
+		d_endVelocitiesForBig = clCreateBuffer(context, CL_MEM_READ_WRITE,
+						       sizeof(double) * 3 * maxNumOfPoints, NULL, &err);
+	else
+		d_endVelocitiesForBig = clCreateBuffer(context, CL_MEM_READ_WRITE,
+						       sizeof(float) * 3 * maxNumOfPoints, NULL, &err);
+	if (err) lcs::Error("Fail to create a buffer for device endVelocitiesForBig");
 
 	// Create d_startOffsetInCell
 	d_startOffsetInCell = clCreateBuffer(context, CL_MEM_READ_ONLY,
@@ -1107,47 +1429,79 @@ void StoreBlocksInDevice() {
 		if (err) lcs::Error("Fail to enqueue write-to-device for d_globalPointIDs");
 	}
 
+	if (configure->GetCellTransformMegabytes() > 0) StoreCellTransformsInDevice();
+
 	clFinish(commandQueue);
 }
 
 void Division() {
-	// Prepare queries
-	PrepareTetrahedronBlockIntersectionQueries();
+	// The native backend divides the domain without OpenCL.
+	bool useOpenCL = configure->GetTracingBackend() == "OpenCL";
+
+	// Store the global geometry in device
+	if (useOpenCL)
+		StoreGeometryInDevice();
+
+	numOfBlocks = numOfBlocksInX * numOfBlocksInY * numOfBlocksInZ;
 
-	// Launch GPU to solve queries
-	LaunchGPUforIntersectionQueries();
+	// Try to load the division from the cache
+	lcs::DivisionCache *divisionCache = NULL;
+	bool divisionIsLoaded = false;
+
+	if (configure->GetDivisionCacheDirectory() != "") {
+		long long sizeOfPositions = GetSizeOfGeometryReal() * 3LL * globalNumOfPoints;
+		divisionCache = new lcs::DivisionCache(configure->GetDivisionCacheDirectory(),
+						       tetrahedralConnectivities, globalNumOfCells, vertexPositions, sizeOfPositions,
+						       numOfBlocks, blockSize, configure->GetEpsilon(),
+						       configure->GetEpsilonForTetBlkIntersection(), configure->GetSharedMemoryKilobytes());
+		divisionIsLoaded = divisionCache->Load(numOfInterestingBlocks, interestingBlockMap,
+						       startOffsetsInLocalIDMap, blocksOfTets, localIDsOfTets,
+						       blocks, canFitInSharedMemory);
+	}
+
+	if (divisionIsLoaded) {
+		printf("The division is loaded from %s.\n", divisionCache->GetFileName().c_str());
+		printf("The number of non-zero blocks is %d.\n", numOfInterestingBlocks);
+		printf("\n");
+
+		if (configure->UseUnitTestForTetBlkIntersection())
+			UnitTestForLoadedDivision();
+	} else {
+		// Prepare queries
+		PrepareTetrahedronBlockIntersectionQueries();
+
+		// Launch GPU to solve queries
+		if (useOpenCL)
+			LaunchGPUforIntersectionQueries();
+		else
+			SolveIntersectionQueriesInHost();
 	
-	// Main process of division
-	DivisionProcess();
+		// Main process of division
+		DivisionProcess();
+
+		if (divisionCache)
+			divisionCache->Save(numOfInterestingBlocks, interestingBlockMap,
+					    startOffsetsInLocalIDMap, blocksOfTets, localIDsOfTets,
+					    blocks, canFitInSharedMemory);
+	}
+
+	delete divisionCache;
+
+	if (!useOpenCL) return;
+
+	// Store the maps in device
+	StoreDivisionMapsInDevice();
 
 	// Store blocks in the global memory of device
 	StoreBlocksInDevice();
 }
 
-void InitialCellLocation() {
+void LocateGridPointsInDevice(int xRes, int yRes, int zRes, double minX, double minY, double minZ,
+			      double dx, double dy, double dz) {
 	printf("Start to use GPU to process initial cell location ...\n");
 	printf("\n");
 
-	int startTime = clock();
-
-	double minX = configure->GetBoundingBoxMinX();
-	double maxX = configure->GetBoundingBoxMaxX();
-	double minY = configure->GetBoundingBoxMinY();
-	double maxY = configure->GetBoundingBoxMaxY();
-	double minZ = configure->GetBoundingBoxMinZ();
-	double maxZ = configure->GetBoundingBoxMaxZ();
-
-	int xRes = configure->GetBoundingBoxXRes();
-	int yRes = configure->GetBoundingBoxYRes();
-	int zRes = configure->GetBoundingBoxZRes();
-
-	double dx = (maxX - minX) / xRes;
-	double dy = (maxY - minY) / yRes;
-	double dz = (maxZ - minZ) / zRes;
-
 	int numOfGridPoints = (xRes + 1) * (yRes + 1) * (zRes + 1);
-	initialCellLocations = new int [numOfGridPoints];
-	memset(initialCellLocations, 255, sizeof(int) * numOfGridPoints);
 
 	// Create the program
 	cl_program program = CreateProgram(initialCellLocationKernel, "initial cell location");
@@ -1163,8 +1517,10 @@ void InitialCellLocation() {
 				   initialCellLocations, 0, NULL, &copyHlocTDloc);
 	if (err) lcs::Error("Fail to enqueue copyHlocTDloc");
 
+	bool pointCentric = configure->GetInitialCellLocation() == "PointCentric";
+
 	// Create the kernel
-	cl_kernel kernel = clCreateKernel(program, "InitialCellLocation", &err);
+	cl_kernel kernel = clCreateKernel(program, pointCentric ? "PointCentricCellLocation" : "InitialCellLocation", &err);
 	if (err) lcs::Error("Fail to create the kernel for Initial Cell Location");
 
 	// Get the work group size
@@ -1177,56 +1533,116 @@ void InitialCellLocation() {
 	printf("workGroupSize = %d\n", workGroupSize);
 	printf("\n");
 
-	// Set the argument values for the kernel
-	clSetKernelArg(kernel, 0, sizeof(cl_mem), &d_vertexPositions);
-	clSetKernelArg(kernel, 1, sizeof(cl_mem), &d_tetrahedralConnectivities);
-	clSetKernelArg(kernel, 2, sizeof(cl_mem), &d_cellLocations);
+	size_t localWorkSize[] = {workGroupSize};
+	size_t globalWorkSize[1];
+
+	// The cells of every interesting block sorted by their global IDs (for the point-centric kernel)
+	cl_mem d_startOffsetInCellForLocation = NULL, d_cellIDsForLocation = NULL;
+
+	if (pointCentric) {
+		int *startOffsetInCellForLocation, *cellIDsForLocation;
+		lcs::GetSortedCellsOfBlocks(blocks, numOfInterestingBlocks, startOffsetInCellForLocation, cellIDsForLocation);
+
+		int numOfCellIDs = startOffsetInCellForLocation[numOfInterestingBlocks];
+
+		d_startOffsetInCellForLocation = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+								sizeof(int) * (numOfInterestingBlocks + 1),
+								startOffsetInCellForLocation, &err);
+		if (err) lcs::Error("Fail to create a buffer for device startOffsetInCellForLocation");
+
+		d_cellIDsForLocation = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+						      sizeof(int) * std::max(numOfCellIDs, 1), cellIDsForLocation, &err);
+		if (err) lcs::Error("Fail to create a buffer for device cellIDsForLocation");
+
+		delete [] startOffsetInCellForLocation;
+		delete [] cellIDsForLocation;
+
+		// Set the argument values for the kernel
+		clSetKernelArg(kernel, 0, sizeof(cl_mem), &d_vertexPositions);
+		clSetKernelArg(kernel, 1, sizeof(cl_mem), &d_tetrahedralConnectivities);
+		clSetKernelArg(kernel, 2, sizeof(cl_mem), &d_interestingBlockMap);
+		clSetKernelArg(kernel, 3, sizeof(cl_mem), &d_startOffsetInCellForLocation);
+		clSetKernelArg(kernel, 4, sizeof(cl_mem), &d_cellIDsForLocation);
+		clSetKernelArg(kernel, 5, sizeof(cl_mem), &d_cellLocations);
+
+		cl_int cl_xRes = xRes;
+		cl_int cl_yRes = yRes;
+		cl_int cl_zRes = zRes;
+
+		clSetKernelArg(kernel, 6, sizeof(cl_int), &cl_xRes);
+		clSetKernelArg(kernel, 7, sizeof(cl_int), &cl_yRes);
+		clSetKernelArg(kernel, 8, sizeof(cl_int), &cl_zRes);
+
+		double floatNumbers[11] = {minX, minY, minZ, dx, dy, dz, globalMinX, globalMinY, globalMinZ,
+					   blockSize, configure->GetEpsilon()};
+
+		for (int i = 0; i < 11; i++)
+			if (configure->UseDouble())
+				clSetKernelArg(kernel, 9 + i, sizeof(cl_double), floatNumbers + i);
+			else {
+				cl_float value = (float)floatNumbers[i];
+				clSetKernelArg(kernel, 9 + i, sizeof(cl_float), &value);
+			}
+
+		cl_int cl_numOfBlocksInX = numOfBlocksInX;
+		cl_int cl_numOfBlocksInY = numOfBlocksInY;
+		cl_int cl_numOfBlocksInZ = numOfBlocksInZ;
+
+		clSetKernelArg(kernel, 20, sizeof(cl_int), &cl_numOfBlocksInX);
+		clSetKernelArg(kernel, 21, sizeof(cl_int), &cl_numOfBlocksInY);
+		clSetKernelArg(kernel, 22, sizeof(cl_int), &cl_numOfBlocksInZ);
+
+		globalWorkSize[0] = ((numOfGridPoints - 1) / workGroupSize + 1) * workGroupSize;
+	} else {
+		// Set the argument values for the kernel
+		clSetKernelArg(kernel, 0, sizeof(cl_mem), &d_vertexPositions);
+		clSetKernelArg(kernel, 1, sizeof(cl_mem), &d_tetrahedralConnectivities);
+		clSetKernelArg(kernel, 2, sizeof(cl_mem), &d_cellLocations);
 	
-	cl_int cl_xRes = xRes;
-	cl_int cl_yRes = yRes;
-	cl_int cl_zRes = zRes;
+		cl_int cl_xRes = xRes;
+		cl_int cl_yRes = yRes;
+		cl_int cl_zRes = zRes;
 	
-	clSetKernelArg(kernel, 3, sizeof(cl_int), &cl_xRes);
-	clSetKernelArg(kernel, 4, sizeof(cl_int), &cl_yRes);
-	clSetKernelArg(kernel, 5, sizeof(cl_int), &cl_zRes);
+		clSetKernelArg(kernel, 3, sizeof(cl_int), &cl_xRes);
+		clSetKernelArg(kernel, 4, sizeof(cl_int), &cl_yRes);
+		clSetKernelArg(kernel, 5, sizeof(cl_int), &cl_zRes);
 
-	void *floatNumbers;
+		void *floatNumbers;
 
-	if (configure->UseDouble()) {
-		floatNumbers = new double [7];
-		((double *)floatNumbers)[0] = minX;
-		((double *)floatNumbers)[1] = minY;
-		((double *)floatNumbers)[2] = minZ;
-		((double *)floatNumbers)[3] = dx;
-		((double *)floatNumbers)[4] = dy;
-		((double *)floatNumbers)[5] = dz;
-		((double *)floatNumbers)[6] = configure->GetEpsilon();
-		for (int i = 0; i < 7; i++)
-			clSetKernelArg(kernel, 6 + i, sizeof(cl_double), (double *)floatNumbers + i);
-	} else {
-		floatNumbers = new float [7];
-		((float *)floatNumbers)[0] = (float)minX;
-		((float *)floatNumbers)[1] = (float)minY;
-		((float *)floatNumbers)[2] = (float)minZ;
-		((float *)floatNumbers)[3] = (float)dx;
-		((float *)floatNumbers)[4] = (float)dy;
-		((float *)floatNumbers)[5] = (float)dz;
-		((float *)floatNumbers)[6] = (float)configure->GetEpsilon();
-		for (int i = 0; i < 7; i++)
-			clSetKernelArg(kernel, 6 + i, sizeof(cl_float), (float *)floatNumbers + i);
-	}
+		if (configure->UseDouble()) {
+			floatNumbers = new double [7];
+			((double *)floatNumbers)[0] = minX;
+			((double *)floatNumbers)[1] = minY;
+			((double *)floatNumbers)[2] = minZ;
+			((double *)floatNumbers)[3] = dx;
+			((double *)floatNumbers)[4] = dy;
+			((double *)floatNumbers)[5] = dz;
+			((double *)floatNumbers)[6] = configure->GetEpsilon();
+			for (int i = 0; i < 7; i++)
+				clSetKernelArg(kernel, 6 + i, sizeof(cl_double), (double *)floatNumbers + i);
+		} else {
+			floatNumbers = new float [7];
+			((float *)floatNumbers)[0] = (float)minX;
+			((float *)floatNumbers)[1] = (float)minY;
+			((float *)floatNumbers)[2] = (float)minZ;
+			((float *)floatNumbers)[3] = (float)dx;
+			((float *)floatNumbers)[4] = (float)dy;
+			((float *)floatNumbers)[5] = (float)dz;
+			((float *)floatNumbers)[6] = (float)configure->GetEpsilon();
+			for (int i = 0; i < 7; i++)
+				clSetKernelArg(kernel, 6 + i, sizeof(cl_float), (float *)floatNumbers + i);
+		}
 
-	if (configure->UseDouble())
-		delete [] (double *)floatNumbers;
-	else
-		delete [] (float *)floatNumbers;
+		if (configure->UseDouble())
+			delete [] (double *)floatNumbers;
+		else
+			delete [] (float *)floatNumbers;
 
-	cl_int cl_numOfCells = globalNumOfCells;
-	clSetKernelArg(kernel, 13, sizeof(cl_int), &cl_numOfCells);
+		cl_int cl_numOfCells = globalNumOfCells;
+		clSetKernelArg(kernel, 13, sizeof(cl_int), &cl_numOfCells);
 
-	// Set local / global work size
-	size_t localWorkSize[] = {workGroupSize};
-	size_t globalWorkSize[] = {((globalNumOfCells - 1) / workGroupSize + 1) * workGroupSize};
+		globalWorkSize[0] = ((globalNumOfCells - 1) / workGroupSize + 1) * workGroupSize;
+	}
 
 	// Enqueue the kernel event
 	cl_event kernelEvent;
@@ -1247,20 +1663,84 @@ void InitialCellLocation() {
 
 	// Release some resources
 	clReleaseMemObject(d_cellLocations);
+	if (pointCentric) {
+		clReleaseMemObject(d_startOffsetInCellForLocation);
+		clReleaseMemObject(d_cellIDsForLocation);
+	}
 
 	clReleaseEvent(copyHlocTDloc);
 	clReleaseEvent(kernelEvent);
 	clReleaseEvent(copyDlocTHloc);
+}
+
+void LocateGridPointsByWalking(int xRes, int yRes, int zRes, double minX, double minY, double minZ,
+			       double dx, double dy, double dz) {
+	printf("Start to walk along the scanlines to process initial cell location ...\n");
+	printf("\n");
+
+	frameStream->GetTetrahedralGrid()->BuildBarycentricTransforms();
+
+	int *startOffsetInCell, *cellIDs;
+	lcs::GetSortedCellsOfBlocks(blocks, numOfInterestingBlocks, startOffsetInCell, cellIDs);
+
+	lcs::BlockIndex index;
+	index.minX = globalMinX;
+	index.minY = globalMinY;
+	index.minZ = globalMinZ;
+	index.blockSize = blockSize;
+	index.numOfBlocksInX = numOfBlocksInX;
+	index.numOfBlocksInY = numOfBlocksInY;
+	index.numOfBlocksInZ = numOfBlocksInZ;
+	index.interestingBlockMap = interestingBlockMap;
+	index.startOffsetInCell = startOffsetInCell;
+	index.cellIDs = cellIDs;
+
+	double origin[3] = {minX, minY, minZ};
+	double spacing[3] = {dx, dy, dz};
+
+	lcs::LocateGridPointsByWalking(frameStream->GetTetrahedralGrid(), index, xRes, yRes, zRes, origin, spacing,
+				       configure->GetEpsilon(), initialCellLocations);
+
+	delete [] startOffsetInCell;
+	delete [] cellIDs;
+}
+
+void InitialCellLocation() {
+	double startTime = lcs::GetWallTime();
+
+	double minX = configure->GetBoundingBoxMinX();
+	double maxX = configure->GetBoundingBoxMaxX();
+	double minY = configure->GetBoundingBoxMinY();
+	double maxY = configure->GetBoundingBoxMaxY();
+	double minZ = configure->GetBoundingBoxMinZ();
+	double maxZ = configure->GetBoundingBoxMaxZ();
+
+	int xRes = configure->GetBoundingBoxXRes();
+	int yRes = configure->GetBoundingBoxYRes();
+	int zRes = configure->GetBoundingBoxZRes();
+
+	double dx = (maxX - minX) / xRes;
+	double dy = (maxY - minY) / yRes;
+	double dz = (maxZ - minZ) / zRes;
+
+	int numOfGridPoints = (xRes + 1) * (yRes + 1) * (zRes + 1);
+	initialCellLocations = new int [numOfGridPoints];
+	memset(initialCellLocations, 255, sizeof(int) * numOfGridPoints);
+
+	if (configure->GetInitialCellLocation() == "Walk")
+		LocateGridPointsByWalking(xRes, yRes, zRes, minX, minY, minZ, dx, dy, dz);
+	else
+		LocateGridPointsInDevice(xRes, yRes, zRes, minX, minY, minZ, dx, dy, dz);
 
 	/// DEBUG ///
+	// The cell IDs are in the order of the data files.
 	FILE *locationFile = fopen("lcsInitialLocations.txt", "w");
 	for (int i = 0; i < numOfGridPoints; i++)
 		if (initialCellLocations[i] != -1)
-			fprintf(locationFile, "%d %d\n", i, initialCellLocations[i]);
+			fprintf(locationFile, "%d %d\n", i,
+				frameStream->GetTetrahedralGrid()->GetOriginalCellID(initialCellLocations[i]));
 	fclose(locationFile);
 
-	int endTime = clock();
-
 	printf("First 10 results: ");
 	for (int i = 0; i < 10; i++) {
 		if (i) printf(" ");
@@ -1268,14 +1748,14 @@ void InitialCellLocation() {
 	}
 	printf("\n\n");
 
-	printf("The GPU Kernel for initial cell locations cost %lf sec.\n", (endTime - startTime) * 1.0 / CLOCKS_PER_SEC);
+	printf("The initial cell location cost %lf sec.\n", lcs::GetWallTime() - startTime);
 	printf("\n");
 
 	// Unit Test for Initial Cell Location Kernel
-	startTime = clock();
+	int unitTestStartTime = clock();
 
 	if (configure->UseUnitTestForInitialCellLocation()) {
-		lcs::UnitTestForInitialCellLocations(frames[0]->GetTetrahedralGrid(),
+		lcs::UnitTestForInitialCellLocations(frameStream->GetTetrahedralGrid(),
 						     xRes, yRes, zRes,
 						     minX, minY, minZ,
 						     dx, dy, dz,
@@ -1284,9 +1764,22 @@ void InitialCellLocation() {
 		printf("\n");
 	}
 
-	endTime = clock();
+	// The particles are traced for one interval in the velocities of frame 0.
+	if (configure->UseUnitTestForMeshRenumbering()) {
+		lcs::UnitTestForMeshRenumbering(frameStream->GetTetrahedralGrid(),
+						xRes, yRes, zRes,
+						minX, minY, minZ,
+						dx, dy, dz,
+						initialCellLocations,
+						configure->GetTimeStep(),
+						(int)(configure->GetTimeInterval() / configure->GetTimeStep() + 0.5),
+						configure->GetEpsilon());
+		printf("\n");
+	}
 
-	printf("The unit test cost %lf sec.\n", (endTime - startTime) * 1.0 / CLOCKS_PER_SEC);
+	int unitTestEndTime = clock();
+
+	printf("The unit test cost %lf sec.\n", (unitTestEndTime - unitTestStartTime) * 1.0 / CLOCKS_PER_SEC);
 	printf("\n");
 }
 
@@ -1325,13 +1818,14 @@ void InitializeParticleRecordsInDevice() {
 					  sizeof(int) * numOfInitialActiveParticles, NULL, &err);
 	if (err) lcs::Error("Fail to create a buffer for device blockLocations");
 
-	// Initialize d_placesOfInterest (Another part is in lastPositions initialization)
+	// Initialize d_placesOfInterest (Another part is in lastPositions initialization).
+	// The particle states are padded to 4 components so that the kernels access them as double4.
 	if (configure->UseDouble())
 		d_placesOfInterest = clCreateBuffer(context, CL_MEM_READ_WRITE,
-						    sizeof(double) * 3 * numOfInitialActiveParticles, NULL, &err);
+						    sizeof(double) * 4 * numOfInitialActiveParticles, NULL, &err);
 	else
 		d_placesOfInterest = clCreateBuffer(context, CL_MEM_READ_WRITE,
-						    sizeof(float) * 3 * numOfInitialActiveParticles, NULL, &err);
+						    sizeof(float) * 4 * numOfInitialActiveParticles, NULL, &err);
 	if (err) lcs::Error("Fail to create a buffer for device placesOfInterest");	
 
 	// Initialize d_activeParticles[2]
@@ -1378,84 +1872,113 @@ void InitializeParticleRecordsInDevice() {
 
 	// Initialize some integration-specific device arrays
 	switch (lcs::ParticleRecord::GetDataType()) {
-	case lcs::ParticleRecord::RK4: {	
+	case lcs::ParticleRecord::FE:
+	case lcs::ParticleRecord::RK4:
+	case lcs::ParticleRecord::RK45: {	
 		// Initialize d_lastPositionForRK4
 		void *lastPosition;
 		if (configure->UseDouble())
-			lastPosition = new double [numOfInitialActiveParticles * 3];
+			lastPosition = new double [numOfInitialActiveParticles * 4];
 		else
-			lastPosition = new float [numOfInitialActiveParticles * 3];
+			lastPosition = new float [numOfInitialActiveParticles * 4];
 		for (int i = 0; i < numOfInitialActiveParticles; i++) {
-			lcs::ParticleRecordDataForRK4 *data = (lcs::ParticleRecordDataForRK4 *)particleRecords[i]->GetData();
-			lcs::Vector point = data->GetLastPosition();
+			// Every particle starts at its last position.
+			lcs::Vector point = particleRecords[i]->GetPositionInInterest();
 			double x = point.GetX();
 			double y = point.GetY();
 			double z = point.GetZ();
 			if (configure->UseDouble()) {
-				((double *)lastPosition)[i * 3] = x;
-				((double *)lastPosition)[i * 3 + 1] = y;
-				((double *)lastPosition)[i * 3 + 2] = z;
+				((double *)lastPosition)[i * 4] = x;
+				((double *)lastPosition)[i * 4 + 1] = y;
+				((double *)lastPosition)[i * 4 + 2] = z;
+				((double *)lastPosition)[i * 4 + 3] = 0;
 			} else {
-				((float *)lastPosition)[i * 3] = x;
-				((float *)lastPosition)[i * 3 + 1] = y;
-				((float *)lastPosition)[i * 3 + 2] = z;
+				((float *)lastPosition)[i * 4] = x;
+				((float *)lastPosition)[i * 4 + 1] = y;
+				((float *)lastPosition)[i * 4 + 2] = z;
+				((float *)lastPosition)[i * 4 + 3] = 0;
 			}
 		}
 
 		if (configure->UseDouble())
 			d_lastPositionForRK4 = clCreateBuffer(context, CL_MEM_READ_WRITE,
-							      sizeof(double) * 3 * numOfInitialActiveParticles, NULL, &err);
+							      sizeof(double) * 4 * numOfInitialActiveParticles, NULL, &err);
 		else
 			d_lastPositionForRK4 = clCreateBuffer(context, CL_MEM_READ_WRITE,
-							      sizeof(float) * 3 * numOfInitialActiveParticles, NULL, &err);
+							      sizeof(float) * 4 * numOfInitialActiveParticles, NULL, &err);
 		if (err) lcs::Error("Fail to create a buffer for device lastPosition for RK4");
 
 		if (configure->UseDouble())
 			err = clEnqueueWriteBuffer(commandQueue, d_lastPositionForRK4, CL_FALSE, 0,
-						   sizeof(double) * 3 * numOfInitialActiveParticles, lastPosition, 0, NULL, NULL);
+						   sizeof(double) * 4 * numOfInitialActiveParticles, lastPosition, 0, NULL, NULL);
 		else
 			err = clEnqueueWriteBuffer(commandQueue, d_lastPositionForRK4, CL_FALSE, 0,
-						   sizeof(float) * 3 * numOfInitialActiveParticles, lastPosition, 0, NULL, NULL);
+						   sizeof(float) * 4 * numOfInitialActiveParticles, lastPosition, 0, NULL, NULL);
 		if (err) lcs::Error("Fail to enqueue write-to-device for d_lastPositionForRK4");
 
 		// Additional work of placesOfInterest initialization
 		if (configure->UseDouble())
 			err = clEnqueueWriteBuffer(commandQueue, d_placesOfInterest, CL_FALSE, 0,
-						   sizeof(double) * 3 * numOfInitialActiveParticles, lastPosition, 0, NULL, NULL);
+						   sizeof(double) * 4 * numOfInitialActiveParticles, lastPosition, 0, NULL, NULL);
 		else
 			err = clEnqueueWriteBuffer(commandQueue, d_placesOfInterest, CL_FALSE, 0,
-						   sizeof(float) * 3 * numOfInitialActiveParticles, lastPosition, 0, NULL, NULL);
+						   sizeof(float) * 4 * numOfInitialActiveParticles, lastPosition, 0, NULL, NULL);
 		if (err) lcs::Error("Fail to enqueue write-to-device for d_placesOfInterest");
 
+		// FE has no intermediate stages.
+		if (lcs::ParticleRecord::GetDataType() == lcs::ParticleRecord::FE) break;
+
 		// Initialize d_k1ForRK4
 		if (configure->UseDouble())
 			d_k1ForRK4 = clCreateBuffer(context, CL_MEM_READ_WRITE,
-						    sizeof(double) * 3 * numOfInitialActiveParticles, NULL, &err);
+						    sizeof(double) * 4 * numOfInitialActiveParticles, NULL, &err);
 		else
 			d_k1ForRK4 = clCreateBuffer(context, CL_MEM_READ_WRITE,
-						    sizeof(float) * 3 * numOfInitialActiveParticles, NULL, &err);
+						    sizeof(float) * 4 * numOfInitialActiveParticles, NULL, &err);
 		if (err) lcs::Error("Fail to create a buffer for device k1 for RK4");
 
 		// Initialize d_k2ForRK4
 		if (configure->UseDouble())
 			d_k2ForRK4 = clCreateBuffer(context, CL_MEM_READ_WRITE,
-						    sizeof(double) * 3 * numOfInitialActiveParticles, NULL, &err);
+						    sizeof(double) * 4 * numOfInitialActiveParticles, NULL, &err);
 		else
 			d_k2ForRK4 = clCreateBuffer(context, CL_MEM_READ_WRITE,
-						    sizeof(float) * 3 * numOfInitialActiveParticles, NULL, &err);
+						    sizeof(float) * 4 * numOfInitialActiveParticles, NULL, &err);
 		if (err) lcs::Error("Fail to create a buffer for device k2 for RK4");
 
 		// Initialize d_k3ForRK4
 		if (configure->UseDouble())
 			d_k3ForRK4 = clCreateBuffer(context, CL_MEM_READ_WRITE,
-						    sizeof(double) * 3 * numOfInitialActiveParticles, NULL, &err);
+						    sizeof(double) * 4 * numOfInitialActiveParticles, NULL, &err);
 		else
 			d_k3ForRK4 = clCreateBuffer(context, CL_MEM_READ_WRITE,
-						    sizeof(float) * 3 * numOfInitialActiveParticles, NULL, &err);
+						    sizeof(float) * 4 * numOfInitialActiveParticles, NULL, &err);
 		if (err) lcs::Error("Fail to create a buffer for device k3 for RK4");
+
+		if (lcs::ParticleRecord::GetDataType() != lcs::ParticleRecord::RK45) break;
+
+		// Initialize d_k4ForRK45 and d_k5ForRK45
+		int sizeOfReal = configure->UseDouble() ? sizeof(double) : sizeof(float);
+
+		d_k4ForRK45 = clCreateBuffer(context, CL_MEM_READ_WRITE, sizeOfReal * 4 * numOfInitialActiveParticles, NULL, &err);
+		if (err) lcs::Error("Fail to create a buffer for device k4 for RK45");
+
+		d_k5ForRK45 = clCreateBuffer(context, CL_MEM_READ_WRITE, sizeOfReal * 4 * numOfInitialActiveParticles, NULL, &err);
+		if (err) lcs::Error("Fail to create a buffer for device k5 for RK45");
+
+		// Initialize d_stepSizesForRK45. 0 makes the kernel start with timeStep, the same as pastTimes.
+		d_stepSizesForRK45 = clCreateBuffer(context, CL_MEM_READ_WRITE, sizeOfReal * numOfInitialActiveParticles, NULL, &err);
+		if (err) lcs::Error("Fail to create a buffer for device step sizes for RK45");
+
+		err = clEnqueueWriteBuffer(commandQueue, d_stepSizesForRK45, CL_FALSE, 0, sizeOfReal * numOfInitialActiveParticles,
+					   pastTimes, 0, NULL, NULL);
+		if (err) lcs::Error("Fail to enqueue write-to-device for d_stepSizesForRK45");
 	} break;
 	}
 
+	// The non-blocking writes read from the host arrays until the queue finishes.
+	clFinish(commandQueue);
+
 	// Release some arrays
 	delete [] stage;
 	delete [] exitCells;
@@ -1464,10 +1987,11 @@ void InitializeParticleRecordsInDevice() {
 		delete [] (double *)pastTimes;
 	else
 		delete [] (float *)pastTimes;
-
-	clFinish(commandQueue);
 }
 
+// The queue is out-of-order, so the commands of the tracing loop are chained by events instead of clFinish.
+cl_event tracingEvent;
+
 void BigBlockInitializationForPositions() {
 	// create the program
 	cl_program program = CreateProgram(bigBlockInitializationForPositionsKernel, "big block initialization for positions");
@@ -1506,7 +2030,8 @@ void BigBlockInitializationForPositions() {
 	clFinish(commandQueue);
 }
 
-void BigBlockInitializationForVelocities(int currStartVIndex) {
+// The kernel runs after the last command in the chain and the write of the end velocities.
+void BigBlockInitializationForVelocities(int currStartVIndex, cl_event loadVelocities) {
 	// create the program
 	cl_program program = CreateProgram(bigBlockInitializationForVelocitiesKernel, "big block initialization for velocities");
 
@@ -1539,28 +2064,59 @@ void BigBlockInitializationForVelocities(int currStartVIndex) {
 	size_t globalWorkSize[] = {workGroupSize * numOfBigBlocks};
 
 	// Enqueue the kernel event
-	err = clEnqueueNDRangeKernel(commandQueue, kernel, 1, NULL, globalWorkSize, localWorkSize, 0, NULL, NULL);
+	cl_event waitList[2] = {loadVelocities, tracingEvent};
+	cl_event kernelEvent;
+	err = clEnqueueNDRangeKernel(commandQueue, kernel, 1, NULL, globalWorkSize, localWorkSize,
+				     1 + lcs::GetNumOfWaitEvents(tracingEvent), waitList, &kernelEvent);
 	if (err) lcs::Error("Fail to enqueue big block initialization for velocities kernel");
 
-	// Synchronization Point
-	clFinish(commandQueue);
+	if (lcs::Telemetry::IsEnabled()) lcs::Telemetry::RecordKernel("BigBlockInitializationForVelocities", kernelEvent);
+	lcs::ChainEvent(tracingEvent, kernelEvent);
 }
 
-/// DEBUG ///
-double kernelSum;
+void EnqueueChainedKernel(cl_kernel kernel, size_t globalWorkSize, size_t localWorkSize, const char *kernelName) {
+	cl_event event;
+	err = clEnqueueNDRangeKernel(commandQueue, kernel, 1, NULL, &globalWorkSize, &localWorkSize,
+				     lcs::GetNumOfWaitEvents(tracingEvent), lcs::GetWaitList(tracingEvent), &event);
+	if (err) {
+		char errorMessage[100];
+		sprintf(errorMessage, "Fail to enqueue %s", kernelName);
+		lcs::Error(errorMessage);
+	}
+	if (lcs::Telemetry::IsEnabled()) lcs::Telemetry::RecordKernel(kernelName, event);
+	lcs::ChainEvent(tracingEvent, event);
+}
 
-void LaunchBlockedTracingKernel(cl_kernel kernel, size_t workGroupSize, int numOfEvents, cl_event *events,
-				int currStartVIndex, int numOfWorkGroups, double beginTime, double finishTime) {
-	int starTime;
+// The write is not blocking, so data has to outlive it.
+void EnqueueChainedWrite(cl_mem buffer, size_t offset, size_t size, const void *data, const char *errorMessage) {
+	cl_event event;
+	err = clEnqueueWriteBuffer(commandQueue, buffer, CL_FALSE, offset, size, data,
+				   lcs::GetNumOfWaitEvents(tracingEvent), lcs::GetWaitList(tracingEvent), &event);
+	if (err) lcs::Error(errorMessage);
+	lcs::ChainEvent(tracingEvent, event);
+}
 
-	printf("Start to use GPU to process blocked tracing ...\n");
-	printf("\n");
+// It is the only synchronization with the host in a run of the tracing loop, and it ends an interval when it reads 0.
+int ReadNumOfActiveParticles() {
+	int numOfActiveParticles;
+	err = clEnqueueReadBuffer(commandQueue, d_numOfActiveParticles, CL_TRUE, 0, sizeof(int), &numOfActiveParticles,
+				  lcs::GetNumOfWaitEvents(tracingEvent), lcs::GetWaitList(tracingEvent), NULL);
+	if (err) lcs::Error("Fail to read d_numOfActiveParticles");
 
-	int startTime = clock();
+	// Everything recorded before has finished.
+	lcs::Telemetry::Flush();
 
+	return numOfActiveParticles;
+}
+
+// The kernel runs after the last command in the chain.
+void LaunchBlockedTracingKernel(cl_kernel kernel, size_t workGroupSize, int currStartVIndex,
+				    int numOfWorkGroups, cl_int numOfActiveBlocks, double beginTime, double finishTime) {
 	// Set the argument values for the kernel
 	switch (lcs::ParticleRecord::GetDataType()) {
-	case lcs::ParticleRecord::RK4: {
+	case lcs::ParticleRecord::FE:
+	case lcs::ParticleRecord::RK4:
+	case lcs::ParticleRecord::RK45: {
 		clSetKernelArg(kernel, 1, sizeof(cl_mem), &d_velocities[currStartVIndex]);
 		clSetKernelArg(kernel, 2, sizeof(cl_mem), &d_velocities[1 - currStartVIndex]);
 
@@ -1580,38 +2136,26 @@ void LaunchBlockedTracingKernel(cl_kernel kernel, size_t workGroupSize, int numO
 	} break;
 	}
 
+	clSetKernelArg(kernel, 37, sizeof(cl_int), &numOfActiveBlocks);
+
 	// Set local / global work size
 	size_t localWorkSize[] = {workGroupSize};
 	size_t globalWorkSize[] = {numOfWorkGroups * workGroupSize};
 
-	/// DEBUG ///
-	printf("workGroupSize = %d\n", workGroupSize);
-	printf("numOfWorkGroups = %d\n", numOfWorkGroups);
-
 	// Enqueue the kernel event
 	cl_event kernelEvent;
 	err = clEnqueueNDRangeKernel(commandQueue, kernel, 1, NULL, globalWorkSize, localWorkSize,
-				     numOfEvents, events, &kernelEvent);
-
-	/// DEBUG ///
-	printf("err = %d\n", err);
-
+				     lcs::GetNumOfWaitEvents(tracingEvent), lcs::GetWaitList(tracingEvent), &kernelEvent);
 	if (err) lcs::Error("Fail to enqueue blocked tracing kernel");
 
-	/// DEBUG ///
-	err = clFinish(commandQueue);
-	printf("blocked tracing kernel clFinish = %d\n", err);
-
-	// Release some resources
-	clReleaseEvent(kernelEvent);
-
-	int endTime = clock();
+	if (lcs::Telemetry::IsEnabled()) lcs::Telemetry::RecordKernel("BlockedTracing", kernelEvent);
 
-	/// DEBUG ///
-	kernelSum += (double)(endTime - startTime) / CLOCKS_PER_SEC;
+	if (configure->UseBenchmark()) {
+		clRetainEvent(kernelEvent);
+		tracingKernelEvents.push_back(kernelEvent);
+	}
 
-	printf("The GPU Kernel for blocked tracing cost %lf sec.\n", (endTime - startTime) * 1.0 / CLOCKS_PER_SEC);
-	printf("\n");
+	lcs::ChainEvent(tracingEvent, kernelEvent);
 }
 
 void InitializeInitialActiveParticles() {
@@ -1644,7 +2188,12 @@ void InitializeInitialActiveParticles() {
 	// Initialize particleRecords
 	particleRecords = new lcs::ParticleRecord * [numOfInitialActiveParticles];
 
-	int idx = -1, activeIdx = -1;
+	// Sort the seeded grid points along the Morton curve, so that neighbouring particles are close in space.
+	int *activeGridPoints = new int [numOfInitialActiveParticles];
+	std::vector<std::pair<unsigned long long, int> > seeds;
+	seeds.reserve(numOfInitialActiveParticles);
+
+	int idx = -1, rank = -1;
 	for (int i = 0; i <= xRes; i++)
 		for (int j = 0; j <= yRes; j++)
 			for (int k = 0; k <= zRes; k++) {
@@ -1652,45 +2201,74 @@ void InitializeInitialActiveParticles() {
 
 				if (initialCellLocations[idx] == -1) continue;
 
-				activeIdx++;
-
-				switch (lcs::ParticleRecord::GetDataType()) {
-				case lcs::ParticleRecord::RK4: {
-					lcs::ParticleRecordDataForRK4 *data = new lcs::ParticleRecordDataForRK4();
-					data->SetLastPosition(lcs::Vector(minX + i * dx, minY + j * dy, minZ + k * dz));
-					particleRecords[activeIdx] = new
-								     lcs::ParticleRecord(lcs::ParticleRecordDataForRK4::COMPUTING_K1,
-								     idx, data);
-				} break;
-				}
+				rank++;
+				activeGridPoints[rank] = idx;
+				seeds.push_back(std::make_pair(lcs::MortonCode(i, j, k), rank));
 			}
 
+	std::sort(seeds.begin(), seeds.end());
+
+	seedRanks = new int [numOfInitialActiveParticles];
+
+	for (int activeIdx = 0; activeIdx < numOfInitialActiveParticles; activeIdx++) {
+		seedRanks[activeIdx] = seeds[activeIdx].second;
+
+		idx = activeGridPoints[seedRanks[activeIdx]];
+
+		int k = idx % (zRes + 1);
+		int j = idx / (zRes + 1) % (yRes + 1);
+		int i = idx / (zRes + 1) / (yRes + 1);
+
+		switch (lcs::ParticleRecord::GetDataType()) {
+		case lcs::ParticleRecord::FE: {
+			lcs::ParticleRecordDataForFE *data = new lcs::ParticleRecordDataForFE();
+			data->SetLastPosition(lcs::Vector(minX + i * dx, minY + j * dy, minZ + k * dz));
+			particleRecords[activeIdx] = new
+						     lcs::ParticleRecord(lcs::ParticleRecordDataForFE::COMPUTING_K1,
+						     idx, data);
+		} break;
+		case lcs::ParticleRecord::RK4: {
+			lcs::ParticleRecordDataForRK4 *data = new lcs::ParticleRecordDataForRK4();
+			data->SetLastPosition(lcs::Vector(minX + i * dx, minY + j * dy, minZ + k * dz));
+			particleRecords[activeIdx] = new
+						     lcs::ParticleRecord(lcs::ParticleRecordDataForRK4::COMPUTING_K1,
+						     idx, data);
+		} break;
+		case lcs::ParticleRecord::RK45: {
+			lcs::ParticleRecordDataForRK45 *data = new lcs::ParticleRecordDataForRK45();
+			data->SetLastPosition(lcs::Vector(minX + i * dx, minY + j * dy, minZ + k * dz));
+			particleRecords[activeIdx] = new
+						     lcs::ParticleRecord(lcs::ParticleRecordDataForRK45::COMPUTING_K1,
+						     idx, data);
+		} break;
+		}
+	}
+
+	delete [] activeGridPoints;
+
 	// Initialize exitCells
 	exitCells = new int [numOfInitialActiveParticles];
 	for (int i = 0; i < numOfInitialActiveParticles; i++)
 		exitCells[i] = initialCellLocations[particleRecords[i]->GetGridPointID()];
-
-	// Initialize particle records in device
-	InitializeParticleRecordsInDevice();
 }
 
 void InitializeVelocityData(void **velocities) {
 	// Initialize velocity data
 	for (int i = 0; i < 2; i++)
-		if (configure->UseDouble())
+		if (UseDoubleGeometry())
 			velocities[i] = new double [globalNumOfPoints * 3];
 		else
 			velocities[i] = new float [globalNumOfPoints * 3];
 
 	// Read velocities[0]
-	if (configure->UseDouble())
-		frames[0]->GetTetrahedralGrid()->ReadVelocities((double *)velocities[0]);
+	if (UseDoubleGeometry())
+		frameStream->ReadVelocities(0, (double *)velocities[0]);
 	else
-		frames[0]->GetTetrahedralGrid()->ReadVelocities((float *)velocities[0]);
+		frameStream->ReadVelocities(0, (float *)velocities[0]);
 
 	// Create d_velocities[2]
 	for (int i = 0; i < 2; i++) {
-		if (configure->UseDouble())
+		if (UseDoubleGeometry())
 			d_velocities[i] = clCreateBuffer(context, CL_MEM_READ_ONLY,
 							 sizeof(double) * 3 * globalNumOfPoints, NULL, &err);
 		else
@@ -1700,7 +2278,7 @@ void InitializeVelocityData(void **velocities) {
 	}
 
 	// Initialize d_velocities[0]
-	if (configure->UseDouble())
+	if (UseDoubleGeometry())
 		err = clEnqueueWriteBuffer(commandQueue, d_velocities[0], CL_TRUE, 0, sizeof(double) * 3 * globalNumOfPoints,
 					   velocities[0], 0, NULL, NULL);
 	else
@@ -1711,14 +2289,14 @@ void InitializeVelocityData(void **velocities) {
 
 cl_event LoadVelocities(void *velocities, cl_mem d_velocities, int frameIdx) {
 	// Read velocities
-	if (configure->UseDouble())
-		frames[frameIdx]->GetTetrahedralGrid()->ReadVelocities((double *)velocities);
+	if (UseDoubleGeometry())
+		frameStream->ReadVelocities(frameIdx, (double *)velocities);
 	else
-		frames[frameIdx]->GetTetrahedralGrid()->ReadVelocities((float *)velocities);
+		frameStream->ReadVelocities(frameIdx, (float *)velocities);
 
 	// Enqueue write for d_velocities[frameIdx]
 	cl_event writeEvent;
-	if (configure->UseDouble())
+	if (UseDoubleGeometry())
 		err = clEnqueueWriteBuffer(commandQueue, d_velocities, CL_FALSE, 0, sizeof(double) * 3 * globalNumOfPoints,
 					   velocities, 0, NULL, &writeEvent);
 	else
@@ -1813,9 +2391,10 @@ void InitializeCollectActiveParticlesForNewRunKernel(cl_program &collect2Program
 	for (; workGroupSize * 2 <= upperBound; workGroupSize <<= 1);
 }
 
-int CollectActiveParticlesForNewInterval(cl_kernel collect1InitKernel, cl_kernel collect1PickKernel, int collect1WorkGroupSize,
-					 cl_kernel scanKernel, cl_kernel reverseUpdateKernel, int scanWorkGroupSize,
-					 int numOfBanks, cl_mem d_activeParticles) {
+// The number of active particles stays in d_numOfActiveParticles for the first run of the interval.
+void CollectActiveParticlesForNewInterval(cl_kernel collect1InitKernel, cl_kernel collect1PickKernel, int collect1WorkGroupSize,
+					  cl_kernel scanKernel, cl_kernel reverseUpdateKernel, int scanWorkGroupSize,
+					  int numOfBanks, cl_mem d_activeParticles) {
 	// Prepare for exclusive scan
 	clSetKernelArg(collect1InitKernel, 0, sizeof(cl_mem), &d_exitCells);
 	clSetKernelArg(collect1InitKernel, 1, sizeof(cl_mem), &d_exclusiveScanArrayForInt);
@@ -1825,16 +2404,12 @@ int CollectActiveParticlesForNewInterval(cl_kernel collect1InitKernel, cl_kernel
 	size_t localWorkSize = collect1WorkGroupSize;
 	size_t globalWorkSize = ((length - 1) / localWorkSize + 1) * localWorkSize;
 
-	err = clEnqueueNDRangeKernel(commandQueue, collect1InitKernel, 1, NULL,
-				     &globalWorkSize, &localWorkSize, 0, NULL, NULL);
-	if (err) lcs::Error("Fail to enqueue collect1InitKernel");
-	
-	clFinish(commandQueue);
+	EnqueueChainedKernel(collect1InitKernel, globalWorkSize, localWorkSize, "Collect1InitKernel");
 
 	// Launch exclusive scan
-	int sum;
-	sum = lcs::GPUExclusiveScanForInt(scanWorkGroupSize, numOfBanks, scanKernel, reverseUpdateKernel,
-					  d_exclusiveScanArrayForInt, numOfInitialActiveParticles, commandQueue);
+	lcs::GPUExclusiveScanForInt(scanWorkGroupSize, numOfBanks, scanKernel, reverseUpdateKernel,
+				    d_exclusiveScanArrayForInt, numOfInitialActiveParticles,
+				    d_numOfActiveParticles, 0, commandQueue, tracingEvent);
 
 	// Compaction
 	clSetKernelArg(collect1PickKernel, 0, sizeof(cl_mem), &d_exitCells);
@@ -1842,14 +2417,7 @@ int CollectActiveParticlesForNewInterval(cl_kernel collect1InitKernel, cl_kernel
 	clSetKernelArg(collect1PickKernel, 2, sizeof(cl_mem), &d_activeParticles);
 	clSetKernelArg(collect1PickKernel, 3, sizeof(cl_int), &length);
 
-	err = clEnqueueNDRangeKernel(commandQueue, collect1PickKernel, 1, NULL,
-				     &globalWorkSize, &localWorkSize, 0, NULL, NULL);
-	if (err) lcs::Error("Fail to enqueue collect1PickKernel");
-
-	clFinish(commandQueue);
-
-	// Return number of active particles
-	return sum;
+	EnqueueChainedKernel(collect1PickKernel, globalWorkSize, localWorkSize, "Collect1PickKernel");
 }
 
 int CollectActiveParticlesForNewRun(cl_kernel collect2InitKernel, cl_kernel collect2PickKernel, int collect2WorkGroupSize,
@@ -1864,19 +2432,12 @@ int CollectActiveParticlesForNewRun(cl_kernel collect2InitKernel, cl_kernel coll
 	size_t localWorkSize = collect2WorkGroupSize;
 	size_t globalWorkSize = ((length - 1) / localWorkSize + 1) * localWorkSize;
 
-	err = clEnqueueNDRangeKernel(commandQueue, collect2InitKernel, 1, NULL,
-				     &globalWorkSize, &localWorkSize, 0, NULL, NULL);
-	if (err) lcs::Error("Fail to enqueue collect2InitKernel");
-	
-	clFinish(commandQueue);
+	EnqueueChainedKernel(collect2InitKernel, globalWorkSize, localWorkSize, "Collect2InitKernel");
 
 	// Launch exclusive scan
-	int sum;
-	sum = lcs::GPUExclusiveScanForInt(scanWorkGroupSize, numOfBanks, scanKernel, reverseUpdateKernel,
-					  d_exclusiveScanArrayForInt, length, commandQueue);
-
-	/// DEBUG ///
-	printf("CollectActiveParticlesForNewRun(): length = %d, sum = %d\n", length, sum);
+	lcs::GPUExclusiveScanForInt(scanWorkGroupSize, numOfBanks, scanKernel, reverseUpdateKernel,
+				    d_exclusiveScanArrayForInt, length,
+				    d_numOfActiveParticles, 0, commandQueue, tracingEvent);
 
 	// Compaction
 	clSetKernelArg(collect2PickKernel, 0, sizeof(cl_mem), &d_exitCells);
@@ -1885,14 +2446,10 @@ int CollectActiveParticlesForNewRun(cl_kernel collect2InitKernel, cl_kernel coll
 	clSetKernelArg(collect2PickKernel, 3, sizeof(cl_mem), &d_newActiveParticles);
 	clSetKernelArg(collect2PickKernel, 4, sizeof(cl_int), &length);
 
-	err = clEnqueueNDRangeKernel(commandQueue, collect2PickKernel, 1, NULL,
-				     &globalWorkSize, &localWorkSize, 0, NULL, NULL);
-	if (err) lcs::Error("Fail to enqueue collect2PickKernel");
-
-	clFinish(commandQueue);
+	EnqueueChainedKernel(collect2PickKernel, globalWorkSize, localWorkSize, "Collect2PickKernel");
 
 	// Return number of active particles
-	return sum;
+	return ReadNumOfActiveParticles();
 }
 
 void InitializeInterestingBlockMarks() {
@@ -2009,25 +2566,21 @@ void InitializeRedistributeParticlesKernel(cl_program &redistributeProgram,
 	//clSetKernelArg(statisticsKernel, 6, sizeof(cl_mem), &numOfActiveParticles);
 }
 
+// It returns an upper bound of the number of active blocks. The blocks beyond the actual number have no particles.
 int RedistributeParticles(cl_kernel collectBlocksKernel, cl_kernel collectParticlesKernel, cl_kernel statisticsKernel,
 			  size_t workGroupSize1, size_t workGroupSize2, size_t workGroupSize3,
 			  cl_mem d_activeParticles, cl_int numOfActiveParticles, cl_int iBMCount,
 			  int numOfStages, cl_kernel scanKernel, cl_kernel reverseUpdateKernel, int scanWorkGroupSize,
 			  int numOfBanks) {
-	/// DEBUG ///
-	err = clFinish(commandQueue);
-	printf("Before collect blocks Kernel, err = %d\n", err);
-
 	/// DEBUG ///
 	//lcs::CheckFloatArrayInDevice("placesOfInterest.txt", commandQueue, d_placesOfInterest, numOfInitialActiveParticles * 3);
-	printf("iBMCount = %d\n", iBMCount);
 
-	// Intialize d_numOfActiveBlocks
-	int zero = 0;
+	// Every active block has at least one active particle, so d_numOfActiveBlocks need not be read back.
+	int maxNumOfActiveBlocks = std::min((int)numOfActiveParticles, numOfInterestingBlocks);
 
-	err = clEnqueueWriteBuffer(commandQueue, d_numOfActiveBlocks, CL_TRUE, 0, sizeof(int),
-				   &zero, 0, NULL, NULL);
-	if (err) lcs::Error("Fail to write d_numOfActiveBlocks");
+	// Intialize d_numOfActiveBlocks
+	static const int zero = 0;
+	EnqueueChainedWrite(d_numOfActiveBlocks, 0, sizeof(int), &zero, "Fail to write d_numOfActiveBlocks");
 
 	// Launch collectActiveBlocksKernel
 	clSetKernelArg(collectBlocksKernel, 0, sizeof(cl_mem), &d_activeParticles);
@@ -2036,25 +2589,18 @@ int RedistributeParticles(cl_kernel collectBlocksKernel, cl_kernel collectPartic
 
 	size_t globalWorkSize = ((numOfActiveParticles - 1) / workGroupSize1 + 1) * workGroupSize1;
 
-	err = clEnqueueNDRangeKernel(commandQueue, collectBlocksKernel, 1, NULL,
-				     &globalWorkSize, &workGroupSize1, 0, NULL, NULL);
-	if (err) lcs::Error("Fail to enqueue collectBlocksKernel");
-
-	/// DEBUG ///
-	err = clFinish(commandQueue);
-	printf("err = %d\n", err);
-
-	if (err) lcs::Error("non-zero err value");
-
-	// Get the number of active blocks
-	int numOfActiveBlocks;
-
-	err = clEnqueueReadBuffer(commandQueue, d_numOfActiveBlocks, CL_TRUE, 0, sizeof(int),
-				  &numOfActiveBlocks, 0, NULL, NULL);
-	if (err) lcs::Error("Fail to read d_numOfActiveBlocks");
-
-	/// DEBUG ///
-	printf("numOfActiveBlocks = %d\n", numOfActiveBlocks);
+	EnqueueChainedKernel(collectBlocksKernel, globalWorkSize, workGroupSize1, "CollectBlocksKernel");
+
+	// The actual number of active blocks is only read for the telemetry, and it is ready at the next synchronization.
+	if (lcs::Telemetry::IsEnabled()) {
+		static int numOfActiveBlocks;
+		cl_event event;
+		err = clEnqueueReadBuffer(commandQueue, d_numOfActiveBlocks, CL_FALSE, 0, sizeof(int), &numOfActiveBlocks,
+					  lcs::GetNumOfWaitEvents(tracingEvent), lcs::GetWaitList(tracingEvent), &event);
+		if (err) lcs::Error("Fail to read d_numOfActiveBlocks");
+		lcs::ChainEvent(tracingEvent, event);
+		lcs::Telemetry::RecordPassLater("activeBlocks", &numOfActiveBlocks);
+	}
 
 	/// DEBUG ///
 	//lcs::CheckIntArrayInDevice("blockLocations.txt", commandQueue, d_blockLocations, numOfInitialActiveParticles);
@@ -2066,28 +2612,20 @@ int RedistributeParticles(cl_kernel collectBlocksKernel, cl_kernel collectPartic
 		memset(zeroArray, 0, sizeof(int) * numOfInterestingBlocks * numOfStages);
 	}
 
-	err = clEnqueueWriteBuffer(commandQueue, d_numOfParticlesByStageInBlocks, CL_TRUE, 0,
-				   numOfActiveBlocks * numOfStages * sizeof(int), zeroArray, 0, NULL, NULL);
-	if (err) lcs::Error("Fail to write d_numOfParticlesByStageInBlocks");
+	EnqueueChainedWrite(d_numOfParticlesByStageInBlocks, 0, maxNumOfActiveBlocks * numOfStages * sizeof(int), zeroArray,
+			    "Fail to write d_numOfParticlesByStageInBlocks");
 
 	clSetKernelArg(statisticsKernel, 3, sizeof(cl_mem), &d_activeParticles);
 	clSetKernelArg(statisticsKernel, 7, sizeof(cl_int), &numOfActiveParticles);
 
 	globalWorkSize = ((numOfActiveParticles - 1) / workGroupSize3 + 1) * workGroupSize3;
 
-	err = clEnqueueNDRangeKernel(commandQueue, statisticsKernel, 1, NULL,
-				     &globalWorkSize, &workGroupSize3, 0, NULL, NULL);
-	if (err) lcs::Error("Fail to enqueue statisticsKernel");
-
-	clFinish(commandQueue);
-
-	// Prefix scan for d_numOfParticlesByStageInBlocks
-	int sum;
-	sum = lcs::GPUExclusiveScanForInt(scanWorkGroupSize, numOfBanks, scanKernel, reverseUpdateKernel,
-					  d_numOfParticlesByStageInBlocks, numOfActiveBlocks * numOfStages, commandQueue);
+	EnqueueChainedKernel(statisticsKernel, globalWorkSize, workGroupSize3, "StatisticsKernel");
 
-	/// DEBUG ///
-	printf("sum = %d\n", sum);
+	// Prefix scan for d_numOfParticlesByStageInBlocks. The sum closes d_startOffsetInParticles.
+	lcs::GPUExclusiveScanForInt(scanWorkGroupSize, numOfBanks, scanKernel, reverseUpdateKernel,
+				    d_numOfParticlesByStageInBlocks, maxNumOfActiveBlocks * numOfStages,
+				    d_startOffsetInParticles, maxNumOfActiveBlocks, commandQueue, tracingEvent);
 
 	// Collect particles to blocks
 	clSetKernelArg(collectParticlesKernel, 3, sizeof(cl_mem), &d_activeParticles);
@@ -2095,19 +2633,10 @@ int RedistributeParticles(cl_kernel collectBlocksKernel, cl_kernel collectPartic
 
 	globalWorkSize = ((numOfActiveParticles - 1) / workGroupSize2 + 1) * workGroupSize2;
 
-	err = clEnqueueNDRangeKernel(commandQueue, collectParticlesKernel, 1, NULL,
-				     &globalWorkSize, &workGroupSize2, 0, NULL, NULL);
-
-	/// DEBUG ///
-	printf("err = %d\n", err);
-	if (err) lcs::Error("Fail to enqueue collectParticlesKernel");
-
-	/// DEBUG ///
-	err = clFinish(commandQueue);
-	if (err) lcs::Error("collectParticleKernel execution error");
+	EnqueueChainedKernel(collectParticlesKernel, globalWorkSize, workGroupSize2, "CollectParticlesKernel");
 
 	// return
-	return numOfActiveBlocks;
+	return maxNumOfActiveBlocks;
 }
 
 void InitializeCollectEveryKElementKernel(cl_program &everyKElementProgram, cl_kernel &everyKElementKernel,
@@ -2129,63 +2658,40 @@ void InitializeCollectEveryKElementKernel(cl_program &everyKElementProgram, cl_k
 	clSetKernelArg(everyKElementKernel, 2, sizeof(cl_int), &maxNumOfStages);
 }
 
-void GetStartOffsetInParticles(cl_kernel everyKElementKernel, cl_int numOfActiveBlocks, size_t workGroupSize,
-			       int numOfActiveParticles) {
-	/// DEBUG ///
-	printf("In GetStartOffsetInParticles()\n");
-	printf("numOfActiveBlocks = %d\n", numOfActiveBlocks);
-	printf("numOfActiveParticles = %d\n", numOfActiveParticles);
-
-
-	err = clEnqueueWriteBuffer(commandQueue, d_startOffsetInParticles, CL_TRUE, sizeof(int) * numOfActiveBlocks, sizeof(int),
-				   &numOfActiveParticles, 0, NULL, NULL);
-	if (err) lcs::Error("Fail to write to d_startOffsetInParticles");
-
+// d_startOffsetInParticles[numOfActiveBlocks] is filled by RedistributeParticles().
+void GetStartOffsetInParticles(cl_kernel everyKElementKernel, cl_int numOfActiveBlocks, size_t workGroupSize) {
 	clSetKernelArg(everyKElementKernel, 3, sizeof(cl_int), &numOfActiveBlocks);
 
 	size_t globalWorkSize = ((numOfActiveBlocks - 1) / workGroupSize + 1) * workGroupSize;
 
-	err = clEnqueueNDRangeKernel(commandQueue, everyKElementKernel, 1, NULL,
-				     &globalWorkSize, &workGroupSize, 0, NULL, NULL);
-	if (err) lcs::Error("Fail to enqueue everyKElementKernel");
-
-	clFinish(commandQueue);
+	EnqueueChainedKernel(everyKElementKernel, globalWorkSize, workGroupSize, "EveryKElementKernel");
 }
 
+// It returns an upper bound of the number of work groups. The tracing kernel skips the groups beyond
+// d_numOfGroupsForBlocks[numOfActiveBlocks].
 int AssignWorkGroups(cl_kernel getNumKernel, cl_kernel assignKernel, 
-		      size_t workGroupSize1, size_t workGroupSize2, cl_int numOfActiveBlocks,
-		      int scanWorkGroupSize, int numOfBanks, cl_kernel scanKernel, cl_kernel reverseUpdateKernel) {
+		     size_t workGroupSize1, size_t workGroupSize2, cl_int numOfActiveBlocks,
+		     int numOfActiveParticles, int tracingWorkGroupSize,
+		     int scanWorkGroupSize, int numOfBanks, cl_kernel scanKernel, cl_kernel reverseUpdateKernel) {
 	// Get numOfGroupsForBlocks
 	clSetKernelArg(getNumKernel, 2, sizeof(cl_int), &numOfActiveBlocks);
 
 	size_t globalWorkSize = ((numOfActiveBlocks - 1) / workGroupSize1 + 1) * workGroupSize1;
 
-	err = clEnqueueNDRangeKernel(commandQueue, getNumKernel, 1, NULL, &globalWorkSize, &workGroupSize1, 0, NULL, NULL);
-	if (err) lcs::Error("Fail to enqueue getNumKernel");
-
-	clFinish(commandQueue);
-
-	// Exclusive scan of numOfGroupsForBlocks
-	int sum;
-	sum = lcs::GPUExclusiveScanForInt(scanWorkGroupSize, numOfBanks, scanKernel, reverseUpdateKernel,
-					  d_numOfGroupsForBlocks, numOfActiveBlocks, commandQueue);
+	EnqueueChainedKernel(getNumKernel, globalWorkSize, workGroupSize1, "GetNumKernel");
 
-	// Fill in the sum
-	err = clEnqueueWriteBuffer(commandQueue, d_numOfGroupsForBlocks, CL_TRUE,
-				   sizeof(int) * numOfActiveBlocks, sizeof(int), &sum, 0, NULL, NULL);
-	if (err) lcs::Error("Fail to write to d_numOfGroupsForBlocks");
+	// Exclusive scan of numOfGroupsForBlocks, with the sum filled in at the end
+	lcs::GPUExclusiveScanForInt(scanWorkGroupSize, numOfBanks, scanKernel, reverseUpdateKernel,
+				    d_numOfGroupsForBlocks, numOfActiveBlocks,
+				    d_numOfGroupsForBlocks, numOfActiveBlocks, commandQueue, tracingEvent);
 
 	// Assign groups
 	globalWorkSize = numOfActiveBlocks * workGroupSize2;
 
-	err = clEnqueueNDRangeKernel(commandQueue, assignKernel, 1, NULL, &globalWorkSize, &workGroupSize2, 0, NULL, NULL);
-	if (err) lcs::Error("Fail to enqueue assignKernel");
-
-	/// DEBUG ///
-	err = clFinish(commandQueue);
-	if (err) lcs::Error("Get non-zero er in AssignWorkGroups()");
+	EnqueueChainedKernel(assignKernel, globalWorkSize, workGroupSize2, "AssignKernel");
 
-	return sum;
+	// A block needs at most one more group than its share of the particles.
+	return numOfActiveBlocks + (numOfActiveParticles - 1) / tracingWorkGroupSize + 1;
 }
 
 void InitializeAssignGroupsKernel(cl_program &assignGroupsProgram, cl_kernel &getNumKernel, cl_kernel &assignKernel,
@@ -2227,12 +2733,23 @@ void InitializeAssignGroupsKernel(cl_program &assignGroupsProgram, cl_kernel &ge
 void InitializeTracingKernel(cl_program &tracingProgram, cl_kernel &tracingKernel, int &workGroupSize, double epsilon) {
 	static char kernelName[100];
 	switch (lcs::ParticleRecord::GetDataType()) {
+	case lcs::ParticleRecord::FE: {
+		sprintf(kernelName, "%sFE%s", blockedTracingKernelPrefix, blockedTracingKernelSuffix);
+	} break;
 	case lcs::ParticleRecord::RK4: {
 		sprintf(kernelName, "%sRK4%s", blockedTracingKernelPrefix, blockedTracingKernelSuffix);
 	} break;
+	case lcs::ParticleRecord::RK45: {
+		sprintf(kernelName, "%sRK45%s", blockedTracingKernelPrefix, blockedTracingKernelSuffix);
+	} break;
 	}
 
-	tracingProgram = CreateProgram(kernelName, "blocked tracing");
+	// The gathered particle states are indexed by their positions in blockedActiveParticleIDList.
+	std::string tracingOptions;
+	if (configure->UseParticleGathering()) tracingOptions += " -D GATHERED_PARTICLES";
+	if (configure->GetCellTransformMegabytes() > 0) tracingOptions += " -D CELL_TRANSFORMS";
+
+	tracingProgram = CreateProgram(kernelName, "blocked tracing", tracingOptions.c_str(), pointLocationKernels);
 
 	tracingKernel = clCreateKernel(tracingProgram, "BlockedTracing", &err);
 	if (err) lcs::Error("Fail to create the kernel for tracing");
@@ -2273,6 +2790,7 @@ void InitializeTracingKernel(cl_program &tracingProgram, cl_kernel &tracingKerne
 
 	clSetKernelArg(tracingKernel, 20, sizeof(cl_mem), &d_stages);
 	clSetKernelArg(tracingKernel, 21, sizeof(cl_mem), &d_lastPositionForRK4);
+	// They are NULL for FE, whose kernel does not use them.
 	clSetKernelArg(tracingKernel, 22, sizeof(cl_mem), &d_k1ForRK4);
 	clSetKernelArg(tracingKernel, 23, sizeof(cl_mem), &d_k2ForRK4);
 	clSetKernelArg(tracingKernel, 24, sizeof(cl_mem), &d_k3ForRK4);
@@ -2287,6 +2805,8 @@ void InitializeTracingKernel(cl_program &tracingProgram, cl_kernel &tracingKerne
 	clSetKernelArg(tracingKernel, 30, sizeof(cl_mem), &d_exitCells);
 
 	clSetKernelArg(tracingKernel, 31, configure->GetSharedMemoryKilobytes() * 1024, NULL);
+
+	clSetKernelArg(tracingKernel, 36, sizeof(cl_mem), &d_numOfGroupsForBlocks);
 	
 	if (configure->UseDouble()) {
 		cl_double d_timeStep = configure->GetTimeStep();
@@ -2298,6 +2818,261 @@ void InitializeTracingKernel(cl_program &tracingProgram, cl_kernel &tracingKerne
 		clSetKernelArg(tracingKernel, 34, sizeof(cl_float), &f_timeStep);
 		clSetKernelArg(tracingKernel, 35, sizeof(cl_float), &f_epsilon);
 	}
+
+	// The precomputed transforms follow the step size control of RK45, which the RK4 kernel leaves unused.
+	if (configure->GetCellTransformMegabytes() > 0) {
+		clSetKernelArg(tracingKernel, 44, sizeof(cl_mem), &d_cellTransforms);
+		clSetKernelArg(tracingKernel, 45, sizeof(cl_mem), &d_blockedCellTransforms);
+		clSetKernelArg(tracingKernel, 46, sizeof(cl_mem), &d_startOffsetInCellForTransforms);
+		clSetKernelArg(tracingKernel, 47, sizeof(int), &useGlobalTransforms);
+
+		if (lcs::ParticleRecord::GetDataType() == lcs::ParticleRecord::RK4) {
+			cl_mem unusedBuffer = NULL;
+			clSetKernelArg(tracingKernel, 38, sizeof(cl_mem), &unusedBuffer);
+			clSetKernelArg(tracingKernel, 39, sizeof(cl_mem), &unusedBuffer);
+			clSetKernelArg(tracingKernel, 40, sizeof(cl_mem), &unusedBuffer);
+
+			cl_double d_unused = 0;
+			cl_float f_unused = 0;
+			for (int i = 41; i <= 43; i++)
+				if (configure->UseDouble()) clSetKernelArg(tracingKernel, i, sizeof(cl_double), &d_unused);
+				else clSetKernelArg(tracingKernel, i, sizeof(cl_float), &f_unused);
+		}
+	}
+
+	// Additional arrays and the step size control of RK45
+	if (lcs::ParticleRecord::GetDataType() == lcs::ParticleRecord::RK45) {
+		clSetKernelArg(tracingKernel, 38, sizeof(cl_mem), &d_k4ForRK45);
+		clSetKernelArg(tracingKernel, 39, sizeof(cl_mem), &d_k5ForRK45);
+		clSetKernelArg(tracingKernel, 40, sizeof(cl_mem), &d_stepSizesForRK45);
+
+		// A step never goes beyond an interval.
+		double maxTimeStep = configure->GetMaxTimeStep();
+		if (maxTimeStep <= 0) maxTimeStep = configure->GetTimeInterval();
+
+		if (configure->UseDouble()) {
+			cl_double d_tolerance = configure->GetTolerance();
+			cl_double d_minTimeStep = configure->GetMinTimeStep();
+			cl_double d_maxTimeStep = maxTimeStep;
+			clSetKernelArg(tracingKernel, 41, sizeof(cl_double), &d_tolerance);
+			clSetKernelArg(tracingKernel, 42, sizeof(cl_double), &d_minTimeStep);
+			clSetKernelArg(tracingKernel, 43, sizeof(cl_double), &d_maxTimeStep);
+		} else {
+			cl_float f_tolerance = configure->GetTolerance();
+			cl_float f_minTimeStep = configure->GetMinTimeStep();
+			cl_float f_maxTimeStep = maxTimeStep;
+			clSetKernelArg(tracingKernel, 41, sizeof(cl_float), &f_tolerance);
+			clSetKernelArg(tracingKernel, 42, sizeof(cl_float), &f_minTimeStep);
+			clSetKernelArg(tracingKernel, 43, sizeof(cl_float), &f_maxTimeStep);
+		}
+	}
+}
+
+void InitializeParticleGatheringKernels(cl_program &gatherProgram, cl_kernel &gatherKernel, cl_kernel &scatterKernel,
+					int &gatherWorkGroupSize, int &scatterWorkGroupSize, cl_kernel tracingKernel) {
+	gatherProgram = CreateProgram(gatherParticlesKernels, "gather particles");
+
+	gatherKernel = clCreateKernel(gatherProgram, "GatherParticles", &err);
+	if (err) lcs::Error("Fail to create the kernel for gather particles kernel");
+
+	scatterKernel = clCreateKernel(gatherProgram, "ScatterParticles", &err);
+	if (err) lcs::Error("Fail to create the kernel for scatter particles kernel");
+
+	size_t maxWorkGroupSize1;
+	err = clGetKernelWorkGroupInfo(gatherKernel, deviceIDs[0], CL_KERNEL_WORK_GROUP_SIZE,
+				       sizeof(size_t), &maxWorkGroupSize1, NULL);
+	if (err) lcs::Error("Fail to get the maximum work group size for gather particles kernel");
+
+	gatherWorkGroupSize = maxWorkGroupSize1;
+
+	size_t maxWorkGroupSize2;
+	err = clGetKernelWorkGroupInfo(scatterKernel, deviceIDs[0], CL_KERNEL_WORK_GROUP_SIZE,
+				       sizeof(size_t), &maxWorkGroupSize2, NULL);
+	if (err) lcs::Error("Fail to get the maximum work group size for scatter particles kernel");
+
+	scatterWorkGroupSize = maxWorkGroupSize2;
+
+	// The ks and the step sizes which the integration does not have are NULL.
+	cl_int numOfKs;
+	switch (lcs::ParticleRecord::GetDataType()) {
+	case lcs::ParticleRecord::FE: numOfKs = 0; break;
+	case lcs::ParticleRecord::RK4: numOfKs = 3; break;
+	case lcs::ParticleRecord::RK45: numOfKs = 5; break;
+	}
+
+	cl_mem ks[5] = {d_k1ForRK4, d_k2ForRK4, d_k3ForRK4, d_k4ForRK45, d_k5ForRK45};
+	cl_mem stepSizes = numOfKs > 3 ? d_stepSizesForRK45 : NULL;
+
+	// Create the gathered arrays
+	int sizeOfReal = configure->UseDouble() ? sizeof(double) : sizeof(float);
+
+	d_gatheredStages = clCreateBuffer(context, CL_MEM_READ_WRITE, sizeof(int) * numOfInitialActiveParticles, NULL, &err);
+	if (err) lcs::Error("Fail to create a buffer for device gatheredStages");
+
+	d_gatheredPastTimes = clCreateBuffer(context, CL_MEM_READ_WRITE, sizeOfReal * numOfInitialActiveParticles, NULL, &err);
+	if (err) lcs::Error("Fail to create a buffer for device gatheredPastTimes");
+
+	d_gatheredLastPositions = clCreateBuffer(context, CL_MEM_READ_WRITE, sizeOfReal * 4 * numOfInitialActiveParticles, NULL, &err);
+	if (err) lcs::Error("Fail to create a buffer for device gatheredLastPositions");
+
+	d_gatheredPlacesOfInterest = clCreateBuffer(context, CL_MEM_READ_WRITE, sizeOfReal * 4 * numOfInitialActiveParticles, NULL, &err);
+	if (err) lcs::Error("Fail to create a buffer for device gatheredPlacesOfInterest");
+
+	for (int i = 0; i < 5; i++)
+		if (i < numOfKs) {
+			d_gatheredKs[i] = clCreateBuffer(context, CL_MEM_READ_WRITE, sizeOfReal * 4 * numOfInitialActiveParticles, NULL, &err);
+			if (err) lcs::Error("Fail to create a buffer for device gatheredKs");
+		} else
+			d_gatheredKs[i] = NULL;
+
+	if (stepSizes) {
+		d_gatheredStepSizes = clCreateBuffer(context, CL_MEM_READ_WRITE, sizeOfReal * numOfInitialActiveParticles, NULL, &err);
+		if (err) lcs::Error("Fail to create a buffer for device gatheredStepSizes");
+	} else
+		d_gatheredStepSizes = NULL;
+
+	d_gatheredLocalTetIDs = clCreateBuffer(context, CL_MEM_READ_WRITE, sizeof(int) * numOfInitialActiveParticles, NULL, &err);
+	if (err) lcs::Error("Fail to create a buffer for device gatheredLocalTetIDs");
+
+	d_gatheredExitCells = clCreateBuffer(context, CL_MEM_READ_WRITE, sizeof(int) * numOfInitialActiveParticles, NULL, &err);
+	if (err) lcs::Error("Fail to create a buffer for device gatheredExitCells");
+
+	// Set gatherKernel parameters
+	clSetKernelArg(gatherKernel, 0, sizeof(cl_mem), &d_blockedActiveParticles);
+	clSetKernelArg(gatherKernel, 1, sizeof(cl_mem), &d_stages);
+	clSetKernelArg(gatherKernel, 2, sizeof(cl_mem), &d_pastTimes);
+	clSetKernelArg(gatherKernel, 3, sizeof(cl_mem), &d_lastPositionForRK4);
+	for (int i = 0; i < 5; i++)
+		clSetKernelArg(gatherKernel, 4 + i, sizeof(cl_mem), &ks[i]);
+	clSetKernelArg(gatherKernel, 9, sizeof(cl_mem), &stepSizes);
+	clSetKernelArg(gatherKernel, 10, sizeof(cl_mem), &d_localTetIDs);
+	clSetKernelArg(gatherKernel, 11, sizeof(cl_mem), &d_gatheredStages);
+	clSetKernelArg(gatherKernel, 12, sizeof(cl_mem), &d_gatheredPastTimes);
+	clSetKernelArg(gatherKernel, 13, sizeof(cl_mem), &d_gatheredLastPositions);
+	for (int i = 0; i < 5; i++)
+		clSetKernelArg(gatherKernel, 14 + i, sizeof(cl_mem), &d_gatheredKs[i]);
+	clSetKernelArg(gatherKernel, 19, sizeof(cl_mem), &d_gatheredStepSizes);
+	clSetKernelArg(gatherKernel, 20, sizeof(cl_mem), &d_gatheredLocalTetIDs);
+	clSetKernelArg(gatherKernel, 21, sizeof(cl_int), &numOfKs);
+
+	// Set scatterKernel parameters
+	clSetKernelArg(scatterKernel, 0, sizeof(cl_mem), &d_blockedActiveParticles);
+	clSetKernelArg(scatterKernel, 1, sizeof(cl_mem), &d_gatheredStages);
+	clSetKernelArg(scatterKernel, 2, sizeof(cl_mem), &d_gatheredPastTimes);
+	clSetKernelArg(scatterKernel, 3, sizeof(cl_mem), &d_gatheredLastPositions);
+	for (int i = 0; i < 5; i++)
+		clSetKernelArg(scatterKernel, 4 + i, sizeof(cl_mem), &d_gatheredKs[i]);
+	clSetKernelArg(scatterKernel, 9, sizeof(cl_mem), &d_gatheredStepSizes);
+	clSetKernelArg(scatterKernel, 10, sizeof(cl_mem), &d_gatheredPlacesOfInterest);
+	clSetKernelArg(scatterKernel, 11, sizeof(cl_mem), &d_gatheredExitCells);
+	clSetKernelArg(scatterKernel, 12, sizeof(cl_mem), &d_stages);
+	clSetKernelArg(scatterKernel, 13, sizeof(cl_mem), &d_pastTimes);
+	clSetKernelArg(scatterKernel, 14, sizeof(cl_mem), &d_lastPositionForRK4);
+	for (int i = 0; i < 5; i++)
+		clSetKernelArg(scatterKernel, 15 + i, sizeof(cl_mem), &ks[i]);
+	clSetKernelArg(scatterKernel, 20, sizeof(cl_mem), &stepSizes);
+	clSetKernelArg(scatterKernel, 21, sizeof(cl_mem), &d_placesOfInterest);
+	clSetKernelArg(scatterKernel, 22, sizeof(cl_mem), &d_exitCells);
+	clSetKernelArg(scatterKernel, 23, sizeof(cl_int), &numOfKs);
+
+	// The tracing kernel works on the gathered arrays instead.
+	clSetKernelArg(tracingKernel, 20, sizeof(cl_mem), &d_gatheredStages);
+	clSetKernelArg(tracingKernel, 21, sizeof(cl_mem), &d_gatheredLastPositions);
+	clSetKernelArg(tracingKernel, 22, sizeof(cl_mem), &d_gatheredKs[0]);
+	clSetKernelArg(tracingKernel, 23, sizeof(cl_mem), &d_gatheredKs[1]);
+	clSetKernelArg(tracingKernel, 24, sizeof(cl_mem), &d_gatheredKs[2]);
+	clSetKernelArg(tracingKernel, 25, sizeof(cl_mem), &d_gatheredPastTimes);
+	clSetKernelArg(tracingKernel, 26, sizeof(cl_mem), &d_gatheredPlacesOfInterest);
+	clSetKernelArg(tracingKernel, 29, sizeof(cl_mem), &d_gatheredLocalTetIDs);
+	clSetKernelArg(tracingKernel, 30, sizeof(cl_mem), &d_gatheredExitCells);
+
+	if (lcs::ParticleRecord::GetDataType() == lcs::ParticleRecord::RK45) {
+		clSetKernelArg(tracingKernel, 38, sizeof(cl_mem), &d_gatheredKs[3]);
+		clSetKernelArg(tracingKernel, 39, sizeof(cl_mem), &d_gatheredKs[4]);
+		clSetKernelArg(tracingKernel, 40, sizeof(cl_mem), &d_gatheredStepSizes);
+	}
+}
+
+// It gathers or scatters the first numOfActiveParticles particles of d_blockedActiveParticles.
+void MoveBlockedParticles(cl_kernel kernel, size_t workGroupSize, cl_int numOfActiveParticles, int lengthArgIndex,
+			  const char *kernelName) {
+	clSetKernelArg(kernel, lengthArgIndex, sizeof(cl_int), &numOfActiveParticles);
+
+	size_t globalWorkSize = ((numOfActiveParticles - 1) / workGroupSize + 1) * workGroupSize;
+
+	EnqueueChainedKernel(kernel, globalWorkSize, workGroupSize, kernelName);
+}
+
+void InitializeRelocateParticlesKernel(cl_program &relocateProgram, cl_kernel &relocateKernel, int &relocateWorkGroupSize) {
+	relocateProgram = CreateProgram(relocateParticlesKernel, "relocate particles", "", pointLocationKernels);
+
+	relocateKernel = clCreateKernel(relocateProgram, "RelocateParticles", &err);
+	if (err) lcs::Error("Fail to create the kernel for relocate particles kernel");
+
+	size_t maxWorkGroupSize;
+	err = clGetKernelWorkGroupInfo(relocateKernel, deviceIDs[0], CL_KERNEL_WORK_GROUP_SIZE,
+				       sizeof(size_t), &maxWorkGroupSize, NULL);
+	if (err) lcs::Error("Fail to get the maximum work group size for relocate particles kernel");
+
+	relocateWorkGroupSize = maxWorkGroupSize;
+
+	// Set relocateKernel parameters
+	clSetKernelArg(relocateKernel, 0, sizeof(cl_mem), &d_blockedActiveParticles);
+	clSetKernelArg(relocateKernel, 1, sizeof(cl_mem), &d_placesOfInterest);
+	clSetKernelArg(relocateKernel, 2, sizeof(cl_mem), &d_pastTimes);
+	clSetKernelArg(relocateKernel, 3, sizeof(cl_mem), &d_exitCells);
+	clSetKernelArg(relocateKernel, 4, sizeof(cl_mem), &d_vertexPositions);
+	clSetKernelArg(relocateKernel, 5, sizeof(cl_mem), &d_tetrahedralConnectivities);
+	clSetKernelArg(relocateKernel, 6, sizeof(cl_mem), &d_interestingBlockMap);
+	clSetKernelArg(relocateKernel, 7, sizeof(cl_mem), &d_startOffsetInCell);
+	clSetKernelArg(relocateKernel, 8, sizeof(cl_mem), &d_globalCellIDs);
+
+	double floatNumbers[5] = {globalMinX, globalMinY, globalMinZ, blockSize, configure->GetEpsilon()};
+
+	for (int i = 0; i < 5; i++)
+		if (configure->UseDouble())
+			clSetKernelArg(relocateKernel, 9 + i, sizeof(cl_double), floatNumbers + i);
+		else {
+			cl_float value = (float)floatNumbers[i];
+			clSetKernelArg(relocateKernel, 9 + i, sizeof(cl_float), &value);
+		}
+
+	cl_int cl_numOfBlocksInX = numOfBlocksInX;
+	cl_int cl_numOfBlocksInY = numOfBlocksInY;
+	cl_int cl_numOfBlocksInZ = numOfBlocksInZ;
+
+	clSetKernelArg(relocateKernel, 14, sizeof(cl_int), &cl_numOfBlocksInX);
+	clSetKernelArg(relocateKernel, 15, sizeof(cl_int), &cl_numOfBlocksInY);
+	clSetKernelArg(relocateKernel, 16, sizeof(cl_int), &cl_numOfBlocksInZ);
+}
+
+// Locate the particles of the last tracing kernel whose walks left the mesh with the block division.
+void RelocateParticles(cl_kernel kernel, size_t workGroupSize, cl_int numOfActiveParticles, double finishTime) {
+	if (configure->UseDouble()) {
+		cl_double d_endTime = finishTime;
+		clSetKernelArg(kernel, 17, sizeof(cl_double), &d_endTime);
+	} else {
+		cl_float f_endTime = finishTime;
+		clSetKernelArg(kernel, 17, sizeof(cl_float), &f_endTime);
+	}
+
+	clSetKernelArg(kernel, 18, sizeof(cl_int), &numOfActiveParticles);
+
+	size_t globalWorkSize = ((numOfActiveParticles - 1) / workGroupSize + 1) * workGroupSize;
+
+	EnqueueChainedKernel(kernel, globalWorkSize, workGroupSize, "RelocateParticles");
+}
+
+void ReleaseGatheredParticles() {
+	clReleaseMemObject(d_gatheredStages);
+	clReleaseMemObject(d_gatheredPastTimes);
+	clReleaseMemObject(d_gatheredLastPositions);
+	clReleaseMemObject(d_gatheredPlacesOfInterest);
+	for (int i = 0; i < 5; i++)
+		if (d_gatheredKs[i]) clReleaseMemObject(d_gatheredKs[i]);
+	if (d_gatheredStepSizes) clReleaseMemObject(d_gatheredStepSizes);
+	clReleaseMemObject(d_gatheredLocalTetIDs);
+	clReleaseMemObject(d_gatheredExitCells);
 }
 
 /// DEBUG ///
@@ -2320,6 +3095,9 @@ void Tracing() {
 	// Initialize initial active particle data
 	InitializeInitialActiveParticles();
 
+	// Initialize particle records in device
+	InitializeParticleRecordsInDevice();
+
 	// Initialize velocity data
 	void *velocities[2];
 	int currStartVIndex = 1;
@@ -2332,7 +3110,7 @@ void Tracing() {
 	d_offsetInBlocks = clCreateBuffer(context, CL_MEM_READ_WRITE, sizeof(int) * numOfInitialActiveParticles, NULL, &err);
 	if (err) lcs::Error("Fail to create a buffer for device offsetInBlocks");
 
-	d_numOfGroupsForBlocks = clCreateBuffer(context, CL_MEM_READ_WRITE, sizeof(int) * numOfInterestingBlocks, NULL, &err);
+	d_numOfGroupsForBlocks = clCreateBuffer(context, CL_MEM_READ_WRITE, sizeof(int) * (numOfInterestingBlocks + 1), NULL, &err);
 	if (err) lcs::Error("Fail to create a buffer for device numOfGroupsForBlocks");
 
 	d_activeBlocks = clCreateBuffer(context, CL_MEM_READ_WRITE, sizeof(int) * numOfInterestingBlocks, NULL, &err);
@@ -2344,6 +3122,9 @@ void Tracing() {
 	d_numOfActiveBlocks = clCreateBuffer(context, CL_MEM_READ_WRITE, sizeof(int), NULL, &err);
 	if (err) lcs::Error("Fail to create a buffer for device numOfActiveBlocks");
 
+	d_numOfActiveParticles = clCreateBuffer(context, CL_MEM_READ_WRITE, sizeof(int), NULL, &err);
+	if (err) lcs::Error("Fail to create a buffer for device numOfActiveParticles");
+
 	d_startOffsetInParticles = clCreateBuffer(context, CL_MEM_READ_WRITE, sizeof(int) * (numOfInterestingBlocks + 1), NULL, &err);
 	if (err) lcs::Error("Fail to create a buffer for device startOffsetInParticles");
 
@@ -2357,11 +3138,13 @@ void Tracing() {
 	// Initialize numOfParticlesByStageInBlocks
 	int maxNumOfStages;
 	switch (lcs::ParticleRecord::GetDataType()) {
+	case lcs::ParticleRecord::FE: maxNumOfStages = 1; break;
 	case lcs::ParticleRecord::RK4: maxNumOfStages = 4; break;
+	case lcs::ParticleRecord::RK45: maxNumOfStages = 6; break;
 	}
 
 	d_numOfParticlesByStageInBlocks = clCreateBuffer(context, CL_MEM_READ_WRITE,
-							 sizeof(int) * numOfInterestingBlocks * 4, NULL, &err);
+							 sizeof(int) * numOfInterestingBlocks * maxNumOfStages, NULL, &err);
 	if (err) lcs::Error("Fail to create a buffer for device numOfParticlesByStageInBlocks");
 
 	// Initialize blocked tracing kernel
@@ -2371,7 +3154,22 @@ void Tracing() {
 
 	InitializeTracingKernel(tracingProgram, tracingKernel, tracingWorkGroupSize, configure->GetEpsilon());
 
-	printf("tracingWorkGroupSize = %d\n", tracingWorkGroupSize);
+	// Initialize gather / scatter particles kernels
+	bool gathering = configure->UseParticleGathering();
+	cl_program gatherProgram;
+	cl_kernel gatherKernel, scatterKernel;
+	int gatherWorkGroupSize, scatterWorkGroupSize;
+
+	if (gathering)
+		InitializeParticleGatheringKernels(gatherProgram, gatherKernel, scatterKernel,
+						   gatherWorkGroupSize, scatterWorkGroupSize, tracingKernel);
+
+	// Initialize relocate particles kernel
+	cl_program relocateProgram;
+	cl_kernel relocateKernel;
+	int relocateWorkGroupSize;
+
+	InitializeRelocateParticlesKernel(relocateProgram, relocateKernel, relocateWorkGroupSize);
 
 	// Initialize assign groups kernel
 	cl_program assignGroupsProgram;
@@ -2426,86 +3224,43 @@ void Tracing() {
 	currActiveParticleArray = 0;
 	double currTime = 0;
 	double interval = configure->GetTimeInterval();
-	cl_event events[10];
+	tracingEvent = NULL;
 
 	// Main loop for blocked tracing
-	int startTime = clock();
-
-	/// DEBUG ///
-	kernelSum = 0;
-	int numOfKernelCalls = 0;
+	double startTime = lcs::GetWallTime();
+	int numOfRuns = 0;
 
 	for (int frameIdx = 0; frameIdx + 1 < numOfFrames; frameIdx++, currTime += interval) {
 		printf("*********Tracing between frame %d and frame %d*********\n", frameIdx, frameIdx + 1);
 		printf("\n");
 
-		/// DEBUG ///
-		int startTime;
-		startTime = clock();
+		double intervalStartTime = lcs::GetWallTime();
+
+		lcs::Telemetry::BeginInterval(frameIdx);
 
 		currStartVIndex = 1 - currStartVIndex;
 
 		// Collect active particles
-		int lastNumOfActiveParticles;
-
-		lastNumOfActiveParticles = CollectActiveParticlesForNewInterval(collect1InitKernel, collect1PickKernel,
-										collect1WorkGroupSize, scanKernel,
-										reverseUpdateKernel, scanWorkGroupSize,
-										numOfBanks, d_activeParticles[currActiveParticleArray]);
-		
-		/// DEBUG ///
-		//printf("lastNumOfActiveParticles = %d\n", lastNumOfActiveParticles);
-		//int *activeParticles = new int [lastNumOfActiveParticles];
-		//err = clEnqueueReadBuffer(commandQueue, d_activeParticles[currActiveParticleArray], CL_TRUE, 0, sizeof(int) * lastNumOfActiveParticles, activeParticles, 0, NULL, NULL);
-		//if (err) lcs::Error("Fail to read d_activeParticles");
-		//for (int i = 0; i < lastNumOfActiveParticles; i++)
-		//	printf("%d\t", activeParticles[i]);
-		//delete [] activeParticles;
+		CollectActiveParticlesForNewInterval(collect1InitKernel, collect1PickKernel,
+						     collect1WorkGroupSize, scanKernel,
+						     reverseUpdateKernel, scanWorkGroupSize,
+						     numOfBanks, d_activeParticles[currActiveParticleArray]);
 
-		/// DEBUG ///
-		printf("CollectActiveParticlesForNewInterval done.\n");
-
-		// Load end velocities
+		// Load end velocities. The file is read while the device collects the active particles.
 		cl_event loadVelocities = LoadVelocities(velocities[1 - currStartVIndex],
 							 d_velocities[1 - currStartVIndex], frameIdx + 1);
 
-		clFinish(commandQueue);
-
 		// Initialize big blocks
-		BigBlockInitializationForVelocities(currStartVIndex);
+		BigBlockInitializationForVelocities(currStartVIndex, loadVelocities);
+		clReleaseEvent(loadVelocities);
 
-		/// DEBUG ///
-		printf("BigBlockInitializationForVelocities done.\n");
-
-		while (true) {
-			// Get active particles
-			currActiveParticleArray = 1 - currActiveParticleArray;
+		int numOfActiveParticles = ReadNumOfActiveParticles();
 
-			int numOfActiveParticles;
+		while (numOfActiveParticles) {
+			numOfRuns++;
 
-			numOfActiveParticles = CollectActiveParticlesForNewRun(collect2InitKernel, collect2PickKernel,
-									       collect2WorkGroupSize, scanKernel,
-									       reverseUpdateKernel, scanWorkGroupSize,
-									       numOfBanks,
-									       d_activeParticles[1 - currActiveParticleArray],
-									       d_activeParticles[currActiveParticleArray],
-									       lastNumOfActiveParticles);
-
-			/// DEBUG ///
-			printf("CollectActiveParticlesForNewRun done.\n");
-
-			//lcs::CheckIntArrayInDevice("activeParticles.txt", commandQueue, d_activeParticles[currActiveParticleArray], numOfActiveParticles);
-
-			/// DEBUG ///
-			printf("numOfActiveParticles = %d\n", numOfActiveParticles);
-			printf("\n");
-
-			lastNumOfActiveParticles = numOfActiveParticles;
-
-			if (!numOfActiveParticles) break;
-
-			/// DEBUG ///
-			numOfKernelCalls++;
+			lcs::Telemetry::BeginPass();
+			lcs::Telemetry::RecordPass("activeParticles", numOfActiveParticles);
 
 			int numOfActiveBlocks = RedistributeParticles(collectBlocksKernel, collectParticlesKernel,
 								      statisticsKernel,
@@ -2516,11 +3271,7 @@ void Tracing() {
 								      scanKernel, reverseUpdateKernel, scanWorkGroupSize,
 								      numOfBanks);	
 
-			/// DEBUG ///
-			printf("RedistributeParticles done.\n");
-
-			GetStartOffsetInParticles(everyKElementKernel, numOfActiveBlocks, everyKElementWorkGroupSize,
-						  numOfActiveParticles);
+			GetStartOffsetInParticles(everyKElementKernel, numOfActiveBlocks, everyKElementWorkGroupSize);
 
 			/// DEBUG ///
 			//lcs::CheckIntArrayInDevice("numOfParticlesByStageInBlocks.txt", commandQueue, d_numOfParticlesByStageInBlocks, numOfActiveBlocks * 4 + 1);
@@ -2531,6 +3282,7 @@ void Tracing() {
 	
 			int numOfWorkGroups = AssignWorkGroups(getNumKernel, assignKernel, 
 							       getNumWorkGroupSize, assignWorkGroupSize, numOfActiveBlocks,
+							       numOfActiveParticles, tracingWorkGroupSize,
 							       scanWorkGroupSize, numOfBanks, scanKernel, reverseUpdateKernel);
 
 			/// DEBUG ///
@@ -2540,10 +3292,16 @@ void Tracing() {
 			//lcs::CheckIntArrayInDevice("blockedActiveParticles.txt", commandQueue, d_blockedActiveParticles, numOfInitialActiveParticles);
 			//lcs::CheckIntArrayInDevice("stages.txt", commandQueue, d_stages, numOfInitialActiveParticles);
 
-			printf("numOfWorkGroups = %d\n", numOfWorkGroups);	
+			if (gathering)
+				MoveBlockedParticles(gatherKernel, gatherWorkGroupSize, numOfActiveParticles, 22, "GatherParticles");
+
+			LaunchBlockedTracingKernel(tracingKernel, tracingWorkGroupSize, currStartVIndex,
+						   numOfWorkGroups, numOfActiveBlocks, currTime, currTime + interval);
 
-			LaunchBlockedTracingKernel(tracingKernel, tracingWorkGroupSize, 0, NULL,
-						   currStartVIndex, numOfWorkGroups, currTime, currTime + interval);
+			if (gathering)
+				MoveBlockedParticles(scatterKernel, scatterWorkGroupSize, numOfActiveParticles, 24, "ScatterParticles");
+
+			RelocateParticles(relocateKernel, relocateWorkGroupSize, numOfActiveParticles, currTime + interval);
 
 			/// DEBUG ///
 			//lcs::CheckIntArrayInDevice("exitCells.txt", commandQueue, d_exitCells, numOfInitialActiveParticles);
@@ -2578,10 +3336,25 @@ void Tracing() {
 			//clReleaseEvent(initDStartOffsetInParticles);
 			//clReleaseEvent(initDBlockedActiveParticles);
 			//clReleaseEvent(initDBlockedCellLocations);
+
+			// Get active particles
+			currActiveParticleArray = 1 - currActiveParticleArray;
+
+			numOfActiveParticles = CollectActiveParticlesForNewRun(collect2InitKernel, collect2PickKernel,
+									       collect2WorkGroupSize, scanKernel,
+									       reverseUpdateKernel, scanWorkGroupSize,
+									       numOfBanks,
+									       d_activeParticles[1 - currActiveParticleArray],
+									       d_activeParticles[currActiveParticleArray],
+									       numOfActiveParticles);
+
+			//lcs::CheckIntArrayInDevice("activeParticles.txt", commandQueue, d_activeParticles[currActiveParticleArray], numOfActiveParticles);
 		}
 
-		int endTime = clock();
-		printf("This interval cost %lf sec.\n", (double)(endTime - startTime) / CLOCKS_PER_SEC);
+		double intervalTime = lcs::GetWallTime() - intervalStartTime;
+		lcs::Telemetry::RecordInterval("wallTime", intervalTime);
+
+		printf("This interval cost %lf sec.\n", intervalTime);
 		printf("\n");
 
 		/// DEBUG ///
@@ -2595,88 +3368,443 @@ void Tracing() {
 	}
 
 	// Release device resources
+	lcs::ChainEvent(tracingEvent, NULL);
 	clReleaseMemObject(d_exclusiveScanArrayForInt);
 
-	/// DEBUG ///
-	printf("kernelSum = %lf\n", kernelSum);
-	printf("numOfKernelCalls = %d\n", numOfKernelCalls);
+	if (gathering) ReleaseGatheredParticles();
 
-	/// DEBUG ///
-	int endTime = clock();
-	printf("The total tracing time is %lf sec.\n", (double)(endTime - startTime) / CLOCKS_PER_SEC);
+	printf("numOfRuns = %d\n", numOfRuns);
+	printf("The total tracing time is %lf sec.\n", lcs::GetWallTime() - startTime);
 	printf("\n");
+
+	lcs::Telemetry::PrintSummary();
 }
 
-void GetFinalPositions() {
-	void *finalPositions;
+void NativeTracing() {
+	printf("Start to use %d CPU thread(s) to process blocked tracing ...\n", lcs::GetNumOfThreads());
+	printf("\n");
 
-	if (configure->UseDouble())
-		finalPositions = new double [numOfInitialActiveParticles * 3];
-	else
-		finalPositions = new float [numOfInitialActiveParticles * 3];
+	// Initialize initial active particle data
+	InitializeInitialActiveParticles();
+
+	// The host walks evaluate the cells through the cached transforms,
+	// and the walks which leave the mesh search the cells around the vertices of their last cells.
+	frameStream->GetTetrahedralGrid()->BuildBarycentricTransforms();
+	frameStream->GetTetrahedralGrid()->BuildVertexIncidence();
+
+	nativeTracer = new lcs::NativeTracer(frameStream->GetTetrahedralGrid(), blocks, numOfInterestingBlocks,
+					     interestingBlockMap, startOffsetsInLocalIDMap, blocksOfTets, localIDsOfTets,
+					     numOfBlocksInX, numOfBlocksInY, numOfBlocksInZ,
+					     globalMinX, globalMinY, globalMinZ, blockSize,
+					     configure->GetTimeStep(), configure->GetEpsilon());
+
+	double *initialPositions = new double [numOfInitialActiveParticles * 3];
+	for (int i = 0; i < numOfInitialActiveParticles; i++) {
+		lcs::ParticleRecordDataForRK4 *data = (lcs::ParticleRecordDataForRK4 *)particleRecords[i]->GetData();
+		lcs::Vector point = data->GetLastPosition();
+		initialPositions[i * 3] = point.GetX();
+		initialPositions[i * 3 + 1] = point.GetY();
+		initialPositions[i * 3 + 2] = point.GetZ();
+	}
+
+	nativeTracer->InitializeParticles(numOfInitialActiveParticles, initialPositions, exitCells);
+
+	delete [] initialPositions;
+	delete [] exitCells;
+
+	// Main loop for blocked tracing
+	double currTime = 0;
+	double interval = configure->GetTimeInterval();
+	int numOfRuns = 0;
+
+	double startTime = lcs::GetWallTime();
+
+	for (int frameIdx = 0; frameIdx + 1 < numOfFrames; frameIdx++, currTime += interval) {
+		printf("*********Tracing between frame %d and frame %d*********\n", frameIdx, frameIdx + 1);
+		printf("\n");
+
+		double intervalStartTime = lcs::GetWallTime();
+
+		lcs::Telemetry::BeginInterval(frameIdx);
+		nativeTracer->ResetWalkStatistics();
+
+		// The velocities stay in the frame stream while frame frameIdx + 2 is prefetched.
+		const double *startVelocities = frameStream->GetVelocities(frameIdx);
+		const double *endVelocities = frameStream->GetVelocities(frameIdx + 1);
+
+		nativeTracer->SetVelocities(startVelocities, endVelocities);
+
+		int numOfRunsInInterval = nativeTracer->TraceInterval(currTime, currTime + interval);
+		numOfRuns += numOfRunsInInterval;
+
+		double intervalTime = lcs::GetWallTime() - intervalStartTime;
+
+		if (lcs::Telemetry::IsEnabled()) {
+			long long numOfWalks, numOfSteps;
+			int maxNumOfSteps;
+			nativeTracer->GetWalkStatistics(numOfWalks, numOfSteps, maxNumOfSteps);
+
+			lcs::Telemetry::RecordInterval("wallTime", intervalTime);
+			lcs::Telemetry::RecordInterval("numOfWalks", numOfWalks);
+			lcs::Telemetry::RecordInterval("numOfWalkSteps", numOfSteps);
+			lcs::Telemetry::RecordInterval("maxWalkSteps", maxNumOfSteps);
+		}
+
+		printf("This interval cost %lf sec in %d run(s).\n", intervalTime, numOfRunsInInterval);
+		printf("\n");
+	}
+
+	printf("numOfRuns = %d\n", numOfRuns);
+	printf("The total tracing time is %lf sec.\n", lcs::GetWallTime() - startTime);
+	printf("\n");
+}
+
+void ReadFinalStates() {
+	finalPositions = new double [numOfInitialActiveParticles * 3];
+	finalExitCells = new int [numOfInitialActiveParticles];
+	finalPastTimes = new double [numOfInitialActiveParticles];
+
+	if (configure->GetTracingBackend() == "Native") {
+		memcpy(finalPositions, nativeTracer->GetLastPositions(), sizeof(double) * 3 * numOfInitialActiveParticles);
+		memcpy(finalExitCells, nativeTracer->GetExitCells(), sizeof(int) * numOfInitialActiveParticles);
+		memcpy(finalPastTimes, nativeTracer->GetPastTimes(), sizeof(double) * numOfInitialActiveParticles);
+		return;
+	}
 
 	switch (lcs::ParticleRecord::GetDataType()) {
-	case lcs::ParticleRecord::RK4: {
-		if (configure->UseDouble())
-			clEnqueueReadBuffer(commandQueue, d_lastPositionForRK4, CL_TRUE, 0, sizeof(double) * 3 * numOfInitialActiveParticles, finalPositions, 0, NULL, NULL);
-		else
-			clEnqueueReadBuffer(commandQueue, d_lastPositionForRK4, CL_TRUE, 0, sizeof(float) * 3 * numOfInitialActiveParticles, finalPositions, 0, NULL, NULL);
+	case lcs::ParticleRecord::FE:
+	case lcs::ParticleRecord::RK4:
+	case lcs::ParticleRecord::RK45: {
+		// The device positions are padded to 4 components.
+		if (configure->UseDouble()) {
+			double *lastPositions = new double [numOfInitialActiveParticles * 4];
+			err = clEnqueueReadBuffer(commandQueue, d_lastPositionForRK4, CL_TRUE, 0, sizeof(double) * 4 * numOfInitialActiveParticles, lastPositions, 0, NULL, NULL);
+			for (int i = 0; i < numOfInitialActiveParticles; i++)
+				for (int j = 0; j < 3; j++)
+					finalPositions[i * 3 + j] = lastPositions[i * 4 + j];
+			delete [] lastPositions;
+		} else {
+			float *lastPositions = new float [numOfInitialActiveParticles * 4];
+			err = clEnqueueReadBuffer(commandQueue, d_lastPositionForRK4, CL_TRUE, 0, sizeof(float) * 4 * numOfInitialActiveParticles, lastPositions, 0, NULL, NULL);
+			for (int i = 0; i < numOfInitialActiveParticles; i++)
+				for (int j = 0; j < 3; j++)
+					finalPositions[i * 3 + j] = lastPositions[i * 4 + j];
+			delete [] lastPositions;
+		}
+		if (err) lcs::Error("Fail to read d_lastPositionForRK4");
 								   } break;
 	}
 
-	FILE *fout = fopen(lastPositionFile, "w");
+	err = clEnqueueReadBuffer(commandQueue, d_exitCells, CL_TRUE, 0, sizeof(int) * numOfInitialActiveParticles, finalExitCells, 0, NULL, NULL);
+	if (err) lcs::Error("Fail to read d_exitCells");
+
+	if (configure->UseDouble())
+		err = clEnqueueReadBuffer(commandQueue, d_pastTimes, CL_TRUE, 0, sizeof(double) * numOfInitialActiveParticles, finalPastTimes, 0, NULL, NULL);
+	else {
+		float *pastTimes = new float [numOfInitialActiveParticles];
+		err = clEnqueueReadBuffer(commandQueue, d_pastTimes, CL_TRUE, 0, sizeof(float) * numOfInitialActiveParticles, pastTimes, 0, NULL, NULL);
+		for (int i = 0; i < numOfInitialActiveParticles; i++)
+			finalPastTimes[i] = pastTimes[i];
+		delete [] pastTimes;
+	}
+	if (err) lcs::Error("Fail to read d_pastTimes");
+}
+
+void GetFinalPositions() {
+	ReadFinalStates();
+
+	double startTime = lcs::GetWallTime();
+
+	int xRes = configure->GetBoundingBoxXRes();
+	int yRes = configure->GetBoundingBoxYRes();
+	int zRes = configure->GetBoundingBoxZRes();
+
+	double origin[3] = {configure->GetBoundingBoxMinX(), configure->GetBoundingBoxMinY(), configure->GetBoundingBoxMinZ()};
+	double spacing[3] = {(configure->GetBoundingBoxMaxX() - origin[0]) / xRes,
+			     (configure->GetBoundingBoxMaxY() - origin[1]) / yRes,
+			     (configure->GetBoundingBoxMaxZ() - origin[2]) / zRes};
+
+	// Put the particles back into the x-major order of the grid.
+	int *gridPointIDs = new int [numOfInitialActiveParticles];
+	double *sortedPositions = new double [numOfInitialActiveParticles * 3];
+	int *sortedExitCells = new int [numOfInitialActiveParticles];
 	for (int i = 0; i < numOfInitialActiveParticles; i++) {
-		int gridPointID = particleRecords[i]->GetGridPointID();
-		int z = gridPointID % (configure->GetBoundingBoxZRes() + 1);
-		int temp = gridPointID / (configure->GetBoundingBoxZRes() + 1);
-		int y = temp % (configure->GetBoundingBoxYRes() + 1);
-		int x = temp / (configure->GetBoundingBoxYRes() + 1);
-		fprintf(fout, "%d %d %d:", x, y, z);
-		for (int j = 0; j < 3; j++)
-			if (configure->UseDouble())
-				fprintf(fout, " %lf", ((double *)finalPositions)[i * 3 + j]);
-			else
-				fprintf(fout, " %lf", ((float *)finalPositions)[i * 3 + j]);
-		fprintf(fout, "\n");
+		int rank = seedRanks[i];
+		gridPointIDs[rank] = particleRecords[i]->GetGridPointID();
+		memcpy(sortedPositions + rank * 3, finalPositions + i * 3, sizeof(double) * 3);
+		sortedExitCells[rank] = finalExitCells[i];
 	}
-	fclose(fout);
 
-	if (configure->UseDouble())
-		delete [] (double *)finalPositions;
+	const char *fileName;
+
+	if (configure->GetOutputFormat() == "Binary") {
+		fileName = binaryLastPositionFile;
+		lcs::WriteFinalPositionsInBinary(fileName, xRes, yRes, zRes, origin, spacing,
+						 numOfInitialActiveParticles, gridPointIDs, sortedPositions, sortedExitCells,
+						 configure->UseOutputCompression());
+	} else if (configure->GetOutputFormat() == "VTK") {
+		fileName = vtkLastPositionFile;
+		lcs::WriteFinalPositionsInVTK(fileName, xRes, yRes, zRes, origin, spacing,
+					      numOfInitialActiveParticles, gridPointIDs, sortedPositions, sortedExitCells,
+					      configure->UseOutputCompression());
+	} else {
+		fileName = lastPositionFile;
+		lcs::WriteFinalPositionsInText(fileName, xRes, yRes, zRes,
+					       numOfInitialActiveParticles, gridPointIDs, sortedPositions);
+	}
+
+	delete [] gridPointIDs;
+	delete [] sortedPositions;
+	delete [] sortedExitCells;
+
+	printf("The final positions are written to %s in %lf sec.\n", fileName, lcs::GetWallTime() - startTime);
+	printf("\n");
+}
+
+// Throughput of the main phases. Every particle takes a step per timeStep until it leaves the domain.
+// The device time of the tracing kernels in seconds. It releases their events.
+double SumTracingKernelTimes() {
+	double sum = 0;
+
+	for (size_t i = 0; i < tracingKernelEvents.size(); i++) {
+		cl_ulong startTime, endTime;
+
+		err = clGetEventProfilingInfo(tracingKernelEvents[i], CL_PROFILING_COMMAND_START, sizeof(cl_ulong), &startTime, NULL);
+		if (err) lcs::Error("Fail to get the start time of a tracing kernel");
+
+		err = clGetEventProfilingInfo(tracingKernelEvents[i], CL_PROFILING_COMMAND_END, sizeof(cl_ulong), &endTime, NULL);
+		if (err) lcs::Error("Fail to get the end time of a tracing kernel");
+
+		sum += (endTime - startTime) * 1e-9;
+		clReleaseEvent(tracingKernelEvents[i]);
+	}
+
+	tracingKernelEvents.clear();
+
+	return sum;
+}
+
+void ReportBenchmark() {
+	int numOfGridPoints = (configure->GetBoundingBoxXRes() + 1) * (configure->GetBoundingBoxYRes() + 1) *
+			      (configure->GetBoundingBoxZRes() + 1);
+
+	// The steps of RK45 are adaptive, so the particle steps cannot be derived from the traced times.
+	bool fixedTimeStep = configure->GetIntegration() != "RK45";
+
+	double numOfParticleSteps = 0;
+	if (fixedTimeStep)
+		for (int i = 0; i < numOfInitialActiveParticles; i++)
+			numOfParticleSteps += floor(finalPastTimes[i] / configure->GetTimeStep() + 0.5);
+
+	if (fixedTimeStep)
+		printf("Benchmark: %d tetrahedra, %d grid points, %d particles, %.0lf particle steps\n",
+		       globalNumOfCells, numOfGridPoints, numOfInitialActiveParticles, numOfParticleSteps);
+	else
+		printf("Benchmark: %d tetrahedra, %d grid points, %d particles\n",
+		       globalNumOfCells, numOfGridPoints, numOfInitialActiveParticles);
+	printf("Division            : %10.6lf sec, %14.2lf tets/s\n",
+	       divisionTime, divisionTime > 0 ? globalNumOfCells / divisionTime : 0);
+	printf("InitialCellLocation : %10.6lf sec, %14.2lf tets/s, %14.2lf grid points/s\n",
+	       initialCellLocationTime,
+	       initialCellLocationTime > 0 ? globalNumOfCells / initialCellLocationTime : 0,
+	       initialCellLocationTime > 0 ? numOfGridPoints / initialCellLocationTime : 0);
+	// The tracing times of runs with and without the cell transforms can be compared by this line.
+	printf("Tracing backend     : %s, %s, cell transforms %s\n", configure->GetTracingBackend().c_str(),
+	       configure->GetIntegration().c_str(), configure->GetCellTransformMegabytes() > 0 ? "enabled" : "disabled");
+	if (fixedTimeStep)
+		printf("Tracing             : %10.6lf sec, %14.2lf particle steps/s\n",
+		       tracingTime, tracingTime > 0 ? numOfParticleSteps / tracingTime : 0);
 	else
-		delete [] (float *)finalPositions;
+		printf("Tracing             : %10.6lf sec, %14.2lf particles/s\n",
+		       tracingTime, tracingTime > 0 ? numOfInitialActiveParticles / tracingTime : 0);
+	if (configure->GetTracingBackend() == "OpenCL") {
+		double tracingKernelTime = SumTracingKernelTimes();
+		printf("BlockedTracing      : %10.6lf sec of kernels, %.2lf MB of cell transforms\n",
+		       tracingKernelTime, cellTransformBytes / (double)(1 << 20));
+	}
+	printf("GetFinalPositions   : %10.6lf sec, %14.2lf particles/s\n",
+	       finalPositionTime, finalPositionTime > 0 ? numOfInitialActiveParticles / finalPositionTime : 0);
+	printf("\n");
+}
+
+void FTLEComputation() {
+	printf("Start to compute FTLE ...\n");
+	printf("\n");
+
+	double startTime = lcs::GetWallTime();
+
+	double minX = configure->GetBoundingBoxMinX();
+	double maxX = configure->GetBoundingBoxMaxX();
+	double minY = configure->GetBoundingBoxMinY();
+	double maxY = configure->GetBoundingBoxMaxY();
+	double minZ = configure->GetBoundingBoxMinZ();
+	double maxZ = configure->GetBoundingBoxMaxZ();
+
+	int xRes = configure->GetBoundingBoxXRes();
+	int yRes = configure->GetBoundingBoxYRes();
+	int zRes = configure->GetBoundingBoxZRes();
+
+	double dx = (maxX - minX) / xRes;
+	double dy = (maxY - minY) / yRes;
+	double dz = (maxZ - minZ) / zRes;
+
+	int numOfGridPoints = (xRes + 1) * (yRes + 1) * (zRes + 1);
+
+	// Grid points which were not seeded or whose particles left the domain have no valid flow map.
+	double *flowMap = new double [numOfGridPoints * 3];
+	bool *validPoints = new bool [numOfGridPoints];
+	memset(validPoints, 0, sizeof(bool) * numOfGridPoints);
+
+	int numOfExitedParticles = 0;
+	for (int i = 0; i < numOfInitialActiveParticles; i++) {
+		if (finalExitCells[i] == -1) {
+			numOfExitedParticles++;
+			continue;
+		}
+		int gridPointID = particleRecords[i]->GetGridPointID();
+		validPoints[gridPointID] = true;
+		memcpy(flowMap + gridPointID * 3, finalPositions + i * 3, sizeof(double) * 3);
+	}
+
+	double *ftle = new double [numOfGridPoints];
+	bool *ftleValid = new bool [numOfGridPoints];
+
+	int numOfDefinedPoints = lcs::ComputeFTLE(xRes, yRes, zRes, dx, dy, dz,
+						  configure->GetTimeInterval() * (numOfFrames - 1),
+						  flowMap, validPoints, ftle, ftleValid);
+
+	printf("%d of %d particles left the domain.\n", numOfExitedParticles, numOfInitialActiveParticles);
+	printf("FTLE is defined on %d of %d grid points.\n", numOfDefinedPoints, numOfGridPoints);
+
+	// Write the FTLE field as an image aligned with the seeding grid. The points of an image vary fastest in x.
+	vtkDoubleArray *ftleArray = vtkDoubleArray::New();
+	ftleArray->SetName("FTLE");
+	ftleArray->SetNumberOfComponents(1);
+	ftleArray->SetNumberOfTuples(numOfGridPoints);
+
+	vtkUnsignedCharArray *validArray = vtkUnsignedCharArray::New();
+	validArray->SetName("FTLEValid");
+	validArray->SetNumberOfComponents(1);
+	validArray->SetNumberOfTuples(numOfGridPoints);
+
+	for (int x = 0; x <= xRes; x++)
+		for (int y = 0; y <= yRes; y++)
+			for (int z = 0; z <= zRes; z++) {
+				int gridPointID = (x * (yRes + 1) + y) * (zRes + 1) + z;
+				int imagePointID = (z * (yRes + 1) + y) * (xRes + 1) + x;
+				ftleArray->SetValue(imagePointID, ftle[gridPointID]);
+				validArray->SetValue(imagePointID, ftleValid[gridPointID]);
+			}
+
+	vtkImageData *image = vtkImageData::New();
+	image->SetDimensions(xRes + 1, yRes + 1, zRes + 1);
+	image->SetOrigin(minX, minY, minZ);
+	image->SetSpacing(dx, dy, dz);
+	image->GetPointData()->SetScalars(ftleArray);
+	image->GetPointData()->AddArray(validArray);
+
+	vtkXMLImageDataWriter *writer = vtkXMLImageDataWriter::New();
+	writer->SetFileName(ftleFile);
+	writer->SetInput(image);
+	if (!writer->Write()) lcs::Error("Fail to write the FTLE file");
+
+	writer->Delete();
+	image->Delete();
+	ftleArray->Delete();
+	validArray->Delete();
+
+	delete [] flowMap;
+	delete [] validPoints;
+	delete [] ftle;
+	delete [] ftleValid;
+
+	printf("The FTLE field is written to %s.\n", ftleFile);
+	printf("The FTLE computation cost %lf sec.\n", lcs::GetWallTime() - startTime);
+	printf("\n");
 }
 
-int main() {
+void lcs::RunPipeline(const char *configurationFile) {
+	::configurationFile = configurationFile;
+
 	// Test the system
 	SystemTest();
 
 	// Read the configure file
 	ReadConfFile();
 
-	// Load all the frames
+	// Start the telemetry trace if it is requested
+	if (configure->GetTelemetryFile() != "")
+		lcs::Telemetry::Open(configure->GetTelemetryFile().c_str());
+
+	// Load frame 0 and start to stream the others
 	LoadFrames();
 
 	// Put both topological and geometrical data into arrays
 	GetTopologyAndGeometry();
 
+	// Check the links of the mesh against the ones matched through a map of the faces
+	if (configure->UseUnitTestForTetrahedralLinks()) {
+		lcs::UnitTestForTetrahedralLinks(frameStream->GetTetrahedralGrid());
+		printf("\n");
+	}
+
+	// Check the vertex-to-cell incidence against the one collected vertex by vertex
+	if (configure->UseUnitTestForVertexIncidence()) {
+		lcs::UnitTestForVertexIncidence(frameStream->GetTetrahedralGrid());
+		printf("\n");
+	}
+
+	// Check the batched natural coordinates against the ones of single cells
+	if (configure->UseUnitTestForNaturalCoordinates()) {
+		lcs::UnitTestForNaturalCoordinates(frameStream->GetTetrahedralGrid(), configure->GetEpsilon());
+		printf("\n");
+	}
+
 	// Get the global bounding box
 	GetGlobalBoundingBox();
 
 	// Calculate the number of blocks in X, Y and Z
 	CalculateNumOfBlocksInXYZ();
 
+	// Get OpenCL platform, device, context and command queue. The native backend does not need any.
+	if (configure->GetTracingBackend() == "OpenCL")
+		InitializeOpenCL();
+
+	double phaseStartTime = lcs::GetWallTime();
+
 	// Divide the flow domain into blocks
 	Division();
 
+	divisionTime = lcs::GetWallTime() - phaseStartTime;
+	phaseStartTime = lcs::GetWallTime();
+
 	// Initially locate global tetrahedral cells for interesting Cartesian grid points
 	InitialCellLocation();
 
+	initialCellLocationTime = lcs::GetWallTime() - phaseStartTime;
+	phaseStartTime = lcs::GetWallTime();
+
 	// Main Tracing Process
-	Tracing();
+	if (configure->GetTracingBackend() == "Native")
+		NativeTracing();
+	else
+		Tracing();
+
+	tracingTime = lcs::GetWallTime() - phaseStartTime;
+	phaseStartTime = lcs::GetWallTime();
 
 	// Get final positions for initial active particles
 	GetFinalPositions();
 
-	return 0;
+	finalPositionTime = lcs::GetWallTime() - phaseStartTime;
+
+	// Report the throughput of the phases
+	if (configure->UseBenchmark())
+		ReportBenchmark();
+
+	// Compute the FTLE field from the flow map
+	if (configure->UseFTLE())
+		FTLEComputation();
+
+	lcs::Telemetry::Close();
 }